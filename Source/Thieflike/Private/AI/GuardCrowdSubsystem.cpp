@@ -0,0 +1,603 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "AI/GuardCrowdSubsystem.h"
+#include "Thieflike.h"
+#include "Stealth/StealthSettings.h"
+#include "Stealth/StealthMemory.h"
+#include "Character/PlayerCharacter.h"
+#include "Object/InteractionSubsystem.h"
+#include "Stealth/StealthStreamingSubsystem.h"
+#include "GameFramework/Character.h"
+#include "Components/CapsuleComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "Async/ParallelFor.h"
+#include "Algo/MinElement.h"
+#include "HAL/IConsoleManager.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("GuardCrowd Tick"), STAT_GuardCrowdTick, STATGROUP_Stealth);
+DECLARE_CYCLE_STAT(TEXT("GuardCrowd Representation"), STAT_GuardCrowdRepresentation, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("GuardCrowd Guards"), STAT_GuardCrowdGuards, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("GuardCrowd Promoted"), STAT_GuardCrowdPromoted, STATGROUP_Stealth);
+
+namespace GuardCrowd
+{
+	// Suspicion per second when the player is fully visible right in front of the guard
+	constexpr float SuspicionGainRate = 1.5f;
+	constexpr float SuspicionDecayRate = 0.15f;
+	constexpr float SuspiciousThreshold = 0.3f;
+	constexpr float AlertedThreshold = 0.99f;
+
+	// Suspicious guards slow down to look around
+	constexpr float SuspiciousSpeedScale = 0.5f;
+	constexpr float AlertedSpeedScale = 2.0f;
+
+	constexpr float WaypointAcceptRadius = 10.0f;
+
+	// Sight is traced from this far above the guard's feet
+	constexpr float EyeHeight = 160.0f;
+
+	// Patrolling guards open closed doors in front of them and close open doors once they are past them
+	constexpr float DoorOpenReach = 150.0f;
+	constexpr float DoorCloseMinDistance = 150.0f;
+	constexpr float DoorCloseReach = 250.0f;
+	constexpr float DoorFacingCos = 0.7f;
+}
+
+void UGuardCrowdSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Collection.InitializeDependency<UStealthEventBus>();
+	Super::Initialize(Collection);
+}
+
+void UGuardCrowdSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	LLM_SCOPE_BYTAG(Stealth_Guards);
+	PendingNoises.Reserve(MaxPendingNoises);
+
+	GuardClass = UStealthSettings::Get()->GuardCharacterClass.LoadSynchronous();
+
+	// Crowd locations are on the floor; characters are placed by their capsule centre
+	GuardHalfHeight = 0.0f;
+	if (const ACharacter* GuardDefaults = GuardClass ? GuardClass->GetDefaultObject<ACharacter>() : nullptr)
+	{
+		GuardHalfHeight = GuardDefaults->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+	}
+
+	if (UStealthEventBus* EventBus = InWorld.GetSubsystem<UStealthEventBus>())
+	{
+		NoiseHandle = EventBus->OnEvent(EStealthEventType::Noise).AddUObject(this, &UGuardCrowdSubsystem::OnNoise);
+	}
+}
+
+void UGuardCrowdSubsystem::Deinitialize()
+{
+	if (UStealthEventBus* EventBus = GetWorld()->GetSubsystem<UStealthEventBus>())
+	{
+		EventBus->OnEvent(EStealthEventType::Noise).Remove(NoiseHandle);
+	}
+	ResetCrowd();
+
+	Super::Deinitialize();
+}
+
+TStatId UGuardCrowdSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UGuardCrowdSubsystem, STATGROUP_Stealth);
+}
+
+int32 UGuardCrowdSubsystem::AddGuard(const TArray<FVector>& Route, float Speed)
+{
+	if (GetWorld()->GetNetMode() == NM_Client)
+	{
+		return INDEX_NONE;
+	}
+
+	LLM_SCOPE_BYTAG(Stealth_Guards);
+
+	FGuardPatrolFragment& NewPatrol = Patrol.AddDefaulted_GetRef();
+	NewPatrol.Location = Route.Num() > 0 ? Route[0] : FVector::ZeroVector;
+	NewPatrol.Speed = Speed;
+	NewPatrol.RouteStart = RoutePoints.Num();
+	NewPatrol.RouteLength = Route.Num();
+	NewPatrol.WaypointIndex = Route.Num() > 1 ? 1 : 0;
+	RoutePoints.Append(Route);
+
+	Perception.AddDefaulted();
+	Alert.AddDefaulted();
+	Representation.AddDefaulted();
+	PreviousAlertState.Add(EGuardAlertState::Patrolling);
+
+	return Patrol.Num() - 1;
+}
+
+void UGuardCrowdSubsystem::ResetCrowd()
+{
+	for (const TWeakObjectPtr<ACharacter>& Character : Representation)
+	{
+		if (Character.IsValid())
+		{
+			Character->Destroy();
+		}
+	}
+
+	Patrol.Reset();
+	Perception.Reset();
+	Alert.Reset();
+	Representation.Reset();
+	PreviousAlertState.Reset();
+	RoutePoints.Reset();
+	PendingNoises.Reset();
+	NextDoorGuard = 0;
+	NumPromoted = 0;
+}
+
+void UGuardCrowdSubsystem::OnNoise(const FStealthEvent& Event)
+{
+	if (PendingNoises.Num() < MaxPendingNoises)
+	{
+		PendingNoises.Add({ Event.Location, Event.Value });
+		return;
+	}
+
+	FNoise* Quietest = Algo::MinElementBy(PendingNoises, &FNoise::Loudness);
+	if (Quietest->Loudness < Event.Value)
+	{
+		*Quietest = { Event.Location, Event.Value };
+	}
+}
+
+void UGuardCrowdSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_GuardCrowdTick);
+	LLM_SCOPE_BYTAG(Stealth_Guards);
+	STEALTH_HOT_PATH_SCOPE("GuardCrowd");
+
+	if (Patrol.Num() == 0)
+	{
+		PendingNoises.Reset();
+		return;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Gather every player's state once for every batch
+	FPlayerContexts Players;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* Controller = It->Get();
+		if (const APlayerCharacter* PlayerCharacter = Controller ? Cast<APlayerCharacter>(Controller->GetPawn()) : nullptr)
+		{
+			FPlayerContext& Player = Players.AddDefaulted_GetRef();
+			Player.Actor = PlayerCharacter;
+			Player.Location = PlayerCharacter->GetActorLocation();
+			Player.Visibility = PlayerCharacter->CurrentVisibility / 100.0f;
+		}
+	}
+
+	// Only the baked door portals within earshot of a noise need testing
+	ClosedDoors = {};
+	const UStealthStreamingSubsystem* Streaming = GetWorld()->GetSubsystem<UStealthStreamingSubsystem>();
+	if (PendingNoises.Num() > 0 && Streaming && Streaming->NumPortals() > 0)
+	{
+		float MaxHearingRange = 0.0f;
+		for (const FGuardPerceptionFragment& GuardPerception : Perception)
+		{
+			MaxHearingRange = FMath::Max(MaxHearingRange, GuardPerception.HearingRange);
+		}
+
+		FBox Earshot(ForceInit);
+		for (const FNoise& Noise : PendingNoises)
+		{
+			Earshot += FBox::BuildAABB(Noise.Location, FVector(MaxHearingRange * Noise.Loudness));
+		}
+
+		TArrayView<FBox> Gathered = FStealthFrameArena::Get().AllocateArray<FBox>(Streaming->NumPortals());
+		ClosedDoors = Gathered.Left(Streaming->GatherClosedPortals(Earshot, Gathered));
+	}
+
+	const UStealthSettings* Settings = UStealthSettings::Get();
+	const int32 BatchSize = FMath::Max(Settings->GuardBatchSize, 1);
+	const int32 NumBatches = FMath::DivideAndRoundUp(Patrol.Num(), BatchSize);
+
+	ParallelFor(NumBatches, [this, BatchSize, DeltaTime, &Players](int32 BatchIndex)
+	{
+		STEALTH_HOT_PATH_SCOPE("GuardCrowd");
+		const int32 First = BatchIndex * BatchSize;
+		ProcessBatch(First, FMath::Min(First + BatchSize, Patrol.Num()), DeltaTime, Players);
+	});
+	PendingNoises.Reset();
+	ClosedDoors = {};
+
+	// Report alert changes in guard order so listeners see a deterministic sequence
+	if (UStealthEventBus* EventBus = GetWorld()->GetSubsystem<UStealthEventBus>())
+	{
+		for (int32 GuardIndex = 0; GuardIndex < Alert.Num(); ++GuardIndex)
+		{
+			if (Alert[GuardIndex].State != PreviousAlertState[GuardIndex])
+			{
+				EventBus->Post(EStealthEventType::GuardAlert, Representation[GuardIndex].Get(), Patrol[GuardIndex].Location, static_cast<float>(Alert[GuardIndex].State));
+				PreviousAlertState[GuardIndex] = Alert[GuardIndex].State;
+			}
+		}
+	}
+
+	UpdateRepresentation(Players);
+	RequestDoors(Players);
+
+	SET_DWORD_STAT(STAT_GuardCrowdGuards, Patrol.Num());
+	SET_DWORD_STAT(STAT_GuardCrowdPromoted, NumPromoted);
+
+	const double ElapsedMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	if (BudgetCheckSamples.Num() < BudgetCheckFrames)
+	{
+		BudgetCheckSamples.Add(static_cast<float>(ElapsedMs));
+		if (BudgetCheckSamples.Num() == BudgetCheckFrames)
+		{
+			ReportBudgetCheck();
+		}
+	}
+	else if (ElapsedMs > Settings->GuardFrameBudgetMs && StartTime - LastBudgetWarningTime > 1.0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("GuardCrowd: %d guards took %.3f ms (budget %.3f ms)"), Patrol.Num(), ElapsedMs, Settings->GuardFrameBudgetMs);
+		LastBudgetWarningTime = StartTime;
+	}
+}
+
+void UGuardCrowdSubsystem::StartBudgetCheck(int32 Frames)
+{
+	BudgetCheckFrames = FMath::Max(Frames, 1);
+	BudgetCheckSamples.Reset();
+	BudgetCheckSamples.Reserve(BudgetCheckFrames);
+}
+
+void UGuardCrowdSubsystem::ReportBudgetCheck()
+{
+	const float BudgetMs = UStealthSettings::Get()->GuardFrameBudgetMs;
+
+	TArray<float> Sorted = BudgetCheckSamples;
+	Sorted.Sort();
+	double Total = 0.0;
+	int32 OverBudget = 0;
+	for (const float Sample : Sorted)
+	{
+		Total += Sample;
+		OverBudget += Sample > BudgetMs ? 1 : 0;
+	}
+	const float P95 = Sorted[FMath::Min(FMath::FloorToInt(Sorted.Num() * 0.95f), Sorted.Num() - 1)];
+
+	// Judged on the 95th percentile: a promotion spawning a character is an expected occasional spike
+	UE_LOG(LogTemp, Display, TEXT("GuardCrowd budget check: %d guards (%d promoted), %d frames: mean %.3f ms, p95 %.3f ms, max %.3f ms, %d frames over the %.3f ms budget: %s"),
+		Patrol.Num(), NumPromoted, Sorted.Num(), Total / Sorted.Num(), P95, Sorted.Last(), OverBudget, BudgetMs, P95 <= BudgetMs ? TEXT("PASS") : TEXT("FAIL"));
+
+	BudgetCheckFrames = 0;
+	BudgetCheckSamples.Empty();
+}
+
+void UGuardCrowdSubsystem::ProcessBatch(int32 First, int32 Last, float DeltaTime, TConstArrayView<FPlayerContext> Players)
+{
+	const float ClosedDoorHearingScale = UStealthSettings::Get()->ClosedDoorHearingScale;
+
+	// Sight lines are queued while the batch moves and traced together before perception is applied
+	FStealthFrameArena& Arena = FStealthFrameArena::Get();
+	TArrayView<FSightQuery> SightQueries = Arena.AllocateArray<FSightQuery>((Last - First) * Players.Num());
+	TArrayView<float> SightGain = Arena.AllocateArray<float>(Last - First);
+	int32 NumSightQueries = 0;
+
+	for (int32 GuardIndex = First; GuardIndex < Last; ++GuardIndex)
+	{
+		FGuardPatrolFragment& GuardPatrol = Patrol[GuardIndex];
+		const FGuardPerceptionFragment& GuardPerception = Perception[GuardIndex];
+		const FGuardAlertFragment& GuardAlert = Alert[GuardIndex];
+
+		// ---- Patrol ---- //
+		float SpeedScale = 1.0f;
+		FVector MoveTarget = GuardPatrol.Location;
+		if (GuardAlert.State == EGuardAlertState::Alerted)
+		{
+			// Alerted guards head to where they last noticed the player
+			SpeedScale = GuardCrowd::AlertedSpeedScale;
+			MoveTarget = GuardAlert.LastKnownPlayerLocation;
+		}
+		else if (GuardPatrol.RouteLength > 0)
+		{
+			SpeedScale = GuardAlert.State == EGuardAlertState::Suspicious ? GuardCrowd::SuspiciousSpeedScale : 1.0f;
+			MoveTarget = RoutePoints[GuardPatrol.RouteStart + GuardPatrol.WaypointIndex];
+		}
+
+		FVector ToTarget = MoveTarget - GuardPatrol.Location;
+		ToTarget.Z = 0.0f;
+		const float TargetDistance = ToTarget.Size();
+		const float Step = GuardPatrol.Speed * SpeedScale * DeltaTime;
+
+		if (TargetDistance <= FMath::Max(Step, GuardCrowd::WaypointAcceptRadius))
+		{
+			GuardPatrol.Location.X = MoveTarget.X;
+			GuardPatrol.Location.Y = MoveTarget.Y;
+			if (GuardAlert.State != EGuardAlertState::Alerted && GuardPatrol.RouteLength > 0)
+			{
+				GuardPatrol.WaypointIndex = (GuardPatrol.WaypointIndex + 1) % GuardPatrol.RouteLength;
+			}
+		}
+		else
+		{
+			GuardPatrol.Location += ToTarget * (Step / TargetDistance);
+			GuardPatrol.Yaw = FMath::RadiansToDegrees(FMath::Atan2(ToTarget.Y, ToTarget.X));
+		}
+
+		// ---- Sight query ---- //
+		const FVector Eye = GuardPatrol.Location + FVector(0.0f, 0.0f, GuardCrowd::EyeHeight);
+		float SinYaw, CosYaw;
+		FMath::SinCos(&SinYaw, &CosYaw, FMath::DegreesToRadians(GuardPatrol.Yaw));
+		for (int32 PlayerIndex = 0; PlayerIndex < Players.Num(); ++PlayerIndex)
+		{
+			const FPlayerContext& Player = Players[PlayerIndex];
+			const FVector ToPlayer = Player.Location - Eye;
+			const float DistanceSq = ToPlayer.SizeSquared();
+			if (DistanceSq < FMath::Square(GuardPerception.SightRange) && DistanceSq > KINDA_SMALL_NUMBER)
+			{
+				const float Distance = FMath::Sqrt(DistanceSq);
+				const float Facing = (ToPlayer.X * CosYaw + ToPlayer.Y * SinYaw) / Distance;
+
+				// Dark + far = barely noticed, lit + close = spotted quickly. The sight line is only traced for guards
+				// that would notice something, which is few of them in a big crowd.
+				const float PotentialGain = Player.Visibility * (1.0f - Distance / GuardPerception.SightRange) * GuardCrowd::SuspicionGainRate;
+				if (Facing >= GuardPerception.HalfFovCos && PotentialGain > 0.0f)
+				{
+					SightQueries[NumSightQueries++] = { GuardIndex, PlayerIndex, Eye, PotentialGain };
+				}
+			}
+		}
+	}
+
+	// Each guard goes after the visible player it would spot fastest; a sight line is not traced for a player
+	// who could not beat the one already seen
+	for (int32 Index = 0; Index < NumSightQueries; ++Index)
+	{
+		const FSightQuery& Query = SightQueries[Index];
+		float& Gain = SightGain[Query.GuardIndex - First];
+		if (Query.Gain > Gain && HasLineOfSight(Query.GuardIndex, Query.Eye, Players[Query.PlayerIndex]))
+		{
+			Gain = Query.Gain;
+			Alert[Query.GuardIndex].LastKnownPlayerLocation = Players[Query.PlayerIndex].Location;
+		}
+	}
+
+	for (int32 GuardIndex = First; GuardIndex < Last; ++GuardIndex)
+	{
+		const FGuardPatrolFragment& GuardPatrol = Patrol[GuardIndex];
+		FGuardPerceptionFragment& GuardPerception = Perception[GuardIndex];
+		FGuardAlertFragment& GuardAlert = Alert[GuardIndex];
+
+		// ---- Perception ---- //
+		const float Gain = SightGain[GuardIndex - First];
+		for (const FNoise& Noise : PendingNoises)
+		{
+			float HearingRange = GuardPerception.HearingRange * Noise.Loudness;
+			const float DistanceSq = FVector::DistSquared(Noise.Location, GuardPatrol.Location);
+			if (HearingRange <= 0.0f || DistanceSq >= FMath::Square(HearingRange))
+			{
+				continue;
+			}
+
+			// Every closed door in between cuts the range
+			for (const FBox& Door : ClosedDoors)
+			{
+				if (FMath::LineBoxIntersection(Door, Noise.Location, GuardPatrol.Location, GuardPatrol.Location - Noise.Location))
+				{
+					HearingRange *= ClosedDoorHearingScale;
+				}
+			}
+			if (DistanceSq < FMath::Square(HearingRange))
+			{
+				GuardPerception.Suspicion += 0.5f * (1.0f - FMath::Sqrt(DistanceSq) / HearingRange);
+				GuardAlert.LastKnownPlayerLocation = Noise.Location;
+			}
+		}
+
+		GuardPerception.Suspicion += (Gain > 0.0f ? Gain : -GuardCrowd::SuspicionDecayRate) * DeltaTime;
+		GuardPerception.Suspicion = FMath::Clamp(GuardPerception.Suspicion, 0.0f, 1.0f);
+
+		// ---- Alert ---- //
+		// Alerted guards keep searching until suspicion drops back under the suspicious threshold
+		const bool bStayAlerted = GuardAlert.State == EGuardAlertState::Alerted && GuardPerception.Suspicion >= GuardCrowd::SuspiciousThreshold;
+
+		EGuardAlertState NewState = EGuardAlertState::Patrolling;
+		if (GuardPerception.Suspicion >= GuardCrowd::AlertedThreshold || bStayAlerted)
+		{
+			NewState = EGuardAlertState::Alerted;
+		}
+		else if (GuardPerception.Suspicion >= GuardCrowd::SuspiciousThreshold)
+		{
+			NewState = EGuardAlertState::Suspicious;
+		}
+
+		if (NewState != GuardAlert.State)
+		{
+			GuardAlert.State = NewState;
+			GuardAlert.TimeInState = 0.0f;
+		}
+		else
+		{
+			GuardAlert.TimeInState += DeltaTime;
+		}
+	}
+}
+
+void UGuardCrowdSubsystem::RequestDoors(TConstArrayView<FPlayerContext> Players)
+{
+	UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>();
+	// Doors are only toggled on the server
+	if (!Interactions || Interactions->NumDoors() == 0 || Players.Num() == 0 || GetWorld()->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	// Only guards near a player, and at most GuardDoorRequestsPerFrame of them, starting where the last frame
+	// stopped. The rest ask on a later frame; the door windows are wide enough for a walking guard to wait a few.
+	const UStealthSettings* Settings = UStealthSettings::Get();
+	const int32 MaxGuards = FMath::Min(Settings->GuardDoorRequestsPerFrame, Patrol.Num());
+	const float MaxDistanceSq = FMath::Square(Settings->GuardDoorDistance);
+
+	// Resolved with the players' requests in one pass; two guards at one door never both toggle it
+	FInteractionRequest Request;
+	Request.Priority = InteractionPriority::Guard;
+	Request.Query = EInteractionQuery::Nearby;
+	Request.MinFacing = GuardCrowd::DoorFacingCos;
+	int32 NumRequested = 0;
+	int32 GuardIndex = NextDoorGuard % Patrol.Num();
+	for (int32 Visited = 0; Visited < Patrol.Num() && NumRequested < MaxGuards; ++Visited, GuardIndex = (GuardIndex + 1) % Patrol.Num())
+	{
+		const FGuardPatrolFragment& GuardPatrol = Patrol[GuardIndex];
+		if (GetClosestPlayerDistanceSq(GuardPatrol.Location, Players) > MaxDistanceSq)
+		{
+			continue;
+		}
+		++NumRequested;
+
+		float SinYaw, CosYaw;
+		FMath::SinCos(&SinYaw, &CosYaw, FMath::DegreesToRadians(GuardPatrol.Yaw));
+
+		Request.Requester = Representation[GuardIndex];
+		Request.RequesterId = GuardIndex;
+		Request.Origin = GuardPatrol.Location;
+		Request.Forward = FVector(CosYaw, SinYaw, 0.0f);
+
+		Request.Action = EInteractionAction::Open;
+		Request.Direction = Request.Forward;
+		Request.Reach = GuardCrowd::DoorOpenReach;
+		Request.MinDistance = 0.0f;
+		Interactions->Request(Request);
+
+		// Searching guards leave doors open behind them
+		if (Alert[GuardIndex].State == EGuardAlertState::Patrolling)
+		{
+			Request.Action = EInteractionAction::Close;
+			Request.Direction = -Request.Forward;
+			Request.Reach = GuardCrowd::DoorCloseReach;
+			Request.MinDistance = GuardCrowd::DoorCloseMinDistance;
+			Interactions->Request(Request);
+		}
+	}
+	NextDoorGuard = GuardIndex;
+}
+
+bool UGuardCrowdSubsystem::HasLineOfSight(int32 GuardIndex, const FVector& Eye, const FPlayerContext& Player) const
+{
+	// Representation only changes on the game thread after the batches, so reading it here is safe
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(GuardSight), false, Player.Actor);
+	Params.AddIgnoredActor(Representation[GuardIndex].Get());
+	return !GetWorld()->LineTraceTestByChannel(Eye, Player.Location, ECC_Visibility, Params);
+}
+
+float UGuardCrowdSubsystem::GetClosestPlayerDistanceSq(const FVector& Location, TConstArrayView<FPlayerContext> Players)
+{
+	float ClosestSq = TNumericLimits<float>::Max();
+	for (const FPlayerContext& Player : Players)
+	{
+		ClosestSq = FMath::Min(ClosestSq, static_cast<float>(FVector::DistSquared(Location, Player.Location)));
+	}
+	return ClosestSq;
+}
+
+void UGuardCrowdSubsystem::UpdateRepresentation(TConstArrayView<FPlayerContext> Players)
+{
+	SCOPE_CYCLE_COUNTER(STAT_GuardCrowdRepresentation);
+
+	const UStealthSettings* Settings = UStealthSettings::Get();
+	const float PromoteDistanceSq = FMath::Square(Settings->GuardPromoteDistance);
+	const float DemoteDistanceSq = FMath::Square(FMath::Max(Settings->GuardDemoteDistance, Settings->GuardPromoteDistance));
+
+	for (int32 GuardIndex = 0; GuardIndex < Patrol.Num(); ++GuardIndex)
+	{
+		const FGuardPatrolFragment& GuardPatrol = Patrol[GuardIndex];
+		const float DistanceSq = GetClosestPlayerDistanceSq(GuardPatrol.Location, Players);
+		TWeakObjectPtr<ACharacter>& Character = Representation[GuardIndex];
+
+		if (ACharacter* GuardCharacter = Character.Get())
+		{
+			if (DistanceSq > DemoteDistanceSq)
+			{
+				GuardCharacter->Destroy();
+				Character.Reset();
+				--NumPromoted;
+			}
+			else
+			{
+				// The crowd simulation stays authoritative, the character just mirrors it
+				GuardCharacter->SetActorLocationAndRotation(GuardPatrol.Location + FVector(0.0f, 0.0f, GuardHalfHeight), FRotator(0.0f, GuardPatrol.Yaw, 0.0f));
+			}
+		}
+		else if (!Character.IsExplicitlyNull())
+		{
+			// Character was destroyed by someone else
+			Character.Reset();
+			--NumPromoted;
+		}
+		else if (GuardClass && DistanceSq < PromoteDistanceSq && NumPromoted < Settings->MaxPromotedGuards)
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+			if (ACharacter* NewCharacter = GetWorld()->SpawnActor<ACharacter>(GuardClass, GuardPatrol.Location + FVector(0.0f, 0.0f, GuardHalfHeight), FRotator(0.0f, GuardPatrol.Yaw, 0.0f), SpawnParams))
+			{
+				Character = NewCharacter;
+				++NumPromoted;
+			}
+		}
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+// Stealth.Guards.Spawn [Count] [Radius] - spawns guards on square patrol loops around the player (or the origin)
+static FAutoConsoleCommandWithWorldAndArgs StealthGuardsSpawnCommand(
+	TEXT("Stealth.Guards.Spawn"),
+	TEXT("Spawns crowd guards for profiling. Args: [Count=1000] [Radius=10000]. Use 'stat Stealth' to see the per-frame cost."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UGuardCrowdSubsystem* Crowd = World ? World->GetSubsystem<UGuardCrowdSubsystem>() : nullptr;
+		if (!Crowd)
+		{
+			return;
+		}
+
+		const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000;
+		const float Radius = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 10000.0f;
+
+		FVector Center = FVector::ZeroVector;
+		if (ACharacter* PlayerCharacter = UGameplayStatics::GetPlayerCharacter(World, 0))
+		{
+			Center = PlayerCharacter->GetActorLocation() - FVector(0.0f, 0.0f, PlayerCharacter->GetCapsuleComponent()->GetScaledCapsuleHalfHeight());
+		}
+
+		FRandomStream Random(Crowd->NumGuards());
+		TArray<FVector> Route;
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			const FVector Corner = Center + FVector(Random.FRandRange(-Radius, Radius), Random.FRandRange(-Radius, Radius), 0.0f);
+			const float Side = Random.FRandRange(300.0f, 1500.0f);
+			Route = { Corner, Corner + FVector(Side, 0, 0), Corner + FVector(Side, Side, 0), Corner + FVector(0, Side, 0) };
+			Crowd->AddGuard(Route, Random.FRandRange(100.0f, 200.0f));
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("GuardCrowd: %d guards"), Crowd->NumGuards());
+	}));
+
+// Stealth.Guards.CheckBudget [Frames] - run headless after spawning, e.g.
+// -nullrhi -ExecCmds="Stealth.Guards.Spawn 1000; Stealth.Guards.CheckBudget 600"
+static FAutoConsoleCommandWithWorldAndArgs StealthGuardsCheckBudgetCommand(
+	TEXT("Stealth.Guards.CheckBudget"),
+	TEXT("Times the crowd update over the next frames of normal play and logs PASS if the 95th percentile stays within GuardFrameBudgetMs. Args: [Frames=600]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UGuardCrowdSubsystem* Crowd = World ? World->GetSubsystem<UGuardCrowdSubsystem>() : nullptr;
+		if (!Crowd || Crowd->NumGuards() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("GuardCrowd: no guards to time, spawn some with Stealth.Guards.Spawn first"));
+			return;
+		}
+		Crowd->StartBudgetCheck(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 600);
+	}));
+#endif
@@ -2,6 +2,8 @@
 
 
 #include "Character/LightDetector.h"
+#include "Thieflike.h"
+#include "Stealth/StealthMemory.h"
 
 // Sets default values
 ALightDetector::ALightDetector()
@@ -15,7 +17,6 @@ ALightDetector::ALightDetector()
 void ALightDetector::BeginPlay()
 {
 	Super::BeginPlay();
-	
 }
 
 // Called every frame
@@ -31,7 +32,17 @@ void ALightDetector::ProcessRenderTexture(UTextureRenderTarget2D* detectorTextur
 	// Read the pixels from our RenderTexture and store the data into our colour array
 	// Note: ReadPixels is allegedly a very slow operation
 	fRenderTarget = detectorTexture->GameThread_GetRenderTargetResource();
-	fRenderTarget->ReadPixels(pixelStorage);
+
+	// Cap the read back to the centre MaxDetectorPixels
+	const FIntPoint Size = fRenderTarget->GetSizeXY();
+	FIntRect ReadRect(FIntPoint::ZeroValue, Size);
+	if (Size.X * Size.Y > MaxDetectorPixels)
+	{
+		const int32 Side = FMath::Max(FMath::FloorToInt(FMath::Sqrt(static_cast<float>(MaxDetectorPixels))), 1);
+		const FIntPoint Min((Size.X - FMath::Min(Side, Size.X)) / 2, (Size.Y - FMath::Min(Side, Size.Y)) / 2);
+		ReadRect = FIntRect(Min, Min + FIntPoint(FMath::Min(Side, Size.X), FMath::Min(Side, Size.Y)));
+	}
+	fRenderTarget->ReadPixels(pixelStorage, FReadSurfaceDataFlags(), ReadRect);
 
 	// We iterate through every pixel we retrieved and find the brightest pixel
 	for (int pixelNum = 0; pixelNum < pixelStorage.Num(); pixelNum++)
@@ -55,6 +66,10 @@ void ALightDetector::ProcessRenderTexture(UTextureRenderTarget2D* detectorTextur
 
 float ALightDetector::CalculateBrightness()
 {
+	// The render target read back allocates inside the engine on every call, so it is left out of the count
+	LLM_SCOPE_BYTAG(Stealth_Lights);
+	STEALTH_HOT_PATH_SUSPEND();
+
 	// Ensure that the user has actually supplied us with RenderTextures
 	if (detectorTextureTop == nullptr || detectorTextureBottom == nullptr)
 	{
@@ -2,6 +2,7 @@
 
 
 #include "Character/PlayerCharacter.h"
+#include "Character/PlayerCharacterAssets.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "EngineUtils.h" // For TActorIterator
 #include "Engine/DirectionalLight.h" // To easily find the main light source
@@ -9,10 +10,30 @@
 #include "Components/SpotLightComponent.h" // For spot lights
 #include "Kismet/KismetSystemLibrary.h" // For UKismetSystemLibrary::LineTraceSingleByChannel 
 #include "Object/Door.h"
+#include "Object/InteractionSubsystem.h"
+#include "GameFramework/PlayerState.h"
 #include "Character/LightDetector.h" // LightDetector
+#include "Stealth/StealthEventBus.h"
+#include "Movement/ClimbableIndexSubsystem.h"
+#include "Movement/StealthCharacterMovementComponent.h"
+#include "Stealth/StealthLightSubsystem.h"
+#include "Stealth/StealthExposure.h"
+#include "Stealth/StealthMemory.h"
+#include "Stealth/StealthFootstepSubsystem.h"
+#include "Stealth/StealthSettings.h"
+#include "Stealth/StealthStreamingSubsystem.h"
+#include "Thieflike.h"
+#include "Net/UnrealNetwork.h"
+#include "Misc/App.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
+#include "Misc/CommandLine.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Player Simulation Steps"), STAT_PlayerSimulationSteps, STATGROUP_Stealth);
 
 // Sets default values
-APlayerCharacter::APlayerCharacter()
+APlayerCharacter::APlayerCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<UStealthCharacterMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
 	// Set this character to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
@@ -54,6 +75,8 @@ APlayerCharacter::APlayerCharacter()
 	FirstPersonMeshComponent->SetupAttachment(FirstPersonCameraComponent);
 	FirstPersonMeshComponent->bCastDynamicShadow = false;
 	FirstPersonMeshComponent->CastShadow = false;
+
+	PlayerAssets = FPrimaryAssetId(UPlayerCharacterAssets::AssetType, TEXT("PA_Player"));
 }
 
 // Called when the game starts or when spawned
@@ -63,15 +86,13 @@ void APlayerCharacter::BeginPlay()
 
 	check(GEngine != nullptr);
 
-	// Get the player controller for this character
-	if (APlayerController* PlayerController = Cast<APlayerController>(Controller))
-	{
-		// Get the enhanced input local player subsystem and add a new input mapping context to it
-		if (UEnhancedInputLocalPlayerSubsystem* Subsystem = ULocalPlayer::GetSubsystem<UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()))
-		{
-			Subsystem->AddMappingContext(FirstPersonContext, 0);
-		}
-	}
+	GetStealthMovement()->MaxSprintSpeed = RunSpeed;
+
+	// No-op until the context has streamed in; its load callback adds it otherwise
+	AddInputMappingContext();
+
+	CameraHeight = PreviousCameraHeight = FirstPersonSpringArmComponent->GetRelativeLocation().Z;
+
 	// Display a debug message for five seconds. 
 	// The -1 "Key" value argument prevents the message from being updated or refreshed.
 	GEngine->AddOnScreenDebugMessage(-1, 5.0f, FColor::Red, TEXT("We are using FPSCharacter."));
@@ -82,27 +103,63 @@ void APlayerCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	LLM_SCOPE_BYTAG(Stealth_Player);
+	STEALTH_HOT_PATH_SCOPE("PlayerCharacter");
+
+	if (!bReportedControllable)
+	{
+		CheckControllable();
+	}
+
 	if (!FirstPersonSpringArmComponent && !FirstPersonCameraComponent)
 	{
 		return;
 	}
 
+	// Gameplay state advances at the fixed simulation rate; the camera and traversal position shown are
+	// interpolated between the last two steps
+	const int32 NumSteps = SimulationStep.Advance(DeltaTime);
+	if (NumSteps > 0)
+	{
+		// However many steps the frame runs, the lights are read once
+		SampleVisibility();
+	}
+	for (int32 Step = 0; Step < NumSteps; ++Step)
+	{
+		SimulateStep(SimulationStep.GetStepSeconds());
+	}
+	UpdatePresentation(SimulationStep.GetAlpha());
+
+	// What the crosshair is on is looked up every frame, for each local player, in the same pass as every
+	// other interaction
+	if (IsLocallyControlled() && FirstPersonCameraComponent)
+	{
+		RequestInteraction(EInteractionAction::Focus);
+	}
+
+	// Climb input is only triggered while held, so it is consumed once this frame's steps have used it
+	if (NumSteps > 0)
+	{
+		ClimbInput = 0.0f;
+		ClimbLateralInput = 0.0f;
+	}
+}
+
+void APlayerCharacter::SimulateStep(float DeltaTime)
+{
+	INC_DWORD_STAT(STAT_PlayerSimulationSteps);
+
+	PreviousLeanOffset = CurrentLeanOffset;
+	PreviousLeanRoll = CurrentLeanRoll;
+	PreviousCameraHeight = CameraHeight;
+
 	float AllowedLean = GetAllowedLeanOffset(TargetLeanOffset); //GetAllowedLeanOffset is for Lean to the Playercharacter FirstPersonSpringArmComponent.
 	float LeanRatio = (MaxLeanOffset != 0.f) ? FMath::Abs(CurrentLeanOffset / MaxLeanOffset) : 0.f; // While Leaning Roll until contacts the wall
 
 	CurrentLeanOffset = FMath::FInterpTo(CurrentLeanOffset, AllowedLean, DeltaTime, LeanInterpSpeed);
 	CurrentLeanRoll = FMath::FInterpTo(CurrentLeanRoll, TargetLeanRoll * LeanRatio, DeltaTime, LeanInterpSpeed);
 
-	// Move camera right/left
-	FVector SocketOffset = FirstPersonSpringArmComponent->SocketOffset;
-	SocketOffset.Y = CurrentLeanOffset;
-	FirstPersonSpringArmComponent->SocketOffset = SocketOffset;
-
-	// Roll
-	FirstPersonCameraComponent->SetRelativeRotation(FRotator(0.f, 0.f, CurrentLeanRoll));
-
-	// Calculate visibility every frame
-	CalculateVisibility();
+	UpdateVisibility(DeltaTime);
 
 	// -------- Smooth Crouch Capsule Height Transition --------
 	float CurrentHalfHeight = GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
@@ -114,76 +171,123 @@ void APlayerCharacter::Tick(float DeltaTime)
 	GetCapsuleComponent()->SetCapsuleHalfHeight(NewHalfHeight);
 
 	// Smooth camera height
+	CameraHeight = FMath::FInterpTo(CameraHeight, TargetCapsuleHalfHeight, DeltaTime, CrouchTransitionSpeed);
+
+	if (HasAuthority())
+	{
+		UpdateFootsteps(DeltaTime);
+	}
+
+	// Remote owners drive their own traversal; keep them inside what the server validated
+	if (HasAuthority() && !IsLocallyControlled() && (bIsClimbing || bIsMantling))
+	{
+		CheckClientTraversal();
+	}
+
+	// ---- Handle Climbing / Mantling ---- //
+	// Only the controlling side moves the character; the server and other clients follow replicated movement
+	if ((!bIsClimbing && !bIsMantling) || !IsLocallyControlled())
+	{
+		return;
+	}
+
+	// Step from the simulated position, not the interpolated one shown last frame
+	SetActorLocation(TraversalLocation);
+	PreviousTraversalLocation = TraversalLocation;
+
+	if (bIsClimbing)
+	{
+		UpdateClimb(DeltaTime);
+	}
+	else
+	{
+		UpdateMantle(DeltaTime);
+	}
+
+	TraversalLocation = GetActorLocation();
+}
+
+void APlayerCharacter::UpdatePresentation(float Alpha)
+{
+	// Move camera right/left
+	FVector SocketOffset = FirstPersonSpringArmComponent->SocketOffset;
+	SocketOffset.Y = FMath::Lerp(PreviousLeanOffset, CurrentLeanOffset, Alpha);
+	FirstPersonSpringArmComponent->SocketOffset = SocketOffset;
+
+	// Roll
+	FirstPersonCameraComponent->SetRelativeRotation(FRotator(0.f, 0.f, FMath::Lerp(PreviousLeanRoll, CurrentLeanRoll, Alpha)));
+
 	FVector CameraLocation = FirstPersonSpringArmComponent->GetRelativeLocation();
-	CameraLocation.Z = FMath::FInterpTo(CameraLocation.Z, TargetCapsuleHalfHeight, DeltaTime, CrouchTransitionSpeed);
+	CameraLocation.Z = FMath::Lerp(PreviousCameraHeight, CameraHeight, Alpha);
 	FirstPersonSpringArmComponent->SetRelativeLocation(CameraLocation);
 
-	// ---- Handle Mantling ---- //
-	if (bIsMantling)
+	if ((bIsClimbing || bIsMantling) && IsLocallyControlled())
 	{
-		FVector CurrentLocation = GetActorLocation();
+		SetActorLocation(FMath::Lerp(PreviousTraversalLocation, TraversalLocation, Alpha));
+	}
+}
 
-		// --- Stuck Check
-		// If we haven't moved significantly since last frame, we might be stuck in geometry
-		if (FVector::DistSquared(CurrentLocation, LastMantleLocation) < 50.0f)
+void APlayerCharacter::UpdateMantle(float DeltaTime)
+{
+	FVector CurrentLocation = GetActorLocation();
+
+	// --- Stuck Check
+	// If we haven't moved significantly since the last step, we might be stuck in geometry
+	if (FVector::DistSquared(CurrentLocation, LastMantleLocation) < 50.0f)
+	{
+		StuckTimer += DeltaTime;
+		if (StuckTimer > 0.4f)
 		{
-			StuckTimer += DeltaTime;
-			if (StuckTimer > 0.4f)
-			{
-				StopMantle(false);
-				return;
-			}
+			StopMantle(false);
+			return;
 		}
-		else
+	}
+	else
+	{
+		//Reset timer if we have moved
+		StuckTimer = 0.0f;
+	}
+	LastMantleLocation = CurrentLocation;
+	//---
+	bool bReachedHeight = FMath::IsNearlyEqual(CurrentLocation.Z, MantleTargetPosition.Z, 5.0f);
+
+	if (!bReachedHeight)
+	{
+		// PHASE 1: VERTICAL HOIST
+
+		// Check Input
+		if (!bIsJumpHeld)
 		{
-			//Reset timer if we have moved
-			StuckTimer = 0.0f;
+			StopMantle(false); // Fail -> Push Back
+			return;
 		}
-		LastMantleLocation = CurrentLocation;
-		//---
-		bool bReachedHeight = FMath::IsNearlyEqual(CurrentLocation.Z, MantleTargetPosition.Z, 5.0f);
 
-		if (!bReachedHeight)
-		{
-			// PHASE 1: VERTICAL HOIST
+		FVector NewLoc = CurrentLocation;
+		NewLoc.Z = FMath::FInterpTo(CurrentLocation.Z, MantleTargetPosition.Z, DeltaTime, MantleSpeed);
 
-			// Check Input
-			if (!bIsJumpHeld)
-			{
-				StopMantle(false); // Fail -> Push Back
-				return;
-			}
+		// FIX: Pull slightly AWAY from the wall while going up
+		// This prevents catching your capsule on the "lip" of the ledge
+		FVector SafeWallLocation = MantleTargetPosition - (GetActorForwardVector() * 25.0f); // Stay 25 units back from target X/Y
+		NewLoc.X = FMath::FInterpTo(CurrentLocation.X, SafeWallLocation.X, DeltaTime, MantleSpeed * 0.5f);
+		NewLoc.Y = FMath::FInterpTo(CurrentLocation.Y, SafeWallLocation.Y, DeltaTime, MantleSpeed * 0.5f);
 
-			FVector NewLoc = CurrentLocation;
-			NewLoc.Z = FMath::FInterpTo(CurrentLocation.Z, MantleTargetPosition.Z, DeltaTime, MantleSpeed);
+		SetActorLocation(NewLoc);
+	}
+	else
+	{
+		// PHASE 2: FORWARD STEP
+		FVector NewLoc = CurrentLocation;
+		NewLoc.Z = MantleTargetPosition.Z;
+		NewLoc.X = FMath::FInterpTo(CurrentLocation.X, MantleTargetPosition.X, DeltaTime, MantleSpeed);
+		NewLoc.Y = FMath::FInterpTo(CurrentLocation.Y, MantleTargetPosition.Y, DeltaTime, MantleSpeed);
 
-			// FIX: Pull slightly AWAY from the wall while going up
-			// This prevents catching your capsule on the "lip" of the ledge
-			FVector SafeWallLocation = MantleTargetPosition - (GetActorForwardVector() * 25.0f); // Stay 25 units back from target X/Y
-			NewLoc.X = FMath::FInterpTo(CurrentLocation.X, SafeWallLocation.X, DeltaTime, MantleSpeed * 0.5f);
-			NewLoc.Y = FMath::FInterpTo(CurrentLocation.Y, SafeWallLocation.Y, DeltaTime, MantleSpeed * 0.5f);
+		SetActorLocation(NewLoc);
 
-			SetActorLocation(NewLoc);
-		}
-		else
+		if (FVector::Dist2D(NewLoc, MantleTargetPosition) < 10.0f)
 		{
-			// PHASE 2: FORWARD STEP
-			FVector NewLoc = CurrentLocation;
-			NewLoc.Z = MantleTargetPosition.Z;
-			NewLoc.X = FMath::FInterpTo(CurrentLocation.X, MantleTargetPosition.X, DeltaTime, MantleSpeed);
-			NewLoc.Y = FMath::FInterpTo(CurrentLocation.Y, MantleTargetPosition.Y, DeltaTime, MantleSpeed);
-
-			SetActorLocation(NewLoc);
-
-			if (FVector::Dist2D(NewLoc, MantleTargetPosition) < 10.0f)
-			{
-				StopMantle(true); // Success -> Walking Mode
-			}
+			StopMantle(true); // Success -> Walking Mode
 		}
-		return;
 	}
-
-	Super::Tick(DeltaTime);
 }
 
 // Called to bind functionality to input
@@ -191,41 +295,218 @@ void APlayerCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputCom
 {
 	Super::SetupPlayerInputComponent(PlayerInputComponent);
 
-	// Check the UInputComponent passed to this function and cast it to an UEnhancedInputComponent
-	if (UEnhancedInputComponent* EnhancedInputComponent = CastChecked<UEnhancedInputComponent>(PlayerInputComponent))
+	// A new input component starts with no bindings. Bind now if the Input bundle is in; otherwise it binds on arrival.
+	BoundInputActions.Reset();
+	BindInputActions();
+
+	AddInputMappingContext();
+}
+
+// ---- Async asset loading ---- //
+void APlayerCharacter::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	// Dedicated servers have no local player or first-person view
+	if (!IsRunningDedicatedServer())
 	{
-		// Bind Movement Actions
-		EnhancedInputComponent->BindAction(MoveAction, ETriggerEvent::Triggered, this, &APlayerCharacter::Move);
+		RequestPlayerAssets();
+	}
+}
 
-		// Bind Look Actions
-		EnhancedInputComponent->BindAction(LookAction, ETriggerEvent::Triggered, this, &APlayerCharacter::Look);
+void APlayerCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// The bundles stay loaded for the next character; the handles are shared with it, so they are released, not cancelled
+	AssetLoadHandles.Reset();
 
-		// Bind Jump Actions
-		EnhancedInputComponent->BindAction(JumpAction, ETriggerEvent::Started, this, &APlayerCharacter::Jump);
+	Super::EndPlay(EndPlayReason);
+}
 
-		// Lean
-		EnhancedInputComponent->BindAction(LeanRightAction, ETriggerEvent::Started, this, &APlayerCharacter::StartLeanRight);
-		EnhancedInputComponent->BindAction(LeanRightAction, ETriggerEvent::Completed, this, &APlayerCharacter::StopLeanRight);
-		EnhancedInputComponent->BindAction(LeanLeftAction, ETriggerEvent::Started, this, &APlayerCharacter::StartLeanLeft);
-		EnhancedInputComponent->BindAction(LeanLeftAction, ETriggerEvent::Completed, this, &APlayerCharacter::StopLeanLeft);
+const UPlayerCharacterAssets* APlayerCharacter::GetLoadedAssets() const
+{
+	return PlayerAssets.IsValid() ? UAssetManager::Get().GetPrimaryAssetObject<UPlayerCharacterAssets>(PlayerAssets) : nullptr;
+}
 
-		// Crouch
-		EnhancedInputComponent->BindAction(CrouchAction, ETriggerEvent::Started, this, &APlayerCharacter::StartCrouch);
+void APlayerCharacter::RequestPlayerAssets()
+{
+	if (!PlayerAssets.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s has no PlayerAssets set; it will have no input or first-person arms"), *GetName());
+		return;
+	}
 
-		// Walk
-		EnhancedInputComponent->BindAction(SprintAction, ETriggerEvent::Started, this, &APlayerCharacter::StartSprint);
-		EnhancedInputComponent->BindAction(SprintAction, ETriggerEvent::Completed, this, &APlayerCharacter::StopSprint);
+	LLM_SCOPE_BYTAG(Stealth_Player);
+
+	// Bundles are only ever added, so every player character can ask without unloading what another one is using
+	AssetLoadHandles.Add(UAssetManager::Get().ChangeBundleStateForPrimaryAssets({ PlayerAssets }, { UPlayerCharacterAssets::InputBundle }, {}, false,
+		FStreamableDelegate::CreateUObject(this, &APlayerCharacter::OnInputBundleLoaded), FStreamableManager::AsyncLoadHighPriority));
+}
+
+void APlayerCharacter::OnInputBundleLoaded()
+{
+	BindInputActions();
+	AddInputMappingContext();
+
+	// Arms, animation and the materials they pull in, at normal priority now that the player can move
+	LLM_SCOPE_BYTAG(Stealth_Player);
+	AssetLoadHandles.Add(UAssetManager::Get().ChangeBundleStateForPrimaryAssets({ PlayerAssets }, { UPlayerCharacterAssets::VisualBundle }, {}, false,
+		FStreamableDelegate::CreateUObject(this, &APlayerCharacter::OnVisualBundleLoaded)));
+}
+
+void APlayerCharacter::OnVisualBundleLoaded()
+{
+	const UPlayerCharacterAssets* Assets = GetLoadedAssets();
+	if (!Assets)
+	{
+		return;
+	}
+
+	if (USkeletalMesh* Mesh = Assets->FirstPersonMesh.Get())
+	{
+		FirstPersonMeshComponent->SetSkeletalMeshAsset(Mesh);
+	}
+
+	if (UClass* AnimClass = Assets->FirstPersonAnimClass.Get())
+	{
+		FirstPersonMeshComponent->SetAnimInstanceClass(AnimClass);
+	}
+}
+
+void APlayerCharacter::AddInputMappingContext()
+{
+	const UPlayerCharacterAssets* Assets = GetLoadedAssets();
+	UInputMappingContext* Context = Assets ? Assets->FirstPersonContext.Get() : nullptr;
+	APlayerController* PlayerController = Cast<APlayerController>(Controller);
+	if (!Context || !PlayerController)
+	{
+		return;
+	}
+
+	// Get the enhanced input local player subsystem and add a new input mapping context to it
+	if (UEnhancedInputLocalPlayerSubsystem* Subsystem = ULocalPlayer::GetSubsystem<UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()))
+	{
+		if (!Subsystem->HasMappingContext(Context))
+		{
+			Subsystem->AddMappingContext(Context, 0);
+		}
+	}
+}
 
+void APlayerCharacter::BindInputActions()
+{
+	if (const UPlayerCharacterAssets* Assets = GetLoadedAssets())
+	{
+		for (const TSoftObjectPtr<UInputAction>* Action : Assets->GetInputActions())
+		{
+			BindInputAction(*Action);
+		}
+	}
+}
+
+void APlayerCharacter::BindInputAction(const TSoftObjectPtr<UInputAction>& Action)
+{
+	const UPlayerCharacterAssets* Assets = GetLoadedAssets();
+	UInputAction* LoadedAction = Action.Get();
+	UEnhancedInputComponent* EnhancedInputComponent = Cast<UEnhancedInputComponent>(InputComponent);
+	if (!Assets || !LoadedAction || !EnhancedInputComponent || BoundInputActions.Contains(LoadedAction))
+	{
+		return;
+	}
+	BoundInputActions.Add(LoadedAction);
+
+	if (Action == Assets->MoveAction)
+	{
+		// Bind Movement Actions
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Triggered, this, &APlayerCharacter::Move);
+	}
+	else if (Action == Assets->LookAction)
+	{
+		// Bind Look Actions
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Triggered, this, &APlayerCharacter::Look);
+	}
+	else if (Action == Assets->JumpAction)
+	{
+		// Bind Jump Actions
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Started, this, &APlayerCharacter::Jump);
+	}
+	else if (Action == Assets->LeanRightAction)
+	{
+		// Lean
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Started, this, &APlayerCharacter::StartLeanRight);
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Completed, this, &APlayerCharacter::StopLeanRight);
+	}
+	else if (Action == Assets->LeanLeftAction)
+	{
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Started, this, &APlayerCharacter::StartLeanLeft);
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Completed, this, &APlayerCharacter::StopLeanLeft);
+	}
+	else if (Action == Assets->CrouchAction)
+	{
+		// Crouch
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Started, this, &APlayerCharacter::StartCrouch);
+	}
+	else if (Action == Assets->SprintAction)
+	{
+		// Walk
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Started, this, &APlayerCharacter::StartSprint);
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Completed, this, &APlayerCharacter::StopSprint);
+	}
+	else if (Action == Assets->InteractAction)
+	{
 		// Interact
-		EnhancedInputComponent->BindAction(InteractAction, ETriggerEvent::Started, this, &APlayerCharacter::Interact);
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Started, this, &APlayerCharacter::Interact);
+	}
+	else if (Action == Assets->ClimbAction)
+	{
+		// Climb
+		EnhancedInputComponent->BindAction(LoadedAction, ETriggerEvent::Started, this, &APlayerCharacter::ToggleClimb);
+	}
+}
+
+void APlayerCharacter::CheckControllable()
+{
+	// Controllable = possessed locally, mapping context in, and move + look bound
+	const UPlayerCharacterAssets* Assets = IsLocallyControlled() ? GetLoadedAssets() : nullptr;
+	if (!Assets || !Assets->FirstPersonContext.IsValid() || !BoundInputActions.Contains(Assets->MoveAction.Get()) || !BoundInputActions.Contains(Assets->LookAction.Get()))
+	{
+		return;
+	}
+	bReportedControllable = true;
+
+	UE_LOG(LogTemp, Display, TEXT("Startup: first controllable frame %.3f s after process start (frame %llu)"), FPlatformTime::Seconds() - GStartTime, (uint64)GFrameCounter);
+
+	// For scripted startup comparisons: -game -nullrhi -ExitWhenControllable
+	if (FParse::Param(FCommandLine::Get(), TEXT("ExitWhenControllable")))
+	{
+		FPlatformMisc::RequestExit(false, TEXT("ExitWhenControllable"));
 	}
 }
+
+void APlayerCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	// The owner already knows its own lean and traversal state
+	DOREPLIFETIME_CONDITION(APlayerCharacter, LeanDirection, COND_SkipOwner);
+	DOREPLIFETIME_CONDITION(APlayerCharacter, bIsMantling, COND_SkipOwner);
+	DOREPLIFETIME_CONDITION(APlayerCharacter, bIsClimbing, COND_SkipOwner);
+	DOREPLIFETIME(APlayerCharacter, ReplicatedVisibility);
+}
+
 void APlayerCharacter::Move(const FInputActionValue& Value)
 {
 
 	// 2D Vector of movement values returned from the input action
 	const FVector2D MovementValue = Value.Get<FVector2D>();
 
+	// Forward/back climbs, right/left moves across walls (ladders and ropes ignore it)
+	if (bIsClimbing)
+	{
+		ClimbInput = FMath::Clamp(MovementValue.Y, -1.0f, 1.0f);
+		ClimbLateralInput = FMath::Clamp(MovementValue.X, -1.0f, 1.0f);
+		return;
+	}
+
 	// Prevent movement while climbing
 	if (bIsMantling) return;
 
@@ -258,6 +539,13 @@ void APlayerCharacter::Look(const FInputActionValue& Value)
 
 void APlayerCharacter::Jump()
 {
+	// Jumping off a ladder / rope
+	if (bIsClimbing)
+	{
+		StopClimb(true);
+		return;
+	}
+
 	// If crouching, stand up first so mantle checks use standing height
 	if (GetCharacterMovement() && GetCharacterMovement()->IsCrouching())
 	{
@@ -272,14 +560,7 @@ void APlayerCharacter::Jump()
 	// Check for Mantle Opportunity
 	if (bIsGrounded && CanMantle(TargetLocation))
 	{
-		bIsMantling = true;
-		MantleTargetPosition = TargetLocation;
-		bIsJumpHeld = true;
-
-		LastMantleLocation = GetActorLocation();
-		StuckTimer = 0.0f;
-
-		GetCharacterMovement()->SetMovementMode(MOVE_Flying);
+		StartMantle(TargetLocation);
 		return;
 	}
 
@@ -287,8 +568,30 @@ void APlayerCharacter::Jump()
 	Super::Jump();
 }
 
+void APlayerCharacter::StartMantle(const FVector& TargetLocation)
+{
+	bIsMantling = true;
+	MantleTargetPosition = TargetLocation;
+	bIsJumpHeld = true;
+
+	LastMantleLocation = GetActorLocation();
+	StuckTimer = 0.0f;
+	TraversalLocation = PreviousTraversalLocation = GetActorLocation();
+
+	GetCharacterMovement()->SetMovementMode(MOVE_Flying);
+	NotifyTraversalChanged();
+
+	if (UStealthEventBus* EventBus = UStealthEventBus::Get(this))
+	{
+		EventBus->Post(EStealthEventType::MantleStart, this, GetActorLocation(), 0.0f);
+	}
+}
+
 void APlayerCharacter::StartCrouch(const FInputActionValue& Value)
 {
+	// No crouching on a ladder
+	if (bIsClimbing) return;
+
 	// Toggle Crouch
 	if (GetCharacterMovement()->IsCrouching())
 	{
@@ -305,65 +608,151 @@ void APlayerCharacter::StartCrouch(const FInputActionValue& Value)
 void APlayerCharacter::StartLeanRight(const FInputActionValue& Value)
 {
 	UE_LOG(LogTemp, Warning, TEXT("Lean Right Started"));
-	TargetLeanOffset = +MaxLeanOffset;
-	TargetLeanRoll = +MaxLeanRoll;
+	SetLeanDirection(1);
 }
 
 void APlayerCharacter::StopLeanRight(const FInputActionValue& Value)
 {
 	UE_LOG(LogTemp, Warning, TEXT("Lean Right Stopped"));
-	TargetLeanOffset = 0.0f;
-	TargetLeanRoll = 0.0f;
+	SetLeanDirection(0);
 }
 
 void APlayerCharacter::StartLeanLeft(const FInputActionValue& Value)
 {
 	UE_LOG(LogTemp, Warning, TEXT("Lean Left Started"));
-	TargetLeanOffset = -MaxLeanOffset;
-	TargetLeanRoll = -MaxLeanRoll;
+	SetLeanDirection(-1);
 }
 
 void APlayerCharacter::StopLeanLeft(const FInputActionValue& Value)
 {
 	UE_LOG(LogTemp, Warning, TEXT("Lean Left Stopped"));
-	TargetLeanOffset = 0.0f;
-	TargetLeanRoll = 0.0f;
+	SetLeanDirection(0);
 }
 
+void APlayerCharacter::SetLeanDirection(int8 Direction)
+{
+	ApplyLeanDirection(Direction);
 
-void APlayerCharacter::Interact()
+	if (!HasAuthority())
+	{
+		ServerSetLean(Direction);
+	}
+}
+
+void APlayerCharacter::ApplyLeanDirection(int8 Direction)
 {
-	FHitResult HitResult;
-	FVector Start = FirstPersonCameraComponent->GetComponentLocation();
-	FVector End = Start + FirstPersonCameraComponent->GetForwardVector() * InteractLineTraceLength;
+	LeanDirection = Direction;
+	TargetLeanOffset = Direction * MaxLeanOffset;
+	TargetLeanRoll = Direction * MaxLeanRoll;
+}
 
-	FCollisionQueryParams Params;
-	Params.AddIgnoredActor(this);
+void APlayerCharacter::ServerSetLean_Implementation(int8 Direction)
+{
+	ApplyLeanDirection(FMath::Clamp<int8>(Direction, -1, 1));
+}
+
+void APlayerCharacter::OnRep_LeanDirection()
+{
+	// Offset and roll are interpolated in Tick from the new targets
+	ApplyLeanDirection(LeanDirection);
+}
+
+void APlayerCharacter::Interact()
+{
+	// Doors are toggled on the server and replicate back
+	if (!HasAuthority())
+	{
+		ServerInteract();
+		return;
+	}
 
-	GetWorld()->LineTraceSingleByChannel(HitResult, Start, End, ECollisionChannel::ECC_Visibility, Params);
+	// Resolved with every other player's and guard's request on the next interaction update, which toggles
+	// the door (if any) and posts the Interact event
+	RequestInteraction(EInteractionAction::Toggle);
+}
 
-	ADoor* Door = Cast<ADoor>(HitResult.GetActor());
-	if (Door)
+void APlayerCharacter::RequestInteraction(EInteractionAction Action)
+{
+	if (UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>())
 	{
-		FVector PlayerForward = GetActorForwardVector();
-		Door->OnInteract(PlayerForward);
+		FInteractionRequest Request;
+		Request.Requester = this;
+		Request.RequesterId = GetPlayerState() ? GetPlayerState()->GetPlayerId() : 0;
+		Request.Priority = InteractionPriority::Player;
+		Request.Query = EInteractionQuery::Aim;
+		Request.Action = Action;
+		Request.Origin = FirstPersonCameraComponent->GetComponentLocation();
+		Request.Direction = FirstPersonCameraComponent->GetForwardVector();
+		Request.Reach = InteractLineTraceLength;
+		Request.Forward = GetActorForwardVector();
+		Interactions->Request(Request);
 	}
 }
 
+void APlayerCharacter::ServerInteract_Implementation()
+{
+	Interact();
+}
+
 void APlayerCharacter::StartSprint()
 {
-	GetCharacterMovement()->MaxWalkSpeed = RunSpeed;
+	// Carried to the server in the saved moves, so it simulates the sprint too
+	GetStealthMovement()->bWantsToSprint = true;
 }
 
 void APlayerCharacter::StopSprint()
 {
-	GetCharacterMovement()->MaxWalkSpeed = WalkSpeed;
+	GetStealthMovement()->bWantsToSprint = false;
+}
+
+UStealthCharacterMovementComponent* APlayerCharacter::GetStealthMovement() const
+{
+	return CastChecked<UStealthCharacterMovementComponent>(GetCharacterMovement());
+}
+
+void APlayerCharacter::UpdateFootsteps(float DeltaTime)
+{
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	if (bIsClimbing || bIsMantling || !Movement->IsMovingOnGround())
+	{
+		return;
+	}
+
+	const float Speed = GetVelocity().Size2D();
+	const float Stride = UStealthSettings::Get()->FootstepStride;
+	FootstepDistance += Speed * DeltaTime;
+	if (FootstepDistance < Stride)
+	{
+		return;
+	}
+	FootstepDistance = FMath::Fmod(FootstepDistance, Stride);
+
+	UStealthFootstepSubsystem* Footsteps = GetWorld()->GetSubsystem<UStealthFootstepSubsystem>();
+	if (!Footsteps)
+	{
+		return;
+	}
+
+	// The sprint flag arrives with the client's moves, so the server hears the same gait
+	EStealthGait Gait = EStealthGait::Walk;
+	if (Movement->IsCrouching())
+	{
+		Gait = EStealthGait::Crouch;
+	}
+	else if (GetStealthMovement()->IsSprinting() && Speed > WalkSpeed)
+	{
+		Gait = EStealthGait::Run;
+	}
+
+	const FVector FootLocation = GetActorLocation() - FVector(0.0f, 0.0f, GetCapsuleComponent()->GetScaledCapsuleHalfHeight());
+	Footsteps->ReportFootstep(this, FootLocation, Gait, Movement->CurrentFloor.HitResult.GetComponent());
 }
 
 void APlayerCharacter::StopMantle(bool bSuccess)
 {
 	bIsMantling = false;
 	bIsJumpHeld = false;
+	NotifyTraversalChanged();
 
 	if (bSuccess)
 	{
@@ -382,6 +771,243 @@ void APlayerCharacter::StopMantle(bool bSuccess)
 		// Optional: Add a tiny velocity impulse to ensure they fall away
 		GetCharacterMovement()->Velocity += PushBack * 1.5f;
 	}
+
+	if (UStealthEventBus* EventBus = UStealthEventBus::Get(this))
+	{
+		EventBus->Post(EStealthEventType::MantleStop, this, GetActorLocation(), bSuccess ? 1.0f : 0.0f);
+	}
+}
+
+// -------- Climbing --------
+void APlayerCharacter::ToggleClimb()
+{
+	if (bIsClimbing)
+	{
+		StopClimb(false);
+	}
+	else if (!bIsMantling)
+	{
+		StartClimb();
+	}
+}
+
+bool APlayerCharacter::StartClimb()
+{
+	UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>();
+	if (!ClimbableIndex)
+	{
+		return false;
+	}
+
+	// Index lookup instead of probe traces
+	float Alpha = 0.0f;
+	float Offset = 0.0f;
+	const FClimbableHandle Surface = ClimbableIndex->FindSurface(GetActorLocation(), GetActorForwardVector(), ClimbAttachDistance + GetCapsuleComponent()->GetScaledCapsuleRadius(), Alpha, Offset);
+	if (!Surface.IsSet())
+	{
+		return false;
+	}
+
+	if (GetCharacterMovement()->IsCrouching())
+	{
+		UnCrouch();
+	}
+
+	bIsClimbing = true;
+	ClimbSurface = Surface;
+	ClimbAlpha = Alpha;
+	ClimbOffset = Offset;
+	ClimbInput = 0.0f;
+	ClimbLateralInput = 0.0f;
+	TraversalLocation = PreviousTraversalLocation = GetActorLocation();
+
+	GetCharacterMovement()->SetMovementMode(MOVE_Flying);
+	GetCharacterMovement()->StopMovementImmediately();
+	NotifyTraversalChanged();
+	return true;
+}
+
+void APlayerCharacter::StopClimb(bool bJumpOff)
+{
+	UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>();
+	const bool bValidSurface = ClimbableIndex && ClimbableIndex->IsValidSurface(ClimbSurface);
+	const FVector SurfaceNormal = bValidSurface ? ClimbableIndex->GetSurface(ClimbSurface).Normal : -GetActorForwardVector();
+
+	bIsClimbing = false;
+	ClimbSurface.Reset();
+	ClimbInput = 0.0f;
+	ClimbLateralInput = 0.0f;
+
+	GetCharacterMovement()->SetMovementMode(MOVE_Falling);
+	NotifyTraversalChanged();
+
+	if (bJumpOff)
+	{
+		// Push away from the surface
+		LaunchCharacter(SurfaceNormal * 300.0f + FVector(0.0f, 0.0f, 200.0f), true, true);
+	}
+}
+
+void APlayerCharacter::UpdateClimb(float DeltaTime)
+{
+	UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>();
+	if (!ClimbableIndex || !ClimbableIndex->IsValidSurface(ClimbSurface))
+	{
+		// Surface went away (rope removed, level streamed out), even if another one has taken its slot since
+		StopClimb(false);
+		return;
+	}
+
+	const float Input = ClimbInput;
+
+	const FClimbableSurface& Surface = ClimbableIndex->GetSurface(ClimbSurface);
+	const float Length = FVector::Dist(Surface.Bottom, Surface.Top);
+	if (Length > KINDA_SMALL_NUMBER)
+	{
+		ClimbAlpha += Input * ClimbSpeed * DeltaTime / Length;
+	}
+
+	// Sideways across walls; the surface's right may face either way relative to the climber's
+	const float LateralExtent = Surface.GetLateralExtent();
+	const float LateralSign = FVector::DotProduct(GetActorRightVector(), Surface.GetRight()) >= 0.0f ? 1.0f : -1.0f;
+	ClimbOffset = FMath::Clamp(ClimbOffset + ClimbLateralInput * LateralSign * ClimbSpeed * DeltaTime, -LateralExtent, LateralExtent);
+
+	// Stepping off at the bottom
+	if (ClimbAlpha <= 0.0f && Input < 0.0f)
+	{
+		StopClimb(false);
+		return;
+	}
+
+	ClimbAlpha = FMath::Min(ClimbAlpha, 1.0f);
+
+	// Hang in front of the surface
+	const float HangDistance = GetCapsuleComponent()->GetScaledCapsuleRadius() + 2.0f;
+	const FVector ClimbLocation = Surface.GetPoint(FMath::Max(ClimbAlpha, 0.0f), ClimbOffset) + Surface.Normal * HangDistance;
+	SetActorLocation(ClimbLocation, true);
+
+	// Top of the climb: hand over to the mantle logic to get onto the ledge
+	if (ClimbAlpha >= 1.0f && Input > 0.0f)
+	{
+		FVector MantleTarget;
+		if (CanMantle(MantleTarget))
+		{
+			bIsClimbing = false;
+			ClimbSurface.Reset();
+			StartMantle(MantleTarget);
+		}
+	}
+}
+
+void APlayerCharacter::NotifyTraversalChanged()
+{
+	if (!HasAuthority() && IsLocallyControlled())
+	{
+		ServerSetTraversal(bIsMantling, bIsClimbing);
+	}
+}
+
+void APlayerCharacter::ServerSetTraversal_Implementation(bool bMantling, bool bClimbing)
+{
+	const bool bStarting = (bMantling && !bIsMantling) || (bClimbing && !bIsClimbing);
+	if (bStarting && !ValidateTraversalStart(bMantling, bClimbing))
+	{
+		RejectTraversal();
+		return;
+	}
+
+	bIsMantling = bMantling;
+	bIsClimbing = bClimbing;
+
+	// Mantle and climb moves are SetActorLocation driven, so trust the owning client's position while they run
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	Movement->bIgnoreClientMovementErrorChecksAndCorrection = bMantling || bClimbing;
+	Movement->bServerAcceptClientAuthoritativePosition = bMantling || bClimbing;
+	Movement->SetMovementMode((bMantling || bClimbing) ? MOVE_Flying : MOVE_Falling);
+}
+
+bool APlayerCharacter::ValidateTraversalStart(bool bMantling, bool bClimbing)
+{
+	LastValidTraversalLocation = GetActorLocation();
+
+	// One move at a time
+	if (bMantling == bClimbing)
+	{
+		return false;
+	}
+
+	// Probe from where the server last accepted the player, the same way the client did
+	if (bMantling)
+	{
+		FVector Target;
+		if (!CanMantle(Target))
+		{
+			return false;
+		}
+		ServerMantleBounds = FBox(GetActorLocation(), Target).ExpandBy(GetCapsuleComponent()->GetScaledCapsuleRadius() + TraversalTolerance);
+		return true;
+	}
+
+	UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>();
+	float Alpha = 0.0f;
+	float Offset = 0.0f;
+	return ClimbableIndex && ClimbableIndex->FindSurface(GetActorLocation(), GetActorForwardVector(),
+		ClimbAttachDistance + GetCapsuleComponent()->GetScaledCapsuleRadius() + TraversalTolerance, Alpha, Offset).IsSet();
+}
+
+void APlayerCharacter::CheckClientTraversal()
+{
+	bool bInBounds = false;
+	if (bIsMantling)
+	{
+		bInBounds = ServerMantleBounds.IsInsideOrOn(GetActorLocation());
+	}
+	else if (UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>())
+	{
+		// Climbers hang a capsule radius in front of the surface
+		float Alpha = 0.0f;
+		float Offset = 0.0f;
+		bInBounds = ClimbableIndex->FindSurface(GetActorLocation(), GetActorForwardVector(),
+			GetCapsuleComponent()->GetScaledCapsuleRadius() + TraversalTolerance, Alpha, Offset).IsSet();
+	}
+
+	if (bInBounds)
+	{
+		LastValidTraversalLocation = GetActorLocation();
+		return;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("%s: client %s left its validated bounds, cancelling"), *GetName(), bIsMantling ? TEXT("mantle") : TEXT("climb"));
+	RejectTraversal();
+}
+
+void APlayerCharacter::RejectTraversal()
+{
+	bIsMantling = false;
+	bIsClimbing = false;
+
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	Movement->bIgnoreClientMovementErrorChecksAndCorrection = false;
+	Movement->bServerAcceptClientAuthoritativePosition = false;
+	SetActorLocation(LastValidTraversalLocation, false, nullptr, ETeleportType::TeleportPhysics);
+	Movement->SetMovementMode(MOVE_Falling);
+
+	ClientRejectTraversal(GetActorLocation());
+}
+
+void APlayerCharacter::ClientRejectTraversal_Implementation(FVector ServerLocation)
+{
+	// Not reported back to the server, which has already ended the move; normal movement corrections take over
+	bIsMantling = false;
+	bIsJumpHeld = false;
+	bIsClimbing = false;
+	ClimbSurface.Reset();
+	ClimbInput = 0.0f;
+	ClimbLateralInput = 0.0f;
+
+	SetActorLocation(ServerLocation, false, nullptr, ETeleportType::TeleportPhysics);
+	TraversalLocation = PreviousTraversalLocation = ServerLocation;
+	GetCharacterMovement()->SetMovementMode(MOVE_Falling);
 }
 
 // -------- Mantling --------
@@ -398,6 +1024,22 @@ bool APlayerCharacter::CanMantle(FVector& OutMantleTargetLocation)
 
 	const float MaxJumpHeight = (JumpZ * JumpZ) / (2.0f * Gravity);
 
+	// Where cells of baked stealth data are streamed in, the baked ledges replace the traces below. The bake only
+	// keeps walkable edges, and the navmesh insets them from the wall by up to a capsule radius.
+	const UStealthStreamingSubsystem* Streaming = GetWorld()->GetSubsystem<UStealthStreamingSubsystem>();
+	if (Streaming && Streaming->NumLoadedCells() > 0)
+	{
+		const FVector Feet = GetActorLocation() - FVector(0.0f, 0.0f, CapsuleHalfHeight);
+		const float MaxDistance = MaxFrontMantleCheckDistance + GetCapsuleComponent()->GetScaledCapsuleRadius();
+		FVector LedgePoint;
+		if (!Streaming->FindLedge(Feet, GetActorForwardVector(), MaxDistance, CapsuleHalfHeight, MaxJumpHeight + MaxMantleReachHeight, LedgePoint))
+		{
+			return false;
+		}
+		OutMantleTargetLocation = LedgePoint + FVector(0.0f, 0.0f, CapsuleHalfHeight + 2.0f);
+		return true;
+	}
+
 	// ----2. Forward trace (find wall) ----//
 	FVector Start = GetActorLocation();
 	FVector Forward = GetActorForwardVector();
@@ -479,12 +1121,59 @@ float APlayerCharacter::GetAllowedLeanOffset(float DesiredLean)
 
 // Calculate the player's visibility based on lighting conditions
 void APlayerCharacter::CalculateVisibility()
+{
+	SampleVisibility();
+	UpdateVisibility(GetWorld() ? GetWorld()->GetDeltaSeconds() : 0.0f);
+}
+
+FStealthExposureQuery APlayerCharacter::BuildExposureQuery() const
+{
+	// Follows the capsule through the crouch interpolation, from the standing to the movement component's crouched height
+	const UCapsuleComponent* Capsule = GetCapsuleComponent();
+	const float StandingHalfHeight = GetDefaultHalfHeight();
+	const float CrouchedHalfHeight = GetCharacterMovement()->GetCrouchedHalfHeight() * Capsule->GetShapeScale();
+
+	FStealthExposureQuery Query;
+	Query.Center = GetActorLocation();
+	Query.Right = GetActorRightVector();
+	Query.HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+	Query.Radius = Capsule->GetScaledCapsuleRadius();
+	Query.LeanOffset = CurrentLeanOffset;
+	Query.CrouchAlpha = FMath::GetMappedRangeValueClamped(FVector2f(StandingHalfHeight, CrouchedHalfHeight), FVector2f(0.0f, 1.0f), Query.HalfHeight);
+	return Query;
+}
+
+void APlayerCharacter::BuildExposureSamples(int32 NumPoints, StealthExposure::FCharacterSamples& OutSamples) const
+{
+	const FStealthExposureQuery Query = BuildExposureQuery();
+	StealthExposure::BuildCharacterSamples(Query.Center, Query.Right, Query.HalfHeight, Query.Radius, Query.LeanOffset, Query.CrouchAlpha, NumPoints, OutSamples);
+}
+
+bool APlayerCharacter::UsesRenderLightDetector() const
+{
+	// Standalone only. In a networked game every player, the listen-server host included, is read from the
+	// analytic lights so the guards judge everyone by the same model.
+	return LightDetectorActor && UStealthSettings::Get()->bUseRenderLightDetector && GetNetMode() == NM_Standalone
+		&& IsLocallyControlled() && FApp::CanEverRender();
+}
+
+void APlayerCharacter::SampleVisibility()
 {
 	//Determine target visibility percentage (0 to 100)
 	float TargetVisibilityPercent = AmbientLightFactor * 100.0f;
 
-	if (LightDetectorActor)
+	if (!HasAuthority())
+	{
+		// Clients use the server's value
+		TargetVisibilityPercent = ReplicatedVisibility / 255.0f * 100.0f;
+	}
+	else if (UsesRenderLightDetector())
 	{
+		// Capture from where the head is now, crouched or leaning
+		StealthExposure::FCharacterSamples Body;
+		BuildExposureSamples(3, Body);
+		LightDetectorActor->SetActorLocation(Body.Points[0]);
+
 		//LightDetector returns brightness (0 ~ 255). regularitise 0 ~ 1.
 		float Brightness = LightDetectorActor->CalculateBrightness();
 		float Normalized = FMath::Clamp(Brightness / 255.0f, 0.0f, 1.0f);
@@ -493,19 +1182,72 @@ void APlayerCharacter::CalculateVisibility()
 		float Exposure = FMath::Lerp(AmbientLightFactor, 1.0f, Normalized);
 		TargetVisibilityPercent = Exposure * 100.0f;
 	}
+	else if (UStealthLightSubsystem* Lights = GetWorld() ? GetWorld()->GetSubsystem<UStealthLightSubsystem>() : nullptr)
+	{
+		// Analytic lights at several points on the capsule. Occlusion is traced when the points move, a light switches
+		// or the cache gets old; otherwise, and for flickering lights, the cached terms are evaluated at the current time
+		// by the batched pipeline, specialised for the layout.
+		const UStealthSettings* Settings = UStealthSettings::Get();
+		const double Now = UStealthLightSubsystem::GetFlickerTime(GetWorld());
+		const FStealthExposureQuery Query = BuildExposureQuery();
+		StealthExposure::FCharacterSamples Samples;
+		StealthExposure::BuildCharacterSamples(Query.Center, Query.Right, Query.HalfHeight, Query.Radius, Query.LeanOffset, Query.CrouchAlpha, Settings->ExposureSamplePoints, Samples);
+		if (!ExposureCache.Matches(Samples) || ExposureCache.LightRevision != Lights->GetRevision() || ExposureCache.LightStateRevision != Lights->GetStateRevision()
+			|| Now - ExposureCache.BuildTime > Settings->ExposureCacheMaxAge)
+		{
+			StealthExposure::BuildExposureCache(GetWorld(), Lights->GetLights(), Samples, this, ExposureCache);
+			ExposureCache.LightRevision = Lights->GetRevision();
+			ExposureCache.LightStateRevision = Lights->GetStateRevision();
+			ExposureCache.BuildTime = Now;
+		}
+
+		FStealthExposureSource Source;
+		Source.Backend = EStealthExposureBackend::Cached;
+		Source.Cache = &ExposureCache;
+		Source.Time = Now;
+		float Normalized = 0.0f;
+		StealthExposure::EvaluateQueries(Source, StealthExposure::GetLayout(Settings->ExposureSamplePoints), MakeArrayView(&Query, 1), MakeArrayView(&Normalized, 1));
+		float Exposure = FMath::Lerp(AmbientLightFactor, 1.0f, Normalized);
+		TargetVisibilityPercent = Exposure * 100.0f;
+	}
+
+	TargetVisibility = TargetVisibilityPercent;
+}
 
+void APlayerCharacter::UpdateVisibility(float DeltaTime)
+{
 	// Smoothly
-	if (GetWorld())
+	if (DeltaTime > 0.0f)
 	{
-		CurrentVisibility = FMath::FInterpTo(CurrentVisibility, TargetVisibilityPercent, GetWorld()->GetDeltaSeconds(), VisibilityInterpSpeed);
+		CurrentVisibility = FMath::FInterpTo(CurrentVisibility, TargetVisibility, DeltaTime, VisibilityInterpSpeed);
 	}
 	else
 	{
-		CurrentVisibility = TargetVisibilityPercent;
+		CurrentVisibility = TargetVisibility;
 	}
 
 	// limited safety
 	CurrentVisibility = FMath::Clamp(CurrentVisibility, 0.0f, 100.0f);
+
+	// Only dirty the replicated byte when it moved far enough to matter
+	if (HasAuthority())
+	{
+		const int32 Quantized = FMath::RoundToInt(CurrentVisibility / 100.0f * 255.0f);
+		if (FMath::Abs(Quantized - ReplicatedVisibility) >= VisibilityReplicationThreshold || (Quantized != ReplicatedVisibility && (Quantized == 0 || Quantized == 255)))
+		{
+			ReplicatedVisibility = static_cast<uint8>(Quantized);
+		}
+	}
+
+	// Only broadcast meaningful changes, the interpolation would otherwise post every frame
+	if (FMath::Abs(CurrentVisibility - LastPostedVisibility) >= VisibilityEventThreshold)
+	{
+		if (UStealthEventBus* EventBus = UStealthEventBus::Get(this))
+		{
+			EventBus->Post(EStealthEventType::VisibilityChanged, this, GetActorLocation(), CurrentVisibility);
+		}
+		LastPostedVisibility = CurrentVisibility;
+	}
 }
 
 void APlayerCharacter::OnStartCrouch(float HalfHeightAdjust, float ScaledHalfHeightAdjust)
@@ -517,15 +1259,17 @@ void APlayerCharacter::OnStartCrouch(float HalfHeightAdjust, float ScaledHalfHei
 		return;
 	}
 
-	// Set the target height for the Tick function to interpolate towards (e.g., 44.0f)
-	TargetCapsuleHalfHeight = 44.0f; // Half the original height of 88.0f
+	// Set the target height for the Tick function to interpolate towards, the same crouched height the exposure query maps against
+	TargetCapsuleHalfHeight = GetCharacterMovement()->GetCrouchedHalfHeight();
 
 	if (GetCharacterMovement() && FirstPersonSpringArmComponent && FirstPersonCameraComponent)
 	{
 		GetCharacterMovement()->MaxWalkSpeedCrouched = CrouchSpeed;
 		FirstPersonSpringArmComponent->SetRelativeLocation(FVector(0.0f, 0.0f, 32.0f));
+		CameraHeight = PreviousCameraHeight = 32.0f;
 		// Camera rotation reset
 		FirstPersonCameraComponent->SetRelativeRotation(FRotator::ZeroRotator);
+		LeanDirection = 0;
 		TargetLeanOffset = 0.0f;
 		TargetLeanRoll = 0.0f;
 	}
@@ -535,16 +1279,18 @@ void APlayerCharacter::OnEndCrouch(float HalfHeightAdjust, float ScaledHalfHeigh
 {
 	Super::OnEndCrouch(HalfHeightAdjust, ScaledHalfHeightAdjust);
 
-	// Set the target height for the Tick function to interpolate towards (e.g., 88.0f)
-	TargetCapsuleHalfHeight = 88.0f; // Original standing height
+	// Set the target height for the Tick function to interpolate towards: the class default standing height
+	TargetCapsuleHalfHeight = GetClass()->GetDefaultObject<ACharacter>()->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
 
 	if (GetCharacterMovement() && FirstPersonSpringArmComponent && FirstPersonCameraComponent)
 	{
 		// Set back to your default walk speed (e.g., 600.0f)
 		GetCharacterMovement()->MaxWalkSpeed = WalkSpeed;
 		FirstPersonSpringArmComponent->SetRelativeLocation(FVector(0.0f, 0.0f, 64.0f));
+		CameraHeight = PreviousCameraHeight = 64.0f;
 		// Camera rotation reset
 		FirstPersonCameraComponent->SetRelativeRotation(FRotator::ZeroRotator);
+		LeanDirection = 0;
 		TargetLeanOffset = 0.0f;
 		TargetLeanRoll = 0.0f;
 	}
@@ -0,0 +1,8 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Character/PlayerCharacterAssets.h"
+
+const FPrimaryAssetType UPlayerCharacterAssets::AssetType(TEXT("PlayerCharacterAssets"));
+const FName UPlayerCharacterAssets::InputBundle(TEXT("Input"));
+const FName UPlayerCharacterAssets::VisualBundle(TEXT("Visual"));
@@ -2,4 +2,58 @@
 
 
 #include "GameMode/StealthGameMode.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetConnection.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
 
+static float GStealthLogBandwidthInterval = 0.0f;
+static FAutoConsoleVariableRef CVarStealthLogBandwidth(
+	TEXT("Stealth.Net.LogBandwidth"),
+	GStealthLogBandwidthInterval,
+	TEXT("When > 0 the server logs bytes/sec sent to and received from every client at this interval (seconds)."));
+
+AStealthGameMode::AStealthGameMode()
+{
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+void AStealthGameMode::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (GStealthLogBandwidthInterval <= 0.0f)
+	{
+		return;
+	}
+
+	BandwidthLogTimer += DeltaSeconds;
+	if (BandwidthLogTimer >= GStealthLogBandwidthInterval)
+	{
+		BandwidthLogTimer = 0.0f;
+		LogClientBandwidth();
+	}
+}
+
+void AStealthGameMode::LogClientBandwidth()
+{
+	UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	if (!NetDriver)
+	{
+		return;
+	}
+
+	for (UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		if (!Connection)
+		{
+			continue;
+		}
+
+		const APlayerState* PlayerState = Connection->PlayerController ? Connection->PlayerController->PlayerState : nullptr;
+		UE_LOG(LogTemp, Display, TEXT("Net: %s out %d B/s, in %d B/s"),
+			PlayerState ? *PlayerState->GetPlayerName() : *Connection->GetName(),
+			Connection->OutBytesPerSecond, Connection->InBytesPerSecond);
+	}
+}
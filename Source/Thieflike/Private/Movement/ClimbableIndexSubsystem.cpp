@@ -0,0 +1,196 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Movement/ClimbableIndexSubsystem.h"
+#include "Thieflike.h"
+#include "Projectile/ArrowProjectileSubsystem.h"
+#include "Stealth/StealthSettings.h"
+#include "Engine/World.h"
+
+void UClimbableIndexSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	// Rope arrows leave a rope hanging from where they land
+	if (UArrowProjectileSubsystem* Arrows = InWorld.GetSubsystem<UArrowProjectileSubsystem>())
+	{
+		ArrowImpactHandle = Arrows->OnArrowImpact.AddUObject(this, &UClimbableIndexSubsystem::OnArrowImpact);
+	}
+}
+
+void UClimbableIndexSubsystem::Deinitialize()
+{
+	if (UArrowProjectileSubsystem* Arrows = GetWorld()->GetSubsystem<UArrowProjectileSubsystem>())
+	{
+		Arrows->OnArrowImpact.Remove(ArrowImpactHandle);
+	}
+	Surfaces.Empty();
+	Generations.Empty();
+	Cells.Empty();
+	Ropes.Empty();
+
+	Super::Deinitialize();
+}
+
+FBox UClimbableIndexSubsystem::GetSurfaceBounds(const FClimbableSurface& Surface) const
+{
+	return FBox(Surface.Bottom.ComponentMin(Surface.Top), Surface.Bottom.ComponentMax(Surface.Top)).ExpandBy(Surface.HalfWidth);
+}
+
+template <typename FuncType>
+void UClimbableIndexSubsystem::ForEachCell(const FBox& Bounds, FuncType&& Func) const
+{
+	const FIntVector Min(FMath::FloorToInt(Bounds.Min.X / CellSize), FMath::FloorToInt(Bounds.Min.Y / CellSize), FMath::FloorToInt(Bounds.Min.Z / CellSize));
+	const FIntVector Max(FMath::FloorToInt(Bounds.Max.X / CellSize), FMath::FloorToInt(Bounds.Max.Y / CellSize), FMath::FloorToInt(Bounds.Max.Z / CellSize));
+
+	for (int32 X = Min.X; X <= Max.X; ++X)
+	{
+		for (int32 Y = Min.Y; Y <= Max.Y; ++Y)
+		{
+			for (int32 Z = Min.Z; Z <= Max.Z; ++Z)
+			{
+				Func(FIntVector(X, Y, Z));
+			}
+		}
+	}
+}
+
+FClimbableHandle UClimbableIndexSubsystem::AddSurface(const FClimbableSurface& Surface)
+{
+	LLM_SCOPE_BYTAG(Stealth_Climbing);
+
+	const int32 SurfaceId = Surfaces.Add(Surface);
+	if (SurfaceId >= Generations.Num())
+	{
+		Generations.SetNumZeroed(SurfaceId + 1);
+	}
+	ForEachCell(GetSurfaceBounds(Surface), [this, SurfaceId](const FIntVector& Cell)
+	{
+		Cells.FindOrAdd(Cell).Add(SurfaceId);
+	});
+
+	FClimbableHandle Handle;
+	Handle.Index = SurfaceId;
+	Handle.Generation = Generations[SurfaceId];
+	return Handle;
+}
+
+void UClimbableIndexSubsystem::RemoveSurface(const FClimbableHandle& Handle)
+{
+	if (!IsValidSurface(Handle))
+	{
+		return;
+	}
+
+	const int32 SurfaceId = Handle.Index;
+
+	ForEachCell(GetSurfaceBounds(Surfaces[SurfaceId]), [this, SurfaceId](const FIntVector& Cell)
+	{
+		if (TArray<int32>* CellSurfaces = Cells.Find(Cell))
+		{
+			CellSurfaces->RemoveSingleSwap(SurfaceId);
+			if (CellSurfaces->Num() == 0)
+			{
+				Cells.Remove(Cell);
+			}
+		}
+	});
+	Surfaces.RemoveAt(SurfaceId);
+	++Generations[SurfaceId];
+}
+
+FClimbableHandle UClimbableIndexSubsystem::FindSurface(const FVector& Location, const FVector& Forward, float MaxDistance, float& OutAlpha, float& OutOffset) const
+{
+	int32 BestSurface = INDEX_NONE;
+	float BestDistanceSq = FMath::Square(MaxDistance);
+
+	ForEachCell(FBox(Location, Location).ExpandBy(MaxDistance), [&](const FIntVector& Cell)
+	{
+		const TArray<int32>* CellSurfaces = Cells.Find(Cell);
+		if (!CellSurfaces)
+		{
+			return;
+		}
+
+		for (const int32 SurfaceId : *CellSurfaces)
+		{
+			const FClimbableSurface& Surface = Surfaces[SurfaceId];
+
+			// Only grab surfaces we are facing (ropes can be grabbed from any side)
+			if (Surface.Type != EClimbableType::Rope && FVector::DotProduct(Forward, Surface.Normal) > -0.3f)
+			{
+				continue;
+			}
+
+			// Closest point on the centre line, then sideways across the surface as far as it reaches
+			const FVector OnLine = FMath::ClosestPointOnSegment(Location, Surface.Bottom, Surface.Top);
+			const float LateralExtent = Surface.GetLateralExtent();
+			const float Offset = LateralExtent > 0.0f ? FMath::Clamp(FVector::DotProduct(Location - OnLine, Surface.GetRight()), -LateralExtent, LateralExtent) : 0.0f;
+			const FVector Closest = OnLine + Surface.GetRight() * Offset;
+
+			const float DistanceSq = FVector::DistSquared(Closest, Location);
+			if (DistanceSq < BestDistanceSq)
+			{
+				BestDistanceSq = DistanceSq;
+				BestSurface = SurfaceId;
+
+				const float Length = FVector::Dist(Surface.Bottom, Surface.Top);
+				OutAlpha = Length > KINDA_SMALL_NUMBER ? FVector::Dist(Surface.Bottom, OnLine) / Length : 0.0f;
+				OutOffset = Offset;
+			}
+		}
+	});
+
+	FClimbableHandle Handle;
+	if (BestSurface != INDEX_NONE)
+	{
+		Handle.Index = BestSurface;
+		Handle.Generation = Generations[BestSurface];
+	}
+	return Handle;
+}
+
+void UClimbableIndexSubsystem::OnArrowImpact(EArrowType ArrowType, const FHitResult& Hit)
+{
+	// Ropes need something to hang from: walls, beams or ceilings, not floors
+	if (ArrowType != EArrowType::Rope || Hit.ImpactNormal.Z > 0.7f)
+	{
+		return;
+	}
+
+	FVector Normal = Hit.ImpactNormal;
+	Normal.Z = 0.0f;
+	if (!Normal.Normalize())
+	{
+		Normal = -FVector(Hit.TraceEnd - Hit.TraceStart).GetSafeNormal2D();
+	}
+
+	// One trace at impact time to find where the rope reaches the floor
+	const FVector Top = Hit.ImpactPoint + Normal * 15.0f;
+	FVector Bottom = Top - FVector(0.0f, 0.0f, UStealthSettings::Get()->RopeArrowLength);
+
+	FHitResult FloorHit;
+	if (GetWorld()->LineTraceSingleByChannel(FloorHit, Top, Bottom, ECC_WorldStatic))
+	{
+		Bottom = FloorHit.ImpactPoint;
+	}
+
+	FClimbableSurface Rope;
+	Rope.Top = Top;
+	Rope.Bottom = Bottom;
+	Rope.Normal = Normal;
+	Rope.HalfWidth = 30.0f;
+	Rope.Type = EClimbableType::Rope;
+	Ropes.Add(AddSurface(Rope));
+
+	// A climber on the oldest rope drops off when it goes, the same as for any removed surface
+	const int32 NumExpired = Ropes.Num() - UStealthSettings::Get()->MaxRopeArrows;
+	for (int32 Index = 0; Index < NumExpired; ++Index)
+	{
+		RemoveSurface(Ropes[Index]);
+	}
+	if (NumExpired > 0)
+	{
+		Ropes.RemoveAt(0, NumExpired, EAllowShrinking::No);
+	}
+}
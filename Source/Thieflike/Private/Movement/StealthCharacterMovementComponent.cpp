@@ -0,0 +1,84 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Movement/StealthCharacterMovementComponent.h"
+#include "GameFramework/Character.h"
+
+namespace StealthMovement
+{
+	class FSavedMove : public FSavedMove_Character
+	{
+	public:
+		virtual void Clear() override
+		{
+			FSavedMove_Character::Clear();
+			bSavedWantsToSprint = false;
+		}
+
+		virtual uint8 GetCompressedFlags() const override
+		{
+			uint8 Flags = FSavedMove_Character::GetCompressedFlags();
+			if (bSavedWantsToSprint)
+			{
+				Flags |= FLAG_Custom_0;
+			}
+			return Flags;
+		}
+
+		virtual bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* Character, float MaxDelta) const override
+		{
+			return bSavedWantsToSprint == static_cast<const FSavedMove*>(NewMove.Get())->bSavedWantsToSprint
+				&& FSavedMove_Character::CanCombineWith(NewMove, Character, MaxDelta);
+		}
+
+		virtual void SetMoveFor(ACharacter* Character, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData) override
+		{
+			FSavedMove_Character::SetMoveFor(Character, InDeltaTime, NewAccel, ClientData);
+			bSavedWantsToSprint = CastChecked<UStealthCharacterMovementComponent>(Character->GetCharacterMovement())->bWantsToSprint;
+		}
+
+		virtual void PrepMoveFor(ACharacter* Character) override
+		{
+			FSavedMove_Character::PrepMoveFor(Character);
+			CastChecked<UStealthCharacterMovementComponent>(Character->GetCharacterMovement())->bWantsToSprint = bSavedWantsToSprint;
+		}
+
+	private:
+		bool bSavedWantsToSprint = false;
+	};
+
+	class FPredictionData : public FNetworkPredictionData_Client_Character
+	{
+	public:
+		explicit FPredictionData(const UCharacterMovementComponent& ClientMovement)
+			: FNetworkPredictionData_Client_Character(ClientMovement)
+		{
+		}
+
+		virtual FSavedMovePtr AllocateNewMove() override
+		{
+			return FSavedMovePtr(new FSavedMove());
+		}
+	};
+}
+
+float UStealthCharacterMovementComponent::GetMaxSpeed() const
+{
+	return IsSprinting() ? MaxSprintSpeed : Super::GetMaxSpeed();
+}
+
+void UStealthCharacterMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
+{
+	Super::UpdateFromCompressedFlags(Flags);
+	bWantsToSprint = (Flags & FSavedMove_Character::FLAG_Custom_0) != 0;
+}
+
+FNetworkPredictionData_Client* UStealthCharacterMovementComponent::GetPredictionData_Client() const
+{
+	if (!ClientPredictionData)
+	{
+		UStealthCharacterMovementComponent* MutableThis = const_cast<UStealthCharacterMovementComponent*>(this);
+		MutableThis->ClientPredictionData = new StealthMovement::FPredictionData(*this);
+	}
+	return ClientPredictionData;
+}
@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Object/ClimbableSurfaceComponent.h"
+
+UClimbableSurfaceComponent::UClimbableSurfaceComponent()
+{
+	// Only used as a marker, the actual ladder mesh does the blocking
+	SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	SetBoxExtent(FVector(10.0f, 50.0f, 150.0f));
+}
+
+FClimbableSurface UClimbableSurfaceComponent::GetSurface() const
+{
+	const FVector Extent = GetScaledBoxExtent();
+	const FVector Up = GetUpVector();
+	const FVector Forward = GetForwardVector();
+
+	// The climbable line runs along the front face of the box
+	const FVector FaceCenter = GetComponentLocation() + Forward * Extent.X;
+
+	FClimbableSurface Surface;
+	Surface.Bottom = FaceCenter - Up * Extent.Z;
+	Surface.Top = FaceCenter + Up * Extent.Z;
+	Surface.Normal = Forward;
+	Surface.HalfWidth = Extent.Y;
+	Surface.Type = ClimbableType;
+	return Surface;
+}
+
+void UClimbableSurfaceComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>())
+	{
+		SurfaceHandle = ClimbableIndex->AddSurface(GetSurface());
+	}
+}
+
+void UClimbableSurfaceComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>())
+	{
+		ClimbableIndex->RemoveSurface(SurfaceHandle);
+	}
+	SurfaceHandle.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
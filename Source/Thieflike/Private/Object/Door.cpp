@@ -5,6 +5,16 @@
 #include "UObject/ConstructorHelpers.h"
 #include "DrawDebugHelpers.h"
 #include "Kismet/GameplayStatics.h"
+#include "Stealth/StealthEventBus.h"
+#include "Save/StealthSaveSubsystem.h"
+#include "Object/InteractionSubsystem.h"
+#include "Stealth/StealthStreamingSubsystem.h"
+#include "Net/UnrealNetwork.h"
+
+namespace DoorSwing
+{
+	constexpr float DegreesPerSecond = 80.0f;
+}
 
 // Sets default values
 ADoor::ADoor()
@@ -19,9 +29,14 @@ ADoor::ADoor()
 	Door->SetupAttachment(RootComponent);
 	Door->SetRelativeLocation(FVector(0.0f, 50.0f, -100.f));
 
+	// Doors only send anything when toggled; they sit dormant the rest of the time
+	bReplicates = true;
+	NetDormancy = DORM_DormantAll;
+
 	isClosed = true;
 	Opening = false;
 	Closing = false;
+	OpenDirection = 1;
 
 	DotP = 0.0f;
 	MaxDegree = 0.0f;
@@ -29,10 +44,49 @@ ADoor::ADoor()
 	DoorCurrentRotation = 0.0f;
 }
 
+void ADoor::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	// Before BeginPlay, as a dynamically spawned door on a client gets its initial OnRep ahead of it
+	ClosedRotation = Door->GetRelativeRotation().Quaternion();
+}
+
 // Called when the game starts or when spawned
 void ADoor::BeginPlay()
 {
 	Super::BeginPlay();
+
+	if (UStealthSaveSubsystem* Save = GetWorld()->GetSubsystem<UStealthSaveSubsystem>())
+	{
+		Save->RegisterDoor(this);
+	}
+	if (UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>())
+	{
+		Interactions->RegisterDoor(this);
+	}
+	if (UStealthStreamingSubsystem* Streaming = GetWorld()->GetSubsystem<UStealthStreamingSubsystem>())
+	{
+		Streaming->RegisterDoor(this);
+	}
+}
+
+void ADoor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UStealthSaveSubsystem* Save = GetWorld()->GetSubsystem<UStealthSaveSubsystem>())
+	{
+		Save->UnregisterDoor(this, EndPlayReason == EEndPlayReason::RemovedFromWorld);
+	}
+	if (UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>())
+	{
+		Interactions->UnregisterDoor(this);
+	}
+	if (UStealthStreamingSubsystem* Streaming = GetWorld()->GetSubsystem<UStealthStreamingSubsystem>())
+	{
+		Streaming->UnregisterDoor(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -40,63 +94,136 @@ void ADoor::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	if (Opening)
+	// The swing is simulated in fixed steps and the shown rotation interpolated between the last two
+	const int32 NumSteps = SimulationStep.Advance(DeltaTime);
+	for (int32 Step = 0; Step < NumSteps; ++Step)
 	{
-		OpenDoor(DeltaTime);
+		PreviousRotation = DoorCurrentRotation;
+
+		if (Opening)
+		{
+			OpenDoor(SimulationStep.GetStepSeconds());
+		}
+
+		if (Closing)
+		{
+			CloseDoor(SimulationStep.GetStepSeconds());
+		}
 	}
 
-	if (Closing)
+	ShowRotation(FMath::Lerp(PreviousRotation, DoorCurrentRotation, SimulationStep.GetAlpha()));
+}
+
+void ADoor::ShowRotation(float Yaw)
+{
+	if (Yaw != ShownRotation)
 	{
-		CloseDoor(DeltaTime);
+		ShownRotation = Yaw;
+		Door->SetRelativeRotation(ClosedRotation * FQuat(FVector::UpVector, FMath::DegreesToRadians(Yaw)));
 	}
 }
 
-void ADoor::OnInteract(const FVector& InteractorForward)
+void ADoor::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
-	UE_LOG(LogTemp, Display, TEXT("Interacted with Door!"));
-	ToggleDoor(InteractorForward);
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ADoor, isClosed);
+	DOREPLIFETIME(ADoor, OpenDirection);
 }
 
-void ADoor::OpenDoor(float DeltaTime)
+void ADoor::OnActorChannelOpen(FInBunch& InBunch, UNetConnection* Connection)
 {
-	DoorCurrentRotation = Door->GetRelativeRotation().Yaw;
+	Super::OnActorChannelOpen(InBunch, Connection);
 
-	AddRotation = PosNeg * DeltaTime * 80;
+	bInitialReplication = true;
+}
 
-	if (FMath::IsNearlyEqual(DoorCurrentRotation, MaxDegree, 1.5f))
-	{
-		Closing = false;
-		Opening = false;
-	}
-	else if (Opening)
+void ADoor::PostRepNotifies()
+{
+	Super::PostRepNotifies();
+
+	bInitialReplication = false;
+}
+
+void ADoor::OnRep_DoorState()
+{
+	PosNeg = OpenDirection;
+	MaxDegree = PosNeg * 90.0f;
+
+	// A client joining after the door was opened shouldn't watch it swing open as it comes into relevancy
+	if (bInitialReplication)
 	{
-		FRotator NewRotation = FRotator(0.0f, AddRotation, 0.0f);
-		Door->AddRelativeRotation(FQuat(NewRotation), false, 0, ETeleportType::None);
+		Opening = Closing = false;
+		DoorCurrentRotation = PreviousRotation = isClosed ? 0.0f : MaxDegree;
+		ShowRotation(DoorCurrentRotation);
+		return;
 	}
+
+	Opening = !isClosed;
+	Closing = isClosed;
 }
 
-void ADoor::CloseDoor(float DeltaTime)
+void ADoor::RestoreState(bool bClosed, float Yaw)
 {
-	DoorCurrentRotation = Door->GetRelativeRotation().Yaw;
+	isClosed = bClosed;
 
-	if (DoorCurrentRotation > 0)
+	// The swing direction follows the yaw; a door that had only just started opening keeps its current one
+	if (Yaw != 0.0f)
 	{
-		AddRotation = -DeltaTime * 80;
+		PosNeg = FMath::Sign(Yaw);
+		OpenDirection = static_cast<int8>(PosNeg);
 	}
 	else
 	{
-		AddRotation = DeltaTime * 80;
+		PosNeg = OpenDirection;
+	}
+	MaxDegree = PosNeg * 90.0f;
+
+	// isClosed is the state the door is heading to, so a yaw short of it means the save caught the swing
+	Opening = !bClosed && Yaw != MaxDegree;
+	Closing = bClosed && Yaw != 0.0f;
+
+	DoorCurrentRotation = PreviousRotation = Yaw;
+	ShowRotation(Yaw);
+
+	FlushNetDormancy();
+}
+
+void ADoor::OnInteract(const FVector& InteractorForward)
+{
+	// The swing replicates from the server; a client toggling its copy would drift from it
+	if (!HasAuthority())
+	{
+		return;
 	}
 
-	if (FMath::IsNearlyEqual(DoorCurrentRotation, 0.0, 1.5f))
+	UE_LOG(LogTemp, Verbose, TEXT("Interacted with Door!"));
+	ToggleDoor(InteractorForward);
+}
+
+void ADoor::SetFocused(bool bFocused)
+{
+	Door->SetRenderCustomDepth(bFocused);
+}
+
+void ADoor::OpenDoor(float DeltaTime)
+{
+	// Constant speed that stops exactly on the limit, whatever the step size
+	DoorCurrentRotation = FMath::FInterpConstantTo(DoorCurrentRotation, MaxDegree, DeltaTime, DoorSwing::DegreesPerSecond);
+	if (DoorCurrentRotation == MaxDegree)
 	{
 		Closing = false;
 		Opening = false;
 	}
-	else if (Closing)
+}
+
+void ADoor::CloseDoor(float DeltaTime)
+{
+	DoorCurrentRotation = FMath::FInterpConstantTo(DoorCurrentRotation, 0.0f, DeltaTime, DoorSwing::DegreesPerSecond);
+	if (DoorCurrentRotation == 0.0f)
 	{
-		FRotator NewRotation = FRotator(0.0f, AddRotation, 0.0f);
-		Door->AddRelativeRotation(FQuat(NewRotation), false, 0, ETeleportType::None);
+		Closing = false;
+		Opening = false;
 	}
 }
 
@@ -105,6 +232,7 @@ void ADoor::ToggleDoor(FVector ForwardVector)
 	DotP = FVector::DotProduct(Door->GetForwardVector(), ForwardVector);
 
 	PosNeg = FMath::Sign(DotP);
+	OpenDirection = static_cast<int8>(PosNeg);
 
 	MaxDegree = PosNeg * 90.0f;
 
@@ -120,5 +248,14 @@ void ADoor::ToggleDoor(FVector ForwardVector)
 		isClosed = true;
 		Closing = true;
 	}
+
+	// Wake up just long enough to send the new state
+	FlushNetDormancy();
+
+	// Let AI / audio know the door changed state (1 = opening, 0 = closing)
+	if (UStealthEventBus* EventBus = UStealthEventBus::Get(this))
+	{
+		EventBus->Post(EStealthEventType::DoorToggled, this, Door->GetComponentLocation(), isClosed ? 0.0f : 1.0f);
+	}
 }
 
@@ -0,0 +1,374 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Object/InteractionSubsystem.h"
+#include "Thieflike.h"
+#include "Object/Door.h"
+#include "Stealth/StealthEventBus.h"
+#include "Stealth/StealthSettings.h"
+#include "Stealth/StealthMemory.h"
+#include "Async/ParallelFor.h"
+#include "Algo/Reverse.h"
+#include "Components/StaticMeshComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Interaction Resolve"), STAT_InteractionResolve, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Interaction Requests"), STAT_InteractionRequests, STATGROUP_Stealth);
+
+void UInteractionSubsystem::Deinitialize()
+{
+	Doors.Reset();
+	Candidates = {};
+	CandidateIndices.Reset();
+	Pending.Reset();
+	Foci.Reset();
+	PreviousFoci.Reset();
+
+	Super::Deinitialize();
+}
+
+TStatId UInteractionSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UInteractionSubsystem, STATGROUP_Stealth);
+}
+
+void UInteractionSubsystem::RegisterDoor(ADoor* Door)
+{
+	Doors.AddUnique(Door);
+}
+
+void UInteractionSubsystem::UnregisterDoor(ADoor* Door)
+{
+	Doors.Remove(Door);
+}
+
+void UInteractionSubsystem::Request(const FInteractionRequest& Request)
+{
+	Pending.Add(Request);
+}
+
+void UInteractionSubsystem::GatherCandidates()
+{
+	TArrayView<FCandidate> Gathered = FStealthFrameArena::Get().AllocateArray<FCandidate>(Doors.Num());
+	int32 NumCandidates = 0;
+	CandidateIndices.Reset();
+	for (const TWeakObjectPtr<ADoor>& Door : Doors)
+	{
+		if (ADoor* DoorActor = Door.Get())
+		{
+			CandidateIndices.Add(DoorActor, NumCandidates);
+			Gathered[NumCandidates++] = { Door, DoorActor->Door->Bounds.Origin, DoorActor->isClosed, DoorActor->Opening || DoorActor->Closing };
+		}
+	}
+	Candidates = Gathered.Left(NumCandidates);
+	CandidatesFrame = GFrameCounter;
+}
+
+void UInteractionSubsystem::Evaluate(const FInteractionRequest& Request, FInteractionResult& Result) const
+{
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(Interaction), false, Request.Requester.Get());
+
+	if (Request.Query == EInteractionQuery::Aim)
+	{
+		const FVector End = Request.Origin + Request.Direction * Request.Reach;
+		FHitResult Hit;
+		GetWorld()->LineTraceSingleByChannel(Hit, Request.Origin, End, ECC_Visibility, Params);
+		Result.Point = Hit.bBlockingHit ? Hit.ImpactPoint : End;
+		if (const int32* Target = Hit.bBlockingHit ? CandidateIndices.Find(Hit.GetActor()) : nullptr)
+		{
+			Result.Target = *Target;
+			Result.DistanceSq = FMath::Square(Hit.Distance);
+		}
+		return;
+	}
+
+	// Closest door in the cone that is in the other state; the line trace only runs for that one. A swinging door
+	// already reports the state it is heading to, so it is left alone until it gets there, or two guards on either
+	// side would keep turning it round.
+	int32 Best = INDEX_NONE;
+	float BestDistanceSq = FMath::Square(Request.Reach);
+	for (int32 Index = 0; Index < Candidates.Num(); ++Index)
+	{
+		const FCandidate& Candidate = Candidates[Index];
+		if ((Request.Action == EInteractionAction::Open && !Candidate.bClosed) || (Request.Action == EInteractionAction::Close && Candidate.bClosed) || Candidate.bSwinging)
+		{
+			continue;
+		}
+
+		const FVector ToDoor = Candidate.Location - Request.Origin;
+		const float DistanceSq = ToDoor.SizeSquared();
+		if (DistanceSq > BestDistanceSq || DistanceSq < FMath::Square(Request.MinDistance) || DistanceSq <= KINDA_SMALL_NUMBER)
+		{
+			continue;
+		}
+		if (FVector::DotProduct(ToDoor, Request.Direction) < Request.MinFacing * FMath::Sqrt(DistanceSq))
+		{
+			continue;
+		}
+		Best = Index;
+		BestDistanceSq = DistanceSq;
+	}
+
+	if (Best == INDEX_NONE)
+	{
+		return;
+	}
+
+	FHitResult Hit;
+	if (GetWorld()->LineTraceSingleByChannel(Hit, Request.Origin, Candidates[Best].Location, ECC_Visibility, Params) && Hit.GetActor() != Candidates[Best].Door.Get())
+	{
+		return;
+	}
+	Result.Target = Best;
+	Result.Point = Candidates[Best].Location;
+	Result.DistanceSq = BestDistanceSq;
+}
+
+void UInteractionSubsystem::Resolve(TConstArrayView<FInteractionRequest> Requests, TArray<FInteractionResult>& OutResults)
+{
+	SCOPE_CYCLE_COUNTER(STAT_InteractionResolve);
+
+	GatherCandidates();
+
+	OutResults.Reset();
+	OutResults.SetNum(Requests.Num());
+	ParallelFor(Requests.Num(), [this, Requests, &OutResults](int32 Index)
+	{
+		STEALTH_HOT_PATH_SCOPE("Interaction");
+		Evaluate(Requests[Index], OutResults[Index]);
+	});
+
+	// One request per door: higher priority, then closer, then lower requester id, so the winner doesn't depend on
+	// which request was queued first
+	TArrayView<int32> Winners = FStealthFrameArena::Get().AllocateArray<int32>(Candidates.Num());
+	for (int32& Winner : Winners)
+	{
+		Winner = INDEX_NONE;
+	}
+	for (int32 Index = 0; Index < Requests.Num(); ++Index)
+	{
+		const int32 Target = OutResults[Index].Target;
+		if (Target == INDEX_NONE || Requests[Index].Action == EInteractionAction::Focus)
+		{
+			continue;
+		}
+
+		const int32 Current = Winners[Target];
+		if (Current == INDEX_NONE
+			|| Requests[Index].Priority > Requests[Current].Priority
+			|| (Requests[Index].Priority == Requests[Current].Priority && OutResults[Index].DistanceSq < OutResults[Current].DistanceSq)
+			|| (Requests[Index].Priority == Requests[Current].Priority && OutResults[Index].DistanceSq == OutResults[Current].DistanceSq && Requests[Index].RequesterId < Requests[Current].RequesterId))
+		{
+			Winners[Target] = Index;
+		}
+	}
+
+	for (int32 Index = 0; Index < Requests.Num(); ++Index)
+	{
+		FInteractionResult& Result = OutResults[Index];
+		if (Result.Target == INDEX_NONE || Requests[Index].Action == EInteractionAction::Focus)
+		{
+			continue;
+		}
+
+		const bool bClosed = Candidates[Result.Target].bClosed;
+		const EInteractionAction Action = Requests[Index].Action;
+		if ((Action == EInteractionAction::Open && !bClosed) || (Action == EInteractionAction::Close && bClosed))
+		{
+			Result.Outcome = EInteractionOutcome::NotNeeded;
+		}
+		else
+		{
+			Result.Outcome = Winners[Result.Target] == Index ? EInteractionOutcome::Applied : EInteractionOutcome::Lost;
+		}
+	}
+}
+
+ADoor* UInteractionSubsystem::GetFocus(const AActor* Requester) const
+{
+	const FFocus* Focus = Foci.FindByPredicate([Requester](const FFocus& Candidate) { return Candidate.Requester.Get() == Requester; });
+	return Focus ? Focus->Door.Get() : nullptr;
+}
+
+void UInteractionSubsystem::UpdateFocus()
+{
+	// Rebuilt from this frame's Focus requests, so a requester that stopped asking loses its focus
+	Swap(Foci, PreviousFoci);
+	Foci.Reset();
+	for (int32 Index = 0; Index < Processing.Num(); ++Index)
+	{
+		if (Processing[Index].Action == EInteractionAction::Focus)
+		{
+			if (ADoor* Door = GetCandidateDoor(Results[Index].Target))
+			{
+				Foci.Add({ Processing[Index].Requester, Door });
+			}
+		}
+	}
+
+	// A door stays outlined while any requester has it in focus
+	auto IsFocused = [](const TArray<FFocus>& InFoci, const ADoor* Door)
+	{
+		return InFoci.ContainsByPredicate([Door](const FFocus& Focus) { return Focus.Door.Get() == Door; });
+	};
+	for (const FFocus& Focus : PreviousFoci)
+	{
+		ADoor* Door = Focus.Door.Get();
+		if (Door && !IsFocused(Foci, Door))
+		{
+			Door->SetFocused(false);
+		}
+	}
+	for (const FFocus& Focus : Foci)
+	{
+		if (!IsFocused(PreviousFoci, Focus.Door.Get()))
+		{
+			Focus.Door->SetFocused(true);
+		}
+	}
+}
+
+void UInteractionSubsystem::Tick(float DeltaTime)
+{
+	STEALTH_HOT_PATH_SCOPE("Interaction");
+	SET_DWORD_STAT(STAT_InteractionRequests, Pending.Num());
+	if (Pending.Num() == 0 && Foci.Num() == 0)
+	{
+		return;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Requests queued while applying (a door reacting to the event bus, say) wait for the next update
+	Swap(Processing, Pending);
+	Pending.Reset();
+	Resolve(Processing, Results);
+
+	// Doors replicate from the server; a client only evaluates, for focus
+	const bool bApply = GetWorld()->GetNetMode() != NM_Client;
+	UStealthEventBus* EventBus = GetWorld()->GetSubsystem<UStealthEventBus>();
+	for (int32 Index = 0; Index < Processing.Num(); ++Index)
+	{
+		const FInteractionRequest& Request = Processing[Index];
+		const FInteractionResult& Result = Results[Index];
+
+		// Aiming is a deliberate use, heard whether or not it found a door
+		if (EventBus && Request.Query == EInteractionQuery::Aim && Request.Action != EInteractionAction::Focus)
+		{
+			EventBus->Post(EStealthEventType::Interact, Request.Requester.Get(), Result.Point, 0.0f);
+		}
+
+		if (bApply && Result.Outcome == EInteractionOutcome::Applied)
+		{
+			if (ADoor* Door = GetCandidateDoor(Result.Target))
+			{
+				// Waking the door for replication may allocate
+				STEALTH_HOT_PATH_SUSPEND();
+				Door->OnInteract(Request.Forward);
+			}
+		}
+	}
+	UpdateFocus();
+	Processing.Reset();
+
+	const double ElapsedMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	const float BudgetMs = UStealthSettings::Get()->InteractionFrameBudgetMs;
+	if (ElapsedMs > BudgetMs && StartTime - LastBudgetWarningTime > 1.0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Interaction: %d requests took %.3f ms (budget %.3f ms)"), Results.Num(), ElapsedMs, BudgetMs);
+		LastBudgetWarningTime = StartTime;
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+// Stealth.Interaction.Benchmark [Requesters] [Frames] - needs doors in the level
+static FAutoConsoleCommandWithWorldAndArgs StealthInteractionBenchmarkCommand(
+	TEXT("Stealth.Interaction.Benchmark"),
+	TEXT("Times door lookups for AI requesters crowding the level's doors, one trace per caller against one resolver pass, and checks conflicts resolve the same in any request order. Args: [Requesters=100] [Frames=100]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UInteractionSubsystem* Interactions = World ? World->GetSubsystem<UInteractionSubsystem>() : nullptr;
+		if (!Interactions || Interactions->NumDoors() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("InteractionBenchmark: no doors in this level"));
+			return;
+		}
+
+		const int32 NumRequesters = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100;
+		const int32 NumFrames = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 100;
+
+		// Guards gathered round the doors, several per door, facing them from either side
+		TArray<FInteractionResult> Results;
+		Interactions->Resolve({}, Results);
+		TArray<FVector> DoorLocations;
+		for (int32 Index = 0; Interactions->GetCandidateDoor(Index); ++Index)
+		{
+			DoorLocations.Add(Interactions->GetCandidateDoor(Index)->Door->Bounds.Origin);
+		}
+
+		FRandomStream Random(NumRequesters);
+		TArray<FInteractionRequest> Requests;
+		for (int32 Index = 0; Index < NumRequesters; ++Index)
+		{
+			const FVector& DoorLocation = DoorLocations[Random.RandHelper(DoorLocations.Num())];
+			const float Angle = Random.FRandRange(0.0f, 2.0f * PI);
+			const FVector Origin = DoorLocation + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.0f) * Random.FRandRange(60.0f, 140.0f);
+
+			FInteractionRequest& Request = Requests.AddDefaulted_GetRef();
+			Request.RequesterId = Index;
+			Request.Query = EInteractionQuery::Nearby;
+			Request.Action = EInteractionAction::Toggle;
+			Request.Origin = Origin;
+			Request.Direction = (DoorLocation - Origin).GetSafeNormal();
+			Request.Forward = Request.Direction;
+			Request.Reach = 150.0f;
+		}
+
+		// Each caller tracing for itself, the way APlayerCharacter::Interact used to
+		int32 SerialHits = 0;
+		const double SerialStart = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			for (const FInteractionRequest& Request : Requests)
+			{
+				FHitResult Hit;
+				World->LineTraceSingleByChannel(Hit, Request.Origin, Request.Origin + Request.Direction * Request.Reach, ECC_Visibility);
+				SerialHits += Cast<ADoor>(Hit.GetActor()) ? 1 : 0;
+			}
+		}
+		const double SerialMs = (FPlatformTime::Seconds() - SerialStart) * 1000.0 / NumFrames;
+
+		// Each simulated frame starts from an empty frame arena, like a real one
+		const double ResolveStart = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			FStealthFrameArena::Get().Rewind();
+			Interactions->Resolve(Requests, Results);
+		}
+		const double ResolveMs = (FPlatformTime::Seconds() - ResolveStart) * 1000.0 / NumFrames;
+
+		int32 NumApplied = 0;
+		int32 NumLost = 0;
+		TMap<int32, EInteractionOutcome> Outcomes;
+		for (int32 Index = 0; Index < Requests.Num(); ++Index)
+		{
+			NumApplied += Results[Index].Outcome == EInteractionOutcome::Applied ? 1 : 0;
+			NumLost += Results[Index].Outcome == EInteractionOutcome::Lost ? 1 : 0;
+			Outcomes.Add(Requests[Index].RequesterId, Results[Index].Outcome);
+		}
+
+		// Same requests, reversed: every requester must end up with the same outcome
+		Algo::Reverse(Requests);
+		Interactions->Resolve(Requests, Results);
+		bool bOrderIndependent = true;
+		for (int32 Index = 0; Index < Requests.Num(); ++Index)
+		{
+			bOrderIndependent &= Outcomes.FindChecked(Requests[Index].RequesterId) == Results[Index].Outcome;
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("InteractionBenchmark: %d requesters, %d doors, %d frames: per-caller traces %.3f ms/frame (%d door hits), resolver %.3f ms/frame (%d applied, %d lost to another requester)"),
+			NumRequesters, DoorLocations.Num(), NumFrames, SerialMs, SerialHits / NumFrames, ResolveMs, NumApplied, NumLost);
+		UE_LOG(LogTemp, Display, TEXT("InteractionBenchmark: conflict resolution independent of request order: %s"), bOrderIndependent ? TEXT("PASS") : TEXT("FAIL"));
+	}));
+#endif
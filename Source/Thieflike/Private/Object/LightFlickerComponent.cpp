@@ -0,0 +1,126 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Object/LightFlickerComponent.h"
+#include "Save/StealthSaveSubsystem.h"
+#include "Components/LocalLightComponent.h"
+#include "Net/UnrealNetwork.h"
+#include "Misc/App.h"
+
+ULightFlickerComponent::ULightFlickerComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	SetIsReplicatedByDefault(true);
+}
+
+void ULightFlickerComponent::OnRegister()
+{
+	Super::OnRegister();
+
+	if (BaseIntensities.Num() > 0 || !GetOwner())
+	{
+		return;
+	}
+
+	TArray<ULocalLightComponent*> LightComponents;
+	GetOwner()->GetComponents<ULocalLightComponent>(LightComponents);
+	for (ULocalLightComponent* LightComponent : LightComponents)
+	{
+		BaseIntensities.Emplace(LightComponent, LightComponent->Intensity);
+	}
+}
+
+void ULightFlickerComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (GetOwner()->HasAuthority())
+	{
+		ResolvedSeed = Seed != 0 ? static_cast<uint32>(Seed) : UStealthSaveSubsystem::StableId(GetOwner());
+	}
+
+	// Servers only need the envelope; the rendered intensity is animated where someone looks at it
+	SetComponentTickEnabled(FApp::CanEverRender() && GetFlicker().IsAnimated());
+}
+
+void ULightFlickerComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	for (const TPair<TWeakObjectPtr<ULocalLightComponent>, float>& Base : BaseIntensities)
+	{
+		if (ULocalLightComponent* LightComponent = Base.Key.Get())
+		{
+			LightComponent->SetIntensity(Base.Value);
+		}
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+FStealthFlicker ULightFlickerComponent::GetFlicker() const
+{
+	FStealthFlicker Flicker;
+	Flicker.Amplitude = Amplitude;
+	Flicker.Frequency = Frequency;
+	if (ResolvedSeed != 0)
+	{
+		Flicker.Seed = ResolvedSeed;
+	}
+	else
+	{
+		Flicker.Seed = Seed != 0 ? static_cast<uint32>(Seed) : UStealthSaveSubsystem::StableId(GetOwner());
+	}
+	return Flicker;
+}
+
+void ULightFlickerComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(ULightFlickerComponent, ResolvedSeed, COND_InitialOnly);
+}
+
+void ULightFlickerComponent::OnRep_ResolvedSeed()
+{
+	// The registry described these lights with the locally derived seed
+	UStealthLightSubsystem* Lights = GetWorld() ? GetWorld()->GetSubsystem<UStealthLightSubsystem>() : nullptr;
+	if (!Lights)
+	{
+		return;
+	}
+	for (const TPair<TWeakObjectPtr<ULocalLightComponent>, float>& Base : BaseIntensities)
+	{
+		if (ULocalLightComponent* LightComponent = Base.Key.Get())
+		{
+			Lights->RefreshFlicker(LightComponent);
+		}
+	}
+}
+
+float ULightFlickerComponent::GetBaseIntensity(const ULocalLightComponent* LightComponent) const
+{
+	for (const TPair<TWeakObjectPtr<ULocalLightComponent>, float>& Base : BaseIntensities)
+	{
+		if (Base.Key.Get() == LightComponent)
+		{
+			return Base.Value;
+		}
+	}
+	return LightComponent->Intensity;
+}
+
+void ULightFlickerComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// Same envelope and clock the stealth code evaluates on the server, so what the player sees is what the guards see
+	const float Scale = GetFlicker().Evaluate(UStealthLightSubsystem::GetFlickerTime(GetWorld()));
+	for (const TPair<TWeakObjectPtr<ULocalLightComponent>, float>& Base : BaseIntensities)
+	{
+		ULocalLightComponent* LightComponent = Base.Key.Get();
+		if (LightComponent && LightComponent->IsVisible())
+		{
+			LightComponent->SetIntensity(Base.Value * Scale);
+		}
+	}
+}
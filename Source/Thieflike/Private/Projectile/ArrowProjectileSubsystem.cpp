@@ -0,0 +1,344 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Projectile/ArrowProjectileSubsystem.h"
+#include "Thieflike.h"
+#include "Stealth/StealthSettings.h"
+#include "Stealth/StealthMemory.h"
+#include "Stealth/StealthEventBus.h"
+#include "Stealth/StealthLightSubsystem.h"
+#include "Movement/ClimbableIndexSubsystem.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Kismet/GameplayStatics.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Arrows Sweep"), STAT_ArrowsSweep, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Arrows In Flight"), STAT_ArrowsInFlight, STATGROUP_Stealth);
+
+namespace ArrowProjectiles
+{
+	// Transform used for pool slots that aren't in flight
+	const FTransform HiddenTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+}
+
+void UArrowProjectileSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	LLM_SCOPE_BYTAG(Stealth_Arrows);
+
+	const UStealthSettings* Settings = UStealthSettings::Get();
+
+	if (UStaticMesh* Mesh = Settings->ArrowMesh.LoadSynchronous())
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		AActor* VisualActor = InWorld.SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+
+		ArrowInstances = NewObject<UInstancedStaticMeshComponent>(VisualActor, TEXT("ArrowInstances"));
+		ArrowInstances->SetMobility(EComponentMobility::Movable);
+		ArrowInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		ArrowInstances->SetCastShadow(false);
+		ArrowInstances->SetStaticMesh(Mesh);
+		VisualActor->SetRootComponent(ArrowInstances);
+		ArrowInstances->RegisterComponent();
+	}
+
+	GrowPool(FMath::Max(Settings->ArrowPoolSize, 1));
+}
+
+void UArrowProjectileSubsystem::GrowPool(int32 NumSlots)
+{
+	const int32 FirstNewSlot = Pool.Num();
+	if (NumSlots <= FirstNewSlot)
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(Stealth_Arrows);
+
+	Pool.SetNum(NumSlots);
+	ActiveSlots.Reserve(NumSlots);
+	FreeSlots.Reserve(NumSlots);
+	PendingImpacts.Reserve(NumSlots);
+	// Pop from the back hands out the lowest new slot first
+	for (int32 Slot = NumSlots - 1; Slot >= FirstNewSlot; --Slot)
+	{
+		FreeSlots.Add(Slot);
+	}
+
+	TArray<FTransform> NewTransforms;
+	NewTransforms.Init(ArrowProjectiles::HiddenTransform, NumSlots - FirstNewSlot);
+	InstanceTransforms.Append(NewTransforms);
+	if (ArrowInstances)
+	{
+		ArrowInstances->AddInstances(NewTransforms, false, true);
+	}
+}
+
+SIZE_T UArrowProjectileSubsystem::GetAllocatedSize() const
+{
+	return Pool.GetAllocatedSize() + PendingImpacts.GetAllocatedSize() + ActiveSlots.GetAllocatedSize() + FreeSlots.GetAllocatedSize() + InstanceTransforms.GetAllocatedSize();
+}
+
+void UArrowProjectileSubsystem::Deinitialize()
+{
+	Pool.Reset();
+	PendingImpacts.Reset();
+	ActiveSlots.Reset();
+	FreeSlots.Reset();
+	InstanceTransforms.Reset();
+	ArrowInstances = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UArrowProjectileSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UArrowProjectileSubsystem, STATGROUP_Stealth);
+}
+
+void UArrowProjectileSubsystem::FireArrow(EArrowType ArrowType, FVector Start, FVector Velocity, AActor* Instigator)
+{
+	if (Pool.Num() == 0)
+	{
+		return;
+	}
+
+	int32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		// Pool exhausted: steal the oldest arrow in flight
+		Slot = ActiveSlots[0];
+		ActiveSlots.RemoveAt(0, 1, EAllowShrinking::No);
+		++NumRecycled;
+	}
+
+	FArrowProjectile& Arrow = Pool[Slot];
+	Arrow.Location = Start;
+	Arrow.Velocity = Velocity;
+	Arrow.Age = 0.0f;
+	Arrow.Type = ArrowType;
+	Arrow.Instigator = Instigator;
+
+	ActiveSlots.Add(Slot);
+}
+
+void UArrowProjectileSubsystem::Tick(float DeltaTime)
+{
+	LLM_SCOPE_BYTAG(Stealth_Arrows);
+	STEALTH_HOT_PATH_SCOPE("Arrows");
+
+	const bool bStressing = StressTimeLeft > 0.0f;
+	const double StartTime = bStressing ? FPlatformTime::Seconds() : 0.0;
+
+	TickStressTest(DeltaTime);
+
+	if (ActiveSlots.Num() > 0)
+	{
+		SweepArrows(DeltaTime);
+	}
+	SET_DWORD_STAT(STAT_ArrowsInFlight, ActiveSlots.Num());
+
+	if (bStressing)
+	{
+		StressWorstFrameMs = FMath::Max(StressWorstFrameMs, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+		StressPeakInFlight = FMath::Max(StressPeakInFlight, ActiveSlots.Num());
+		const uint64 UsedMemory = FPlatformMemory::GetStats().UsedPhysical;
+		StressPeakMemory = FMath::Max(StressPeakMemory, UsedMemory);
+		if (StressTimeLeft <= 0.0f)
+		{
+			// Process memory is logged for reference only; it moves with everything else the engine does.
+			// The checks are on what the arrows own, and on the rope surfaces they leave in the climbable index.
+			const int32 Recycled = NumRecycled - StressStartRecycled;
+			const int64 PoolGrowth = static_cast<int64>(GetAllocatedSize()) - static_cast<int64>(StressStartAllocatedSize);
+			const UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>();
+			const int32 SurfaceGrowth = ClimbableIndex ? ClimbableIndex->NumSurfaces() - StressStartSurfaces : 0;
+			const int32 MaxRopes = UStealthSettings::Get()->MaxRopeArrows;
+
+			const TCHAR* Result = TEXT("PASS");
+			if (Recycled > 0)
+			{
+				Result = TEXT("FAIL (pool too small for the load)");
+			}
+			else if (PoolGrowth > 0)
+			{
+				Result = TEXT("FAIL (the pool allocated during the test)");
+			}
+			else if (SurfaceGrowth > MaxRopes)
+			{
+				Result = TEXT("FAIL (rope surfaces are not expiring)");
+			}
+
+			UE_LOG(LogTemp, Display, TEXT("Arrow stress test done: pool %d, peak in flight %d, %d recycled from a full pool, pool memory %+lld bytes, %+d climbable surfaces (rope limit %d), worst frame %.3f ms, process peak memory +%lld KB, end memory %+lld KB: %s"),
+				Pool.Num(), StressPeakInFlight, Recycled, PoolGrowth, SurfaceGrowth, MaxRopes, StressWorstFrameMs, static_cast<int64>(StressPeakMemory - StressStartMemory) / 1024,
+				(static_cast<int64>(UsedMemory) - static_cast<int64>(StressStartMemory)) / 1024, Result);
+		}
+	}
+}
+
+void UArrowProjectileSubsystem::SweepArrows(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ArrowsSweep);
+
+	UWorld* World = GetWorld();
+	const UStealthSettings* Settings = UStealthSettings::Get();
+	const FVector Gravity(0.0f, 0.0f, World->GetGravityZ() * Settings->ArrowGravityScale);
+
+	FHitResult Hit;
+
+	// Advance every arrow in one pass, compacting the active list in place (keeps oldest-first order).
+	// Impacts are only collected here: their callbacks may fire new arrows, which must not touch the list mid-compaction.
+	int32 NumKept = 0;
+	for (int32 ActiveIndex = 0; ActiveIndex < ActiveSlots.Num(); ++ActiveIndex)
+	{
+		const int32 Slot = ActiveSlots[ActiveIndex];
+		FArrowProjectile& Arrow = Pool[Slot];
+
+		const FVector Start = Arrow.Location;
+		Arrow.Velocity += Gravity * DeltaTime;
+		const FVector End = Start + Arrow.Velocity * DeltaTime;
+		Arrow.Age += DeltaTime;
+
+		const FCollisionQueryParams Params(SCENE_QUERY_STAT(ArrowSweep), false, Arrow.Instigator.Get());
+		if (World->LineTraceSingleByChannel(Hit, Start, End, ECC_Visibility, Params))
+		{
+			PendingImpacts.Add({ Arrow, Hit });
+			ReleaseSlot(Slot);
+			continue;
+		}
+
+		if (Arrow.Age > Settings->ArrowMaxLifetime)
+		{
+			ReleaseSlot(Slot);
+			continue;
+		}
+
+		Arrow.Location = End;
+		InstanceTransforms[Slot] = FTransform(Arrow.Velocity.ToOrientationQuat(), End);
+		ActiveSlots[NumKept++] = Slot;
+	}
+	ActiveSlots.SetNum(NumKept, EAllowShrinking::No);
+
+	if (ArrowInstances)
+	{
+		ArrowInstances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+	}
+
+	// The slots are already free, so arrows fired from a callback can reuse them
+	for (const FArrowImpact& Impact : PendingImpacts)
+	{
+		HandleImpact(Impact.Arrow, Impact.Hit);
+	}
+	PendingImpacts.Reset();
+}
+
+void UArrowProjectileSubsystem::ReleaseSlot(int32 Slot)
+{
+	Pool[Slot].Instigator.Reset();
+	InstanceTransforms[Slot] = ArrowProjectiles::HiddenTransform;
+	FreeSlots.Add(Slot);
+}
+
+void UArrowProjectileSubsystem::HandleImpact(const FArrowProjectile& Arrow, const FHitResult& Hit)
+{
+	const UStealthSettings* Settings = UStealthSettings::Get();
+
+	switch (Arrow.Type)
+	{
+	case EArrowType::Water:
+		if (UStealthLightSubsystem* Lights = GetWorld()->GetSubsystem<UStealthLightSubsystem>())
+		{
+			Lights->DouseLightsNear(Hit.ImpactPoint, Settings->WaterArrowDouseRadius);
+		}
+		break;
+
+	case EArrowType::Noise:
+		UStealthEventBus::ReportNoise(this, Arrow.Instigator.Get(), Hit.ImpactPoint, Settings->NoiseArrowLoudness);
+		break;
+
+	case EArrowType::Rope:
+		// Climb points are created by listeners of OnArrowImpact
+		break;
+	}
+
+	AActor* HitActor = Hit.GetActor();
+	if (HitActor && HitActor->Implements<UArrowTarget>())
+	{
+		IArrowTarget::Execute_OnArrowImpact(HitActor, Arrow.Type, Hit);
+	}
+
+	OnArrowImpact.Broadcast(Arrow.Type, Hit);
+}
+
+void UArrowProjectileSubsystem::StartStressTest(float ArrowsPerSecond, float Seconds)
+{
+	// Every arrow lives at most ArrowMaxLifetime, so this many slots keep the test on the no-allocation path
+	// instead of measuring pool exhaustion. Growing happens before the baseline below is taken.
+	const int32 MaxInFlight = FMath::CeilToInt(ArrowsPerSecond * (UStealthSettings::Get()->ArrowMaxLifetime + 1.0f));
+	if (MaxInFlight > Pool.Num())
+	{
+		UE_LOG(LogTemp, Display, TEXT("Arrow stress test: growing the pool from %d to %d slots for %.0f arrows/s"), Pool.Num(), MaxInFlight, ArrowsPerSecond);
+		GrowPool(MaxInFlight);
+	}
+
+	StressRate = ArrowsPerSecond;
+	StressTimeLeft = Seconds;
+	StressAccumulator = 0.0f;
+	StressWorstFrameMs = 0.0;
+	StressPeakInFlight = 0;
+	StressStartRecycled = NumRecycled;
+	StressStartAllocatedSize = GetAllocatedSize();
+	const UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>();
+	StressStartSurfaces = ClimbableIndex ? ClimbableIndex->NumSurfaces() - ClimbableIndex->NumRopes() : 0;
+	StressRandom.Initialize(1234);
+	StressStartMemory = StressPeakMemory = FPlatformMemory::GetStats().UsedPhysical;
+}
+
+void UArrowProjectileSubsystem::TickStressTest(float DeltaTime)
+{
+	if (StressTimeLeft <= 0.0f)
+	{
+		return;
+	}
+
+	APlayerController* PlayerController = UGameplayStatics::GetPlayerController(this, 0);
+	if (!PlayerController)
+	{
+		StressTimeLeft = 0.0f;
+		return;
+	}
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	StressAccumulator += StressRate * DeltaTime;
+	for (; StressAccumulator >= 1.0f; StressAccumulator -= 1.0f)
+	{
+		const FVector Direction = StressRandom.VRandCone(ViewRotation.Vector(), FMath::DegreesToRadians(15.0f));
+		FireArrow(static_cast<EArrowType>(StressRandom.RandRange(0, 2)), ViewLocation + Direction * 50.0f, Direction * 3000.0f, PlayerController->GetPawn());
+	}
+
+	StressTimeLeft -= DeltaTime;
+}
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommandWithWorldAndArgs StealthArrowsStressCommand(
+	TEXT("Stealth.Arrows.Stress"),
+	TEXT("Fires pooled arrows from the player's view, with the pool grown to fit the load, and logs PASS if no arrow was recycled from a full pool, the pool never allocated and rope surfaces stayed within MaxRopeArrows. Args: [ArrowsPerSecond=500] [Seconds=30]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UArrowProjectileSubsystem* Arrows = World ? World->GetSubsystem<UArrowProjectileSubsystem>() : nullptr)
+		{
+			Arrows->StartStressTest(Args.Num() > 0 ? FCString::Atof(*Args[0]) : 500.0f, Args.Num() > 1 ? FCString::Atof(*Args[1]) : 30.0f);
+		}
+	}));
+#endif
@@ -0,0 +1,711 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Save/StealthSaveSubsystem.h"
+#include "Thieflike.h"
+#include "Object/Door.h"
+#include "Character/PlayerCharacter.h"
+#include "Stealth/StealthLightSubsystem.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Algo/BinarySearch.h"
+#include "Engine/World.h"
+#include "Kismet/GameplayStatics.h"
+
+DECLARE_CYCLE_STAT(TEXT("Save Gather"), STAT_StealthSaveGather, STATGROUP_Stealth);
+
+namespace StealthSave
+{
+	// Door yaw is stored in 1/100 degree, which fits +-180 in an int16
+	int16 QuantizeYaw(float Yaw)
+	{
+		return static_cast<int16>(FMath::Clamp(FMath::RoundToInt(FRotator::NormalizeAxis(Yaw) * 100.0f), -18000, 18000));
+	}
+
+	float DequantizeYaw(int16 Yaw)
+	{
+		return Yaw / 100.0f;
+	}
+
+	// Journal records are framed so a record cut short by a crash is dropped instead of misread
+	struct FRecordHeader
+	{
+		uint32 Magic = UStealthSaveSubsystem::SaveMagic;
+		uint32 Version = UStealthSaveSubsystem::SaveVersion;
+		uint32 Size = 0;
+
+		friend FArchive& operator<<(FArchive& Ar, FRecordHeader& Header)
+		{
+			return Ar << Header.Magic << Header.Version << Header.Size;
+		}
+
+		bool IsValid() const { return Magic == UStealthSaveSubsystem::SaveMagic && Version == UStealthSaveSubsystem::SaveVersion; }
+	};
+
+	void ApplyDelta(FStealthSaveData& Data, const FStealthSaveDelta& Delta)
+	{
+		for (int32 Index = 0; Index < Delta.DoorIndices.Num(); ++Index)
+		{
+			const int32 DoorIndex = Delta.DoorIndices[Index];
+			if (Data.DoorYaw.IsValidIndex(DoorIndex))
+			{
+				Data.DoorClosed[DoorIndex] = Delta.DoorClosed[Index];
+				Data.DoorYaw[DoorIndex] = Delta.DoorYaw[Index];
+			}
+		}
+
+		for (int32 Index = 0; Index < Delta.LightIndices.Num(); ++Index)
+		{
+			const int32 LightIndex = Delta.LightIndices[Index];
+			if (LightIndex >= 0 && LightIndex < Data.LightOn.Num())
+			{
+				Data.LightOn[LightIndex] = Delta.LightOn[Index];
+			}
+		}
+
+		if (Delta.NewlyLooted.Num() > 0)
+		{
+			Data.LootedIds.Append(Delta.NewlyLooted);
+			Data.LootedIds.Sort();
+		}
+
+		Data.Player = Delta.Player;
+	}
+}
+
+FArchive& operator<<(FArchive& Ar, FStealthPlayerSave& Player)
+{
+	Ar << Player.Location << Player.MantleTarget << Player.Yaw;
+
+	uint8 Flags = (Player.bCrouched ? 1 : 0) | (Player.bMantling ? 2 : 0);
+	Ar << Flags;
+	Player.bCrouched = (Flags & 1) != 0;
+	Player.bMantling = (Flags & 2) != 0;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FStealthSaveData& Data)
+{
+	return Ar << Data.DoorIds << Data.DoorClosed << Data.DoorYaw << Data.LightIds << Data.LightOn << Data.LootedIds << Data.Player;
+}
+
+FArchive& operator<<(FArchive& Ar, FStealthSaveDelta& Delta)
+{
+	return Ar << Delta.DoorIndices << Delta.DoorClosed << Delta.DoorYaw << Delta.LightIndices << Delta.LightOn << Delta.NewlyLooted << Delta.Player;
+}
+
+uint32 UStealthSaveSubsystem::StableId(const UObject* Object)
+{
+	return Object ? FCrc::StrCrc32(*UWorld::RemovePIEPrefix(Object->GetPathName())) : 0;
+}
+
+FString UStealthSaveSubsystem::GetBasePath(const FString& SlotName)
+{
+	return FPaths::ProjectSavedDir() / TEXT("SaveGames") / SlotName + TEXT(".stealth");
+}
+
+FString UStealthSaveSubsystem::GetJournalPath(const FString& SlotName)
+{
+	return FPaths::ProjectSavedDir() / TEXT("SaveGames") / SlotName + TEXT(".stealthj");
+}
+
+void UStealthSaveSubsystem::Deinitialize()
+{
+	// Let queued saves finish so the slot on disk matches the last save call
+	LastTask.Wait();
+	PendingLoad.Reset();
+
+	Doors.Reset();
+	DoorIds.Reset();
+	UnloadedDoors.Reset();
+	LootedIds.Reset();
+
+	Super::Deinitialize();
+}
+
+TStatId UStealthSaveSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UStealthSaveSubsystem, STATGROUP_Stealth);
+}
+
+void UStealthSaveSubsystem::Tick(float DeltaTime)
+{
+	if (PendingLoad.IsValid() && PendingLoadTask.IsCompleted())
+	{
+		FinishLoad();
+	}
+}
+
+void UStealthSaveSubsystem::Flush()
+{
+	LastTask.Wait();
+	if (PendingLoad.IsValid())
+	{
+		FinishLoad();
+	}
+}
+
+void UStealthSaveSubsystem::RegisterDoor(ADoor* Door)
+{
+	LLM_SCOPE_BYTAG(Stealth_Save);
+	const uint32 Id = StableId(Door);
+	Doors.Add(Door);
+	DoorIds.Add(Id);
+	bDoorsSorted = false;
+
+	// A door coming back from streaming keeps its place in the saved arrays, so quicksaves can go on
+	FDoorState State;
+	if (UnloadedDoors.RemoveAndCopyValue(Id, State))
+	{
+		Door->RestoreState(State.bClosed, StealthSave::DequantizeYaw(State.Yaw));
+	}
+	else
+	{
+		bRegistryDirty = true;
+	}
+}
+
+void UStealthSaveSubsystem::UnregisterDoor(ADoor* Door, bool bStreamedOut)
+{
+	const int32 Index = Doors.IndexOfByKey(Door);
+	if (Index != INDEX_NONE)
+	{
+		if (bStreamedOut)
+		{
+			UnloadedDoors.Add(DoorIds[Index], { Door->isClosed, StealthSave::QuantizeYaw(Door->DoorCurrentRotation) });
+		}
+		else
+		{
+			bRegistryDirty = true;
+		}
+		Doors.RemoveAt(Index);
+		DoorIds.RemoveAt(Index);
+	}
+}
+
+void UStealthSaveSubsystem::MarkLooted(AActor* Item)
+{
+	const uint32 Id = StableId(Item);
+	const int32 Index = Algo::LowerBound(LootedIds, Id);
+	if (!LootedIds.IsValidIndex(Index) || LootedIds[Index] != Id)
+	{
+		LootedIds.Insert(Id, Index);
+	}
+}
+
+bool UStealthSaveSubsystem::IsLooted(const AActor* Item) const
+{
+	return Algo::BinarySearch(LootedIds, StableId(Item)) != INDEX_NONE;
+}
+
+void UStealthSaveSubsystem::SortRegistry()
+{
+	if (!bDoorsSorted)
+	{
+		TArray<int32> Order;
+		Order.SetNumUninitialized(Doors.Num());
+		for (int32 Index = 0; Index < Order.Num(); ++Index)
+		{
+			Order[Index] = Index;
+		}
+		Order.Sort([this](int32 A, int32 B) { return DoorIds[A] < DoorIds[B]; });
+
+		TArray<TWeakObjectPtr<ADoor>> SortedDoors;
+		TArray<uint32> SortedIds;
+		SortedDoors.Reserve(Order.Num());
+		SortedIds.Reserve(Order.Num());
+		for (const int32 Index : Order)
+		{
+			if (SortedIds.Num() > 0 && SortedIds.Last() == DoorIds[Index])
+			{
+				UE_LOG(LogTemp, Warning, TEXT("StealthSave: door %s shares a stable id with another door and will not save reliably"), *GetNameSafe(Doors[Index].Get()));
+			}
+			SortedDoors.Add(Doors[Index]);
+			SortedIds.Add(DoorIds[Index]);
+		}
+		Doors = MoveTemp(SortedDoors);
+		DoorIds = MoveTemp(SortedIds);
+		bDoorsSorted = true;
+	}
+
+	UStealthLightSubsystem* LightSubsystem = GetWorld()->GetSubsystem<UStealthLightSubsystem>();
+	if (LightSubsystem && LightSubsystem->GetRevision() != LightRevision)
+	{
+		const TArray<FStealthLight>& Lights = LightSubsystem->GetLights();
+		LightOrder.SetNumUninitialized(Lights.Num());
+		for (int32 Index = 0; Index < LightOrder.Num(); ++Index)
+		{
+			LightOrder[Index] = Index;
+		}
+		LightOrder.Sort([&Lights](int32 A, int32 B) { return Lights[A].StableId < Lights[B].StableId; });
+
+		LightRevision = LightSubsystem->GetRevision();
+		bRegistryDirty = true;
+	}
+}
+
+void UStealthSaveSubsystem::GatherState(FStealthSaveData& OutData)
+{
+	SCOPE_CYCLE_COUNTER(STAT_StealthSaveGather);
+	LLM_SCOPE_BYTAG(Stealth_Save);
+
+	SortRegistry();
+
+	// Merge the loaded doors with the unloaded ones; both are sorted by stable id
+	const int32 NumDoors = Doors.Num() + UnloadedDoors.Num();
+	OutData.DoorIds.Reset(NumDoors);
+	OutData.DoorClosed.Reset();
+	OutData.DoorYaw.Reset(NumDoors);
+	int32 Loaded = 0;
+	for (auto Unloaded = UnloadedDoors.CreateConstIterator(); Loaded < Doors.Num() || Unloaded;)
+	{
+		if (Unloaded && (Loaded == Doors.Num() || Unloaded.Key() < DoorIds[Loaded]))
+		{
+			OutData.DoorIds.Add(Unloaded.Key());
+			OutData.DoorClosed.Add(Unloaded.Value().bClosed);
+			OutData.DoorYaw.Add(Unloaded.Value().Yaw);
+			++Unloaded;
+		}
+		else
+		{
+			const ADoor* Door = Doors[Loaded].Get();
+			OutData.DoorIds.Add(DoorIds[Loaded]);
+			OutData.DoorClosed.Add(Door ? Door->isClosed : true);
+			OutData.DoorYaw.Add(Door ? StealthSave::QuantizeYaw(Door->DoorCurrentRotation) : 0);
+			++Loaded;
+		}
+	}
+
+	OutData.LightIds.Reset(LightOrder.Num());
+	OutData.LightOn.Init(false, LightOrder.Num());
+	if (const UStealthLightSubsystem* LightSubsystem = GetWorld()->GetSubsystem<UStealthLightSubsystem>())
+	{
+		const TArray<FStealthLight>& Lights = LightSubsystem->GetLights();
+		for (int32 Index = 0; Index < LightOrder.Num(); ++Index)
+		{
+			const FStealthLight& Light = Lights[LightOrder[Index]];
+			OutData.LightIds.Add(Light.StableId);
+			OutData.LightOn[Index] = Light.bOn;
+		}
+	}
+
+	OutData.LootedIds = LootedIds;
+
+	OutData.Player = FStealthPlayerSave();
+	if (const APlayerCharacter* Player = Cast<APlayerCharacter>(UGameplayStatics::GetPlayerPawn(this, 0)))
+	{
+		OutData.Player.Location = FVector3f(Player->GetActorLocation());
+		OutData.Player.Yaw = StealthSave::QuantizeYaw(Player->GetActorRotation().Yaw);
+		OutData.Player.bCrouched = Player->GetCharacterMovement()->IsCrouching();
+		OutData.Player.bMantling = Player->bIsMantling;
+		OutData.Player.MantleTarget = FVector3f(Player->MantleTargetPosition);
+	}
+}
+
+void UStealthSaveSubsystem::SaveGame(const FString& SlotName)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	GatherState(LastSaved);
+	bHasBase = true;
+	bRegistryDirty = false;
+	BaseSlotName = SlotName;
+
+	// The worker gets its own copy; LastSaved stays behind as the base for the next delta
+	LastTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Data = LastSaved, SlotName]() mutable
+	{
+		LLM_SCOPE_BYTAG(Stealth_Save);
+		TArray<uint8> Bytes;
+		FMemoryWriter Writer(Bytes);
+		uint32 Magic = SaveMagic;
+		uint32 Version = SaveVersion;
+		Writer << Magic << Version << Data;
+
+		// Write next to the base and move it into place, so a crash mid-write leaves the old base and journal intact.
+		// The journal belongs to the old base and only goes once the new one is there.
+		const FString BasePath = GetBasePath(SlotName);
+		const FString TempPath = BasePath + TEXT(".tmp");
+		if (!FFileHelper::SaveArrayToFile(Bytes, *TempPath) || !IFileManager::Get().Move(*BasePath, *TempPath, true, true))
+		{
+			UE_LOG(LogTemp, Error, TEXT("StealthSave: failed to write %s"), *BasePath);
+			IFileManager::Get().Delete(*TempPath, false, false, true);
+			return;
+		}
+		IFileManager::Get().Delete(*GetJournalPath(SlotName), false, false, true);
+	}, LastTask);
+
+	LastSaveGameThreadMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	UE_LOG(LogTemp, Verbose, TEXT("StealthSave: saved %s (%d doors, %d lights) in %.3f ms of game thread time"), *SlotName, LastSaved.DoorIds.Num(), LastSaved.LightIds.Num(), LastSaveGameThreadMs);
+}
+
+void UStealthSaveSubsystem::QuickSave(const FString& SlotName)
+{
+	SortRegistry();
+
+	// Deltas are only meaningful against a base with the same doors and lights in the same order
+	if (!bHasBase || bRegistryDirty || SlotName != BaseSlotName)
+	{
+		SaveGame(SlotName);
+		return;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	LLM_SCOPE_BYTAG(Stealth_Save);
+
+	FStealthSaveData Current;
+	GatherState(Current);
+
+	FStealthSaveDelta Delta;
+	for (int32 Index = 0; Index < Current.DoorYaw.Num(); ++Index)
+	{
+		if (Current.DoorClosed[Index] != LastSaved.DoorClosed[Index] || Current.DoorYaw[Index] != LastSaved.DoorYaw[Index])
+		{
+			Delta.DoorIndices.Add(Index);
+			Delta.DoorClosed.Add(Current.DoorClosed[Index]);
+			Delta.DoorYaw.Add(Current.DoorYaw[Index]);
+		}
+	}
+
+	for (int32 Index = 0; Index < Current.LightOn.Num(); ++Index)
+	{
+		if (Current.LightOn[Index] != LastSaved.LightOn[Index])
+		{
+			Delta.LightIndices.Add(Index);
+			Delta.LightOn.Add(Current.LightOn[Index]);
+		}
+	}
+
+	// Loot only ever grows
+	for (const uint32 Id : Current.LootedIds)
+	{
+		if (Algo::BinarySearch(LastSaved.LootedIds, Id) == INDEX_NONE)
+		{
+			Delta.NewlyLooted.Add(Id);
+		}
+	}
+
+	Delta.Player = Current.Player;
+	LastSaved = MoveTemp(Current);
+
+	const int32 NumDoorsChanged = Delta.DoorIndices.Num();
+	const int32 NumLightsChanged = Delta.LightIndices.Num();
+
+	LastTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Delta = MoveTemp(Delta), SlotName]() mutable
+	{
+		LLM_SCOPE_BYTAG(Stealth_Save);
+		TArray<uint8> Payload;
+		FMemoryWriter PayloadWriter(Payload);
+		PayloadWriter << Delta;
+
+		StealthSave::FRecordHeader Header;
+		Header.Size = Payload.Num();
+
+		TArray<uint8> Record;
+		FMemoryWriter RecordWriter(Record);
+		RecordWriter << Header;
+		Record.Append(Payload);
+
+		if (!FFileHelper::SaveArrayToFile(Record, *GetJournalPath(SlotName), &IFileManager::Get(), FILEWRITE_Append))
+		{
+			UE_LOG(LogTemp, Error, TEXT("StealthSave: failed to append to %s"), *GetJournalPath(SlotName));
+		}
+	}, LastTask);
+
+	LastSaveGameThreadMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	UE_LOG(LogTemp, Verbose, TEXT("StealthSave: quicksaved %s (%d doors, %d lights changed) in %.3f ms of game thread time"), *SlotName, NumDoorsChanged, NumLightsChanged, LastSaveGameThreadMs);
+}
+
+void UStealthSaveSubsystem::LoadGame(const FString& SlotName)
+{
+	TSharedPtr<FLoadResult, ESPMode::ThreadSafe> Result = MakeShared<FLoadResult, ESPMode::ThreadSafe>();
+	PendingLoad = Result;
+
+	PendingLoadTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Result, SlotName]()
+	{
+		LLM_SCOPE_BYTAG(Stealth_Save);
+		TArray<uint8> Bytes;
+		if (!FFileHelper::LoadFileToArray(Bytes, *GetBasePath(SlotName)))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthSave: no save at %s"), *GetBasePath(SlotName));
+			return;
+		}
+
+		FMemoryReader Reader(Bytes);
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		Reader << Magic << Version;
+		if (Magic != SaveMagic || Version != SaveVersion)
+		{
+			UE_LOG(LogTemp, Error, TEXT("StealthSave: %s is not a version %u stealth save"), *GetBasePath(SlotName), SaveVersion);
+			return;
+		}
+
+		Reader << Result->Data;
+		if (Reader.IsError())
+		{
+			UE_LOG(LogTemp, Error, TEXT("StealthSave: %s is corrupt"), *GetBasePath(SlotName));
+			return;
+		}
+
+		// Replay the quicksaves on top, stopping at the first damaged record
+		TArray<uint8> Journal;
+		if (FFileHelper::LoadFileToArray(Journal, *GetJournalPath(SlotName), FILEREAD_Silent))
+		{
+			FMemoryReader JournalReader(Journal);
+			int32 NumRecords = 0;
+			while (JournalReader.Tell() < JournalReader.TotalSize())
+			{
+				StealthSave::FRecordHeader Header;
+				JournalReader << Header;
+				const int64 RecordEnd = JournalReader.Tell() + Header.Size;
+				if (JournalReader.IsError() || !Header.IsValid() || RecordEnd > JournalReader.TotalSize())
+				{
+					UE_LOG(LogTemp, Warning, TEXT("StealthSave: journal record %d of %s is damaged, ignoring the rest"), NumRecords, *SlotName);
+					break;
+				}
+
+				FStealthSaveDelta Delta;
+				JournalReader << Delta;
+				if (JournalReader.IsError() || JournalReader.Tell() != RecordEnd)
+				{
+					UE_LOG(LogTemp, Warning, TEXT("StealthSave: journal record %d of %s is damaged, ignoring the rest"), NumRecords, *SlotName);
+					break;
+				}
+
+				StealthSave::ApplyDelta(Result->Data, Delta);
+				++NumRecords;
+			}
+		}
+
+		Result->bSuccess = true;
+	}, LastTask);
+
+	LastTask = PendingLoadTask;
+}
+
+void UStealthSaveSubsystem::FinishLoad()
+{
+	TSharedPtr<FLoadResult, ESPMode::ThreadSafe> Result = MoveTemp(PendingLoad);
+	PendingLoadTask = UE::Tasks::FTask();
+
+	if (Result->bSuccess)
+	{
+		ApplyState(Result->Data);
+
+		// If the world has exactly the saved doors and lights, the loaded file can keep taking deltas
+		GatherState(LastSaved);
+		bRegistryDirty = false;
+		bHasBase = LastSaved.DoorIds == Result->Data.DoorIds && LastSaved.LightIds == Result->Data.LightIds;
+	}
+
+	OnGameLoaded.Broadcast(Result->bSuccess);
+}
+
+void UStealthSaveSubsystem::ApplyState(const FStealthSaveData& Data)
+{
+	SortRegistry();
+
+	for (int32 Index = 0; Index < Doors.Num(); ++Index)
+	{
+		ADoor* Door = Doors[Index].Get();
+		const int32 SavedIndex = Algo::BinarySearch(Data.DoorIds, DoorIds[Index]);
+		if (Door && SavedIndex != INDEX_NONE)
+		{
+			Door->RestoreState(Data.DoorClosed[SavedIndex], StealthSave::DequantizeYaw(Data.DoorYaw[SavedIndex]));
+		}
+	}
+
+	// Saved doors that aren't streamed in get their state when they register
+	UnloadedDoors.Reset();
+	for (int32 SavedIndex = 0; SavedIndex < Data.DoorIds.Num(); ++SavedIndex)
+	{
+		if (Algo::BinarySearch(DoorIds, Data.DoorIds[SavedIndex]) == INDEX_NONE)
+		{
+			UnloadedDoors.Add(Data.DoorIds[SavedIndex], { static_cast<bool>(Data.DoorClosed[SavedIndex]), Data.DoorYaw[SavedIndex] });
+		}
+	}
+
+	if (UStealthLightSubsystem* LightSubsystem = GetWorld()->GetSubsystem<UStealthLightSubsystem>())
+	{
+		const TArray<FStealthLight>& Lights = LightSubsystem->GetLights();
+		for (int32 LightIndex = 0; LightIndex < Lights.Num(); ++LightIndex)
+		{
+			const int32 SavedIndex = Algo::BinarySearch(Data.LightIds, Lights[LightIndex].StableId);
+			if (SavedIndex != INDEX_NONE)
+			{
+				LightSubsystem->SetLightOn(LightIndex, Data.LightOn[SavedIndex]);
+			}
+		}
+	}
+
+	LootedIds = Data.LootedIds;
+
+	if (APlayerCharacter* Player = Cast<APlayerCharacter>(UGameplayStatics::GetPlayerPawn(this, 0)))
+	{
+		Player->SetActorLocationAndRotation(FVector(Data.Player.Location), FRotator(0.0f, StealthSave::DequantizeYaw(Data.Player.Yaw), 0.0f), false, nullptr, ETeleportType::TeleportPhysics);
+		if (AController* Controller = Player->GetController())
+		{
+			Controller->SetControlRotation(Player->GetActorRotation());
+		}
+
+		const bool bCrouching = Player->GetCharacterMovement()->IsCrouching();
+		if (Data.Player.bCrouched && !bCrouching)
+		{
+			Player->Crouch();
+		}
+		else if (!Data.Player.bCrouched && bCrouching)
+		{
+			Player->UnCrouch();
+		}
+
+		if (Data.Player.bMantling)
+		{
+			Player->StartMantle(FVector(Data.Player.MantleTarget));
+		}
+		else if (Player->bIsMantling)
+		{
+			Player->StopMantle(false);
+		}
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommandWithWorldAndArgs GStealthSaveCommand(
+	TEXT("Stealth.Save.Save"),
+	TEXT("Writes a full stealth save. Usage: Stealth.Save.Save [Slot]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UStealthSaveSubsystem* Save = World ? World->GetSubsystem<UStealthSaveSubsystem>() : nullptr)
+		{
+			Save->SaveGame(Args.Num() > 0 ? Args[0] : TEXT("Quick"));
+			UE_LOG(LogTemp, Display, TEXT("StealthSave: save took %.3f ms of game thread time"), Save->GetLastSaveGameThreadMs());
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GStealthQuickSaveCommand(
+	TEXT("Stealth.Save.Quick"),
+	TEXT("Appends what changed since the last save. Usage: Stealth.Save.Quick [Slot]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UStealthSaveSubsystem* Save = World ? World->GetSubsystem<UStealthSaveSubsystem>() : nullptr)
+		{
+			Save->QuickSave(Args.Num() > 0 ? Args[0] : TEXT("Quick"));
+			UE_LOG(LogTemp, Display, TEXT("StealthSave: quicksave took %.3f ms of game thread time"), Save->GetLastSaveGameThreadMs());
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GStealthLoadCommand(
+	TEXT("Stealth.Save.Load"),
+	TEXT("Loads a stealth save. Usage: Stealth.Save.Load [Slot]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UStealthSaveSubsystem* Save = World ? World->GetSubsystem<UStealthSaveSubsystem>() : nullptr)
+		{
+			Save->LoadGame(Args.Num() > 0 ? Args[0] : TEXT("Quick"));
+		}
+	}));
+
+// Spawns doors, saves, changes a few, quicksaves, scrambles everything, loads and checks the state came back.
+// Runs fine headless (-nullrhi), e.g. -ExecCmds="Stealth.Save.RoundTrip 5000".
+static FAutoConsoleCommandWithWorldAndArgs GStealthSaveRoundTripCommand(
+	TEXT("Stealth.Save.RoundTrip"),
+	TEXT("Save / quicksave / load round trip with extra doors. Usage: Stealth.Save.RoundTrip [Doors=5000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UStealthSaveSubsystem* Save = World ? World->GetSubsystem<UStealthSaveSubsystem>() : nullptr;
+		if (!Save)
+		{
+			return;
+		}
+
+		const int32 NumDoors = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 5000;
+		const FString Slot = TEXT("RoundTrip");
+		FRandomStream Random(1234);
+
+		TArray<ADoor*> Spawned;
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		for (int32 Index = 0; Index < NumDoors; ++Index)
+		{
+			const FVector Location(Index % 100 * 300.0f, Index / 100 * 300.0f, -100000.0f);
+			if (ADoor* Door = World->SpawnActor<ADoor>(ADoor::StaticClass(), Location, FRotator::ZeroRotator, SpawnParams))
+			{
+				Door->RestoreState(Random.FRand() < 0.5f, Random.FRand() < 0.5f ? 0.0f : 90.0f);
+				Spawned.Add(Door);
+			}
+		}
+
+		Save->SaveGame(Slot);
+		const double SaveMs = Save->GetLastSaveGameThreadMs();
+		Save->Flush();
+
+		// Roughly what a stretch of play changes between quicksaves
+		for (int32 Index = 0; Index < Spawned.Num() / 20; ++Index)
+		{
+			ADoor* Door = Spawned[Random.RandHelper(Spawned.Num())];
+			Door->RestoreState(!Door->isClosed, Random.FRandRange(-90.0f, 90.0f));
+			if (Index % 4 == 0)
+			{
+				Save->MarkLooted(Door);
+			}
+		}
+
+		Save->QuickSave(Slot);
+		const double QuickSaveMs = Save->GetLastSaveGameThreadMs();
+
+		FStealthSaveData Expected;
+		for (const TWeakObjectPtr<ADoor>& Door : Save->GetDoors())
+		{
+			Expected.DoorClosed.Add(Door.IsValid() && Door->isClosed);
+			Expected.DoorYaw.Add(Door.IsValid() ? StealthSave::QuantizeYaw(Door->DoorCurrentRotation) : 0);
+		}
+
+		TBitArray<> ExpectedLooted;
+		for (ADoor* Door : Spawned)
+		{
+			ExpectedLooted.Add(Save->IsLooted(Door));
+			Door->RestoreState(Random.FRand() < 0.5f, Random.FRandRange(-90.0f, 90.0f));
+		}
+
+		const double LoadStart = FPlatformTime::Seconds();
+		Save->LoadGame(Slot);
+		Save->Flush();
+		const double LoadMs = (FPlatformTime::Seconds() - LoadStart) * 1000.0;
+
+		int32 NumMismatched = 0;
+		const TArray<TWeakObjectPtr<ADoor>>& Doors = Save->GetDoors();
+		for (int32 Index = 0; Index < Doors.Num(); ++Index)
+		{
+			if (Doors[Index].IsValid() && (Expected.DoorClosed[Index] != Doors[Index]->isClosed || Expected.DoorYaw[Index] != StealthSave::QuantizeYaw(Doors[Index]->DoorCurrentRotation)))
+			{
+				++NumMismatched;
+			}
+		}
+
+		for (int32 Index = 0; Index < Spawned.Num(); ++Index)
+		{
+			if (ExpectedLooted[Index] != Save->IsLooted(Spawned[Index]))
+			{
+				++NumMismatched;
+			}
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("StealthSave round trip: %s, %d doors, %d mismatched. Save %.3f ms, quicksave %.3f ms (game thread), load %.3f ms. Base %lld bytes, journal %lld bytes"),
+			NumMismatched == 0 ? TEXT("PASS") : TEXT("FAIL"), Doors.Num(), NumMismatched, SaveMs, QuickSaveMs, LoadMs,
+			IFileManager::Get().FileSize(*UStealthSaveSubsystem::GetBasePath(Slot)), IFileManager::Get().FileSize(*UStealthSaveSubsystem::GetJournalPath(Slot)));
+		if (QuickSaveMs > 5.0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthSave: quicksave took %.3f ms of game thread time (target < 5 ms)"), QuickSaveMs);
+		}
+
+		for (ADoor* Door : Spawned)
+		{
+			Door->Destroy();
+		}
+	}));
+#endif
@@ -0,0 +1,787 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Save/StealthSnapshotSubsystem.h"
+#include "Thieflike.h"
+#include "Save/StealthSaveSubsystem.h"
+#include "Object/Door.h"
+#include "Object/InteractionSubsystem.h"
+#include "Character/PlayerCharacter.h"
+#include "AI/GuardCrowdSubsystem.h"
+#include "Stealth/StealthEventBus.h"
+#include "Stealth/StealthLightSubsystem.h"
+#include "Stealth/StealthSettings.h"
+#include "Movement/StealthCharacterMovementComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "HAL/IConsoleManager.h"
+#include "Engine/World.h"
+
+#include <type_traits>
+
+DECLARE_CYCLE_STAT(TEXT("Snapshot Capture"), STAT_StealthSnapshotCapture, STATGROUP_Stealth);
+DECLARE_CYCLE_STAT(TEXT("Snapshot Restore"), STAT_StealthSnapshotRestore, STATGROUP_Stealth);
+
+struct UStealthSnapshotSubsystem::FPlayerState
+{
+	FVector Location;
+	FRotator Rotation;
+	FRotator ControlRotation;
+	FVector Velocity;
+	uint8 MovementMode;
+	uint8 CustomMovementMode;
+	bool bCrouched;
+	bool bWantsToSprint;
+	float CapsuleHalfHeight;
+	float TargetCapsuleHalfHeight;
+
+	bool bIsMantling;
+	bool bIsJumpHeld;
+	FVector MantleTargetPosition;
+	FVector LastMantleLocation;
+	float StuckTimer;
+
+	bool bIsClimbing;
+	FClimbableHandle ClimbSurface;
+	float ClimbAlpha;
+	float ClimbOffset;
+	float ClimbInput;
+	float ClimbLateralInput;
+
+	int8 LeanDirection;
+	float TargetLeanOffset;
+	float CurrentLeanOffset;
+	float PreviousLeanOffset;
+	float TargetLeanRoll;
+	float CurrentLeanRoll;
+	float PreviousLeanRoll;
+
+	float TargetVisibility;
+	float CurrentVisibility;
+	float LastPostedVisibility;
+	uint8 ReplicatedVisibility;
+
+	float CameraHeight;
+	float PreviousCameraHeight;
+	FVector TraversalLocation;
+	FVector PreviousTraversalLocation;
+	float FootstepDistance;
+	FStealthFixedStep SimulationStep;
+};
+
+struct UStealthSnapshotSubsystem::FDoorState
+{
+	bool bClosed;
+	bool bOpening;
+	bool bClosing;
+	int8 OpenDirection;
+	float PosNeg;
+	float MaxDegree;
+	float Rotation;
+	float PreviousRotation;
+	FStealthFixedStep SimulationStep;
+};
+
+namespace StealthSnapshot
+{
+	// Everything in the buffer is copied as raw bytes. Single structs are zeroed before they are filled in, so their
+	// padding is zero too; arrays of structs with padding go through their fields instead.
+	struct FWriter
+	{
+		uint8* Cursor;
+
+		template <typename T>
+		void Write(const T& Value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Snapshot state must be plain data");
+			FMemory::Memcpy(Cursor, &Value, sizeof(T));
+			Cursor += sizeof(T);
+		}
+
+		template <typename T>
+		void Field(const T& Value) { Write(Value); }
+
+		template <typename T>
+		void WriteArray(const TArray<T>& Array)
+		{
+			static_assert(std::has_unique_object_representations_v<T>, "Padded or floating point elements need their fields passed");
+			FMemory::Memcpy(Cursor, Array.GetData(), Array.Num() * sizeof(T));
+			Cursor += Array.Num() * sizeof(T);
+		}
+
+		template <typename T, typename FieldsType>
+		void WriteArray(const TArray<T>& Array, FieldsType Fields)
+		{
+			for (const T& Element : Array)
+			{
+				Fields(*this, Element);
+			}
+		}
+	};
+
+	struct FReader
+	{
+		const uint8* Cursor;
+
+		template <typename T>
+		void Read(T& Value)
+		{
+			FMemory::Memcpy(&Value, Cursor, sizeof(T));
+			Cursor += sizeof(T);
+		}
+
+		template <typename T>
+		void Field(T& Value) { Read(Value); }
+
+		// Array must already have the captured size
+		template <typename T>
+		void ReadArray(TArray<T>& Array)
+		{
+			FMemory::Memcpy(Array.GetData(), Cursor, Array.Num() * sizeof(T));
+			Cursor += Array.Num() * sizeof(T);
+		}
+
+		template <typename T, typename FieldsType>
+		void ReadArray(TArray<T>& Array, FieldsType Fields)
+		{
+			for (T& Element : Array)
+			{
+				Fields(*this, Element);
+			}
+		}
+	};
+
+	// Bytes a struct takes in the buffer when written through its fields
+	struct FSizer
+	{
+		int32 Bytes = 0;
+
+		template <typename T>
+		void Field(const T&) { Bytes += sizeof(T); }
+	};
+
+	template <typename T, typename FieldsType>
+	int32 GetFieldsSize(FieldsType Fields)
+	{
+		FSizer Sizer;
+		const T Value{};
+		Fields(Sizer, Value);
+		return Sizer.Bytes;
+	}
+
+	// Guard fragment fields in buffer order, shared by capture and restore
+	constexpr auto PatrolFields = [](auto& Archive, auto& Patrol)
+	{
+		Archive.Field(Patrol.Location);
+		Archive.Field(Patrol.Yaw);
+		Archive.Field(Patrol.Speed);
+		Archive.Field(Patrol.RouteStart);
+		Archive.Field(Patrol.RouteLength);
+		Archive.Field(Patrol.WaypointIndex);
+	};
+
+	constexpr auto PerceptionFields = [](auto& Archive, auto& Perception)
+	{
+		Archive.Field(Perception.SightRange);
+		Archive.Field(Perception.HalfFovCos);
+		Archive.Field(Perception.HearingRange);
+		Archive.Field(Perception.Suspicion);
+	};
+
+	constexpr auto AlertFields = [](auto& Archive, auto& Alert)
+	{
+		Archive.Field(Alert.State);
+		Archive.Field(Alert.TimeInState);
+		Archive.Field(Alert.LastKnownPlayerLocation);
+	};
+
+	constexpr auto NoiseFields = [](auto& Archive, auto& Noise)
+	{
+		Archive.Field(Noise.Location);
+		Archive.Field(Noise.Loudness);
+	};
+
+	APlayerCharacter* GetPlayer(const UWorld* World)
+	{
+		return Cast<APlayerCharacter>(UGameplayStatics::GetPlayerCharacter(World, 0));
+	}
+}
+
+const TCHAR* FStealthSnapshot::GetSectionName(int32 Offset) const
+{
+	if (Offset < DoorsOffset)
+	{
+		return TEXT("player");
+	}
+	if (Offset < LightsOffset)
+	{
+		return TEXT("doors");
+	}
+	if (Offset < GuardsOffset)
+	{
+		return TEXT("lights");
+	}
+	return TEXT("guards");
+}
+
+void UStealthSnapshotSubsystem::CapturePlayer(const APlayerCharacter& Player, FPlayerState& OutState)
+{
+	const UCharacterMovementComponent* Movement = Player.GetCharacterMovement();
+
+	OutState.Location = Player.GetActorLocation();
+	OutState.Rotation = Player.GetActorRotation();
+	OutState.ControlRotation = Player.GetControlRotation();
+	OutState.Velocity = Movement->Velocity;
+	OutState.MovementMode = Movement->MovementMode;
+	OutState.CustomMovementMode = Movement->CustomMovementMode;
+	OutState.bCrouched = Player.bIsCrouched;
+	OutState.bWantsToSprint = Player.GetStealthMovement()->bWantsToSprint;
+	OutState.CapsuleHalfHeight = Player.GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
+	OutState.TargetCapsuleHalfHeight = Player.TargetCapsuleHalfHeight;
+
+	OutState.bIsMantling = Player.bIsMantling;
+	OutState.bIsJumpHeld = Player.bIsJumpHeld;
+	OutState.MantleTargetPosition = Player.MantleTargetPosition;
+	OutState.LastMantleLocation = Player.LastMantleLocation;
+	OutState.StuckTimer = Player.StuckTimer;
+
+	OutState.bIsClimbing = Player.bIsClimbing;
+	OutState.ClimbSurface = Player.ClimbSurface;
+	OutState.ClimbAlpha = Player.ClimbAlpha;
+	OutState.ClimbOffset = Player.ClimbOffset;
+	OutState.ClimbInput = Player.ClimbInput;
+	OutState.ClimbLateralInput = Player.ClimbLateralInput;
+
+	OutState.LeanDirection = Player.LeanDirection;
+	OutState.TargetLeanOffset = Player.TargetLeanOffset;
+	OutState.CurrentLeanOffset = Player.CurrentLeanOffset;
+	OutState.PreviousLeanOffset = Player.PreviousLeanOffset;
+	OutState.TargetLeanRoll = Player.TargetLeanRoll;
+	OutState.CurrentLeanRoll = Player.CurrentLeanRoll;
+	OutState.PreviousLeanRoll = Player.PreviousLeanRoll;
+
+	OutState.TargetVisibility = Player.TargetVisibility;
+	OutState.CurrentVisibility = Player.CurrentVisibility;
+	OutState.LastPostedVisibility = Player.LastPostedVisibility;
+	OutState.ReplicatedVisibility = Player.ReplicatedVisibility;
+
+	OutState.CameraHeight = Player.CameraHeight;
+	OutState.PreviousCameraHeight = Player.PreviousCameraHeight;
+	OutState.TraversalLocation = Player.TraversalLocation;
+	OutState.PreviousTraversalLocation = Player.PreviousTraversalLocation;
+	OutState.FootstepDistance = Player.FootstepDistance;
+	OutState.SimulationStep = Player.SimulationStep;
+}
+
+void UStealthSnapshotSubsystem::RestorePlayer(APlayerCharacter& Player, const FPlayerState& State)
+{
+	UCharacterMovementComponent* Movement = Player.GetCharacterMovement();
+
+	// Crouch first: it resizes the capsule and moves the actor, both of which are set exactly below
+	if (State.bCrouched != static_cast<bool>(Player.bIsCrouched))
+	{
+		Movement->bWantsToCrouch = State.bCrouched;
+		if (State.bCrouched)
+		{
+			Movement->Crouch();
+		}
+		else
+		{
+			Movement->UnCrouch();
+		}
+	}
+	Player.GetCapsuleComponent()->SetCapsuleHalfHeight(State.CapsuleHalfHeight, false);
+	Player.GetStealthMovement()->bWantsToSprint = State.bWantsToSprint;
+
+	Player.SetActorLocationAndRotation(State.Location, State.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	if (AController* Controller = Player.GetController())
+	{
+		Controller->SetControlRotation(State.ControlRotation);
+	}
+
+	if (Movement->MovementMode != State.MovementMode || Movement->CustomMovementMode != State.CustomMovementMode)
+	{
+		Movement->SetMovementMode(static_cast<EMovementMode>(State.MovementMode), State.CustomMovementMode);
+	}
+	Movement->Velocity = State.Velocity;
+
+	Player.TargetCapsuleHalfHeight = State.TargetCapsuleHalfHeight;
+
+	Player.bIsMantling = State.bIsMantling;
+	Player.bIsJumpHeld = State.bIsJumpHeld;
+	Player.MantleTargetPosition = State.MantleTargetPosition;
+	Player.LastMantleLocation = State.LastMantleLocation;
+	Player.StuckTimer = State.StuckTimer;
+
+	Player.bIsClimbing = State.bIsClimbing;
+	Player.ClimbSurface = State.ClimbSurface;
+	Player.ClimbAlpha = State.ClimbAlpha;
+	Player.ClimbOffset = State.ClimbOffset;
+	Player.ClimbInput = State.ClimbInput;
+	Player.ClimbLateralInput = State.ClimbLateralInput;
+
+	Player.LeanDirection = State.LeanDirection;
+	Player.TargetLeanOffset = State.TargetLeanOffset;
+	Player.CurrentLeanOffset = State.CurrentLeanOffset;
+	Player.PreviousLeanOffset = State.PreviousLeanOffset;
+	Player.TargetLeanRoll = State.TargetLeanRoll;
+	Player.CurrentLeanRoll = State.CurrentLeanRoll;
+	Player.PreviousLeanRoll = State.PreviousLeanRoll;
+
+	Player.TargetVisibility = State.TargetVisibility;
+	Player.CurrentVisibility = State.CurrentVisibility;
+	Player.LastPostedVisibility = State.LastPostedVisibility;
+	Player.ReplicatedVisibility = State.ReplicatedVisibility;
+	Player.ExposureCache.Reset();
+
+	Player.CameraHeight = State.CameraHeight;
+	Player.PreviousCameraHeight = State.PreviousCameraHeight;
+	Player.TraversalLocation = State.TraversalLocation;
+	Player.PreviousTraversalLocation = State.PreviousTraversalLocation;
+	Player.FootstepDistance = State.FootstepDistance;
+	Player.SimulationStep = State.SimulationStep;
+
+	// Camera offset / roll / height as they were shown at capture time
+	if (Player.FirstPersonSpringArmComponent && Player.FirstPersonCameraComponent)
+	{
+		Player.UpdatePresentation(Player.SimulationStep.GetAlpha());
+	}
+}
+
+void UStealthSnapshotSubsystem::CaptureDoor(const ADoor& Door, FDoorState& OutState)
+{
+	OutState.bClosed = Door.isClosed;
+	OutState.bOpening = Door.Opening;
+	OutState.bClosing = Door.Closing;
+	OutState.OpenDirection = Door.OpenDirection;
+	OutState.PosNeg = Door.PosNeg;
+	OutState.MaxDegree = Door.MaxDegree;
+	OutState.Rotation = Door.DoorCurrentRotation;
+	OutState.PreviousRotation = Door.PreviousRotation;
+	OutState.SimulationStep = Door.SimulationStep;
+}
+
+void UStealthSnapshotSubsystem::RestoreDoor(ADoor& Door, const FDoorState& State)
+{
+	const bool bStateChanged = Door.isClosed != State.bClosed || Door.OpenDirection != State.OpenDirection;
+
+	Door.isClosed = State.bClosed;
+	Door.Opening = State.bOpening;
+	Door.Closing = State.bClosing;
+	Door.OpenDirection = State.OpenDirection;
+	Door.PosNeg = State.PosNeg;
+	Door.MaxDegree = State.MaxDegree;
+	Door.DoorCurrentRotation = State.Rotation;
+	Door.PreviousRotation = State.PreviousRotation;
+	Door.SimulationStep = State.SimulationStep;
+
+	Door.ShowRotation(FMath::Lerp(State.PreviousRotation, State.Rotation, State.SimulationStep.GetAlpha()));
+
+	if (bStateChanged)
+	{
+		Door.FlushNetDormancy();
+	}
+}
+
+void UStealthSnapshotSubsystem::Capture(FStealthSnapshot& Snapshot) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_StealthSnapshotCapture);
+	LLM_SCOPE_BYTAG(Stealth_Save);
+
+	const UWorld* World = GetWorld();
+	const UStealthSaveSubsystem* Save = World->GetSubsystem<UStealthSaveSubsystem>();
+	const UStealthLightSubsystem* Lights = World->GetSubsystem<UStealthLightSubsystem>();
+	const UGuardCrowdSubsystem* Guards = World->GetSubsystem<UGuardCrowdSubsystem>();
+
+	Snapshot.Player = StealthSnapshot::GetPlayer(World);
+	if (Save)
+	{
+		Snapshot.Doors = Save->GetDoors();
+	}
+	else
+	{
+		Snapshot.Doors.Reset();
+	}
+	Snapshot.LightRevision = Lights ? Lights->GetRevision() : 0;
+	Snapshot.NumLights = Lights ? Lights->GetLights().Num() : 0;
+	Snapshot.NumGuards = Guards ? Guards->NumGuards() : 0;
+	const int32 NumNoises = Guards ? Guards->PendingNoises.Num() : 0;
+
+	using FNoise = UGuardCrowdSubsystem::FNoise;
+	Snapshot.DoorsOffset = sizeof(FPlayerState);
+	Snapshot.LightsOffset = Snapshot.DoorsOffset + Snapshot.Doors.Num() * sizeof(FDoorState);
+	Snapshot.GuardsOffset = Snapshot.LightsOffset + Snapshot.NumLights;
+	const int32 GuardBytes = StealthSnapshot::GetFieldsSize<FGuardPatrolFragment>(StealthSnapshot::PatrolFields)
+		+ StealthSnapshot::GetFieldsSize<FGuardPerceptionFragment>(StealthSnapshot::PerceptionFields)
+		+ StealthSnapshot::GetFieldsSize<FGuardAlertFragment>(StealthSnapshot::AlertFields)
+		+ sizeof(EGuardAlertState);
+	const int32 NoiseBytes = StealthSnapshot::GetFieldsSize<FNoise>(StealthSnapshot::NoiseFields);
+	const int32 TotalBytes = Snapshot.GuardsOffset + Snapshot.NumGuards * GuardBytes + 2 * sizeof(int32) + NumNoises * NoiseBytes;
+
+	// Zeroed so the player and door state padding compares equal between snapshots
+	Snapshot.Data.SetNumUninitialized(TotalBytes, EAllowShrinking::No);
+	FMemory::Memzero(Snapshot.Data.GetData(), TotalBytes);
+
+	StealthSnapshot::FWriter Writer{ Snapshot.Data.GetData() };
+
+	FPlayerState PlayerState;
+	FMemory::Memzero(&PlayerState, sizeof(PlayerState));
+	if (const APlayerCharacter* Player = Snapshot.Player.Get())
+	{
+		CapturePlayer(*Player, PlayerState);
+	}
+	Writer.Write(PlayerState);
+
+	for (const TWeakObjectPtr<ADoor>& Door : Snapshot.Doors)
+	{
+		FDoorState DoorState;
+		FMemory::Memzero(&DoorState, sizeof(DoorState));
+		if (Door.IsValid())
+		{
+			CaptureDoor(*Door, DoorState);
+		}
+		Writer.Write(DoorState);
+	}
+
+	if (Lights)
+	{
+		for (const FStealthLight& Light : Lights->GetLights())
+		{
+			Writer.Write(static_cast<uint8>(Light.bOn));
+		}
+	}
+
+	if (Guards)
+	{
+		Writer.WriteArray(Guards->Patrol, StealthSnapshot::PatrolFields);
+		Writer.WriteArray(Guards->Perception, StealthSnapshot::PerceptionFields);
+		Writer.WriteArray(Guards->Alert, StealthSnapshot::AlertFields);
+		Writer.WriteArray(Guards->PreviousAlertState);
+		Writer.Write(Guards->NextDoorGuard);
+		Writer.Write(NumNoises);
+		Writer.WriteArray(Guards->PendingNoises, StealthSnapshot::NoiseFields);
+	}
+	else
+	{
+		Writer.Write(static_cast<int32>(0));
+		Writer.Write(NumNoises);
+	}
+
+	check(Writer.Cursor == Snapshot.Data.GetData() + TotalBytes);
+}
+
+bool UStealthSnapshotSubsystem::Restore(const FStealthSnapshot& Snapshot)
+{
+	SCOPE_CYCLE_COUNTER(STAT_StealthSnapshotRestore);
+
+	if (!Snapshot.IsValid())
+	{
+		return false;
+	}
+
+	UWorld* World = GetWorld();
+	UStealthLightSubsystem* Lights = World->GetSubsystem<UStealthLightSubsystem>();
+	UGuardCrowdSubsystem* Guards = World->GetSubsystem<UGuardCrowdSubsystem>();
+
+	const uint32 LightRevision = Lights ? Lights->GetRevision() : 0;
+	const int32 NumGuards = Guards ? Guards->NumGuards() : 0;
+	if (LightRevision != Snapshot.LightRevision || NumGuards != Snapshot.NumGuards)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StealthSnapshot: lights or guards changed since the capture, not restoring"));
+		return false;
+	}
+
+	StealthSnapshot::FReader Reader{ Snapshot.Data.GetData() };
+
+	FPlayerState PlayerState;
+	Reader.Read(PlayerState);
+	if (APlayerCharacter* Player = Snapshot.Player.Get())
+	{
+		RestorePlayer(*Player, PlayerState);
+	}
+
+	for (const TWeakObjectPtr<ADoor>& Door : Snapshot.Doors)
+	{
+		FDoorState DoorState;
+		Reader.Read(DoorState);
+		if (ADoor* DoorActor = Door.Get())
+		{
+			RestoreDoor(*DoorActor, DoorState);
+		}
+	}
+
+	for (int32 LightIndex = 0; LightIndex < Snapshot.NumLights; ++LightIndex)
+	{
+		uint8 bOn = 0;
+		Reader.Read(bOn);
+		Lights->SetLightOn(LightIndex, bOn != 0);
+	}
+
+	int32 NumNoises = 0;
+	if (Guards)
+	{
+		Reader.ReadArray(Guards->Patrol, StealthSnapshot::PatrolFields);
+		Reader.ReadArray(Guards->Perception, StealthSnapshot::PerceptionFields);
+		Reader.ReadArray(Guards->Alert, StealthSnapshot::AlertFields);
+		Reader.ReadArray(Guards->PreviousAlertState);
+		Reader.Read(Guards->NextDoorGuard);
+		Reader.Read(NumNoises);
+		Guards->PendingNoises.SetNumUninitialized(NumNoises, EAllowShrinking::No);
+		Reader.ReadArray(Guards->PendingNoises, StealthSnapshot::NoiseFields);
+	}
+
+	// Door requests and events queued before the restore belong to the abandoned branch
+	if (UInteractionSubsystem* Interactions = World->GetSubsystem<UInteractionSubsystem>())
+	{
+		Interactions->ResetPending();
+	}
+	if (UStealthEventBus* EventBus = World->GetSubsystem<UStealthEventBus>())
+	{
+		EventBus->Discard();
+	}
+
+	return true;
+}
+
+void UStealthSnapshotSubsystem::Step(float DeltaTime)
+{
+	UWorld* World = GetWorld();
+
+	if (UGuardCrowdSubsystem* Guards = World->GetSubsystem<UGuardCrowdSubsystem>())
+	{
+		Guards->Tick(DeltaTime);
+	}
+
+	// Doors the guards asked for this step open before the doors move
+	if (UInteractionSubsystem* Interactions = World->GetSubsystem<UInteractionSubsystem>())
+	{
+		Interactions->Tick(DeltaTime);
+	}
+
+	if (UStealthSaveSubsystem* Save = World->GetSubsystem<UStealthSaveSubsystem>())
+	{
+		for (const TWeakObjectPtr<ADoor>& Door : Save->GetDoors())
+		{
+			if (Door.IsValid())
+			{
+				Door->Tick(DeltaTime);
+			}
+		}
+	}
+
+	// The actor tick applies lean, crouch and traversal, then movement runs as it would after it in a world tick
+	if (APlayerCharacter* Player = StealthSnapshot::GetPlayer(World))
+	{
+		Player->Tick(DeltaTime);
+
+		UCharacterMovementComponent* Movement = Player->GetCharacterMovement();
+		if (Movement && Movement->IsComponentTickEnabled())
+		{
+			Movement->TickComponent(DeltaTime, LEVELTICK_All, &Movement->PrimaryComponentTick);
+		}
+	}
+
+	// Noises, door toggles and visibility changes from this step reach the guards before the next one, and none
+	// are left queued for the world's own tick to deliver after the branch is abandoned
+	if (UStealthEventBus* EventBus = World->GetSubsystem<UStealthEventBus>())
+	{
+		EventBus->Flush();
+	}
+}
+
+void UStealthSnapshotSubsystem::FlushEvents()
+{
+	if (UStealthEventBus* EventBus = GetWorld()->GetSubsystem<UStealthEventBus>())
+	{
+		EventBus->Flush();
+	}
+}
+
+bool UStealthSnapshotSubsystem::CheckPlayerFrameRates(int32 NumSteps, float VisibilityTolerance)
+{
+	APlayerCharacter* Player = StealthSnapshot::GetPlayer(GetWorld());
+	if (!Player)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Stealth frame rate check: no player to step"));
+		return false;
+	}
+
+	// Frame times a power of two off the step time add up without rounding, so every run takes exactly NumSteps
+	// steps from an empty accumulator. Only the player ticks: the guards and character movement step per frame.
+	const float StepSeconds = 1.0f / FMath::Max(UStealthSettings::Get()->SimulationRate, 1.0f);
+	const float FrameScales[] = { 1.0f, 2.0f, 0.5f };
+	NumSteps = FMath::Max(NumSteps + (NumSteps & 1), 2);
+
+	FStealthSnapshot Start;
+	FlushEvents();
+	Capture(Start);
+
+	FPlayerState Reference;
+	FPlayerState Result;
+	bool bPassed = true;
+	for (const float Scale : FrameScales)
+	{
+		if (!Restore(Start))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Stealth frame rate check: restore was refused (guards or lights changed while stepping)"));
+			return false;
+		}
+		Player->SimulationStep = FStealthFixedStep();
+
+		const int32 NumFrames = FMath::RoundToInt(NumSteps / Scale);
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			Player->Tick(StepSeconds * Scale);
+		}
+
+		FPlayerState& State = Scale == 1.0f ? Reference : Result;
+		FMemory::Memzero(&State, sizeof(State));
+		CapturePlayer(*Player, State);
+		if (Scale == 1.0f)
+		{
+			continue;
+		}
+
+		const float VisibilityError = FMath::Abs(Result.CurrentVisibility - Reference.CurrentVisibility);
+		const float LocationError = FVector::Dist(Result.Location, Reference.Location);
+
+		// Everything but visibility has to match to the bit
+		Result.TargetVisibility = Reference.TargetVisibility;
+		Result.CurrentVisibility = Reference.CurrentVisibility;
+		Result.LastPostedVisibility = Reference.LastPostedVisibility;
+		Result.ReplicatedVisibility = Reference.ReplicatedVisibility;
+		const bool bStateMatches = FMemory::Memcmp(&Result, &Reference, sizeof(FPlayerState)) == 0;
+
+		if (!bStateMatches || VisibilityError > VisibilityTolerance)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Stealth frame rate check: FAIL at %.1f steps per frame, %s (location off by %.3f cm, visibility by %.2f%%)"),
+				1.0f / Scale, bStateMatches ? TEXT("visibility out of tolerance") : TEXT("player state differs"), LocationError, VisibilityError);
+			bPassed = false;
+		}
+		else
+		{
+			UE_LOG(LogTemp, Display, TEXT("Stealth frame rate check: %.1f steps per frame matches, visibility off by %.2f%%"), 1.0f / Scale, VisibilityError);
+		}
+	}
+
+	Restore(Start);
+	return bPassed;
+}
+
+#if !UE_BUILD_SHIPPING
+// Stealth.Snapshot.Benchmark [Iterations] - combine with Stealth.Guards.Spawn / Stealth.Save.RoundTrip to scale the actor count
+static FAutoConsoleCommandWithWorldAndArgs StealthSnapshotBenchmarkCommand(
+	TEXT("Stealth.Snapshot.Benchmark"),
+	TEXT("Times snapshot capture and restore of the current world. Args: [Iterations=1000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UStealthSnapshotSubsystem* Snapshots = World ? World->GetSubsystem<UStealthSnapshotSubsystem>() : nullptr;
+		if (!Snapshots)
+		{
+			return;
+		}
+
+		const int32 Iterations = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000, 1);
+
+		// First capture sizes the buffer; the timed ones reuse it
+		FStealthSnapshot Snapshot;
+		Snapshots->Capture(Snapshot);
+
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			Snapshots->Capture(Snapshot);
+		}
+		const double CaptureUs = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / Iterations;
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			Snapshots->Restore(Snapshot);
+		}
+		const double RestoreUs = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / Iterations;
+
+		UE_LOG(LogTemp, Display, TEXT("StealthSnapshot: %d doors, %d lights, %d guards, %d bytes: capture %.2f us, restore %.2f us"),
+			Snapshot.Doors.Num(), Snapshot.NumLights, Snapshot.NumGuards, Snapshot.Data.Num(), CaptureUs, RestoreUs);
+	}));
+
+// Steps the world forward, restores the starting snapshot, steps again with the same time steps and expects
+// byte-identical state. Logs PASS / FAIL.
+static FAutoConsoleCommandWithWorldAndArgs StealthSnapshotVerifyCommand(
+	TEXT("Stealth.Snapshot.Verify"),
+	TEXT("Checks that restore-then-step reproduces the original steps exactly. Args: [Steps=60] [DeltaTime=0.0166]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UStealthSnapshotSubsystem* Snapshots = World ? World->GetSubsystem<UStealthSnapshotSubsystem>() : nullptr;
+		if (!Snapshots)
+		{
+			return;
+		}
+
+		const int32 NumSteps = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 60, 1);
+		const float DeltaTime = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 1.0f / 60.0f;
+
+		FStealthSnapshot Start;
+		FStealthSnapshot Original;
+		FStealthSnapshot Replayed;
+
+		Snapshots->FlushEvents();
+		Snapshots->Capture(Start);
+		for (int32 Step = 0; Step < NumSteps; ++Step)
+		{
+			Snapshots->Step(DeltaTime);
+		}
+		Snapshots->Capture(Original);
+
+		if (!Snapshots->Restore(Start))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Stealth snapshot verify: FAIL, restore was refused (guards or lights changed while stepping)"));
+			return;
+		}
+		for (int32 Step = 0; Step < NumSteps; ++Step)
+		{
+			Snapshots->Step(DeltaTime);
+		}
+		Snapshots->Capture(Replayed);
+
+		if (Original.Data.Num() != Replayed.Data.Num())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Stealth snapshot verify: FAIL, snapshot size changed (%d vs %d bytes)"), Original.Data.Num(), Replayed.Data.Num());
+			return;
+		}
+
+		for (int32 Offset = 0; Offset < Original.Data.Num(); ++Offset)
+		{
+			if (Original.Data[Offset] != Replayed.Data[Offset])
+			{
+				UE_LOG(LogTemp, Error, TEXT("Stealth snapshot verify: FAIL, first difference at byte %d (%s) after %d steps"), Offset, Original.GetSectionName(Offset), NumSteps);
+				return;
+			}
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("Stealth snapshot verify: PASS, %d bytes identical after %d steps of %.4f s"), Original.Data.Num(), NumSteps, DeltaTime);
+	}));
+
+// Stealth.Snapshot.CheckFrameRate [Steps] [VisibilityTolerance] - stand still or hold a lean / crouch transition while it runs
+static FAutoConsoleCommandWithWorldAndArgs StealthSnapshotCheckFrameRateCommand(
+	TEXT("Stealth.Snapshot.CheckFrameRate"),
+	TEXT("Checks that the player's fixed-step simulation ends in the same state at different frame rates. Args: [Steps=120] [VisibilityTolerance=1.0]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UStealthSnapshotSubsystem* Snapshots = World ? World->GetSubsystem<UStealthSnapshotSubsystem>() : nullptr;
+		if (!Snapshots)
+		{
+			return;
+		}
+
+		const int32 NumSteps = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 120;
+		const float VisibilityTolerance = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 1.0f;
+		if (Snapshots->CheckPlayerFrameRates(NumSteps, VisibilityTolerance))
+		{
+			UE_LOG(LogTemp, Display, TEXT("Stealth frame rate check: PASS"));
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("Stealth frame rate check: FAIL"));
+		}
+	}));
+#endif
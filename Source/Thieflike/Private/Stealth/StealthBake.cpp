@@ -0,0 +1,243 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthBake.h"
+#include "Algo/AnyOf.h"
+#include "Components/LocalLightComponent.h"
+#include "Components/PrimitiveComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/LevelStreaming.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "StaticMeshResources.h"
+#include "WorldPartition/WorldPartition.h"
+#if WITH_EDITOR
+#include "WorldPartition/LoaderAdapter/LoaderAdapterShape.h"
+#endif
+
+namespace StealthBake
+{
+#if WITH_EDITOR
+	// Keeps every World Partition actor of a loaded map in memory until ReleaseWorld
+	TMap<UWorld*, TUniquePtr<FLoaderAdapterShape>> LoadedRegions;
+#endif
+}
+
+UWorld* StealthBake::LoadWorld(const FString& MapName)
+{
+	UPackage* Package = LoadPackage(nullptr, *MapName, LOAD_None);
+	UWorld* World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+	if (!World)
+	{
+		return nullptr;
+	}
+
+	World->AddToRoot();
+	World->WorldType = EWorldType::Editor;
+	if (!World->bIsWorldInitialized)
+	{
+		// Collision is all the sampling needs
+		World->InitWorld(UWorld::InitializationValues()
+			.AllowAudioPlayback(false)
+			.RequiresHitProxies(false)
+			.CreatePhysicsScene(true)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.ShouldSimulatePhysics(false)
+			.EnableTraceCollision(true)
+			.SetTransactional(false));
+	}
+
+	// Sublevels too: a room can be lit, or shadowed, from a streamed level
+	for (ULevelStreaming* StreamingLevel : World->GetStreamingLevels())
+	{
+		StreamingLevel->SetShouldBeLoaded(true);
+		StreamingLevel->SetShouldBeVisible(true);
+	}
+	World->FlushLevelStreaming(EFlushLevelStreamingType::Full);
+
+	// World Partition maps keep most actors in unloaded cells; the lights, occluders, doors, climbables and navmesh
+	// chunks in all of them are bake inputs, so the whole map is loaded
+	if (UWorldPartition* WorldPartition = World->GetWorldPartition())
+	{
+#if WITH_EDITOR
+		if (!WorldPartition->IsInitialized())
+		{
+			WorldPartition->Initialize(World, FTransform::Identity);
+		}
+		TUniquePtr<FLoaderAdapterShape>& Region = LoadedRegions.Add(World, MakeUnique<FLoaderAdapterShape>(World, FBox(FVector(-HALF_WORLD_MAX), FVector(HALF_WORLD_MAX)), TEXT("StealthBake")));
+		Region->Load();
+#else
+		UE_LOG(LogTemp, Error, TEXT("StealthBake: %s uses World Partition, which can only be loaded whole in an editor build"), *MapName);
+		World->RemoveFromRoot();
+		return nullptr;
+#endif
+	}
+	World->UpdateWorldComponents(true, false);
+	return World;
+}
+
+void StealthBake::ReleaseWorld(UWorld* World)
+{
+	if (World)
+	{
+#if WITH_EDITOR
+		TUniquePtr<FLoaderAdapterShape> Region;
+		if (LoadedRegions.RemoveAndCopyValue(World, Region))
+		{
+			Region->Unload();
+		}
+#endif
+		World->RemoveFromRoot();
+	}
+}
+
+const ARecastNavMesh* StealthBake::FindNavMesh(UWorld* World)
+{
+	for (TActorIterator<ARecastNavMesh> It(World); It; ++It)
+	{
+		return *It;
+	}
+	return nullptr;
+}
+
+void StealthBake::GatherLights(UWorld* World, TArray<FStealthLight>& OutLights)
+{
+	TArray<ULocalLightComponent*> LightComponents;
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		It->GetComponents<ULocalLightComponent>(LightComponents);
+		for (ULocalLightComponent* LightComponent : LightComponents)
+		{
+			OutLights.Add(UStealthLightSubsystem::DescribeLight(LightComponent));
+		}
+	}
+}
+
+uint32 StealthBake::HashLight(const FStealthLight& Light)
+{
+	const float Values[] =
+	{
+		static_cast<float>(Light.Location.X), static_cast<float>(Light.Location.Y), static_cast<float>(Light.Location.Z),
+		Light.Radius, Light.Intensity, Light.bOn ? 1.0f : 0.0f,
+		Light.Flicker.Amplitude, Light.Flicker.Frequency, static_cast<float>(Light.Flicker.Seed),
+	};
+	return FCrc::MemCrc32(Values, sizeof(Values));
+}
+
+void StealthBake::FOccluderIndex::Build(UWorld* World, TConstArrayView<ECollisionChannel> Channels)
+{
+	Occluders.Reset();
+	Grid.Reset();
+
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		TInlineComponentArray<UPrimitiveComponent*> Primitives(*It);
+		for (UPrimitiveComponent* Primitive : Primitives)
+		{
+			if (!Primitive->IsRegistered() || !Primitive->IsCollisionEnabled())
+			{
+				continue;
+			}
+			const bool bBlocksAny = Algo::AnyOf(Channels, [Primitive](ECollisionChannel Channel)
+			{
+				return Primitive->GetCollisionResponseToChannel(Channel) == ECR_Block;
+			});
+			if (bBlocksAny)
+			{
+				Occluders.Add({ Primitive->Bounds.GetBox(), HashOccluder(*Primitive, Channels) });
+			}
+		}
+	}
+
+	for (int32 Index = 0; Index < Occluders.Num(); ++Index)
+	{
+		const FIntPoint Min = GetCell(Occluders[Index].Bounds.Min);
+		const FIntPoint Max = GetCell(Occluders[Index].Bounds.Max);
+		for (int32 X = Min.X; X <= Max.X; ++X)
+		{
+			for (int32 Y = Min.Y; Y <= Max.Y; ++Y)
+			{
+				Grid.FindOrAdd(FIntPoint(X, Y)).Add(Index);
+			}
+		}
+	}
+}
+
+uint32 StealthBake::FOccluderIndex::HashRegion(const FBox& Region) const
+{
+	TArray<int32> Candidates;
+	const FIntPoint Min = GetCell(Region.Min);
+	const FIntPoint Max = GetCell(Region.Max);
+	for (int32 X = Min.X; X <= Max.X; ++X)
+	{
+		for (int32 Y = Min.Y; Y <= Max.Y; ++Y)
+		{
+			if (const TArray<int32>* Cell = Grid.Find(FIntPoint(X, Y)))
+			{
+				Candidates.Append(*Cell);
+			}
+		}
+	}
+	Candidates.Sort();
+
+	TArray<uint32> Hashes;
+	int32 LastCandidate = INDEX_NONE;
+	for (const int32 Candidate : Candidates)
+	{
+		if (Candidate != LastCandidate && Occluders[Candidate].Bounds.Intersect(Region))
+		{
+			Hashes.Add(Occluders[Candidate].Hash);
+		}
+		LastCandidate = Candidate;
+	}
+
+	// Sorted so the hash doesn't depend on actor iteration order
+	Hashes.Sort();
+	return FCrc::MemCrc32(Hashes.GetData(), Hashes.Num() * sizeof(uint32));
+}
+
+uint32 StealthBake::FOccluderIndex::HashOccluder(const UPrimitiveComponent& Component, TConstArrayView<ECollisionChannel> Channels)
+{
+	// Where it is, how big it is, what its mesh and collision are and which of the traced channels it blocks
+	const FTransform& Transform = Component.GetComponentTransform();
+	const FVector3f Values[] =
+	{
+		FVector3f(Transform.GetLocation()),
+		FVector3f(Transform.GetRotation().Euler()),
+		FVector3f(Transform.GetScale3D()),
+		FVector3f(Component.Bounds.BoxExtent),
+	};
+	uint32 Hash = FCrc::MemCrc32(Values, sizeof(Values));
+	if (const UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>(&Component))
+	{
+		if (const UStaticMesh* Mesh = MeshComponent->GetStaticMesh())
+		{
+			// The path stays the same when a mesh is reimported; its derived data key and collision guid do not
+			Hash = HashCombine(Hash, GetTypeHash(Mesh->GetPathName()));
+#if WITH_EDITORONLY_DATA
+			if (const FStaticMeshRenderData* RenderData = Mesh->GetRenderData())
+			{
+				Hash = HashCombine(Hash, GetTypeHash(RenderData->DerivedDataKey));
+			}
+#endif
+			if (const UBodySetup* BodySetup = Mesh->GetBodySetup())
+			{
+				Hash = HashCombine(Hash, GetTypeHash(BodySetup->BodySetupGuid));
+			}
+		}
+	}
+	for (const ECollisionChannel Channel : Channels)
+	{
+		Hash = HashCombine(Hash, static_cast<uint32>(Component.GetCollisionResponseToChannel(Channel)));
+	}
+	return Hash;
+}
+
+FIntPoint StealthBake::FOccluderIndex::GetCell(const FVector& Location)
+{
+	return FIntPoint(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+}
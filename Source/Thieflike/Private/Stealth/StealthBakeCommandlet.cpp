@@ -0,0 +1,778 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthBakeCommandlet.h"
+#include "Stealth/StealthBake.h"
+#include "Stealth/StealthCellData.h"
+#include "Stealth/StealthExposure.h"
+#include "Stealth/StealthNavPoly.h"
+#include "Stealth/StealthStreamingSubsystem.h"
+#include "Object/ClimbableSurfaceComponent.h"
+#include "Object/Door.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "Hash/xxhash.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "UObject/Package.h"
+#include "UObject/SavePackage.h"
+#include "WorldPartition/WorldPartition.h"
+#include "WorldPartition/WorldPartitionHelpers.h"
+
+namespace StealthCellBake
+{
+	// Bump when the bake itself changes; it is part of every chunk hash, so old cache entries stop matching
+	constexpr uint32 BakeVersion = 3;
+	constexpr uint32 CacheMagic = 0x4B425453; // 'STBK'
+
+	// Exposure is baked at the standing capsule centre, like UpdateVisibility reads it
+	constexpr float StandingHalfHeight = 88.0f;
+
+	// A navmesh boundary edge is a mantleable ledge when the floor this far out is within the drop range below it
+	constexpr float LedgeProbeOut = 40.0f;
+	constexpr float MinLedgeDrop = 50.0f;
+	constexpr float MaxLedgeDrop = 200.0f;
+	constexpr float MinLedgeLength = 30.0f;
+
+	struct FChunk
+	{
+		FIntPoint Coord = FIntPoint::ZeroValue;
+		FBox Bounds = FBox(ForceInit);
+
+		// Navmesh polygons whose centre is in the chunk; the verts of polygon N are Verts[VertStarts[N]..VertStarts[N + 1]),
+		// and Boundary[V] is set when the edge starting at vert V has no neighbouring polygon
+		TArray<FVector> Verts;
+		TArray<int32> VertStarts;
+		TArray<uint8> Boundary;
+
+		// Lights whose radius reaches the chunk
+		TArray<FStealthLight> Lights;
+
+		TArray<FStealthPortal> Portals;
+		TArray<FStealthClimbable> Climbables;
+
+		uint64 Hash = 0;
+		bool bUpToDate = false;
+		bool bCacheHit = false;
+	};
+
+	// What one chunk bakes to; also the payload of a cache entry
+	struct FBakedChunk
+	{
+		TArray<FStealthExposureSample> ExposureSamples;
+		TArray<FStealthLedge> Ledges;
+		TArray<FStealthClimbable> Climbables;
+		TArray<FStealthPortal> Portals;
+	};
+
+	FIntPoint GetChunk(const FVector& Location, float ChunkSize)
+	{
+		return FIntPoint(FMath::FloorToInt(Location.X / ChunkSize), FMath::FloorToInt(Location.Y / ChunkSize));
+	}
+
+	template <typename ItemType, typename FuncType>
+	void SerializeArray(FArchive& Ar, TArray<ItemType>& Items, FuncType&& SerializeItem)
+	{
+		int32 Num = Items.Num();
+		Ar << Num;
+		if (Ar.IsLoading())
+		{
+			if (Num < 0 || Num > Ar.TotalSize())
+			{
+				Ar.SetError();
+				return;
+			}
+			Items.SetNum(Num);
+		}
+		for (ItemType& Item : Items)
+		{
+			SerializeItem(Item);
+		}
+	}
+
+	void Serialize(FArchive& Ar, FBakedChunk& Baked)
+	{
+		SerializeArray(Ar, Baked.ExposureSamples, [&Ar](FStealthExposureSample& Sample)
+		{
+			Ar << Sample.Location << Sample.Exposure;
+		});
+		SerializeArray(Ar, Baked.Ledges, [&Ar](FStealthLedge& Ledge)
+		{
+			Ar << Ledge.Start << Ledge.End << Ledge.Normal;
+		});
+		SerializeArray(Ar, Baked.Climbables, [&Ar](FStealthClimbable& Climbable)
+		{
+			uint8 Type = static_cast<uint8>(Climbable.Type);
+			Ar << Climbable.Bottom << Climbable.Top << Climbable.Normal << Climbable.HalfWidth << Type;
+			Climbable.Type = static_cast<EClimbableType>(Type);
+		});
+		SerializeArray(Ar, Baked.Portals, [&Ar](FStealthPortal& Portal)
+		{
+			Ar << Portal.Location << Portal.Extent << Portal.DoorId;
+		});
+	}
+
+	FString GetCachePath(const FString& CacheDir, uint64 Hash)
+	{
+		return CacheDir / FString::Printf(TEXT("%016llx.sbk"), Hash);
+	}
+
+	bool LoadFromCache(const FString& CacheDir, uint64 Hash, FBakedChunk& Out)
+	{
+		TArray<uint8> Data;
+		if (!FFileHelper::LoadFileToArray(Data, *GetCachePath(CacheDir, Hash), FILEREAD_Silent))
+		{
+			return false;
+		}
+
+		FMemoryReader Reader(Data);
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		uint64 StoredHash = 0;
+		Reader << Magic << Version << StoredHash;
+		if (Reader.IsError() || Magic != CacheMagic || Version != BakeVersion || StoredHash != Hash)
+		{
+			return false;
+		}
+
+		Serialize(Reader, Out);
+		return !Reader.IsError() && Reader.AtEnd();
+	}
+
+	void SaveToCache(const FString& CacheDir, uint64 Hash, FBakedChunk& Baked)
+	{
+		TArray<uint8> Data;
+		FMemoryWriter Writer(Data);
+		uint32 Magic = CacheMagic;
+		uint32 Version = BakeVersion;
+		Writer << Magic << Version << Hash;
+		Serialize(Writer, Baked);
+
+		// Written aside and moved in, so an interrupted bake never leaves a truncated entry under a valid name
+		const FString TempPath = FPaths::CreateTempFilename(*CacheDir, TEXT("Bake"), TEXT(".tmp"));
+		if (!FFileHelper::SaveArrayToFile(Data, *TempPath) || !IFileManager::Get().Move(*GetCachePath(CacheDir, Hash), *TempPath, true))
+		{
+			IFileManager::Get().Delete(*TempPath, false, false, true);
+			UE_LOG(LogTemp, Warning, TEXT("StealthBake: could not write cache entry %016llx"), Hash);
+		}
+	}
+
+	void BakeExposure(const UWorld* World, const FChunk& Chunk, FBakedChunk& Out)
+	{
+		if (Chunk.Lights.Num() == 0)
+		{
+			// Nothing reaches the chunk; missing samples read as dark
+			return;
+		}
+
+		// One sample per streaming exposure cell, at the capsule centre above a floor point inside a polygon
+		const float CellSize = UStealthStreamingSubsystem::ExposureCellSize;
+		TSet<FIntVector> Keys;
+		TArray<FStealthExposureQuery> Queries;
+		for (int32 PolyIndex = 0; PolyIndex + 1 < Chunk.VertStarts.Num(); ++PolyIndex)
+		{
+			const TConstArrayView<FVector> Verts(Chunk.Verts.GetData() + Chunk.VertStarts[PolyIndex], Chunk.VertStarts[PolyIndex + 1] - Chunk.VertStarts[PolyIndex]);
+			const FBox Bounds(Verts.GetData(), Verts.Num());
+			const FVector Normal = FVector::CrossProduct(Verts[1] - Verts[0], Verts[2] - Verts[0]);
+			if (FMath::Abs(Normal.Z) <= KINDA_SMALL_NUMBER)
+			{
+				continue;
+			}
+
+			for (int32 X = FMath::FloorToInt(Bounds.Min.X / CellSize); X <= FMath::FloorToInt(Bounds.Max.X / CellSize); ++X)
+			{
+				for (int32 Y = FMath::FloorToInt(Bounds.Min.Y / CellSize); Y <= FMath::FloorToInt(Bounds.Max.Y / CellSize); ++Y)
+				{
+					const float CenterX = (X + 0.5f) * CellSize;
+					const float CenterY = (Y + 0.5f) * CellSize;
+					if (!StealthNavPoly::IsInside2D(Verts, CenterX, CenterY))
+					{
+						continue;
+					}
+
+					const float FloorZ = Verts[0].Z - (Normal.X * (CenterX - Verts[0].X) + Normal.Y * (CenterY - Verts[0].Y)) / Normal.Z;
+					const FVector Center(CenterX, CenterY, FloorZ + StandingHalfHeight);
+					bool bAlreadyInSet = false;
+					Keys.Add(UStealthStreamingSubsystem::ExposureKey(Center), &bAlreadyInSet);
+					if (!bAlreadyInSet)
+					{
+						Queries.AddDefaulted_GetRef().Center = Center;
+					}
+				}
+			}
+		}
+
+		FStealthExposureSource Source;
+		Source.World = World;
+		Source.Lights = Chunk.Lights;
+
+		TArray<float> Exposure;
+		Exposure.SetNumUninitialized(Queries.Num());
+		StealthExposure::EvaluateQueries(Source, EStealthExposureLayout::Center, Queries, Exposure);
+
+		Out.ExposureSamples.Reserve(Queries.Num());
+		for (int32 Index = 0; Index < Queries.Num(); ++Index)
+		{
+			FStealthExposureSample& Sample = Out.ExposureSamples.AddDefaulted_GetRef();
+			Sample.Location = Queries[Index].Center;
+			Sample.Exposure = static_cast<uint8>(FMath::RoundToInt(FMath::Clamp(Exposure[Index], 0.0f, 1.0f) * 255.0f));
+		}
+	}
+
+	void BakeLedges(const UWorld* World, const FChunk& Chunk, FBakedChunk& Out)
+	{
+		for (int32 PolyIndex = 0; PolyIndex + 1 < Chunk.VertStarts.Num(); ++PolyIndex)
+		{
+			const int32 First = Chunk.VertStarts[PolyIndex];
+			const int32 NumVerts = Chunk.VertStarts[PolyIndex + 1] - First;
+			FVector PolyCenter = FVector::ZeroVector;
+			for (int32 Vert = 0; Vert < NumVerts; ++Vert)
+			{
+				PolyCenter += Chunk.Verts[First + Vert] / NumVerts;
+			}
+
+			for (int32 Vert = 0; Vert < NumVerts; ++Vert)
+			{
+				if (!Chunk.Boundary[First + Vert])
+				{
+					continue;
+				}
+
+				const FVector& A = Chunk.Verts[First + Vert];
+				const FVector& B = Chunk.Verts[First + (Vert + 1) % NumVerts];
+				const FVector Edge = (B - A).GetSafeNormal2D();
+				if (FVector::Dist2D(A, B) < MinLedgeLength)
+				{
+					continue;
+				}
+
+				// Outward: perpendicular to the edge, away from the polygon
+				const FVector Mid = (A + B) * 0.5f;
+				FVector Out2D(Edge.Y, -Edge.X, 0.0f);
+				if (FVector::DotProduct(Out2D, Mid - PolyCenter) < 0.0f)
+				{
+					Out2D = -Out2D;
+				}
+
+				const FVector ProbeStart = Mid + Out2D * LedgeProbeOut + FVector(0.0f, 0.0f, 10.0f);
+				const FVector ProbeEnd = ProbeStart - FVector(0.0f, 0.0f, MaxLedgeDrop + 10.0f);
+				FHitResult Hit;
+				if (!World->LineTraceSingleByChannel(Hit, ProbeStart, ProbeEnd, ECC_WorldStatic))
+				{
+					continue;
+				}
+
+				const float Drop = Mid.Z - Hit.ImpactPoint.Z;
+				if (Drop >= MinLedgeDrop && Drop <= MaxLedgeDrop)
+				{
+					FStealthLedge& Ledge = Out.Ledges.AddDefaulted_GetRef();
+					Ledge.Start = A;
+					Ledge.End = B;
+					Ledge.Normal = Out2D;
+				}
+			}
+		}
+	}
+
+	void BakeChunk(const UWorld* World, const FChunk& Chunk, FBakedChunk& Out)
+	{
+		BakeExposure(World, Chunk, Out);
+		BakeLedges(World, Chunk, Out);
+		Out.Climbables = Chunk.Climbables;
+		Out.Portals = Chunk.Portals;
+	}
+
+	// Everything the chunk's bake reads, so equal hashes mean equal results
+	uint64 HashChunk(uint64 SettingsHash, const FChunk& Chunk, const StealthBake::FOccluderIndex& Occluders)
+	{
+		FBox Reach = Chunk.Bounds.ExpandBy(FVector(LedgeProbeOut, LedgeProbeOut, 0.0f));
+		Reach.Max.Z += StandingHalfHeight;
+		Reach.Min.Z -= MaxLedgeDrop + 10.0f;
+
+		TArray<uint32> LightHashes;
+		FBox Region = Reach;
+		for (const FStealthLight& Light : Chunk.Lights)
+		{
+			LightHashes.Add(StealthBake::HashLight(Light));
+			Region += Light.Location;
+		}
+		// Sorted so the hash doesn't depend on actor iteration order
+		LightHashes.Sort();
+		const uint32 OccluderHash = Occluders.HashRegion(Region);
+
+		FXxHash64Builder Builder;
+		Builder.Update(&SettingsHash, sizeof(SettingsHash));
+		Builder.Update(Chunk.Verts.GetData(), Chunk.Verts.Num() * sizeof(FVector));
+		Builder.Update(Chunk.VertStarts.GetData(), Chunk.VertStarts.Num() * sizeof(int32));
+		Builder.Update(Chunk.Boundary.GetData(), Chunk.Boundary.Num());
+		Builder.Update(LightHashes.GetData(), LightHashes.Num() * sizeof(uint32));
+		Builder.Update(&OccluderHash, sizeof(OccluderHash));
+		for (const FStealthPortal& Portal : Chunk.Portals)
+		{
+			Builder.Update(&Portal.Location, sizeof(Portal.Location));
+			Builder.Update(&Portal.Extent, sizeof(Portal.Extent));
+			Builder.Update(&Portal.DoorId, sizeof(Portal.DoorId));
+		}
+		for (const FStealthClimbable& Climbable : Chunk.Climbables)
+		{
+			const uint8 Type = static_cast<uint8>(Climbable.Type);
+			Builder.Update(&Climbable.Bottom, sizeof(Climbable.Bottom));
+			Builder.Update(&Climbable.Top, sizeof(Climbable.Top));
+			Builder.Update(&Climbable.Normal, sizeof(Climbable.Normal));
+			Builder.Update(&Climbable.HalfWidth, sizeof(Climbable.HalfWidth));
+			Builder.Update(&Type, sizeof(Type));
+		}
+		return Builder.Finalize().Hash;
+	}
+
+	bool SavePackageFile(UPackage* Package, UObject* Asset, const FString& Extension)
+	{
+		FSavePackageArgs SaveArgs;
+		SaveArgs.TopLevelFlags = Asset ? RF_Public | RF_Standalone : RF_NoFlags;
+		SaveArgs.SaveFlags = SAVE_NoError;
+		const FString Filename = FPackageName::LongPackageNameToFilename(Package->GetName(), Extension);
+		return UPackage::SavePackage(Package, Asset, *Filename, SaveArgs);
+	}
+
+	bool SaveCellAsset(const FString& PackageName, uint64 Hash, FBakedChunk& Baked)
+	{
+		UPackage* Package = CreatePackage(*PackageName);
+		Package->FullyLoad();
+
+		const FString AssetName = FPackageName::GetShortName(PackageName);
+		UStealthCellData* Data = FindObject<UStealthCellData>(Package, *AssetName);
+		if (!Data)
+		{
+			Data = NewObject<UStealthCellData>(Package, *AssetName, RF_Public | RF_Standalone);
+		}
+		Data->ExposureSamples = MoveTemp(Baked.ExposureSamples);
+		Data->Ledges = MoveTemp(Baked.Ledges);
+		Data->Climbables = MoveTemp(Baked.Climbables);
+		Data->Portals = MoveTemp(Baked.Portals);
+		Data->BakeHash = Hash;
+		Package->MarkPackageDirty();
+
+		return SavePackageFile(Package, Data, FPackageName::GetAssetPackageExtension());
+	}
+
+	// Deletes the cell assets under CellDir (the map's output folder) that no chunk in Cells produces any more
+	int32 DeleteStaleAssets(const FString& CellDir, const TMap<FString, FVector>& Cells)
+	{
+		FString Directory;
+		if (!FPackageName::TryConvertLongPackageNameToFilename(CellDir / TEXT(""), Directory))
+		{
+			return 0;
+		}
+
+		TArray<FString> Files;
+		IFileManager::Get().FindFiles(Files, *(Directory / TEXT("SC_*") + FPackageName::GetAssetPackageExtension()), true, false);
+
+		int32 NumDeleted = 0;
+		for (const FString& File : Files)
+		{
+			const FString PackageName = CellDir / FPaths::GetBaseFilename(File);
+			if (Cells.Contains(PackageName))
+			{
+				continue;
+			}
+			if (UPackage* Loaded = FindPackage(nullptr, *PackageName))
+			{
+				ResetLoaders(Loaded);
+			}
+			if (IFileManager::Get().Delete(*(Directory / File), false, true, true))
+			{
+				++NumDeleted;
+			}
+			else
+			{
+				UE_LOG(LogTemp, Warning, TEXT("StealthBake: could not delete stale %s"), *PackageName);
+			}
+		}
+		return NumDeleted;
+	}
+
+#if WITH_EDITOR
+	/**
+	 * Makes the level hold exactly one AStealthCellDataActor per chunk, at the chunk centre and pointing at its asset,
+	 * so the cells stream with the level. Actors of chunks that no longer exist, and duplicates, are removed. Actors
+	 * pointing anywhere outside CellPrefix were placed by hand and are left alone. Changed packages are saved.
+	 */
+	bool SyncCellActors(UWorld* World, const TMap<FString, FVector>& Cells, const FString& CellPrefix, int32& OutSpawned, int32& OutMoved, int32& OutRemoved)
+	{
+		TSet<FString> Placed;
+		TArray<FString> RemovedFiles;
+		bool bLevelDirty = false;
+		bool bSaved = true;
+
+		// Actors with their own package (one file per actor) are saved on their own, the rest with the map
+		auto SaveActor = [&](AStealthCellDataActor* Actor)
+		{
+			if (UPackage* ActorPackage = Actor->GetExternalPackage())
+			{
+				bSaved &= SavePackageFile(ActorPackage, nullptr, FPackageName::GetAssetPackageExtension());
+			}
+			else
+			{
+				bLevelDirty = true;
+			}
+		};
+
+		auto Visit = [&](AStealthCellDataActor* Actor)
+		{
+			const FString PackageName = Actor->CellData.ToSoftObjectPath().GetLongPackageName();
+			if (!PackageName.StartsWith(CellPrefix))
+			{
+				return;
+			}
+
+			const FVector* Location = Cells.Find(PackageName);
+			bool bAlreadyPlaced = false;
+			if (Location)
+			{
+				Placed.Add(PackageName, &bAlreadyPlaced);
+			}
+			if (!Location || bAlreadyPlaced)
+			{
+				if (UPackage* ActorPackage = Actor->GetExternalPackage())
+				{
+					RemovedFiles.Add(FPackageName::LongPackageNameToFilename(ActorPackage->GetName(), FPackageName::GetAssetPackageExtension()));
+				}
+				else
+				{
+					World->DestroyActor(Actor);
+					bLevelDirty = true;
+				}
+				++OutRemoved;
+				return;
+			}
+
+			if (!Actor->GetActorLocation().Equals(*Location, 1.0f))
+			{
+				Actor->SetActorLocation(*Location);
+				SaveActor(Actor);
+				++OutMoved;
+			}
+		};
+
+		// World Partition keeps most actors unloaded; every cell-data actor has to be seen or it would be placed twice
+		if (UWorldPartition* WorldPartition = World->GetWorldPartition())
+		{
+			FWorldPartitionHelpers::ForEachActorWithLoading(WorldPartition, AStealthCellDataActor::StaticClass(), [&Visit](const FWorldPartitionActorDescInstance* ActorDesc)
+			{
+				if (AStealthCellDataActor* Actor = Cast<AStealthCellDataActor>(ActorDesc->GetActor()))
+				{
+					Visit(Actor);
+				}
+				return true;
+			});
+		}
+		else
+		{
+			TArray<AStealthCellDataActor*> Actors;
+			for (TActorIterator<AStealthCellDataActor> It(World); It; ++It)
+			{
+				Actors.Add(*It);
+			}
+			for (AStealthCellDataActor* Actor : Actors)
+			{
+				Visit(Actor);
+			}
+		}
+
+		for (const FString& File : RemovedFiles)
+		{
+			bSaved &= IFileManager::Get().Delete(*File, false, true, true);
+		}
+
+		for (const TPair<FString, FVector>& Cell : Cells)
+		{
+			if (Placed.Contains(Cell.Key))
+			{
+				continue;
+			}
+
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.OverrideLevel = World->PersistentLevel;
+			AStealthCellDataActor* Actor = World->SpawnActor<AStealthCellDataActor>(Cell.Value, FRotator::ZeroRotator, SpawnParams);
+			if (!Actor)
+			{
+				bSaved = false;
+				continue;
+			}
+			const FString AssetName = FPackageName::GetShortName(Cell.Key);
+			Actor->CellData = TSoftObjectPtr<UStealthCellData>(FSoftObjectPath(Cell.Key + TEXT(".") + AssetName));
+			Actor->SetActorLabel(AssetName);
+			SaveActor(Actor);
+			++OutSpawned;
+		}
+
+		if (bLevelDirty)
+		{
+			bSaved &= SavePackageFile(World->GetOutermost(), World, FPackageName::GetMapPackageExtension());
+		}
+		return bSaved;
+	}
+#endif
+}
+
+UStealthBakeCommandlet::UStealthBakeCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UStealthBakeCommandlet::Main(const FString& Params)
+{
+	using namespace StealthCellBake;
+
+	FString MapName;
+	FString CacheDir = FPaths::ProjectSavedDir() / TEXT("StealthBakeCache");
+	FString OutputPath = TEXT("/Game/StealthData");
+	float ChunkSize = 3200.0f;
+	FParse::Value(*Params, TEXT("Map="), MapName);
+	FParse::Value(*Params, TEXT("Cache="), CacheDir);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	FParse::Value(*Params, TEXT("ChunkSize="), ChunkSize);
+	const bool bFull = FParse::Param(*Params, TEXT("Full"));
+	ChunkSize = FMath::Max(ChunkSize, UStealthStreamingSubsystem::ExposureCellSize * 4.0f);
+
+	if (MapName.IsEmpty())
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthBake: pass the level to bake with -Map=/Game/Maps/<Map>"));
+		return 1;
+	}
+	if (!FPackageName::IsValidLongPackageName(OutputPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthBake: -Output must be a content path such as /Game/StealthData, not %s"), *OutputPath);
+		return 1;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	UWorld* World = StealthBake::LoadWorld(MapName);
+	if (!World)
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthBake: could not load %s"), *MapName);
+		return 1;
+	}
+
+	const ARecastNavMesh* NavMesh = StealthBake::FindNavMesh(World);
+	if (!NavMesh)
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthBake: %s has no built navmesh"), *MapName);
+		StealthBake::ReleaseWorld(World);
+		return 1;
+	}
+
+	TArray<FStealthLight> Lights;
+	StealthBake::GatherLights(World, Lights);
+	// Exposure traces Visibility, the ledge probes WorldStatic
+	StealthBake::FOccluderIndex Occluders;
+	Occluders.Build(World, { ECC_Visibility, ECC_WorldStatic });
+
+	// Sort every input into its chunk. Navmesh and actor reads stay on this thread; everything after works on the copies.
+	TArray<FChunk> Chunks;
+	TMap<FIntPoint, int32> ChunkIndices;
+	auto FindOrAddChunk = [&Chunks, &ChunkIndices, ChunkSize](const FVector& Location) -> FChunk&
+	{
+		const FIntPoint Coord = GetChunk(Location, ChunkSize);
+		if (const int32* Index = ChunkIndices.Find(Coord))
+		{
+			return Chunks[*Index];
+		}
+		ChunkIndices.Add(Coord, Chunks.Num());
+		FChunk& Chunk = Chunks.AddDefaulted_GetRef();
+		Chunk.Coord = Coord;
+		return Chunk;
+	};
+
+	TArray<FNavPoly> Polys;
+	TArray<FVector> PolyVerts;
+	TArray<FNavigationPortalEdge> Neighbors;
+	for (int32 TileIndex = 0; TileIndex < NavMesh->GetNavMeshTilesCount(); ++TileIndex)
+	{
+		Polys.Reset();
+		NavMesh->GetPolysInTile(TileIndex, Polys);
+		for (const FNavPoly& Poly : Polys)
+		{
+			PolyVerts.Reset();
+			if (!NavMesh->GetPolyVerts(Poly.Ref, PolyVerts) || PolyVerts.Num() < 3)
+			{
+				continue;
+			}
+			Neighbors.Reset();
+			NavMesh->GetPolyNeighbors(Poly.Ref, Neighbors);
+
+			FChunk& Chunk = FindOrAddChunk(Poly.Center);
+			Chunk.VertStarts.Add(Chunk.Verts.Num());
+			for (int32 Vert = 0; Vert < PolyVerts.Num(); ++Vert)
+			{
+				// An edge shared with a neighbouring polygon has both ends on one of its portal edges
+				const FVector& A = PolyVerts[Vert];
+				const FVector& B = PolyVerts[(Vert + 1) % PolyVerts.Num()];
+				const bool bShared = Neighbors.ContainsByPredicate([&A, &B](const FNavigationPortalEdge& Portal)
+				{
+					return FMath::PointDistToSegmentSquared(Portal.Left, A, B) < 1.0f && FMath::PointDistToSegmentSquared(Portal.Right, A, B) < 1.0f;
+				});
+				Chunk.Boundary.Add(bShared ? 0 : 1);
+			}
+			Chunk.Verts.Append(PolyVerts);
+			Chunk.Bounds += FBox(PolyVerts);
+		}
+	}
+	for (FChunk& Chunk : Chunks)
+	{
+		Chunk.VertStarts.Add(Chunk.Verts.Num());
+	}
+
+	for (TActorIterator<ADoor> It(World); It; ++It)
+	{
+		const FBox DoorBounds = It->GetComponentsBoundingBox();
+		FChunk& Chunk = FindOrAddChunk(It->GetActorLocation());
+		FStealthPortal& Portal = Chunk.Portals.AddDefaulted_GetRef();
+		Portal.Location = DoorBounds.GetCenter();
+		Portal.Extent = DoorBounds.GetExtent();
+		Portal.DoorId = UStealthStreamingSubsystem::GetDoorId(*It);
+		Chunk.Bounds += DoorBounds;
+	}
+
+	TArray<UClimbableSurfaceComponent*> ClimbableComponents;
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		It->GetComponents<UClimbableSurfaceComponent>(ClimbableComponents);
+		for (const UClimbableSurfaceComponent* Component : ClimbableComponents)
+		{
+			const FClimbableSurface Surface = Component->GetSurface();
+			FChunk& Chunk = FindOrAddChunk(Surface.Bottom);
+			FStealthClimbable& Climbable = Chunk.Climbables.AddDefaulted_GetRef();
+			Climbable.Bottom = Surface.Bottom;
+			Climbable.Top = Surface.Top;
+			Climbable.Normal = Surface.Normal;
+			Climbable.HalfWidth = Surface.HalfWidth;
+			Climbable.Type = Surface.Type;
+			Chunk.Bounds += Surface.Bottom;
+			Chunk.Bounds += Surface.Top;
+		}
+	}
+
+	// Anything that changes the bake for every chunk
+	const float SettingsValues[] = { static_cast<float>(BakeVersion), ChunkSize, UStealthStreamingSubsystem::ExposureCellSize, StealthExposure::ReferenceIntensity,
+		StandingHalfHeight, LedgeProbeOut, MinLedgeDrop, MaxLedgeDrop, MinLedgeLength };
+	const uint64 SettingsHash = FXxHash64::HashBuffer(SettingsValues, sizeof(SettingsValues)).Hash;
+
+	ParallelFor(Chunks.Num(), [&](int32 Index)
+	{
+		FChunk& Chunk = Chunks[Index];
+		FBox Reach = Chunk.Bounds;
+		Reach.Max.Z += StandingHalfHeight;
+		for (const FStealthLight& Light : Lights)
+		{
+			if (FMath::SphereAABBIntersection(Light.Location, FMath::Square(Light.Radius), Reach))
+			{
+				Chunk.Lights.Add(Light);
+			}
+		}
+		Chunk.Hash = HashChunk(SettingsHash, Chunk, Occluders);
+	});
+
+	// Assets that were saved from the same inputs are left alone
+	const FString MapShortName = FPackageName::GetShortName(MapName);
+	auto GetPackageName = [&OutputPath, &MapShortName](const FChunk& Chunk)
+	{
+		return OutputPath / MapShortName / FString::Printf(TEXT("SC_%d_%d"), Chunk.Coord.X, Chunk.Coord.Y);
+	};
+
+	TArray<int32> Stale;
+	for (int32 Index = 0; Index < Chunks.Num(); ++Index)
+	{
+		FChunk& Chunk = Chunks[Index];
+		const FString PackageName = GetPackageName(Chunk);
+		if (!bFull && FPackageName::DoesPackageExist(PackageName))
+		{
+			const FString ObjectPath = PackageName + TEXT(".") + FPackageName::GetShortName(PackageName);
+			const UStealthCellData* Existing = LoadObject<UStealthCellData>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn | LOAD_Quiet);
+			Chunk.bUpToDate = Existing && Existing->BakeHash == Chunk.Hash;
+		}
+		if (!Chunk.bUpToDate)
+		{
+			Stale.Add(Index);
+		}
+	}
+
+	// Stale chunks come out of the cache when their inputs were baked before (on any branch, or before an undo); the rest
+	// are rebaked in parallel. Chunks are independent and the traces are scene reads.
+	const double BakeStartTime = FPlatformTime::Seconds();
+	IFileManager::Get().MakeDirectory(*CacheDir, true);
+	TArray<FBakedChunk> Baked;
+	Baked.SetNum(Stale.Num());
+	ParallelFor(Stale.Num(), [&](int32 Index)
+	{
+		FChunk& Chunk = Chunks[Stale[Index]];
+		if (!bFull && LoadFromCache(CacheDir, Chunk.Hash, Baked[Index]))
+		{
+			Chunk.bCacheHit = true;
+			return;
+		}
+
+		Baked[Index] = FBakedChunk();
+		BakeChunk(World, Chunk, Baked[Index]);
+		SaveToCache(CacheDir, Chunk.Hash, Baked[Index]);
+	});
+	const double BakeSeconds = FPlatformTime::Seconds() - BakeStartTime;
+
+	int32 NumCacheHits = 0;
+	int32 NumSaved = 0;
+	int32 NumFailed = 0;
+	for (int32 Index = 0; Index < Stale.Num(); ++Index)
+	{
+		const FChunk& Chunk = Chunks[Stale[Index]];
+		NumCacheHits += Chunk.bCacheHit ? 1 : 0;
+		if (SaveCellAsset(GetPackageName(Chunk), Chunk.Hash, Baked[Index]))
+		{
+			++NumSaved;
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("StealthBake: failed to save %s"), *GetPackageName(Chunk));
+			++NumFailed;
+		}
+	}
+
+	// The level streams the cells through one actor per chunk; chunks that are gone lose their actor and their asset
+	TMap<FString, FVector> Cells;
+	for (const FChunk& Chunk : Chunks)
+	{
+		const FVector Center((Chunk.Coord.X + 0.5f) * ChunkSize, (Chunk.Coord.Y + 0.5f) * ChunkSize, Chunk.Bounds.GetCenter().Z);
+		Cells.Add(GetPackageName(Chunk), Center);
+	}
+
+	const FString CellDir = OutputPath / MapShortName;
+	int32 NumSpawned = 0;
+	int32 NumMoved = 0;
+	int32 NumRemoved = 0;
+#if WITH_EDITOR
+	if (!SyncCellActors(World, Cells, CellDir / TEXT("SC_"), NumSpawned, NumMoved, NumRemoved))
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthBake: failed to save the cell-data actors of %s"), *MapName);
+		++NumFailed;
+	}
+#endif
+	const int32 NumDeleted = DeleteStaleAssets(CellDir, Cells);
+
+	UE_LOG(LogTemp, Display, TEXT("StealthBake: %s: %d chunks, %d up to date, %d cache hits, %d rebaked in %.2f s, %d assets saved to %s; %d lights, %d occluders; %.2f s total"),
+		*MapName, Chunks.Num(), Chunks.Num() - Stale.Num(), NumCacheHits, Stale.Num() - NumCacheHits, BakeSeconds, NumSaved, *CellDir,
+		Lights.Num(), Occluders.Num(), FPlatformTime::Seconds() - StartTime);
+	UE_LOG(LogTemp, Display, TEXT("StealthBake: cell-data actors %d placed, %d moved, %d removed; %d stale assets deleted"),
+		NumSpawned, NumMoved, NumRemoved, NumDeleted);
+
+	StealthBake::ReleaseWorld(World);
+	return NumFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthCellData.h"
+#include "Stealth/StealthStreamingSubsystem.h"
+#include "Engine/AssetManager.h"
+#include "Engine/World.h"
+
+AStealthCellDataActor::AStealthCellDataActor()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+
+#if WITH_EDITORONLY_DATA
+	// Streams with the World Partition cell it is placed in
+	bIsSpatiallyLoaded = true;
+#endif
+}
+
+void AStealthCellDataActor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (CellData.IsNull())
+	{
+		return;
+	}
+
+	// Loads on the async loading thread; nothing blocks the game thread
+	LoadHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(CellData.ToSoftObjectPath(),
+		FStreamableDelegate::CreateUObject(this, &AStealthCellDataActor::OnCellDataLoaded));
+}
+
+void AStealthCellDataActor::OnCellDataLoaded()
+{
+	if (UStealthStreamingSubsystem* Streaming = GetWorld()->GetSubsystem<UStealthStreamingSubsystem>())
+	{
+		Streaming->AddCell(this, CellData.Get());
+	}
+}
+
+void AStealthCellDataActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Cancel the cell before dropping the asset, a worker may still be reading it
+	if (UStealthStreamingSubsystem* Streaming = GetWorld()->GetSubsystem<UStealthStreamingSubsystem>())
+	{
+		Streaming->RemoveCell(this);
+	}
+
+	if (LoadHandle.IsValid())
+	{
+		LoadHandle->CancelHandle();
+		LoadHandle.Reset();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
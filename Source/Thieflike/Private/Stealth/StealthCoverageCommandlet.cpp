@@ -0,0 +1,388 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthCoverageCommandlet.h"
+#include "Stealth/StealthBake.h"
+#include "Stealth/StealthExposure.h"
+#include "Stealth/StealthNavPoly.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "NavMesh/RecastNavMesh.h"
+
+namespace StealthCoverage
+{
+	// Capsule half-heights of APlayerCharacter; exposure is read at the capsule centre like UpdateVisibility does
+	constexpr float StandingHalfHeight = 88.0f;
+	constexpr float CrouchedHalfHeight = 44.0f;
+
+	struct FTile
+	{
+		int32 TileIndex = INDEX_NONE;
+		FIntVector Coord = FIntVector::ZeroValue;
+		FBox Bounds = FBox(ForceInit);
+
+		// Polygons of the tile; the verts of polygon N are Verts[VertStarts[N]..VertStarts[N + 1])
+		TArray<FNavPoly> Polys;
+		TArray<FVector> Verts;
+		TArray<int32> VertStarts;
+
+		// Lights whose radius reaches the tile
+		TArray<FStealthLight> Lights;
+
+		uint32 InputHash = 0;
+		bool bReused = false;
+		TArray<FStealthCoveragePoly> Records;
+	};
+
+	struct FPrevious
+	{
+		TArray<uint8> Data;
+		TMap<FIntVector, const FStealthCoverageTile*> Tiles;
+		const FStealthCoveragePoly* Polys = nullptr;
+	};
+
+	float Area2D(TConstArrayView<FVector> Verts)
+	{
+		float Twice = 0.0f;
+		for (int32 Index = 0; Index < Verts.Num(); ++Index)
+		{
+			const FVector& A = Verts[Index];
+			const FVector& B = Verts[(Index + 1) % Verts.Num()];
+			Twice += A.X * B.Y - B.X * A.Y;
+		}
+		return FMath::Abs(Twice) * 0.5f;
+	}
+
+	uint8 Quantize(float Exposure)
+	{
+		return static_cast<uint8>(FMath::RoundToInt(FMath::Clamp(Exposure, 0.0f, 1.0f) * 255.0f));
+	}
+
+	void LoadPrevious(const FString& Path, FPrevious& Out)
+	{
+		FStealthCoverageHeader Header;
+		if (!FFileHelper::LoadFileToArray(Out.Data, *Path, FILEREAD_Silent) || Out.Data.Num() < static_cast<int32>(sizeof(Header)))
+		{
+			return;
+		}
+
+		FMemory::Memcpy(&Header, Out.Data.GetData(), sizeof(Header));
+		const int64 ExpectedSize = sizeof(Header) + static_cast<int64>(Header.NumTiles) * sizeof(FStealthCoverageTile) + static_cast<int64>(Header.NumPolys) * sizeof(FStealthCoveragePoly);
+		if (!Header.IsValid() || Header.StandingHalfHeight != StandingHalfHeight || Header.CrouchedHalfHeight != CrouchedHalfHeight || Out.Data.Num() != ExpectedSize)
+		{
+			UE_LOG(LogTemp, Display, TEXT("StealthCoverage: %s is from another version, re-sampling everything"), *Path);
+			return;
+		}
+
+		const FStealthCoverageTile* Tiles = reinterpret_cast<const FStealthCoverageTile*>(Out.Data.GetData() + sizeof(Header));
+		Out.Polys = reinterpret_cast<const FStealthCoveragePoly*>(Tiles + Header.NumTiles);
+		for (uint32 Index = 0; Index < Header.NumTiles; ++Index)
+		{
+			const FStealthCoverageTile& Tile = Tiles[Index];
+			if (Tile.FirstPoly >= 0 && Tile.NumPolys >= 0 && static_cast<int64>(Tile.FirstPoly) + Tile.NumPolys <= Header.NumPolys)
+			{
+				Out.Tiles.Add(FIntVector(Tile.X, Tile.Y, Tile.Layer), &Tile);
+			}
+		}
+	}
+
+	void SampleTile(const UWorld* World, float Spacing, FTile& Tile)
+	{
+		FStealthExposureSource Source;
+		Source.World = World;
+		Source.Lights = Tile.Lights;
+
+		// Standing and crouched capsule centres of every floor sample, interleaved, evaluated as one batch per polygon
+		TArray<FStealthExposureQuery> Queries;
+		TArray<float> Exposure;
+
+		Tile.Records.SetNum(Tile.Polys.Num());
+		for (int32 PolyIndex = 0; PolyIndex < Tile.Polys.Num(); ++PolyIndex)
+		{
+			const TConstArrayView<FVector> Verts(Tile.Verts.GetData() + Tile.VertStarts[PolyIndex], Tile.VertStarts[PolyIndex + 1] - Tile.VertStarts[PolyIndex]);
+			FStealthCoveragePoly& Record = Tile.Records[PolyIndex];
+
+			Queries.Reset();
+			auto Sample = [&Queries](const FVector& Floor)
+			{
+				Queries.AddDefaulted_GetRef().Center = Floor + FVector(0.0f, 0.0f, StandingHalfHeight);
+				Queries.AddDefaulted_GetRef().Center = Floor + FVector(0.0f, 0.0f, CrouchedHalfHeight);
+			};
+
+			// Lights that can't reach the tile leave it dark without a single trace
+			if (Tile.Lights.Num() > 0)
+			{
+				// A grid of floor points inside the polygon, on the polygon's plane; small polygons get their centre only
+				const FBox Bounds(Verts.GetData(), Verts.Num());
+				const FVector Normal = FVector::CrossProduct(Verts[1] - Verts[0], Verts[2] - Verts[0]);
+				if (FMath::Abs(Normal.Z) > KINDA_SMALL_NUMBER)
+				{
+					for (int32 X = FMath::FloorToInt(Bounds.Min.X / Spacing); X <= FMath::FloorToInt(Bounds.Max.X / Spacing); ++X)
+					{
+						for (int32 Y = FMath::FloorToInt(Bounds.Min.Y / Spacing); Y <= FMath::FloorToInt(Bounds.Max.Y / Spacing); ++Y)
+						{
+							const float CenterX = (X + 0.5f) * Spacing;
+							const float CenterY = (Y + 0.5f) * Spacing;
+							if (StealthNavPoly::IsInside2D(Verts, CenterX, CenterY))
+							{
+								Sample(FVector(CenterX, CenterY, Verts[0].Z - (Normal.X * (CenterX - Verts[0].X) + Normal.Y * (CenterY - Verts[0].Y)) / Normal.Z));
+							}
+						}
+					}
+				}
+				if (Queries.Num() == 0)
+				{
+					Sample(Tile.Polys[PolyIndex].Center);
+				}
+			}
+
+			float Standing = 0.0f;
+			float Crouched = 0.0f;
+			const int32 NumSamples = Queries.Num() / 2;
+			Exposure.SetNumUninitialized(Queries.Num(), EAllowShrinking::No);
+			StealthExposure::EvaluateQueries(Source, EStealthExposureLayout::Center, Queries, Exposure);
+			for (int32 Index = 0; Index < NumSamples; ++Index)
+			{
+				Standing += Exposure[Index * 2];
+				Crouched += Exposure[Index * 2 + 1];
+			}
+
+			Record.PolyRef = Tile.Polys[PolyIndex].Ref;
+			Record.Center = FVector3f(Tile.Polys[PolyIndex].Center);
+			Record.Area = Area2D(Verts) / 10000.0f;
+			Record.Standing = NumSamples > 0 ? Quantize(Standing / NumSamples) : 0;
+			Record.Crouched = NumSamples > 0 ? Quantize(Crouched / NumSamples) : 0;
+		}
+	}
+}
+
+UStealthCoverageCommandlet::UStealthCoverageCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UStealthCoverageCommandlet::Main(const FString& Params)
+{
+	using namespace StealthCoverage;
+
+	FString MapName;
+	FString OutputDir = FPaths::ProjectSavedDir() / TEXT("StealthCoverage");
+	float Spacing = 100.0f;
+	float HiddenThreshold = 0.25f;
+	FParse::Value(*Params, TEXT("Map="), MapName);
+	FParse::Value(*Params, TEXT("Output="), OutputDir);
+	FParse::Value(*Params, TEXT("Spacing="), Spacing);
+	FParse::Value(*Params, TEXT("HiddenThreshold="), HiddenThreshold);
+	const bool bFull = FParse::Param(*Params, TEXT("Full"));
+	Spacing = FMath::Max(Spacing, 10.0f);
+	const uint8 HiddenByte = Quantize(HiddenThreshold);
+
+	if (MapName.IsEmpty())
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthCoverage: pass the level to audit with -Map=/Game/Maps/<Map>"));
+		return 1;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	UWorld* World = StealthBake::LoadWorld(MapName);
+	if (!World)
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthCoverage: could not load %s"), *MapName);
+		return 1;
+	}
+
+	const ARecastNavMesh* NavMesh = StealthBake::FindNavMesh(World);
+	if (!NavMesh)
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthCoverage: %s has no built navmesh"), *MapName);
+		StealthBake::ReleaseWorld(World);
+		return 1;
+	}
+
+	// Same light list and occluder set the game sees
+	TArray<FStealthLight> Lights;
+	StealthBake::GatherLights(World, Lights);
+	StealthBake::FOccluderIndex Occluders;
+	Occluders.Build(World, { ECC_Visibility });
+
+	// Navmesh reads stay on this thread; everything after works on the copies
+	TArray<FTile> Tiles;
+	int32 NumPolys = 0;
+	for (int32 TileIndex = 0; TileIndex < NavMesh->GetNavMeshTilesCount(); ++TileIndex)
+	{
+		FTile Tile;
+		if (!NavMesh->GetPolysInTile(TileIndex, Tile.Polys) || Tile.Polys.Num() == 0)
+		{
+			continue;
+		}
+		Tile.TileIndex = TileIndex;
+		NavMesh->GetNavMeshTileXY(TileIndex, Tile.Coord.X, Tile.Coord.Y, Tile.Coord.Z);
+
+		TArray<FVector> PolyVerts;
+		for (int32 PolyIndex = Tile.Polys.Num() - 1; PolyIndex >= 0; --PolyIndex)
+		{
+			PolyVerts.Reset();
+			if (!NavMesh->GetPolyVerts(Tile.Polys[PolyIndex].Ref, PolyVerts) || PolyVerts.Num() < 3)
+			{
+				Tile.Polys.RemoveAt(PolyIndex);
+			}
+		}
+		for (const FNavPoly& Poly : Tile.Polys)
+		{
+			PolyVerts.Reset();
+			NavMesh->GetPolyVerts(Poly.Ref, PolyVerts);
+			Tile.VertStarts.Add(Tile.Verts.Num());
+			Tile.Verts.Append(PolyVerts);
+			Tile.Bounds += FBox(PolyVerts);
+		}
+		Tile.VertStarts.Add(Tile.Verts.Num());
+
+		NumPolys += Tile.Polys.Num();
+		Tiles.Add(MoveTemp(Tile));
+	}
+
+	const FString OutputBase = OutputDir / FPackageName::GetShortName(MapName);
+	FPrevious Previous;
+	if (!bFull)
+	{
+		LoadPrevious(OutputBase + TEXT(".stcv"), Previous);
+	}
+
+	// Anything that changes the sampling invalidates every tile
+	const float SettingsValues[] = { Spacing, StealthExposure::ReferenceIntensity, StandingHalfHeight, CrouchedHalfHeight };
+	const uint32 SettingsHash = FCrc::MemCrc32(SettingsValues, sizeof(SettingsValues));
+
+	// A tile's exposure depends on its polygons, the lights reaching it and whatever can stand between the two
+	ParallelFor(Tiles.Num(), [&](int32 Index)
+	{
+		FTile& Tile = Tiles[Index];
+		FBox Reach = Tile.Bounds;
+		Reach.Max.Z += StandingHalfHeight;
+
+		TArray<uint32> LightHashes;
+		FBox Region = Reach;
+		for (const FStealthLight& Light : Lights)
+		{
+			if (FMath::SphereAABBIntersection(Light.Location, FMath::Square(Light.Radius), Reach))
+			{
+				Tile.Lights.Add(Light);
+				LightHashes.Add(StealthBake::HashLight(Light));
+				Region += Light.Location;
+			}
+		}
+
+		// Sorted so the hash doesn't depend on actor iteration order
+		LightHashes.Sort();
+		uint32 Hash = SettingsHash;
+		Hash = FCrc::MemCrc32(Tile.Verts.GetData(), Tile.Verts.Num() * sizeof(FVector), Hash);
+		Hash = FCrc::MemCrc32(Tile.VertStarts.GetData(), Tile.VertStarts.Num() * sizeof(int32), Hash);
+		Hash = FCrc::MemCrc32(LightHashes.GetData(), LightHashes.Num() * sizeof(uint32), Hash);
+		Hash = HashCombine(Hash, Occluders.HashRegion(Region));
+		Tile.InputHash = Hash;
+
+		const FStealthCoverageTile* const* PreviousTile = Previous.Tiles.Find(Tile.Coord);
+		if (PreviousTile && (*PreviousTile)->InputHash == Hash && (*PreviousTile)->NumPolys == Tile.Polys.Num())
+		{
+			// Same polygons, but refs carry the tile salt, so they are taken from the current navmesh
+			Tile.Records = TArray<FStealthCoveragePoly>(Previous.Polys + (*PreviousTile)->FirstPoly, (*PreviousTile)->NumPolys);
+			for (int32 PolyIndex = 0; PolyIndex < Tile.Records.Num(); ++PolyIndex)
+			{
+				Tile.Records[PolyIndex].PolyRef = Tile.Polys[PolyIndex].Ref;
+			}
+			Tile.bReused = true;
+		}
+	});
+
+	const double SampleStartTime = FPlatformTime::Seconds();
+	TArray<int32> Dirty;
+	for (int32 Index = 0; Index < Tiles.Num(); ++Index)
+	{
+		if (!Tiles[Index].bReused)
+		{
+			Dirty.Add(Index);
+		}
+	}
+
+	// Tiles are independent; the occlusion traces are scene reads
+	ParallelFor(Dirty.Num(), [&](int32 Index)
+	{
+		SampleTile(World, Spacing, Tiles[Dirty[Index]]);
+	});
+	const double SampleSeconds = FPlatformTime::Seconds() - SampleStartTime;
+
+	// Write the file and add up the coverage, weighting by floor area
+	FStealthCoverageHeader Header;
+	Header.NumTiles = Tiles.Num();
+	Header.NumPolys = NumPolys;
+	Header.StandingHalfHeight = StandingHalfHeight;
+	Header.CrouchedHalfHeight = CrouchedHalfHeight;
+
+	TArray<uint8> File;
+	File.Reserve(sizeof(Header) + Tiles.Num() * sizeof(FStealthCoverageTile) + NumPolys * sizeof(FStealthCoveragePoly));
+	File.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+
+	int32 FirstPoly = 0;
+	for (const FTile& Tile : Tiles)
+	{
+		FStealthCoverageTile Entry;
+		Entry.X = Tile.Coord.X;
+		Entry.Y = Tile.Coord.Y;
+		Entry.Layer = Tile.Coord.Z;
+		Entry.InputHash = Tile.InputHash;
+		Entry.FirstPoly = FirstPoly;
+		Entry.NumPolys = Tile.Records.Num();
+		File.Append(reinterpret_cast<const uint8*>(&Entry), sizeof(Entry));
+		FirstPoly += Tile.Records.Num();
+	}
+
+	double TotalArea = 0.0;
+	double HiddenStanding = 0.0;
+	double HiddenCrouched = 0.0;
+	double CrouchOnly = 0.0;
+	double Histogram[10] = {};
+	for (const FTile& Tile : Tiles)
+	{
+		File.Append(reinterpret_cast<const uint8*>(Tile.Records.GetData()), Tile.Records.Num() * sizeof(FStealthCoveragePoly));
+		for (const FStealthCoveragePoly& Record : Tile.Records)
+		{
+			TotalArea += Record.Area;
+			HiddenStanding += Record.Standing <= HiddenByte ? Record.Area : 0.0f;
+			HiddenCrouched += Record.Crouched <= HiddenByte ? Record.Area : 0.0f;
+			CrouchOnly += Record.Standing > HiddenByte && Record.Crouched <= HiddenByte ? Record.Area : 0.0f;
+			Histogram[FMath::Min(Record.Standing * 10 / 255, 9)] += Record.Area;
+		}
+	}
+
+	IFileManager::Get().MakeDirectory(*OutputDir, true);
+	if (!FFileHelper::SaveArrayToFile(File, *(OutputBase + TEXT(".stcv"))))
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthCoverage: failed to write %s.stcv"), *OutputBase);
+		StealthBake::ReleaseWorld(World);
+		return 1;
+	}
+
+	auto Percent = [TotalArea](double Area) { return TotalArea > 0.0 ? 100.0 * Area / TotalArea : 0.0; };
+	FString Summary = FString::Printf(TEXT("Map,%s\nPolygons,%d\nTiles,%d\nWalkableArea_m2,%.1f\nHiddenThreshold,%.2f\nHiddenStanding_Pct,%.1f\nHiddenCrouched_Pct,%.1f\nHiddenOnlyCrouched_Pct,%.1f\n"),
+		*MapName, NumPolys, Tiles.Num(), TotalArea, HiddenThreshold, Percent(HiddenStanding), Percent(HiddenCrouched), Percent(CrouchOnly));
+	Summary += TEXT("StandingExposure,Area_Pct\n");
+	for (int32 Bucket = 0; Bucket < UE_ARRAY_COUNT(Histogram); ++Bucket)
+	{
+		Summary += FString::Printf(TEXT("%.1f-%.1f,%.1f\n"), Bucket / 10.0f, (Bucket + 1) / 10.0f, Percent(Histogram[Bucket]));
+	}
+	FFileHelper::SaveStringToFile(Summary, *(OutputBase + TEXT("_Coverage.csv")));
+
+	UE_LOG(LogTemp, Display, TEXT("StealthCoverage: %s: %.0f m2 walkable, hidden standing %.1f%%, hidden crouched %.1f%%, hidden only when crouched %.1f%%"),
+		*MapName, TotalArea, Percent(HiddenStanding), Percent(HiddenCrouched), Percent(CrouchOnly));
+	UE_LOG(LogTemp, Display, TEXT("StealthCoverage: %d polygons in %d tiles, %d tiles re-sampled in %.2f s, %d unchanged; %d lights, %d occluders; %.2f s total, written to %s.stcv"),
+		NumPolys, Tiles.Num(), Dirty.Num(), SampleSeconds, Tiles.Num() - Dirty.Num(), Lights.Num(), Occluders.Num(), FPlatformTime::Seconds() - StartTime, *OutputBase);
+
+	StealthBake::ReleaseWorld(World);
+	return 0;
+}
@@ -0,0 +1,191 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthEventBus.h"
+#include "Thieflike.h"
+#include "Stealth/StealthMemory.h"
+#include "Stealth/StealthSettings.h"
+#include "Engine/World.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
+#include "Tasks/Task.h"
+
+DECLARE_CYCLE_STAT(TEXT("EventBus Drain"), STAT_StealthEventBusDrain, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("EventBus Events"), STAT_StealthEventBusEvents, STATGROUP_Stealth);
+
+int32 FStealthEventRings::RegisterProducer(FName DebugName, uint32 Capacity)
+{
+	check(IsInGameThread());
+	LLM_SCOPE_BYTAG(Stealth_EventBus);
+
+	const int32 Index = NumRings.load(std::memory_order_relaxed);
+	if (Index >= MaxProducers)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StealthEventBus: producer limit reached, can't register %s"), *DebugName.ToString());
+		return INDEX_NONE;
+	}
+	Rings[Index] = MakeUnique<FProducerRing>(DebugName, Capacity);
+	NumRings.store(Index + 1, std::memory_order_release);
+	return Index;
+}
+
+UStealthEventBus* UStealthEventBus::Get(const UObject* WorldContextObject)
+{
+	UWorld* World = GEngine ? GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::ReturnNull) : nullptr;
+	return World ? World->GetSubsystem<UStealthEventBus>() : nullptr;
+}
+
+void UStealthEventBus::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	// Handle 0 is always the game thread ring
+	const int32 GameThreadHandle = Rings.RegisterProducer(TEXT("GameThread"), static_cast<uint32>(UStealthSettings::Get()->GameThreadEventRingSize));
+	check(GameThreadHandle == GameThreadProducer);
+}
+
+void UStealthEventBus::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_StealthEventBusDrain);
+	LLM_SCOPE_BYTAG(Stealth_EventBus);
+	STEALTH_HOT_PATH_SCOPE("EventBus");
+
+	Flush();
+
+	// One warning per frame however many were lost
+	const uint32 Drops = Rings.GetDroppedEventCount();
+	if (Drops != LastReportedDrops)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StealthEventBus: %u events dropped (rings full)"), Drops - LastReportedDrops);
+		LastReportedDrops = Drops;
+	}
+	if (NumEarlyFlushes > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StealthEventBus: game thread ring filled up %d times this frame, raise GameThreadEventRingSize"), NumEarlyFlushes);
+		NumEarlyFlushes = 0;
+	}
+}
+
+void UStealthEventBus::Flush()
+{
+	TGuardValue<bool> FlushingGuard(bFlushing, true);
+	const int32 NumDispatched = Rings.Drain([this](const FStealthEvent& Event)
+	{
+		EventDelegates[static_cast<int32>(Event.Type)].Broadcast(Event);
+	});
+	INC_DWORD_STAT_BY(STAT_StealthEventBusEvents, NumDispatched);
+}
+
+TStatId UStealthEventBus::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UStealthEventBus, STATGROUP_Stealth);
+}
+
+bool UStealthEventBus::Post(EStealthEventType Type, AActor* Source, const FVector& Location, float Value)
+{
+	check(IsInGameThread());
+
+	FStealthEvent Event;
+	Event.Type = Type;
+	Event.Source = Source;
+	Event.Location = Location;
+	Event.Value = Value;
+	Event.Frame = static_cast<uint32>(GFrameCounter);
+	if (Rings.TryPost(GameThreadProducer, Event))
+	{
+		return true;
+	}
+
+	// A subscriber posting while its own dispatch fills the ring can't flush again; that event is dropped
+	if (!bFlushing)
+	{
+		++NumEarlyFlushes;
+		Flush();
+	}
+	return Rings.Post(GameThreadProducer, Event);
+}
+
+void UStealthEventBus::ReportNoise(const UObject* WorldContextObject, AActor* Source, FVector Location, float Loudness)
+{
+	if (UStealthEventBus* Bus = Get(WorldContextObject))
+	{
+		Bus->Post(EStealthEventType::Noise, Source, Location, Loudness);
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+// Stealth.EventBus.Benchmark [Producers] [EventsPerProducer]
+// Every producer posts from its own task while this thread drains at the same time, so each ring sees real
+// single-producer/single-consumer traffic. A producer that finds its ring full waits for the consumer.
+// Producers stamp a per-producer sequence number; the consumer checks every ring arrives complete and in order.
+static FAutoConsoleCommand StealthEventBusBenchmarkCommand(
+	TEXT("Stealth.EventBus.Benchmark"),
+	TEXT("Measures event bus throughput with concurrent producers and checks per-producer FIFO order. Args: [Producers=8] [EventsPerProducer=1000000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumProducers = FMath::Clamp(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 8, 1, FStealthEventRings::MaxProducers);
+		const uint32 EventsPerProducer = static_cast<uint32>(FMath::Max(Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1000000, 1));
+
+		// Registered before anything posts or drains
+		FStealthEventRings BenchRings;
+		for (int32 Index = 0; Index < NumProducers; ++Index)
+		{
+			BenchRings.RegisterProducer(*FString::Printf(TEXT("Bench%d"), Index));
+		}
+
+		std::atomic<uint64> FullRingWaits{ 0 };
+		const double StartTime = FPlatformTime::Seconds();
+
+		TArray<UE::Tasks::FTask> Producers;
+		for (int32 Producer = 0; Producer < NumProducers; ++Producer)
+		{
+			Producers.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [&BenchRings, &FullRingWaits, Producer, EventsPerProducer]()
+			{
+				FStealthEvent Event;
+				Event.Type = EStealthEventType::Noise;
+				Event.Value = static_cast<float>(Producer);
+				for (uint32 Sequence = 0; Sequence < EventsPerProducer; ++Sequence)
+				{
+					Event.Frame = Sequence;
+					while (!BenchRings.Post(Producer, Event))
+					{
+						FullRingWaits.fetch_add(1, std::memory_order_relaxed);
+						FPlatformProcess::Yield();
+					}
+				}
+			}));
+		}
+
+		TArray<uint32> NextSequence;
+		NextSequence.SetNumZeroed(NumProducers);
+		int32 OutOfOrder = 0;
+		const uint64 TotalEvents = static_cast<uint64>(NumProducers) * EventsPerProducer;
+		uint64 Received = 0;
+		while (Received < TotalEvents)
+		{
+			const int32 NumDrained = BenchRings.Drain([&](const FStealthEvent& Event)
+			{
+				uint32& Expected = NextSequence[static_cast<int32>(Event.Value)];
+				OutOfOrder += Event.Frame != Expected ? 1 : 0;
+				Expected = Event.Frame + 1;
+			});
+			Received += NumDrained;
+			if (NumDrained == 0)
+			{
+				FPlatformProcess::Yield();
+			}
+		}
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+		UE::Tasks::Wait(Producers);
+
+		bool bComplete = OutOfOrder == 0;
+		for (const uint32 Next : NextSequence)
+		{
+			bComplete &= Next == EventsPerProducer;
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("StealthEventBus benchmark: %d concurrent producers, %llu events in %.3f s, %.1f M events/sec, %llu waits on a full ring"),
+			NumProducers, TotalEvents, Seconds, TotalEvents / Seconds / 1.0e6, FullRingWaits.load());
+		UE_LOG(LogTemp, Display, TEXT("StealthEventBus benchmark: every producer's events drained complete and in order: %s"), bComplete ? TEXT("PASS") : TEXT("FAIL"));
+	}));
+#endif
@@ -0,0 +1,712 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthExposure.h"
+#include "Thieflike.h"
+#include "Stealth/StealthStreamingSubsystem.h"
+#include "Stealth/StealthSettings.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "Kismet/GameplayStatics.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Exposure Analytic"), STAT_ExposureAnalytic, STATGROUP_Stealth);
+DECLARE_CYCLE_STAT(TEXT("Exposure Batch"), STAT_ExposureBatch, STATGROUP_Stealth);
+DECLARE_CYCLE_STAT(TEXT("Exposure Cache Build"), STAT_ExposureCacheBuild, STATGROUP_Stealth);
+
+namespace StealthExposure
+{
+	// One sample point in capsule space: Up in half-heights from the centre, Side in radii along Right,
+	// Lean = share of the lean offset it follows; weights per posture
+	struct FSampleLayoutPoint
+	{
+		float Up;
+		float Side;
+		float Lean;
+		float StandingWeight;
+		float CrouchedWeight;
+	};
+
+	constexpr FSampleLayoutPoint CenterLayout[] =
+	{
+		{ 0.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+	};
+
+	// Crouching hides the legs more than the head, so the head counts for more
+	constexpr FSampleLayoutPoint BodyLayout[] =
+	{
+		{ 0.85f, 0.0f, 1.0f, 0.45f, 0.5f },	// Head
+		{ 0.0f, 0.0f, 0.35f, 0.35f, 0.35f },	// Torso
+		{ -0.9f, 0.0f, 0.0f, 0.2f, 0.15f },	// Feet
+	};
+
+	constexpr FSampleLayoutPoint DetailedLayout[] =
+	{
+		{ 0.85f, 0.0f, 1.0f, 0.3f, 0.35f },	// Head
+		{ 0.55f, -0.8f, 0.75f, 0.1f, 0.1f },	// Left shoulder
+		{ 0.55f, 0.8f, 0.75f, 0.1f, 0.1f },	// Right shoulder
+		{ 0.0f, 0.0f, 0.35f, 0.15f, 0.15f },	// Torso
+		{ -0.3f, -0.7f, 0.1f, 0.075f, 0.075f },	// Left hip
+		{ -0.3f, 0.7f, 0.1f, 0.075f, 0.075f },	// Right hip
+		{ -0.9f, -0.5f, 0.0f, 0.1f, 0.075f },	// Left foot
+		{ -0.9f, 0.5f, 0.0f, 0.1f, 0.075f },	// Right foot
+	};
+	static_assert(UE_ARRAY_COUNT(DetailedLayout) == static_cast<SIZE_T>(MaxCharacterSamples), "The largest layout fills FCharacterSamples");
+
+	TConstArrayView<FSampleLayoutPoint> GetLayoutTable(EStealthExposureLayout Layout)
+	{
+		switch (Layout)
+		{
+		case EStealthExposureLayout::Body:
+			return BodyLayout;
+		case EStealthExposureLayout::Detailed:
+			return DetailedLayout;
+		default:
+			return CenterLayout;
+		}
+	}
+
+	FORCEINLINE FVector GetLayoutPoint(const FSampleLayoutPoint& Point, const FStealthExposureQuery& Query)
+	{
+		return Query.Center + FVector::UpVector * (Point.Up * Query.HalfHeight) + Query.Right * (Point.Side * Query.Radius + Point.Lean * Query.LeanOffset);
+	}
+
+	// ---- Batched pipeline ---- //
+	// A layout policy expands a query into a fixed number of points; its loop has a compile-time trip count.
+	// Table weights already sum to 1 for both postures, so they are used as they are.
+	template <const auto& Table>
+	struct TLayoutPolicy
+	{
+		static constexpr int32 NumPoints = UE_ARRAY_COUNT(Table);
+
+		static FORCEINLINE void Expand(const FStealthExposureQuery& Query, FVector (&OutPoints)[NumPoints], float (&OutWeights)[NumPoints])
+		{
+			for (int32 Index = 0; Index < NumPoints; ++Index)
+			{
+				OutPoints[Index] = GetLayoutPoint(Table[Index], Query);
+				OutWeights[Index] = FMath::Lerp(Table[Index].StandingWeight, Table[Index].CrouchedWeight, Query.CrouchAlpha);
+			}
+		}
+	};
+
+	// A backend fills the brightness of N points; calls are resolved statically inside the batch loop
+	struct FAnalyticBackend
+	{
+		const UWorld* World;
+		TConstArrayView<FStealthLight> Lights;
+		// Once per batch, not once per query
+		FCollisionQueryParams Params;
+
+		FAnalyticBackend(const UWorld* InWorld, TConstArrayView<FStealthLight> InLights, const AActor* IgnoreActor)
+			: World(InWorld)
+			, Lights(InLights)
+			, Params(SCENE_QUERY_STAT(StealthExposure), false, IgnoreActor)
+		{
+		}
+
+		// EvaluateAnalyticBatch. FORCEINLINE so the fixed-size overload below keeps its compile-time trip counts.
+		FORCEINLINE void Sample(TConstArrayView<FVector> Points, TArrayView<float> OutBrightness) const
+		{
+			for (int32 Index = 0; Index < Points.Num(); ++Index)
+			{
+				OutBrightness[Index] = 0.0f;
+			}
+			if (Points.Num() == 0)
+			{
+				return;
+			}
+
+			// A sphere around all points: one distance check rejects a light for the whole batch. A single point is its own bounds.
+			FVector Center = Points[0];
+			float Extent = 0.0f;
+			if (Points.Num() > 1)
+			{
+				const FBox Bounds(Points.GetData(), Points.Num());
+				Center = Bounds.GetCenter();
+				Extent = Bounds.GetExtent().Size();
+			}
+
+			for (const FStealthLight& Light : Lights)
+			{
+				if (!Light.bOn || FVector::DistSquared(Light.Location, Center) >= FMath::Square(Light.Radius + Extent))
+				{
+					continue;
+				}
+
+				for (int32 Index = 0; Index < Points.Num(); ++Index)
+				{
+					// Same rules as EvaluateAnalytic: brightest unoccluded light, traced only if it could change the result
+					const float Contribution = LightContribution(Light, Points[Index]);
+					if (Contribution > OutBrightness[Index] && (!World || !World->LineTraceTestByChannel(Points[Index], Light.Location, ECC_Visibility, Params)))
+					{
+						OutBrightness[Index] = Contribution;
+					}
+				}
+			}
+		}
+
+		template <int32 N>
+		FORCEINLINE void Sample(const FVector (&Points)[N], float (&OutBrightness)[N]) const
+		{
+			Sample(MakeArrayView(Points), MakeArrayView(OutBrightness));
+		}
+	};
+
+	struct FBakedBackend
+	{
+		const UStealthStreamingSubsystem& Streaming;
+		FAnalyticBackend Fallback;
+
+		template <int32 N>
+		FORCEINLINE void Sample(const FVector (&Points)[N], float (&OutBrightness)[N]) const
+		{
+			for (int32 Index = 0; Index < N; ++Index)
+			{
+				if (!Streaming.SampleBakedExposure(Points[Index], OutBrightness[Index]))
+				{
+					const FVector Point[1] = { Points[Index] };
+					float Brightness[1];
+					Fallback.Sample(Point, Brightness);
+					OutBrightness[Index] = Brightness[0];
+				}
+			}
+		}
+	};
+
+	struct FCachedBackend
+	{
+		const FExposureCache& Cache;
+		double Time;
+
+		template <int32 N>
+		FORCEINLINE void Sample(const FVector (&Points)[N], float (&OutBrightness)[N]) const
+		{
+			for (int32 Index = 0; Index < N; ++Index)
+			{
+				OutBrightness[Index] = Cache.EvaluatePoint(Index, Time);
+			}
+		}
+	};
+
+	struct FConstantBackend
+	{
+		float Brightness;
+
+		template <int32 N>
+		FORCEINLINE void Sample(const FVector (&Points)[N], float (&OutBrightness)[N]) const
+		{
+			for (int32 Index = 0; Index < N; ++Index)
+			{
+				OutBrightness[Index] = Brightness;
+			}
+		}
+	};
+
+	template <typename BackendType, typename LayoutType>
+	void EvaluateQueriesWith(const BackendType& Backend, TConstArrayView<FStealthExposureQuery> Queries, TArrayView<float> OutExposure)
+	{
+		FVector Points[LayoutType::NumPoints];
+		float Weights[LayoutType::NumPoints];
+		float Brightness[LayoutType::NumPoints];
+
+		for (int32 QueryIndex = 0; QueryIndex < Queries.Num(); ++QueryIndex)
+		{
+			LayoutType::Expand(Queries[QueryIndex], Points, Weights);
+			Backend.Sample(Points, Brightness);
+
+			float Exposure = 0.0f;
+			for (int32 Index = 0; Index < LayoutType::NumPoints; ++Index)
+			{
+				Exposure += Brightness[Index] * Weights[Index];
+			}
+			OutExposure[QueryIndex] = Exposure;
+		}
+	}
+
+	template <typename BackendType>
+	void EvaluateQueriesWith(const BackendType& Backend, EStealthExposureLayout Layout, TConstArrayView<FStealthExposureQuery> Queries, TArrayView<float> OutExposure)
+	{
+		switch (Layout)
+		{
+		case EStealthExposureLayout::Body:
+			EvaluateQueriesWith<BackendType, TLayoutPolicy<BodyLayout>>(Backend, Queries, OutExposure);
+			break;
+		case EStealthExposureLayout::Detailed:
+			EvaluateQueriesWith<BackendType, TLayoutPolicy<DetailedLayout>>(Backend, Queries, OutExposure);
+			break;
+		default:
+			EvaluateQueriesWith<BackendType, TLayoutPolicy<CenterLayout>>(Backend, Queries, OutExposure);
+			break;
+		}
+	}
+}
+
+float StealthExposure::EvaluateAnalytic(const UWorld* World, TConstArrayView<FStealthLight> Lights, const FVector& Point, const AActor* IgnoreActor)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ExposureAnalytic);
+
+	const FCollisionQueryParams Params(SCENE_QUERY_STAT(StealthExposure), false, IgnoreActor);
+
+	float Brightness = 0.0f;
+	for (const FStealthLight& Light : Lights)
+	{
+		const float Contribution = LightContribution(Light, Point);
+
+		// Skip the occlusion trace for lights that couldn't change the result
+		if (Contribution <= Brightness)
+		{
+			continue;
+		}
+
+		// Like the render detector we keep the brightest light rather than summing
+		if (!World || !World->LineTraceTestByChannel(Point, Light.Location, ECC_Visibility, Params))
+		{
+			Brightness = Contribution;
+		}
+	}
+	return Brightness;
+}
+
+void StealthExposure::EvaluateAnalyticBatch(const UWorld* World, TConstArrayView<FStealthLight> Lights, TConstArrayView<FVector> Points, TArrayView<float> OutBrightness, const AActor* IgnoreActor)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ExposureBatch);
+	check(OutBrightness.Num() >= Points.Num());
+
+	FAnalyticBackend(World, Lights, IgnoreActor).Sample(Points, OutBrightness);
+}
+
+void StealthExposure::BuildCharacterSamples(const FVector& Center, const FVector& Right, float HalfHeight, float Radius, float LeanOffset, float CrouchAlpha, int32 NumPoints, FCharacterSamples& Out)
+{
+	const TConstArrayView<FSampleLayoutPoint> Layout = GetLayoutTable(GetLayout(NumPoints));
+
+	FStealthExposureQuery Query;
+	Query.Center = Center;
+	Query.Right = Right;
+	Query.HalfHeight = HalfHeight;
+	Query.Radius = Radius;
+	Query.LeanOffset = LeanOffset;
+
+	float TotalWeight = 0.0f;
+	Out.Num = Layout.Num();
+	for (int32 Index = 0; Index < Layout.Num(); ++Index)
+	{
+		const FSampleLayoutPoint& Point = Layout[Index];
+		Out.Points[Index] = GetLayoutPoint(Point, Query);
+		Out.Weights[Index] = FMath::Lerp(Point.StandingWeight, Point.CrouchedWeight, CrouchAlpha);
+		TotalWeight += Out.Weights[Index];
+	}
+
+	for (int32 Index = 0; Index < Out.Num; ++Index)
+	{
+		Out.Weights[Index] /= TotalWeight;
+	}
+}
+
+float StealthExposure::EvaluateCharacter(const UWorld* World, TConstArrayView<FStealthLight> Lights, const FCharacterSamples& Samples, const AActor* IgnoreActor)
+{
+	float Brightness[MaxCharacterSamples];
+	EvaluateAnalyticBatch(World, Lights, MakeArrayView(Samples.Points, Samples.Num), MakeArrayView(Brightness, Samples.Num), IgnoreActor);
+
+	float Exposure = 0.0f;
+	for (int32 Index = 0; Index < Samples.Num; ++Index)
+	{
+		Exposure += Brightness[Index] * Samples.Weights[Index];
+	}
+	return Exposure;
+}
+
+bool StealthExposure::FExposureCache::Matches(const FCharacterSamples& Other) const
+{
+	return IsValid() && Samples.Num == Other.Num
+		&& FMemory::Memcmp(Samples.Points, Other.Points, Other.Num * sizeof(FVector)) == 0
+		&& FMemory::Memcmp(Samples.Weights, Other.Weights, Other.Num * sizeof(float)) == 0;
+}
+
+float StealthExposure::FExposureCache::Evaluate(double Time) const
+{
+	float Exposure = 0.0f;
+	for (int32 Index = 0; Index < Samples.Num; ++Index)
+	{
+		Exposure += EvaluatePoint(Index, Time) * Samples.Weights[Index];
+	}
+	return Exposure;
+}
+
+void StealthExposure::BuildExposureCache(const UWorld* World, TConstArrayView<FStealthLight> Lights, const FCharacterSamples& Samples, const AActor* IgnoreActor, FExposureCache& OutCache)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ExposureCacheBuild);
+
+	const FCollisionQueryParams Params(SCENE_QUERY_STAT(StealthExposure), false, IgnoreActor);
+
+	OutCache.Samples = Samples;
+	OutCache.Terms.Reset();
+	for (int32 Index = 0; Index < Samples.Num; ++Index)
+	{
+		const FVector& Point = Samples.Points[Index];
+
+		// Brightness this point has at every moment of the flicker, from the terms found so far
+		float GuaranteedBrightness = 0.0f;
+		for (const FStealthLight& Light : Lights)
+		{
+			if (!Light.bOn)
+			{
+				continue;
+			}
+
+			// Like EvaluateAnalytic, skip the trace when the light can never be the brightest here, even at its peak
+			const float Falloff = LightFalloff(Light, Point);
+			const float Scale = Light.Intensity / ReferenceIntensity;
+			if (Falloff * FMath::Min(Scale * Light.Flicker.GetMaxScale(), 1.0f) <= GuaranteedBrightness)
+			{
+				continue;
+			}
+
+			if (!World || !World->LineTraceTestByChannel(Point, Light.Location, ECC_Visibility, Params))
+			{
+				OutCache.Terms.Add({ Falloff, Scale, Light.Flicker });
+				GuaranteedBrightness = FMath::Max(GuaranteedBrightness, Falloff * FMath::Min(Scale * Light.Flicker.GetMinScale(), 1.0f));
+			}
+		}
+		OutCache.TermEnds[Index] = OutCache.Terms.Num();
+	}
+}
+
+EStealthExposureLayout StealthExposure::GetLayout(int32 NumPoints)
+{
+	if (NumPoints >= TLayoutPolicy<DetailedLayout>::NumPoints)
+	{
+		return EStealthExposureLayout::Detailed;
+	}
+	return NumPoints >= TLayoutPolicy<BodyLayout>::NumPoints ? EStealthExposureLayout::Body : EStealthExposureLayout::Center;
+}
+
+void StealthExposure::EvaluateQueries(const FStealthExposureSource& Source, EStealthExposureLayout Layout, TConstArrayView<FStealthExposureQuery> Queries, TArrayView<float> OutExposure)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ExposureBatch);
+	check(OutExposure.Num() >= Queries.Num());
+
+	switch (Source.Backend)
+	{
+	case EStealthExposureBackend::Baked:
+		if (Source.Streaming)
+		{
+			EvaluateQueriesWith(FBakedBackend{ *Source.Streaming, FAnalyticBackend(Source.World, Source.Lights, Source.IgnoreActor) }, Layout, Queries, OutExposure);
+			break;
+		}
+		// No streamed data to read: analytic lights, like an unloaded cell
+		EvaluateQueriesWith(FAnalyticBackend(Source.World, Source.Lights, Source.IgnoreActor), Layout, Queries, OutExposure);
+		break;
+
+	case EStealthExposureBackend::Constant:
+		EvaluateQueriesWith(FConstantBackend{ Source.ConstantBrightness }, Layout, Queries, OutExposure);
+		break;
+
+	case EStealthExposureBackend::Cached:
+		check(Source.Cache && Source.Cache->Samples.Num == GetLayoutTable(Layout).Num());
+		EvaluateQueriesWith(FCachedBackend{ *Source.Cache, Source.Time }, Layout, Queries, OutExposure);
+		break;
+
+	default:
+		EvaluateQueriesWith(FAnalyticBackend(Source.World, Source.Lights, Source.IgnoreActor), Layout, Queries, OutExposure);
+		break;
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+// Stealth.Exposure.Benchmark [Iterations]
+// Times one exposure update around the player for the 1, 3 and 8 point layouts, batched and as one query per point.
+static FAutoConsoleCommandWithWorldAndArgs StealthExposureBenchmarkCommand(
+	TEXT("Stealth.Exposure.Benchmark"),
+	TEXT("Times character exposure updates for 1, 3 and 8 sample points. Args: [Iterations=1000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const UStealthLightSubsystem* LightSubsystem = World ? World->GetSubsystem<UStealthLightSubsystem>() : nullptr;
+		if (!LightSubsystem)
+		{
+			return;
+		}
+
+		const int32 NumIterations = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000, 1);
+		const TConstArrayView<FStealthLight> Lights = LightSubsystem->GetLights();
+
+		APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(World, 0);
+		const FVector Center = PlayerPawn ? PlayerPawn->GetActorLocation() : FVector::ZeroVector;
+		const FVector Right = PlayerPawn ? PlayerPawn->GetActorRightVector() : FVector::RightVector;
+
+		for (const int32 NumPoints : { 1, 3, 8 })
+		{
+			StealthExposure::FCharacterSamples Samples;
+			StealthExposure::BuildCharacterSamples(Center, Right, 88.0f, 34.0f, 0.0f, 0.0f, NumPoints, Samples);
+
+			float Checksum = 0.0f;
+			double StartTime = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+			{
+				Checksum += StealthExposure::EvaluateCharacter(World, Lights, Samples, PlayerPawn);
+			}
+			const double BatchedUs = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / NumIterations;
+
+			StartTime = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+			{
+				for (int32 Index = 0; Index < Samples.Num; ++Index)
+				{
+					Checksum -= StealthExposure::EvaluateAnalytic(World, Lights, Samples.Points[Index], PlayerPawn) * Samples.Weights[Index];
+				}
+			}
+			const double PerPointUs = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / NumIterations;
+
+			UE_LOG(LogTemp, Display, TEXT("StealthExposure: %d point(s), %d lights: batched %.2f us/update, per point %.2f us/update"),
+				Samples.Num, Lights.Num(), BatchedUs, PerPointUs);
+
+			// Both paths follow the same rules and must agree
+			if (!FMath::IsNearlyZero(Checksum, 0.01f))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("StealthExposure: batched and per point exposure differ by %.3f in total"), Checksum);
+			}
+		}
+	}));
+
+namespace StealthExposure
+{
+	// Benchmark baseline: the same backends behind one virtual call per sample point
+	struct IExposureSampler
+	{
+		virtual ~IExposureSampler() = default;
+		virtual float Sample(const FVector& Point) const = 0;
+	};
+
+	struct FAnalyticSampler : IExposureSampler
+	{
+		const UWorld* World = nullptr;
+		TConstArrayView<FStealthLight> Lights;
+
+		virtual float Sample(const FVector& Point) const override { return EvaluateAnalytic(World, Lights, Point, nullptr); }
+	};
+
+	struct FBakedSampler : FAnalyticSampler
+	{
+		const UStealthStreamingSubsystem* Streaming = nullptr;
+
+		virtual float Sample(const FVector& Point) const override
+		{
+			float Brightness = 0.0f;
+			return Streaming->SampleBakedExposure(Point, Brightness) ? Brightness : FAnalyticSampler::Sample(Point);
+		}
+	};
+
+	struct FConstantSampler : IExposureSampler
+	{
+		float Brightness = 0.0f;
+
+		virtual float Sample(const FVector& Point) const override { return Brightness; }
+	};
+}
+
+// Stealth.Exposure.BenchmarkBackends [Samples...]
+// Random capsules around the player, evaluated per backend and layout through EvaluateQueries and through the virtual
+// baseline. Analytic samples trace, so the 1M run takes a while in lit areas.
+static FAutoConsoleCommandWithWorldAndArgs StealthExposureBenchmarkBackendsCommand(
+	TEXT("Stealth.Exposure.BenchmarkBackends"),
+	TEXT("Per-sample cost of the specialized exposure pipeline vs virtual dispatch. Args: [Samples...=10000 1000000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		using namespace StealthExposure;
+
+		const UStealthLightSubsystem* LightSubsystem = World ? World->GetSubsystem<UStealthLightSubsystem>() : nullptr;
+		const UStealthStreamingSubsystem* Streaming = World ? World->GetSubsystem<UStealthStreamingSubsystem>() : nullptr;
+		if (!LightSubsystem || !Streaming)
+		{
+			return;
+		}
+
+		TArray<int32> SampleCounts;
+		for (const FString& Arg : Args)
+		{
+			SampleCounts.Add(FMath::Max(FCString::Atoi(*Arg), 1));
+		}
+		if (SampleCounts.Num() == 0)
+		{
+			SampleCounts = { 10000, 1000000 };
+		}
+
+		APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(World, 0);
+		const FVector Origin = PlayerPawn ? PlayerPawn->GetActorLocation() : FVector::ZeroVector;
+
+		FStealthExposureSource Sources[3];
+		Sources[0].Backend = EStealthExposureBackend::Analytic;
+		Sources[1].Backend = EStealthExposureBackend::Baked;
+		Sources[1].Streaming = Streaming;
+		Sources[2].Backend = EStealthExposureBackend::Constant;
+		Sources[2].ConstantBrightness = 0.5f;
+		for (FStealthExposureSource& Source : Sources)
+		{
+			Source.World = World;
+			Source.Lights = LightSubsystem->GetLights();
+		}
+
+		FAnalyticSampler AnalyticSampler;
+		AnalyticSampler.World = World;
+		AnalyticSampler.Lights = LightSubsystem->GetLights();
+		FBakedSampler BakedSampler;
+		BakedSampler.World = World;
+		BakedSampler.Lights = LightSubsystem->GetLights();
+		BakedSampler.Streaming = Streaming;
+		FConstantSampler ConstantSampler;
+		ConstantSampler.Brightness = 0.5f;
+		const IExposureSampler* Samplers[] = { &AnalyticSampler, &BakedSampler, &ConstantSampler };
+
+		TArray<FStealthExposureQuery> Queries;
+		TArray<float> Specialized;
+		TArray<float> Virtual;
+		for (const int32 NumSamples : SampleCounts)
+		{
+			for (const EStealthExposureLayout Layout : { EStealthExposureLayout::Center, EStealthExposureLayout::Body, EStealthExposureLayout::Detailed })
+			{
+				const int32 NumPoints = GetLayoutTable(Layout).Num();
+				const int32 NumQueries = FMath::Max(NumSamples / NumPoints, 1);
+
+				// Capsules are generated up front so only the evaluation is timed
+				FRandomStream Random(NumSamples);
+				Queries.SetNum(NumQueries);
+				for (FStealthExposureQuery& Query : Queries)
+				{
+					Query.Center = Origin + FVector(Random.FRandRange(-2000.0f, 2000.0f), Random.FRandRange(-2000.0f, 2000.0f), 0.0f);
+					Query.Right = FVector(Random.FRandRange(-1.0f, 1.0f), Random.FRandRange(-1.0f, 1.0f), 0.0f).GetSafeNormal();
+					Query.CrouchAlpha = Random.FRand() < 0.5f ? 0.0f : 1.0f;
+					Query.HalfHeight = FMath::Lerp(88.0f, 44.0f, Query.CrouchAlpha);
+					Query.Radius = 34.0f;
+				}
+				Specialized.SetNumUninitialized(NumQueries);
+				Virtual.SetNumUninitialized(NumQueries);
+
+				for (int32 BackendIndex = 0; BackendIndex < UE_ARRAY_COUNT(Sources); ++BackendIndex)
+				{
+					double StartTime = FPlatformTime::Seconds();
+					EvaluateQueries(Sources[BackendIndex], Layout, Queries, Specialized);
+					const double SpecializedNs = (FPlatformTime::Seconds() - StartTime) * 1.0e9 / (NumQueries * NumPoints);
+
+					const IExposureSampler& Sampler = *Samplers[BackendIndex];
+					StartTime = FPlatformTime::Seconds();
+					for (int32 QueryIndex = 0; QueryIndex < NumQueries; ++QueryIndex)
+					{
+						const FStealthExposureQuery& Query = Queries[QueryIndex];
+						FCharacterSamples Samples;
+						BuildCharacterSamples(Query.Center, Query.Right, Query.HalfHeight, Query.Radius, Query.LeanOffset, Query.CrouchAlpha, NumPoints, Samples);
+
+						float Exposure = 0.0f;
+						for (int32 Index = 0; Index < Samples.Num; ++Index)
+						{
+							Exposure += Sampler.Sample(Samples.Points[Index]) * Samples.Weights[Index];
+						}
+						Virtual[QueryIndex] = Exposure;
+					}
+					const double VirtualNs = (FPlatformTime::Seconds() - StartTime) * 1.0e9 / (NumQueries * NumPoints);
+
+					int32 Mismatches = 0;
+					for (int32 QueryIndex = 0; QueryIndex < NumQueries; ++QueryIndex)
+					{
+						Mismatches += FMath::IsNearlyEqual(Specialized[QueryIndex], Virtual[QueryIndex], 0.001f) ? 0 : 1;
+					}
+
+					static const TCHAR* BackendNames[] = { TEXT("Analytic"), TEXT("Baked"), TEXT("Constant") };
+					UE_LOG(LogTemp, Display, TEXT("StealthExposure: %d samples, %s, %d point(s): specialized %.1f ns/sample, virtual %.1f ns/sample, %.2fx%s"),
+						NumQueries * NumPoints, BackendNames[BackendIndex], NumPoints, SpecializedNs, VirtualNs, SpecializedNs > 0.0 ? VirtualNs / SpecializedNs : 0.0,
+						Mismatches > 0 ? *FString::Printf(TEXT(" (%d results differ)"), Mismatches) : TEXT(""));
+				}
+			}
+		}
+	}));
+
+// Stealth.Exposure.BenchmarkFlicker [Lights] [Frames]
+// Synthetic torches around the player. Compares re-evaluating exposure every frame against building the light terms
+// once and evaluating them per frame, for the torches and for steady copies of them.
+static FAutoConsoleCommandWithWorldAndArgs StealthExposureBenchmarkFlickerCommand(
+	TEXT("Stealth.Exposure.BenchmarkFlicker"),
+	TEXT("Times player exposure near flickering lights, recomputed vs cached terms. Args: [Lights=500] [Frames=600]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		using namespace StealthExposure;
+
+		if (!World)
+		{
+			return;
+		}
+
+		const int32 NumLights = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 500, 1);
+		const int32 NumFrames = FMath::Max(Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 600, 1);
+		const double FrameTime = 1.0 / 60.0;
+
+		APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(World, 0);
+		const FVector Origin = PlayerPawn ? PlayerPawn->GetActorLocation() : FVector::ZeroVector;
+		const FVector Right = PlayerPawn ? PlayerPawn->GetActorRightVector() : FVector::RightVector;
+
+		FRandomStream Random(NumLights);
+		TArray<FStealthLight> Torches;
+		Torches.SetNum(NumLights);
+		for (FStealthLight& Torch : Torches)
+		{
+			Torch.Location = Origin + FVector(Random.FRandRange(-1500.0f, 1500.0f), Random.FRandRange(-1500.0f, 1500.0f), Random.FRandRange(50.0f, 250.0f));
+			Torch.Radius = Random.FRandRange(400.0f, 1200.0f);
+			Torch.Intensity = Random.FRandRange(3.0f, 12.0f);
+			Torch.Flicker.Amplitude = Random.FRandRange(0.15f, 0.4f);
+			Torch.Flicker.Frequency = Random.FRandRange(4.0f, 12.0f);
+			Torch.Flicker.Seed = Random.GetUnsignedInt();
+		}
+		TArray<FStealthLight> Steady = Torches;
+		for (FStealthLight& Light : Steady)
+		{
+			Light.Flicker = FStealthFlicker();
+		}
+
+		FCharacterSamples Samples;
+		BuildCharacterSamples(Origin, Right, 88.0f, 34.0f, 0.0f, 0.0f, UStealthSettings::Get()->ExposureSamplePoints, Samples);
+		const double StartWorldTime = World->GetTimeSeconds();
+
+		// Everything re-traced every frame
+		FExposureCache Cache;
+		float Recomputed = 0.0f;
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			BuildExposureCache(World, Torches, Samples, PlayerPawn, Cache);
+			Recomputed += Cache.Evaluate(StartWorldTime + Frame * FrameTime);
+		}
+		const double RecomputedUs = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / NumFrames;
+
+		// Traced once, flicker evaluated from the terms
+		float Cached = 0.0f;
+		float MinExposure = 1.0f;
+		float MaxExposure = 0.0f;
+		StartTime = FPlatformTime::Seconds();
+		BuildExposureCache(World, Torches, Samples, PlayerPawn, Cache);
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			const float Exposure = Cache.Evaluate(StartWorldTime + Frame * FrameTime);
+			Cached += Exposure;
+			MinExposure = FMath::Min(MinExposure, Exposure);
+			MaxExposure = FMath::Max(MaxExposure, Exposure);
+		}
+		const double CachedUs = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / NumFrames;
+		const int32 NumTorchTerms = Cache.Terms.Num();
+
+		StartTime = FPlatformTime::Seconds();
+		BuildExposureCache(World, Steady, Samples, PlayerPawn, Cache);
+		float SteadyTotal = 0.0f;
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			SteadyTotal += Cache.Evaluate(StartWorldTime + Frame * FrameTime);
+		}
+		const double SteadyUs = (FPlatformTime::Seconds() - StartTime) * 1.0e6 / NumFrames;
+
+		UE_LOG(LogTemp, Display, TEXT("StealthExposure: %d flickering lights, %d points, %d frames: recomputed %.2f us/frame, cached terms %.2f us/frame (%d terms), steady lights cached %.2f us/frame"),
+			NumLights, Samples.Num, NumFrames, RecomputedUs, CachedUs, NumTorchTerms, SteadyUs);
+		UE_LOG(LogTemp, Display, TEXT("StealthExposure: exposure pulses between %.3f and %.3f (steady mean %.3f)"), MinExposure, MaxExposure, SteadyTotal / NumFrames);
+
+		// The player doesn't move during the run, so both must see the same flicker
+		if (!FMath::IsNearlyEqual(Recomputed, Cached, 0.01f))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthExposure: recomputed and cached exposure differ by %.3f in total"), Recomputed - Cached);
+		}
+	}));
+#endif
@@ -0,0 +1,332 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthFootstepSubsystem.h"
+#include "Thieflike.h"
+#include "Stealth/StealthSettings.h"
+#include "Stealth/StealthEventBus.h"
+#include "Stealth/StealthMemory.h"
+#include "Stealth/StealthNavPoly.h"
+#include "NavigationSystem.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "Components/PrimitiveComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Footstep Cache Build"), STAT_FootstepCacheBuild, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Footstep Traces"), STAT_FootstepTraces, STATGROUP_Stealth);
+
+namespace StealthFootsteps
+{
+	// Downward trace from slightly above the foot, long enough for steps and slopes
+	constexpr float TraceUp = 50.0f;
+	constexpr float TraceDown = 100.0f;
+}
+
+void UStealthFootstepSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	CellSize = FMath::Max(UStealthSettings::Get()->FootstepCellSize, 1.0f);
+	BuildLoudnessTable();
+	BuildCache();
+}
+
+void UStealthFootstepSubsystem::Deinitialize()
+{
+	Cells.Empty();
+	Super::Deinitialize();
+}
+
+void UStealthFootstepSubsystem::BuildLoudnessTable()
+{
+	const UStealthSettings* Settings = UStealthSettings::Get();
+	for (int32 Surface = 0; Surface < SurfaceType_Max; ++Surface)
+	{
+		const FStealthFootstepLoudness* Loudness = Settings->SurfaceFootstepLoudness.Find(static_cast<EPhysicalSurface>(Surface));
+		if (!Loudness)
+		{
+			Loudness = &Settings->DefaultFootstepLoudness;
+		}
+
+		LoudnessTable[Surface][static_cast<int32>(EStealthGait::Crouch)] = Loudness->Crouch;
+		LoudnessTable[Surface][static_cast<int32>(EStealthGait::Walk)] = Loudness->Walk;
+		LoudnessTable[Surface][static_cast<int32>(EStealthGait::Run)] = Loudness->Run;
+	}
+}
+
+FIntVector UStealthFootstepSubsystem::GetCellKey(const FVector& Location) const
+{
+	return FIntVector(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize), FMath::FloorToInt(Location.Z / CellHeight));
+}
+
+FVector UStealthFootstepSubsystem::GetCellCenter(const FIntVector& Key) const
+{
+	return FVector((Key.X + 0.5f) * CellSize, (Key.Y + 0.5f) * CellSize, (Key.Z + 0.5f) * CellHeight);
+}
+
+TArray<FIntVector> UStealthFootstepSubsystem::GetCachedCells() const
+{
+	TArray<FIntVector> Keys;
+	Cells.GenerateKeyArray(Keys);
+	return Keys;
+}
+
+void UStealthFootstepSubsystem::BuildCache()
+{
+	SCOPE_CYCLE_COUNTER(STAT_FootstepCacheBuild);
+	LLM_SCOPE_BYTAG(Stealth_Footsteps);
+
+	Cells.Reset();
+
+#if WITH_RECAST
+	const UNavigationSystemV1* NavSystem = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	const ARecastNavMesh* NavMesh = NavSystem ? Cast<ARecastNavMesh>(NavSystem->GetDefaultNavDataInstance()) : nullptr;
+	if (!NavMesh)
+	{
+		UE_LOG(LogTemp, Display, TEXT("StealthFootsteps: no navmesh, footstep surfaces are traced and cached as they are walked on"));
+		return;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// One probe per grid cell whose centre lies on a navmesh polygon. Polygons smaller than a cell get one at their centre.
+	TSet<FIntVector> ProbedCells;
+	TArray<FIntVector> ProbeKeys;
+	TArray<FVector> ProbePoints;
+	TArray<FNavPoly> Polys;
+	TArray<FVector> Verts;
+	int32 NumPolys = 0;
+
+	for (int32 TileIndex = 0; TileIndex < NavMesh->GetNavMeshTilesCount(); ++TileIndex)
+	{
+		Polys.Reset();
+		if (!NavMesh->GetPolysInTile(TileIndex, Polys))
+		{
+			continue;
+		}
+
+		for (const FNavPoly& Poly : Polys)
+		{
+			Verts.Reset();
+			if (!NavMesh->GetPolyVerts(Poly.Ref, Verts) || Verts.Num() < 3)
+			{
+				continue;
+			}
+			++NumPolys;
+
+			const FBox Bounds(Verts);
+			const FVector Normal = FVector::CrossProduct(Verts[1] - Verts[0], Verts[2] - Verts[0]);
+			const bool bHasPlane = FMath::Abs(Normal.Z) > KINDA_SMALL_NUMBER;
+			bool bAddedAny = false;
+
+			auto AddProbe = [&](const FVector& Point)
+			{
+				const FIntVector Key = GetCellKey(Point);
+				bool bAlreadyProbed = false;
+				ProbedCells.Add(Key, &bAlreadyProbed);
+				if (!bAlreadyProbed)
+				{
+					ProbeKeys.Add(Key);
+					ProbePoints.Add(Point);
+				}
+				bAddedAny = true;
+			};
+
+			for (int32 X = FMath::FloorToInt(Bounds.Min.X / CellSize); X <= FMath::FloorToInt(Bounds.Max.X / CellSize); ++X)
+			{
+				for (int32 Y = FMath::FloorToInt(Bounds.Min.Y / CellSize); Y <= FMath::FloorToInt(Bounds.Max.Y / CellSize); ++Y)
+				{
+					const float CenterX = (X + 0.5f) * CellSize;
+					const float CenterY = (Y + 0.5f) * CellSize;
+					if (bHasPlane && StealthNavPoly::IsInside2D(Verts, CenterX, CenterY))
+					{
+						const float Z = Verts[0].Z - (Normal.X * (CenterX - Verts[0].X) + Normal.Y * (CenterY - Verts[0].Y)) / Normal.Z;
+						AddProbe(FVector(CenterX, CenterY, Z));
+					}
+				}
+			}
+
+			if (!bAddedAny)
+			{
+				AddProbe(Poly.Center);
+			}
+		}
+	}
+
+	// Traces are independent scene reads
+	TArray<uint8> Surfaces;
+	TArray<bool> Cacheable;
+	Surfaces.SetNumZeroed(ProbePoints.Num());
+	Cacheable.SetNumZeroed(ProbePoints.Num());
+	ParallelFor(ProbePoints.Num(), [&](int32 Index)
+	{
+		bool bCacheable = false;
+		Surfaces[Index] = TraceSurface(ProbePoints[Index], nullptr, bCacheable);
+		Cacheable[Index] = bCacheable;
+	});
+
+	Cells.Reserve(ProbeKeys.Num());
+	for (int32 Index = 0; Index < ProbeKeys.Num(); ++Index)
+	{
+		if (Cacheable[Index])
+		{
+			Cells.Add(ProbeKeys[Index], Surfaces[Index]);
+		}
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("StealthFootsteps: %d cells classified from %d navmesh polygons in %.1f ms"), Cells.Num(), NumPolys, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+#endif
+}
+
+EPhysicalSurface UStealthFootstepSubsystem::TraceSurface(const FVector& FootLocation, const AActor* IgnoreActor, bool& bOutCacheable) const
+{
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(StealthFootstep), false, IgnoreActor);
+	Params.bReturnPhysicalMaterial = true;
+
+	FHitResult Hit;
+	bOutCacheable = false;
+	if (!GetWorld()->LineTraceSingleByChannel(Hit, FootLocation + FVector(0.0f, 0.0f, StealthFootsteps::TraceUp), FootLocation - FVector(0.0f, 0.0f, StealthFootsteps::TraceDown), ECC_Visibility, Params))
+	{
+		return SurfaceType_Default;
+	}
+
+	const UPrimitiveComponent* HitComponent = Hit.GetComponent();
+	bOutCacheable = HitComponent && HitComponent->Mobility != EComponentMobility::Movable;
+	return UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get());
+}
+
+const uint8* UStealthFootstepSubsystem::FindCell(const FVector& FootLocation) const
+{
+	FIntVector Key = GetCellKey(FootLocation);
+	if (const uint8* Surface = Cells.Find(Key))
+	{
+		return Surface;
+	}
+
+	// The foot and the navmesh sit a little apart; near a cell boundary the floor may be in the neighbouring one
+	const float CellZ = FootLocation.Z / CellHeight - Key.Z;
+	Key.Z += CellZ < 0.5f ? -1 : 1;
+	return Cells.Find(Key);
+}
+
+EPhysicalSurface UStealthFootstepSubsystem::GetSurface(const FVector& FootLocation, const UPrimitiveComponent* Floor, const AActor* IgnoreActor)
+{
+	const bool bMovableFloor = Floor && Floor->Mobility == EComponentMobility::Movable;
+	if (!bMovableFloor)
+	{
+		if (const uint8* Surface = FindCell(FootLocation))
+		{
+			return static_cast<EPhysicalSurface>(*Surface);
+		}
+	}
+
+	INC_DWORD_STAT(STAT_FootstepTraces);
+	bool bCacheable = false;
+	const EPhysicalSurface Surface = TraceSurface(FootLocation, IgnoreActor, bCacheable);
+	if (bCacheable && !bMovableFloor)
+	{
+		// Off the navmesh or in tiles that streamed in later. Happens once per cell, so the allocation is allowed.
+		STEALTH_HOT_PATH_SUSPEND();
+		LLM_SCOPE_BYTAG(Stealth_Footsteps);
+		Cells.Add(GetCellKey(FootLocation), static_cast<uint8>(Surface));
+	}
+	return Surface;
+}
+
+float UStealthFootstepSubsystem::ReportFootstep(AActor* Source, const FVector& FootLocation, EStealthGait Gait, const UPrimitiveComponent* Floor)
+{
+	const float Loudness = GetLoudness(GetSurface(FootLocation, Floor, Source), Gait);
+	if (Loudness > 0.0f)
+	{
+		if (UStealthEventBus* EventBus = UStealthEventBus::Get(this))
+		{
+			EventBus->Post(EStealthEventType::Noise, Source, FootLocation, Loudness);
+		}
+	}
+	return Loudness;
+}
+
+float UStealthFootstepSubsystem::ReportFootstepNoise(const UObject* WorldContextObject, AActor* Source, FVector FootLocation, EStealthGait Gait)
+{
+	const UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull);
+	UStealthFootstepSubsystem* Footsteps = World ? World->GetSubsystem<UStealthFootstepSubsystem>() : nullptr;
+	return Footsteps ? Footsteps->ReportFootstep(Source, FootLocation, Gait) : 0.0f;
+}
+
+#if !UE_BUILD_SHIPPING
+// Stealth.Footsteps.Benchmark [Walkers] [Steps]
+// Walkers stride across cached cells (or around the player without a navmesh). Every footstep is resolved twice:
+// through the cache, then with the trace it replaces. Noise is not posted so guards aren't disturbed.
+static FAutoConsoleCommandWithWorldAndArgs StealthFootstepsBenchmarkCommand(
+	TEXT("Stealth.Footsteps.Benchmark"),
+	TEXT("Times footstep surface lookups, cached vs traced. Args: [Walkers=200] [Steps=50]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UStealthFootstepSubsystem* Footsteps = World ? World->GetSubsystem<UStealthFootstepSubsystem>() : nullptr;
+		if (!Footsteps)
+		{
+			return;
+		}
+
+		const int32 NumWalkers = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 200, 1);
+		const int32 NumSteps = FMath::Max(Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 50, 1);
+		const float Stride = UStealthSettings::Get()->FootstepStride;
+
+		FRandomStream Random(NumWalkers);
+		const TArray<FIntVector> CachedCells = Footsteps->GetCachedCells();
+		FVector Origin = FVector::ZeroVector;
+		if (APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(World, 0))
+		{
+			Origin = PlayerPawn->GetNavAgentLocation();
+		}
+
+		// Footstep positions are generated up front so only the lookups are timed
+		TArray<FVector> Steps;
+		Steps.Reserve(NumWalkers * NumSteps);
+		for (int32 Walker = 0; Walker < NumWalkers; ++Walker)
+		{
+			FVector Location = CachedCells.Num() > 0
+				? Footsteps->GetCellCenter(CachedCells[Random.RandHelper(CachedCells.Num())])
+				: Origin + FVector(Random.FRandRange(-2000.0f, 2000.0f), Random.FRandRange(-2000.0f, 2000.0f), 0.0f);
+			const FVector Direction = FVector(Random.FRandRange(-1.0f, 1.0f), Random.FRandRange(-1.0f, 1.0f), 0.0f).GetSafeNormal();
+			for (int32 Step = 0; Step < NumSteps; ++Step)
+			{
+				Steps.Add(Location);
+				Location += Direction * Stride;
+			}
+		}
+
+		const int32 CellsBefore = Footsteps->NumCachedCells();
+		float Checksum = 0.0f;
+
+		double StartTime = FPlatformTime::Seconds();
+		for (const FVector& Step : Steps)
+		{
+			Checksum += Footsteps->GetLoudness(Footsteps->GetSurface(Step), EStealthGait::Walk);
+		}
+		const double CachedSeconds = FPlatformTime::Seconds() - StartTime;
+
+		StartTime = FPlatformTime::Seconds();
+		for (const FVector& Step : Steps)
+		{
+			bool bCacheable = false;
+			Checksum -= Footsteps->GetLoudness(Footsteps->TraceSurface(Step, nullptr, bCacheable), EStealthGait::Walk);
+		}
+		const double TracedSeconds = FPlatformTime::Seconds() - StartTime;
+
+		const double CachedNs = CachedSeconds * 1.0e9 / Steps.Num();
+		const double TracedNs = TracedSeconds * 1.0e9 / Steps.Num();
+		UE_LOG(LogTemp, Display, TEXT("StealthFootsteps: %d walkers x %d steps: cached %.0f ns/footstep (%d cells added on miss), traced %.0f ns/footstep, %.1fx"),
+			NumWalkers, NumSteps, CachedNs, Footsteps->NumCachedCells() - CellsBefore, TracedNs, CachedNs > 0.0 ? TracedNs / CachedNs : 0.0);
+
+		// Cached and traced surfaces should agree except where dynamic geometry has moved
+		if (!FMath::IsNearlyZero(Checksum, 0.01f))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthFootsteps: cached and traced loudness differ by %.2f in total"), Checksum);
+		}
+	}));
+#endif
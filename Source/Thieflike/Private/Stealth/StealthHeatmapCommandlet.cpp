@@ -0,0 +1,269 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthHeatmapCommandlet.h"
+#include "Stealth/StealthTelemetry.h"
+#include "Async/ParallelFor.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "ImageCore.h"
+#include "ImageUtils.h"
+
+namespace StealthHeatmap
+{
+	// Biggest image we write per layer, in cells
+	constexpr int32 MaxImageSize = 4096;
+
+	struct FCell
+	{
+		uint32 Samples = 0;
+		uint32 Seen = 0;
+		uint32 Hidden = 0;
+		uint32 MantleSucceeded = 0;
+		uint32 MantleFailed = 0;
+
+		void Add(const FCell& Other)
+		{
+			Samples += Other.Samples;
+			Seen += Other.Seen;
+			Hidden += Other.Hidden;
+			MantleSucceeded += Other.MantleSucceeded;
+			MantleFailed += Other.MantleFailed;
+		}
+	};
+
+	struct FMapHeat
+	{
+		TMap<FIntPoint, FCell> Cells;
+		int64 NumSamples = 0;
+		int32 NumSessions = 0;
+
+		void Add(const FMapHeat& Other)
+		{
+			for (const TPair<FIntPoint, FCell>& Pair : Other.Cells)
+			{
+				Cells.FindOrAdd(Pair.Key).Add(Pair.Value);
+			}
+			NumSamples += Other.NumSamples;
+			NumSessions += Other.NumSessions;
+		}
+	};
+
+	struct FSession
+	{
+		FString MapName;
+		FMapHeat Heat;
+		bool bValid = false;
+	};
+
+	void ReadSession(const FString& Path, float CellSize, uint8 SeenThreshold, FSession& Out)
+	{
+		// Map the file when the platform can; otherwise read it in one go
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		TUniquePtr<IMappedFileHandle> MappedFile(PlatformFile.OpenMapped(*Path));
+		TUniquePtr<IMappedFileRegion> MappedRegion;
+		TArray64<uint8> Loaded;
+
+		const uint8* Data = nullptr;
+		int64 Size = 0;
+		if (MappedFile && MappedFile->GetFileSize() > 0)
+		{
+			MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+		}
+		if (MappedRegion)
+		{
+			Data = MappedRegion->GetMappedPtr();
+			Size = MappedRegion->GetMappedSize();
+		}
+		else if (FFileHelper::LoadFileToArray(Loaded, *Path))
+		{
+			Data = Loaded.GetData();
+			Size = Loaded.Num();
+		}
+
+		FStealthTelemetryHeader Header;
+		if (!Data || Size < static_cast<int64>(sizeof(Header)))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthHeatmap: %s is empty or unreadable"), *Path);
+			return;
+		}
+
+		FMemory::Memcpy(&Header, Data, sizeof(Header));
+		if (!Header.IsValid())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthHeatmap: %s is not a version %u telemetry file"), *Path, FStealthTelemetryHeader::CurrentVersion);
+			return;
+		}
+		Header.MapName[UE_ARRAY_COUNT(Header.MapName) - 1] = '\0';
+
+		// A session that crashed mid-write may end in a partial sample; it is ignored
+		const int64 NumSamples = (Size - Header.HeaderSize) / Header.SampleSize;
+		const FStealthTelemetrySample* Samples = reinterpret_cast<const FStealthTelemetrySample*>(Data + Header.HeaderSize);
+
+		for (int64 Index = 0; Index < NumSamples; ++Index)
+		{
+			const FStealthTelemetrySample& Sample = Samples[Index];
+			FCell& Cell = Out.Heat.Cells.FindOrAdd(FIntPoint(FMath::FloorToInt(Sample.X / CellSize), FMath::FloorToInt(Sample.Y / CellSize)));
+
+			switch (Sample.Event)
+			{
+			case EStealthTelemetryEvent::None:
+				++Cell.Samples;
+				if (Sample.Visibility >= SeenThreshold)
+				{
+					++Cell.Seen;
+				}
+				else
+				{
+					++Cell.Hidden;
+				}
+				break;
+
+			case EStealthTelemetryEvent::MantleSucceeded:
+				++Cell.MantleSucceeded;
+				break;
+
+			case EStealthTelemetryEvent::MantleFailed:
+				++Cell.MantleFailed;
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		Out.MapName = ANSI_TO_TCHAR(Header.MapName);
+		Out.Heat.NumSamples = NumSamples;
+		Out.Heat.NumSessions = 1;
+		Out.bValid = true;
+	}
+
+	// Counts are log-scaled so a few busy cells don't wash out the rest
+	float LogScale(uint32 Value, uint32 MaxValue)
+	{
+		return MaxValue > 0 ? FMath::Loge(1.0f + Value) / FMath::Loge(1.0f + MaxValue) : 0.0f;
+	}
+
+	void WriteLayer(const FString& Path, const FMapHeat& Heat, const FIntPoint& Min, const FIntPoint& Size, TFunctionRef<float(const FCell&)> Value)
+	{
+		FImage Image(Size.X, Size.Y, ERawImageFormat::G8, EGammaSpace::Linear);
+		FMemory::Memzero(Image.RawData.GetData(), Image.RawData.Num());
+
+		for (const TPair<FIntPoint, FCell>& Pair : Heat.Cells)
+		{
+			const FIntPoint Pixel = Pair.Key - Min;
+			if (Pixel.X >= 0 && Pixel.Y >= 0 && Pixel.X < Size.X && Pixel.Y < Size.Y)
+			{
+				Image.RawData[static_cast<int64>(Pixel.Y) * Size.X + Pixel.X] = static_cast<uint8>(FMath::Clamp(Value(Pair.Value), 0.0f, 1.0f) * 255.0f);
+			}
+		}
+
+		if (!FImageUtils::SaveImageByExtension(*Path, Image))
+		{
+			UE_LOG(LogTemp, Error, TEXT("StealthHeatmap: failed to write %s"), *Path);
+		}
+	}
+
+	void WriteMap(const FString& OutputDir, const FString& MapName, const FMapHeat& Heat, float CellSize)
+	{
+		FIntPoint Min(MAX_int32, MAX_int32);
+		FIntPoint Max(MIN_int32, MIN_int32);
+		FCell Peak;
+		for (const TPair<FIntPoint, FCell>& Pair : Heat.Cells)
+		{
+			Min = Min.ComponentMin(Pair.Key);
+			Max = Max.ComponentMax(Pair.Key);
+			Peak.Samples = FMath::Max(Peak.Samples, Pair.Value.Samples);
+			Peak.Hidden = FMath::Max(Peak.Hidden, Pair.Value.Hidden);
+			Peak.MantleFailed = FMath::Max(Peak.MantleFailed, Pair.Value.MantleFailed);
+		}
+
+		FIntPoint Size = Max - Min + FIntPoint(1, 1);
+		if (Size.X > MaxImageSize || Size.Y > MaxImageSize)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthHeatmap: %s spans %dx%d cells, images are cropped to %d; use a larger -CellSize"), *MapName, Size.X, Size.Y, MaxImageSize);
+			Size = Size.ComponentMin(FIntPoint(MaxImageSize, MaxImageSize));
+		}
+
+		const FString Base = OutputDir / MapName;
+		WriteLayer(Base + TEXT("_Presence.png"), Heat, Min, Size, [&Peak](const FCell& Cell) { return LogScale(Cell.Samples, Peak.Samples); });
+		WriteLayer(Base + TEXT("_Seen.png"), Heat, Min, Size, [](const FCell& Cell) { return Cell.Samples > 0 ? static_cast<float>(Cell.Seen) / Cell.Samples : 0.0f; });
+		WriteLayer(Base + TEXT("_Hidden.png"), Heat, Min, Size, [&Peak](const FCell& Cell) { return LogScale(Cell.Hidden, Peak.Hidden); });
+		WriteLayer(Base + TEXT("_MantleFailed.png"), Heat, Min, Size, [&Peak](const FCell& Cell) { return LogScale(Cell.MantleFailed, Peak.MantleFailed); });
+
+		// Raw numbers for spreadsheets, plus the pixel -> world mapping
+		FString Csv = FString::Printf(TEXT("# Pixel (0,0) = cell (%d,%d), CellSize %.1f\nCellX,CellY,WorldX,WorldY,Samples,Seen,Hidden,MantleSucceeded,MantleFailed\n"), Min.X, Min.Y, CellSize);
+		for (const TPair<FIntPoint, FCell>& Pair : Heat.Cells)
+		{
+			Csv += FString::Printf(TEXT("%d,%d,%.1f,%.1f,%u,%u,%u,%u,%u\n"), Pair.Key.X, Pair.Key.Y, (Pair.Key.X + 0.5f) * CellSize, (Pair.Key.Y + 0.5f) * CellSize,
+				Pair.Value.Samples, Pair.Value.Seen, Pair.Value.Hidden, Pair.Value.MantleSucceeded, Pair.Value.MantleFailed);
+		}
+		FFileHelper::SaveStringToFile(Csv, *(Base + TEXT(".csv")));
+	}
+}
+
+UStealthHeatmapCommandlet::UStealthHeatmapCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UStealthHeatmapCommandlet::Main(const FString& Params)
+{
+	using namespace StealthHeatmap;
+
+	FString InputDir = FPaths::ProjectSavedDir() / TEXT("Telemetry");
+	FString OutputDir = InputDir / TEXT("Heatmaps");
+	float CellSize = 100.0f;
+	float SeenThreshold = 0.5f;
+	FParse::Value(*Params, TEXT("Input="), InputDir);
+	FParse::Value(*Params, TEXT("Output="), OutputDir);
+	FParse::Value(*Params, TEXT("CellSize="), CellSize);
+	FParse::Value(*Params, TEXT("SeenThreshold="), SeenThreshold);
+	CellSize = FMath::Max(CellSize, 1.0f);
+	const uint8 SeenByte = static_cast<uint8>(FMath::Clamp(SeenThreshold, 0.0f, 1.0f) * 255.0f);
+
+	TArray<FString> Files;
+	IFileManager::Get().FindFiles(Files, *(InputDir / TEXT("*.sttl")), true, false);
+	if (Files.Num() == 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("StealthHeatmap: no .sttl files in %s"), *InputDir);
+		return 1;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// One session per task; each builds its own grid so nothing is shared until the merge
+	TArray<FSession> Sessions;
+	Sessions.SetNum(Files.Num());
+	ParallelFor(Files.Num(), [&](int32 Index)
+	{
+		ReadSession(InputDir / Files[Index], CellSize, SeenByte, Sessions[Index]);
+	});
+
+	TMap<FString, FMapHeat> Maps;
+	int64 TotalSamples = 0;
+	for (const FSession& Session : Sessions)
+	{
+		if (Session.bValid)
+		{
+			Maps.FindOrAdd(Session.MapName).Add(Session.Heat);
+			TotalSamples += Session.Heat.NumSamples;
+		}
+	}
+
+	IFileManager::Get().MakeDirectory(*OutputDir, true);
+	for (const TPair<FString, FMapHeat>& Map : Maps)
+	{
+		WriteMap(OutputDir, Map.Key, Map.Value, CellSize);
+		UE_LOG(LogTemp, Display, TEXT("StealthHeatmap: %s: %d sessions, %lld samples, %d cells"), *Map.Key, Map.Value.NumSessions, Map.Value.NumSamples, Map.Value.Cells.Num());
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("StealthHeatmap: %d files, %lld samples aggregated into %s in %.2f s"), Files.Num(), TotalSamples, *OutputDir, FPlatformTime::Seconds() - StartTime);
+	return 0;
+}
@@ -0,0 +1,215 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthLightSubsystem.h"
+#include "Thieflike.h"
+#include "Stealth/StealthEventBus.h"
+#include "Save/StealthSaveSubsystem.h"
+#include "Object/LightFlickerComponent.h"
+#include "Components/LocalLightComponent.h"
+#include "GameFramework/GameStateBase.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "EngineUtils.h" // For TActorIterator
+
+void UStealthLightSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	LLM_SCOPE_BYTAG(Stealth_Lights);
+
+	for (TActorIterator<AActor> It(&InWorld); It; ++It)
+	{
+		RegisterActor(*It);
+	}
+
+	// Lights that arrive or leave later: spawned and destroyed actors, and levels streaming in and out
+	ActorSpawnedHandle = InWorld.AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &UStealthLightSubsystem::RegisterActor));
+	ActorDestroyedHandle = InWorld.AddOnActorDestroyedHandler(FOnActorDestroyed::FDelegate::CreateUObject(this, &UStealthLightSubsystem::UnregisterActor));
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UStealthLightSubsystem::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UStealthLightSubsystem::OnLevelRemoved);
+
+	UE_LOG(LogTemp, Display, TEXT("StealthLights: registered %d lights"), Lights.Num());
+}
+
+void UStealthLightSubsystem::Deinitialize()
+{
+	if (UWorld* World = GetWorld())
+	{
+		World->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+		World->RemoveOnActorDestroyedHandler(ActorDestroyedHandle);
+	}
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+	Lights.Reset();
+	Super::Deinitialize();
+}
+
+void UStealthLightSubsystem::RegisterActor(AActor* Actor)
+{
+	TInlineComponentArray<ULocalLightComponent*> LightComponents(Actor);
+	for (ULocalLightComponent* LightComponent : LightComponents)
+	{
+		RegisterLight(LightComponent);
+	}
+}
+
+void UStealthLightSubsystem::UnregisterActor(AActor* Actor)
+{
+	TInlineComponentArray<ULocalLightComponent*> LightComponents(Actor);
+	for (ULocalLightComponent* LightComponent : LightComponents)
+	{
+		UnregisterLight(LightComponent);
+	}
+}
+
+void UStealthLightSubsystem::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld() || !Level)
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(Stealth_Lights);
+	for (AActor* Actor : Level->Actors)
+	{
+		if (Actor)
+		{
+			RegisterActor(Actor);
+		}
+	}
+}
+
+void UStealthLightSubsystem::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+	{
+		return;
+	}
+
+	// A null level means every level went; lights already collected go with whatever level held them
+	const int32 NumRemoved = Lights.RemoveAll([Level](const FStealthLight& Light)
+	{
+		const ULocalLightComponent* LightComponent = Light.Component.Get();
+		return !LightComponent || !Level || LightComponent->GetComponentLevel() == Level;
+	});
+	if (NumRemoved > 0)
+	{
+		++Revision;
+	}
+}
+
+FStealthLight UStealthLightSubsystem::DescribeLight(ULocalLightComponent* LightComponent)
+{
+	FStealthLight Light;
+	Light.Location = LightComponent->GetComponentLocation();
+	Light.Radius = LightComponent->AttenuationRadius;
+	Light.Intensity = LightComponent->Intensity;
+	Light.bOn = LightComponent->IsVisible();
+	Light.StableId = UStealthSaveSubsystem::StableId(LightComponent);
+	Light.Component = LightComponent;
+
+	// Torches describe their flicker instead of animating a value the stealth code would have to poll
+	const AActor* Owner = LightComponent->GetOwner();
+	if (const ULightFlickerComponent* Flicker = Owner ? Owner->FindComponentByClass<ULightFlickerComponent>() : nullptr)
+	{
+		Light.Intensity = Flicker->GetBaseIntensity(LightComponent);
+		Light.Flicker = Flicker->GetFlicker();
+	}
+	return Light;
+}
+
+double UStealthLightSubsystem::GetFlickerTime(const UWorld* World)
+{
+	if (!World)
+	{
+		return 0.0;
+	}
+	const AGameStateBase* GameState = World->GetGameState();
+	return GameState ? GameState->GetServerWorldTimeSeconds() : World->GetTimeSeconds();
+}
+
+int32 UStealthLightSubsystem::RegisterLight(ULocalLightComponent* LightComponent)
+{
+	if (!LightComponent)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 Existing = Lights.IndexOfByPredicate([LightComponent](const FStealthLight& Light) { return Light.Component.Get() == LightComponent; });
+	if (Existing != INDEX_NONE)
+	{
+		return Existing;
+	}
+
+	LLM_SCOPE_BYTAG(Stealth_Lights);
+	Lights.Add(DescribeLight(LightComponent));
+	++Revision;
+	return Lights.Num() - 1;
+}
+
+void UStealthLightSubsystem::UnregisterLight(ULocalLightComponent* LightComponent)
+{
+	if (Lights.RemoveAll([LightComponent](const FStealthLight& Light) { return Light.Component.Get() == LightComponent; }) > 0)
+	{
+		++Revision;
+	}
+}
+
+int32 UStealthLightSubsystem::DouseLightsNear(FVector Location, float Radius)
+{
+	int32 NumDoused = 0;
+	const float RadiusSq = FMath::Square(Radius);
+
+	for (int32 LightIndex = 0; LightIndex < Lights.Num(); ++LightIndex)
+	{
+		if (Lights[LightIndex].bOn && FVector::DistSquared(Lights[LightIndex].Location, Location) <= RadiusSq)
+		{
+			SetLightOn(LightIndex, false);
+			++NumDoused;
+		}
+	}
+	return NumDoused;
+}
+
+void UStealthLightSubsystem::SetLightOn(int32 LightIndex, bool bOn)
+{
+	FStealthLight& Light = Lights[LightIndex];
+	if (Light.bOn == bOn)
+	{
+		return;
+	}
+
+	Light.bOn = bOn;
+	++StateRevision;
+	if (ULocalLightComponent* LightComponent = Light.Component.Get())
+	{
+		LightComponent->SetVisibility(bOn);
+	}
+
+	if (UStealthEventBus* EventBus = GetWorld()->GetSubsystem<UStealthEventBus>())
+	{
+		EventBus->Post(EStealthEventType::LightToggled, Light.Component.IsValid() ? Light.Component->GetOwner() : nullptr, Light.Location, bOn ? 1.0f : 0.0f);
+	}
+}
+
+void UStealthLightSubsystem::RefreshFlicker(ULocalLightComponent* LightComponent)
+{
+	const AActor* Owner = LightComponent ? LightComponent->GetOwner() : nullptr;
+	const ULightFlickerComponent* Flicker = Owner ? Owner->FindComponentByClass<ULightFlickerComponent>() : nullptr;
+	if (!Flicker)
+	{
+		return;
+	}
+
+	for (FStealthLight& Light : Lights)
+	{
+		if (Light.Component.Get() == LightComponent)
+		{
+			Light.Flicker = Flicker->GetFlicker();
+			// Cached exposure holds the old flicker terms
+			++StateRevision;
+		}
+	}
+}
@@ -0,0 +1,301 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthMemory.h"
+#include "Thieflike.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/ScopeLock.h"
+
+namespace StealthMemory
+{
+	constexpr SIZE_T InitialArenaCapacity = 64 * 1024;
+
+	void CountOverflow();
+}
+
+FStealthFrameArena& FStealthFrameArena::Get()
+{
+	static FStealthFrameArena Arena;
+	return Arena;
+}
+
+FStealthFrameArena::FStealthFrameArena()
+{
+	// Created by the module at startup, so the delegate below is bound on the game thread
+	check(IsInGameThread());
+
+	LLM_SCOPE_BYTAG(Stealth_FrameArena);
+	Capacity = StealthMemory::InitialArenaCapacity;
+	Block = static_cast<uint8*>(FMemory::Malloc(Capacity, PLATFORM_CACHE_LINE_SIZE));
+
+	// Rewound before anything of the new frame runs; lives as long as the process
+	FCoreDelegates::OnBeginFrame.AddRaw(this, &FStealthFrameArena::Rewind);
+}
+
+void* FStealthFrameArena::Allocate(SIZE_T Size, SIZE_T Alignment)
+{
+	// Reserve enough to align anywhere in the block, so the bump never needs a retry
+	const SIZE_T Reserved = Align(FMath::Max<SIZE_T>(Size, 1), Alignment) + Alignment - 1;
+	const SIZE_T Start = Used.fetch_add(Reserved, std::memory_order_relaxed);
+	if (Start + Reserved <= Capacity)
+	{
+		return Align(Block + Start, Alignment);
+	}
+
+#if !UE_BUILD_SHIPPING
+	StealthMemory::CountOverflow();
+#endif
+	LLM_SCOPE_BYTAG(Stealth_FrameArena);
+	void* Memory = FMemory::Malloc(FMath::Max<SIZE_T>(Size, 1), Alignment);
+	FScopeLock Lock(&OverflowLock);
+	OverflowBlocks.Add(Memory);
+	++NumOverflows;
+	return Memory;
+}
+
+void FStealthFrameArena::Rewind()
+{
+	check(IsInGameThread());
+
+	for (void* Memory : OverflowBlocks)
+	{
+		FMemory::Free(Memory);
+	}
+	OverflowBlocks.Reset();
+
+	// Grow once to what the last frame needed, so the next one like it fits
+	const SIZE_T Requested = Used.load(std::memory_order_relaxed);
+	if (Requested > Capacity)
+	{
+		LLM_SCOPE_BYTAG(Stealth_FrameArena);
+		FMemory::Free(Block);
+		Capacity = FMath::RoundUpToPowerOfTwo64(Requested);
+		Block = static_cast<uint8*>(FMemory::Malloc(Capacity, PLATFORM_CACHE_LINE_SIZE));
+		UE_LOG(LogTemp, Verbose, TEXT("StealthFrameArena: grown to %llu KB"), static_cast<uint64>(Capacity / 1024));
+	}
+	Used.store(0, std::memory_order_relaxed);
+}
+
+#if !UE_BUILD_SHIPPING
+
+namespace StealthMemory
+{
+	// Hot path the current thread is in, null outside of one
+	thread_local const TCHAR* CurrentHotPath = nullptr;
+
+	struct FHotPathCount
+	{
+		std::atomic<const TCHAR*> Name{ nullptr };
+		// Every heap allocation made inside the hot path, frame arena fallbacks included
+		std::atomic<int32> Allocations{ 0 };
+		std::atomic<int32> Overflows{ 0 };
+	};
+
+	// Fixed table so counting never allocates. Slot 0 collects frame arena fallbacks on worker threads outside any
+	// hot path scope, and hot paths past the end of the table.
+	constexpr int32 MaxHotPaths = 32;
+	FHotPathCount HotPathCounts[MaxHotPaths];
+	std::atomic<int32> NumHotPaths{ 1 };
+	FCriticalSection HotPathLock;
+
+	std::atomic<bool> bCounting{ false };
+
+	FHotPathCount& FindHotPath(const TCHAR* Name)
+	{
+		auto Find = [Name]() -> FHotPathCount*
+		{
+			const int32 Num = NumHotPaths.load(std::memory_order_acquire);
+			for (int32 Index = 1; Index < Num; ++Index)
+			{
+				const TCHAR* SlotName = HotPathCounts[Index].Name.load(std::memory_order_relaxed);
+				if (SlotName == Name || FCString::Strcmp(SlotName, Name) == 0)
+				{
+					return &HotPathCounts[Index];
+				}
+			}
+			return nullptr;
+		};
+
+		if (FHotPathCount* Count = Find())
+		{
+			return *Count;
+		}
+
+		FScopeLock Lock(&HotPathLock);
+		if (FHotPathCount* Count = Find())
+		{
+			return *Count;
+		}
+		const int32 Num = NumHotPaths.load(std::memory_order_relaxed);
+		if (Num == MaxHotPaths)
+		{
+			return HotPathCounts[0];
+		}
+		HotPathCounts[Num].Name.store(Name, std::memory_order_relaxed);
+		NumHotPaths.store(Num + 1, std::memory_order_release);
+		return HotPathCounts[Num];
+	}
+
+	void CountOverflow()
+	{
+		const TCHAR* Name = CurrentHotPath;
+		if (!bCounting.load(std::memory_order_relaxed) || (IsInGameThread() && !Name))
+		{
+			return;
+		}
+		++(Name ? FindHotPath(Name) : HotPathCounts[0]).Overflows;
+	}
+
+	/**
+	 * Forwards everything to the allocator it wraps and counts the allocations made on threads inside a hot path
+	 * scope while a check runs. Installed the first time a check starts and never removed, the way the engine's
+	 * poison and purgatory proxies are, so blocks from either side of the swap are always freed by the same heap.
+	 */
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+		explicit FCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+		virtual void* Malloc(SIZE_T Size, uint32 Alignment) override { Count(); return Inner->Malloc(Size, Alignment); }
+		virtual void* TryMalloc(SIZE_T Size, uint32 Alignment) override { Count(); return Inner->TryMalloc(Size, Alignment); }
+		virtual void* Realloc(void* Ptr, SIZE_T NewSize, uint32 Alignment) override { if (NewSize > 0) { Count(); } return Inner->Realloc(Ptr, NewSize, Alignment); }
+		virtual void* TryRealloc(void* Ptr, SIZE_T NewSize, uint32 Alignment) override { if (NewSize > 0) { Count(); } return Inner->TryRealloc(Ptr, NewSize, Alignment); }
+		virtual void Free(void* Ptr) override { Inner->Free(Ptr); }
+
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+		virtual void UpdateStats() override { Inner->UpdateStats(); }
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+	private:
+		static void Count()
+		{
+			const TCHAR* Name = CurrentHotPath;
+			if (Name && bCounting.load(std::memory_order_relaxed))
+			{
+				++FindHotPath(Name).Allocations;
+			}
+		}
+
+		FMalloc* Inner;
+	};
+
+	void InstallCountingMalloc()
+	{
+		check(IsInGameThread());
+		static FCountingMalloc* CountingMalloc = nullptr;
+		if (!CountingMalloc)
+		{
+			CountingMalloc = new FCountingMalloc(GMalloc);
+			GMalloc = CountingMalloc;
+		}
+	}
+
+	struct FSteadyStateCheck
+	{
+		int32 WarmupFramesLeft = 0;
+		int32 FramesLeft = 0;
+		int32 Frames = 0;
+		int32 StartOverflows = 0;
+		SIZE_T StartCapacity = 0;
+		FDelegateHandle EndFrameHandle;
+	};
+	FSteadyStateCheck Check;
+
+	void OnEndFrame()
+	{
+		if (Check.WarmupFramesLeft > 0)
+		{
+			if (--Check.WarmupFramesLeft == 0)
+			{
+				for (FHotPathCount& Count : HotPathCounts)
+				{
+					Count.Allocations = 0;
+					Count.Overflows = 0;
+				}
+				Check.StartOverflows = FStealthFrameArena::Get().GetNumOverflows();
+				Check.StartCapacity = FStealthFrameArena::Get().GetCapacity();
+				bCounting = true;
+			}
+			return;
+		}
+
+		if (--Check.FramesLeft > 0)
+		{
+			return;
+		}
+
+		bCounting = false;
+		FCoreDelegates::OnEndFrame.Remove(Check.EndFrameHandle);
+
+		// Overflows outside any hot path scope (one-off tools, say) are listed but not held against the hot paths
+		const FStealthFrameArena& Arena = FStealthFrameArena::Get();
+		const int32 AllOverflows = Arena.GetNumOverflows() - Check.StartOverflows;
+		UE_LOG(LogTemp, Display, TEXT("  frame arena: %llu KB, %d heap fallbacks in all, grown by %llu KB during the check"),
+			static_cast<uint64>(Arena.GetCapacity() / 1024), AllOverflows, static_cast<uint64>((Arena.GetCapacity() - Check.StartCapacity) / 1024));
+
+		int32 Total = 0;
+		for (int32 Index = 0; Index < NumHotPaths; ++Index)
+		{
+			const int32 Allocations = HotPathCounts[Index].Allocations;
+			const int32 Overflows = HotPathCounts[Index].Overflows;
+			Total += Allocations + (Index == 0 ? Overflows : 0);
+			if (Allocations > 0 || Overflows > 0)
+			{
+				UE_LOG(LogTemp, Display, TEXT("  %s: %d heap allocations (%.2f per frame), %d of them frame arena fallbacks"),
+					Index == 0 ? TEXT("(other threads)") : HotPathCounts[Index].Name.load(), FMath::Max(Allocations, Overflows), static_cast<float>(FMath::Max(Allocations, Overflows)) / Check.Frames, Overflows);
+			}
+		}
+
+		if (Total == 0)
+		{
+			UE_LOG(LogTemp, Display, TEXT("Stealth steady-state allocations: PASS, stealth hot paths made no heap allocations over %d frames"), Check.Frames);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("Stealth steady-state allocations: FAIL, stealth hot paths made %d heap allocations over %d frames"), Total, Check.Frames);
+		}
+	}
+}
+
+FStealthHotPathScope::FStealthHotPathScope(const TCHAR* Name)
+	: PreviousName(StealthMemory::CurrentHotPath)
+{
+	StealthMemory::CurrentHotPath = Name;
+}
+
+FStealthHotPathScope::~FStealthHotPathScope()
+{
+	StealthMemory::CurrentHotPath = PreviousName;
+}
+
+// Play for a while, then count heap allocations inside STEALTH_HOT_PATH_SCOPE blocks. Works headless (-nullrhi).
+static FAutoConsoleCommand GStealthMemoryCheckCommand(
+	TEXT("Stealth.Memory.CheckSteadyState"),
+	TEXT("Counts heap allocations made in stealth hot paths after warm-up, frame arena fallbacks included, and expects none. Usage: Stealth.Memory.CheckSteadyState [WarmupFrames=120] [Frames=600]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		using namespace StealthMemory;
+
+		if (Check.EndFrameHandle.IsValid() && (Check.WarmupFramesLeft > 0 || Check.FramesLeft > 0))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Stealth.Memory.CheckSteadyState is already running"));
+			return;
+		}
+
+		InstallCountingMalloc();
+		Check.WarmupFramesLeft = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 120, 1);
+		Check.Frames = Check.FramesLeft = FMath::Max(Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 600, 1);
+		Check.EndFrameHandle = FCoreDelegates::OnEndFrame.AddStatic(&StealthMemory::OnEndFrame);
+	}));
+
+#endif
@@ -0,0 +1,10 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthSettings.h"
+
+UStealthSettings::UStealthSettings()
+{
+	CategoryName = TEXT("Game");
+	SectionName = TEXT("Stealth");
+}
@@ -0,0 +1,489 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthStreamingSubsystem.h"
+#include "Thieflike.h"
+#include "Stealth/StealthSettings.h"
+#include "Stealth/StealthMemory.h"
+#include "Movement/ClimbableIndexSubsystem.h"
+#include "Object/Door.h"
+#include "Tasks/Task.h"
+#include "UObject/GarbageCollection.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Streaming Patch Cells"), STAT_StealthStreamingPatch, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Streaming Loaded Cells"), STAT_StealthStreamingCells, STATGROUP_Stealth);
+
+void UStealthStreamingSubsystem::Deinitialize()
+{
+	for (TPair<TObjectKey<AActor>, TSharedPtr<FStreamedCell, ESPMode::ThreadSafe>>& Pair : Cells)
+	{
+		Pair.Value->bCancelled = true;
+	}
+	Cells.Empty();
+	PatchingCells.Empty();
+	BakedExposure.Empty();
+	Ledges.Empty();
+	LedgeCells.Empty();
+	Portals.Empty();
+	PortalDoors.Empty();
+
+	Super::Deinitialize();
+}
+
+uint32 UStealthStreamingSubsystem::GetDoorId(const AActor* Door)
+{
+	const FVector Location = Door ? Door->GetActorLocation() : FVector::ZeroVector;
+	return GetTypeHash(FIntVector(FMath::RoundToInt(Location.X), FMath::RoundToInt(Location.Y), FMath::RoundToInt(Location.Z)));
+}
+
+TStatId UStealthStreamingSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UStealthStreamingSubsystem, STATGROUP_Stealth);
+}
+
+void UStealthStreamingSubsystem::AddCell(const AActor* CellOwner, const UStealthCellData* Data)
+{
+	if (!CellOwner || !Data)
+	{
+		return;
+	}
+
+	RemoveCell(CellOwner);
+
+	LLM_SCOPE_BYTAG(Stealth_Streaming);
+	TSharedPtr<FStreamedCell, ESPMode::ThreadSafe> Cell = MakeShared<FStreamedCell, ESPMode::ThreadSafe>();
+	Cell->Owner = CellOwner;
+	Cells.Add(CellOwner, Cell);
+
+	// Convert to runtime form on a worker. The GC guard keeps the asset alive while we read it; a cell
+	// cancelled before the guard was taken may already have lost its asset, so it is skipped.
+	UE::Tasks::Launch(UE_SOURCE_LOCATION, [Queue = PreparedCells, Cell, Data]()
+	{
+		FGCScopeGuard GCGuard;
+		if (Cell->bCancelled)
+		{
+			return;
+		}
+		LLM_SCOPE_BYTAG(Stealth_Streaming);
+
+		Cell->Exposure.Reserve(Data->ExposureSamples.Num());
+		for (const FStealthExposureSample& Sample : Data->ExposureSamples)
+		{
+			Cell->Exposure.Emplace(ExposureKey(Sample.Location), Sample.Exposure);
+		}
+
+		Cell->Climbables.Reserve(Data->Climbables.Num());
+		for (const FStealthClimbable& Climbable : Data->Climbables)
+		{
+			FClimbableSurface& Surface = Cell->Climbables.AddDefaulted_GetRef();
+			Surface.Bottom = Climbable.Bottom;
+			Surface.Top = Climbable.Top;
+			Surface.Normal = Climbable.Normal.GetSafeNormal();
+			Surface.HalfWidth = Climbable.HalfWidth;
+			Surface.Type = Climbable.Type;
+		}
+
+		Cell->Ledges = Data->Ledges;
+		Cell->Portals = Data->Portals;
+
+		Queue->Enqueue(Cell);
+	});
+}
+
+void UStealthStreamingSubsystem::RemoveCell(const AActor* CellOwner)
+{
+	TSharedPtr<FStreamedCell, ESPMode::ThreadSafe> Cell;
+	if (!Cells.RemoveAndCopyValue(CellOwner, Cell))
+	{
+		return;
+	}
+
+	// Still on a worker or waiting in the queue: dropped when it comes out
+	const double StartTime = FPlatformTime::Seconds();
+	Cell->bCancelled = true;
+	PatchingCells.Remove(Cell);
+	UnpatchCell(*Cell);
+
+	if (bFlyThrough)
+	{
+		FlyThroughWorstRemoveMs = FMath::Max(FlyThroughWorstRemoveMs, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+	}
+}
+
+void UStealthStreamingSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_StealthStreamingPatch);
+	LLM_SCOPE_BYTAG(Stealth_Streaming);
+	STEALTH_HOT_PATH_SCOPE("Streaming");
+
+	TSharedPtr<FStreamedCell, ESPMode::ThreadSafe> Prepared;
+	while (PreparedCells->Dequeue(Prepared))
+	{
+		if (!Prepared->bCancelled)
+		{
+			PatchingCells.Add(Prepared);
+		}
+	}
+
+	if (PatchingCells.Num() > 0)
+	{
+		const double BudgetEnd = FPlatformTime::Seconds() + UStealthSettings::Get()->CellPatchBudgetMs / 1000.0;
+
+		while (PatchingCells.Num() > 0 && FPlatformTime::Seconds() < BudgetEnd)
+		{
+			FStreamedCell& Cell = *PatchingCells[0];
+			if (!PatchCell(Cell, BudgetEnd))
+			{
+				break;
+			}
+
+			UE_LOG(LogTemp, Verbose, TEXT("StealthStreaming: cell patched in %.3f ms of game thread time over %d frames"), Cell.GameThreadSeconds * 1000.0, Cell.FramesToPatch);
+			if (bFlyThrough)
+			{
+				STEALTH_HOT_PATH_SUSPEND();
+				FlyThroughPatchMs.Add(Cell.GameThreadSeconds * 1000.0);
+				FlyThroughMaxFrames = FMath::Max(FlyThroughMaxFrames, Cell.FramesToPatch);
+			}
+			if (Cell.GameThreadSeconds > 0.001)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("StealthStreaming: cell took %.3f ms of game thread time (target < 1 ms)"), Cell.GameThreadSeconds * 1000.0);
+			}
+			PatchingCells.RemoveAt(0);
+		}
+	}
+
+	SET_DWORD_STAT(STAT_StealthStreamingCells, Cells.Num());
+
+	if (bFlyThrough)
+	{
+		STEALTH_HOT_PATH_SUSPEND();
+		TickFlyThrough(DeltaTime);
+	}
+}
+
+namespace StealthStreaming
+{
+	// Check the clock every few items rather than every item
+	constexpr int32 ItemsPerClockCheck = 64;
+
+	// A climber has to face the wall below a ledge at least this squarely to pull up onto it
+	constexpr float LedgeFacingCos = 0.5f;
+
+	FBox GetLedgeBounds(const FStealthLedge& Ledge)
+	{
+		return FBox(Ledge.Start.ComponentMin(Ledge.End), Ledge.Start.ComponentMax(Ledge.End));
+	}
+
+	// Applies Func to Items from Next onwards until done or out of time. Returns true when the range is done.
+	template <typename ItemType, typename FuncType>
+	bool PatchRange(const TArray<ItemType>& Items, int32& Next, double BudgetEnd, FuncType&& Func)
+	{
+		for (; Next < Items.Num(); ++Next)
+		{
+			if (Next % ItemsPerClockCheck == 0 && FPlatformTime::Seconds() >= BudgetEnd)
+			{
+				return false;
+			}
+			Func(Items[Next]);
+		}
+		return true;
+	}
+}
+
+template <typename FuncType>
+void UStealthStreamingSubsystem::ForEachLedgeCell(const FBox& Bounds, FuncType&& Func)
+{
+	const FIntVector Min(FMath::FloorToInt(Bounds.Min.X / LedgeCellSize), FMath::FloorToInt(Bounds.Min.Y / LedgeCellSize), FMath::FloorToInt(Bounds.Min.Z / LedgeCellSize));
+	const FIntVector Max(FMath::FloorToInt(Bounds.Max.X / LedgeCellSize), FMath::FloorToInt(Bounds.Max.Y / LedgeCellSize), FMath::FloorToInt(Bounds.Max.Z / LedgeCellSize));
+
+	for (int32 X = Min.X; X <= Max.X; ++X)
+	{
+		for (int32 Y = Min.Y; Y <= Max.Y; ++Y)
+		{
+			for (int32 Z = Min.Z; Z <= Max.Z; ++Z)
+			{
+				Func(FIntVector(X, Y, Z));
+			}
+		}
+	}
+}
+
+bool UStealthStreamingSubsystem::PatchCell(FStreamedCell& Cell, double BudgetEnd)
+{
+	using namespace StealthStreaming;
+
+	const double StartTime = FPlatformTime::Seconds();
+	++Cell.FramesToPatch;
+
+	UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>();
+
+	const bool bDone =
+		PatchRange(Cell.Exposure, Cell.NextExposure, BudgetEnd, [this](const TPair<FIntVector, uint8>& Sample)
+		{
+			FBakedExposure& Baked = BakedExposure.FindOrAdd(Sample.Key);
+			Baked.ExposureSum += Sample.Value;
+			++Baked.NumCells;
+		}) &&
+		PatchRange(Cell.Climbables, Cell.NextClimbable, BudgetEnd, [&Cell, ClimbableIndex](const FClimbableSurface& Surface)
+		{
+			if (ClimbableIndex)
+			{
+				Cell.ClimbableHandles.Add(ClimbableIndex->AddSurface(Surface));
+			}
+		}) &&
+		PatchRange(Cell.Ledges, Cell.NextLedge, BudgetEnd, [this, &Cell](const FStealthLedge& Ledge)
+		{
+			const int32 LedgeId = Ledges.Add(Ledge);
+			Cell.LedgeIds.Add(LedgeId);
+			ForEachLedgeCell(GetLedgeBounds(Ledge), [this, LedgeId](const FIntVector& Key)
+			{
+				LedgeCells.FindOrAdd(Key).Add(LedgeId);
+			});
+		}) &&
+		PatchRange(Cell.Portals, Cell.NextPortal, BudgetEnd, [this, &Cell](const FStealthPortal& Portal)
+		{
+			Cell.PortalIds.Add(Portals.Add(Portal));
+		});
+
+	Cell.GameThreadSeconds += FPlatformTime::Seconds() - StartTime;
+	return bDone;
+}
+
+void UStealthStreamingSubsystem::UnpatchCell(FStreamedCell& Cell)
+{
+	for (int32 Index = 0; Index < Cell.NextExposure; ++Index)
+	{
+		const FIntVector& Key = Cell.Exposure[Index].Key;
+		if (FBakedExposure* Baked = BakedExposure.Find(Key))
+		{
+			Baked->ExposureSum -= Cell.Exposure[Index].Value;
+			if (--Baked->NumCells == 0)
+			{
+				BakedExposure.Remove(Key);
+			}
+		}
+	}
+
+	if (UClimbableIndexSubsystem* ClimbableIndex = GetWorld()->GetSubsystem<UClimbableIndexSubsystem>())
+	{
+		for (const FClimbableHandle& Handle : Cell.ClimbableHandles)
+		{
+			ClimbableIndex->RemoveSurface(Handle);
+		}
+	}
+
+	for (const int32 LedgeId : Cell.LedgeIds)
+	{
+		ForEachLedgeCell(StealthStreaming::GetLedgeBounds(Ledges[LedgeId]), [this, LedgeId](const FIntVector& Key)
+		{
+			if (TArray<int32>* CellLedges = LedgeCells.Find(Key))
+			{
+				CellLedges->RemoveSingleSwap(LedgeId);
+				if (CellLedges->Num() == 0)
+				{
+					LedgeCells.Remove(Key);
+				}
+			}
+		});
+		Ledges.RemoveAt(LedgeId);
+	}
+
+	for (const int32 PortalId : Cell.PortalIds)
+	{
+		Portals.RemoveAt(PortalId);
+	}
+
+	Cell.NextExposure = Cell.NextClimbable = Cell.NextLedge = Cell.NextPortal = 0;
+	Cell.ClimbableHandles.Reset();
+	Cell.LedgeIds.Reset();
+	Cell.PortalIds.Reset();
+}
+
+bool UStealthStreamingSubsystem::SampleBakedExposure(const FVector& Location, float& OutExposure) const
+{
+	if (const FBakedExposure* Baked = BakedExposure.Find(ExposureKey(Location)))
+	{
+		OutExposure = Baked->ExposureSum / (255.0f * Baked->NumCells);
+		return true;
+	}
+	return false;
+}
+
+bool UStealthStreamingSubsystem::FindLedge(const FVector& Location, const FVector& Forward, float MaxDistance, float MinHeight, float MaxHeight, FVector& OutPoint) const
+{
+	const FVector Forward2D = Forward.GetSafeNormal2D();
+	const FBox Reach(Location + FVector(-MaxDistance, -MaxDistance, MinHeight), Location + FVector(MaxDistance, MaxDistance, MaxHeight));
+
+	float BestDistanceSq = FMath::Square(MaxDistance);
+	bool bFound = false;
+	ForEachLedgeCell(Reach, [&](const FIntVector& Key)
+	{
+		const TArray<int32>* CellLedges = LedgeCells.Find(Key);
+		if (!CellLedges)
+		{
+			return;
+		}
+
+		for (const int32 LedgeId : *CellLedges)
+		{
+			const FStealthLedge& Ledge = Ledges[LedgeId];
+			if ((Ledge.Normal | Forward2D) > -StealthStreaming::LedgeFacingCos)
+			{
+				continue;
+			}
+
+			// Closest along the edge to where the climber stands, ignoring height
+			const FVector Level(Location.X, Location.Y, (Ledge.Start.Z + Ledge.End.Z) * 0.5f);
+			const FVector Point = FMath::ClosestPointOnSegment(Level, Ledge.Start, Ledge.End);
+			const FVector ToPoint = Point - Location;
+			const float DistanceSq = ToPoint.SizeSquared2D();
+			if (ToPoint.Z < MinHeight || ToPoint.Z > MaxHeight || DistanceSq >= BestDistanceSq || (ToPoint | Forward2D) <= 0.0f || (ToPoint | Ledge.Normal) >= 0.0f)
+			{
+				continue;
+			}
+
+			BestDistanceSq = DistanceSq;
+			OutPoint = Point;
+			bFound = true;
+		}
+	});
+	return bFound;
+}
+
+void UStealthStreamingSubsystem::RegisterDoor(const ADoor* Door)
+{
+	LLM_SCOPE_BYTAG(Stealth_Streaming);
+	PortalDoors.Add(GetDoorId(Door), Door);
+}
+
+void UStealthStreamingSubsystem::UnregisterDoor(const ADoor* Door)
+{
+	const uint32 DoorId = GetDoorId(Door);
+	const TWeakObjectPtr<const ADoor>* Registered = PortalDoors.Find(DoorId);
+	if (Registered && Registered->Get() == Door)
+	{
+		PortalDoors.Remove(DoorId);
+	}
+}
+
+int32 UStealthStreamingSubsystem::GatherClosedPortals(const FBox& Area, TArrayView<FBox> OutBoxes) const
+{
+	int32 NumClosed = 0;
+	for (const FStealthPortal& Portal : Portals)
+	{
+		const FBox Box = FBox::BuildAABB(Portal.Location, Portal.Extent);
+		const TWeakObjectPtr<const ADoor>* Door = PortalDoors.Find(Portal.DoorId);
+		const ADoor* DoorActor = Door ? Door->Get() : nullptr;
+
+		// A door still swinging shut doesn't block anything yet
+		if (DoorActor && DoorActor->isClosed && !DoorActor->Closing && Box.Intersect(Area))
+		{
+			OutBoxes[NumClosed++] = Box;
+		}
+	}
+	return NumClosed;
+}
+
+void UStealthStreamingSubsystem::StartFlyThrough(float Speed, float Distance)
+{
+	APawn* Pawn = UGameplayStatics::GetPlayerPawn(this, 0);
+	if (!Pawn)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StealthStreaming: fly-through needs a player pawn"));
+		return;
+	}
+
+	// The pawn is the World Partition streaming source; it is moved directly, without collision or gravity
+	FlyThroughPawn = Pawn;
+	FlyThroughStart = Pawn->GetActorLocation();
+	FlyThroughDirection = Pawn->GetControlRotation().Vector().GetSafeNormal2D();
+	if (FlyThroughDirection.IsNearlyZero())
+	{
+		FlyThroughDirection = FVector::ForwardVector;
+	}
+	FlyThroughSpeed = FMath::Max(Speed, 1.0f);
+	FlyThroughDistance = FMath::Max(Distance, 1.0f);
+	FlyThroughTravelled = 0.0f;
+	FlyThroughPatchMs.Reset();
+	FlyThroughWorstRemoveMs = 0.0;
+	FlyThroughMaxFrames = 0;
+
+	Pawn->SetActorEnableCollision(false);
+	if (ACharacter* Character = Cast<ACharacter>(Pawn))
+	{
+		Character->GetCharacterMovement()->SetMovementMode(MOVE_Flying);
+		Character->GetCharacterMovement()->StopMovementImmediately();
+	}
+	bFlyThrough = true;
+}
+
+void UStealthStreamingSubsystem::TickFlyThrough(float DeltaTime)
+{
+	APawn* Pawn = FlyThroughPawn.Get();
+	if (!Pawn)
+	{
+		bFlyThrough = false;
+		UE_LOG(LogTemp, Warning, TEXT("StealthStreaming: fly-through pawn went away"));
+		return;
+	}
+
+	// Out and back, so cells stream out behind the pawn as well as in ahead of it
+	FlyThroughTravelled += FlyThroughSpeed * DeltaTime;
+	const float Along = FlyThroughTravelled <= FlyThroughDistance ? FlyThroughTravelled : FMath::Max(2.0f * FlyThroughDistance - FlyThroughTravelled, 0.0f);
+	Pawn->SetActorLocation(FlyThroughStart + FlyThroughDirection * Along, false, nullptr, ETeleportType::TeleportPhysics);
+
+	if (FlyThroughTravelled >= 2.0f * FlyThroughDistance && PatchingCells.Num() == 0)
+	{
+		bFlyThrough = false;
+		Pawn->SetActorEnableCollision(true);
+		if (ACharacter* Character = Cast<ACharacter>(Pawn))
+		{
+			Character->GetCharacterMovement()->SetMovementMode(MOVE_Falling);
+		}
+		ReportFlyThrough();
+	}
+}
+
+void UStealthStreamingSubsystem::ReportFlyThrough()
+{
+	if (FlyThroughPatchMs.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StealthStreaming fly-through: no cells streamed in, fly further or check the level has baked cell data"));
+		return;
+	}
+
+	TArray<double> Sorted = FlyThroughPatchMs;
+	Sorted.Sort();
+	double Total = 0.0;
+	int32 OverBudget = 0;
+	for (const double Sample : Sorted)
+	{
+		Total += Sample;
+		OverBudget += Sample >= 1.0 ? 1 : 0;
+	}
+	const double P95 = Sorted[FMath::Min(FMath::FloorToInt(Sorted.Num() * 0.95f), Sorted.Num() - 1)];
+
+	// Every cell counts: one slow cell is a hitch however fast the others were
+	UE_LOG(LogTemp, Display, TEXT("StealthStreaming fly-through: %d cells patched in, game thread time mean %.3f ms, p95 %.3f ms, max %.3f ms, up to %d frames per cell, slowest removal %.3f ms, %d cells at or over 1 ms: %s"),
+		Sorted.Num(), Total / Sorted.Num(), P95, Sorted.Last(), FlyThroughMaxFrames, FlyThroughWorstRemoveMs, OverBudget, OverBudget == 0 ? TEXT("PASS") : TEXT("FAIL"));
+}
+
+#if !UE_BUILD_SHIPPING
+// Stealth.Streaming.FlyThrough [Speed] [Distance] - run headless on a World Partition map, e.g.
+// -nullrhi -ExecCmds="Stealth.Streaming.FlyThrough 2000 40000"
+static FAutoConsoleCommandWithWorldAndArgs StealthStreamingFlyThroughCommand(
+	TEXT("Stealth.Streaming.FlyThrough"),
+	TEXT("Flies the player out along their view and back so cells stream in and out, then logs the game thread time of each cell patch and PASS if all stay under 1 ms. Args: [Speed=2000] [Distance=40000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UStealthStreamingSubsystem* Streaming = World ? World->GetSubsystem<UStealthStreamingSubsystem>() : nullptr)
+		{
+			Streaming->StartFlyThrough(Args.Num() > 0 ? FCString::Atof(*Args[0]) : 2000.0f, Args.Num() > 1 ? FCString::Atof(*Args[1]) : 40000.0f);
+		}
+	}));
+#endif
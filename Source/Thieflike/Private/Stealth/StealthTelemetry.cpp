@@ -0,0 +1,264 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Stealth/StealthTelemetry.h"
+#include "Thieflike.h"
+#include "Stealth/StealthSettings.h"
+#include "Stealth/StealthEventBus.h"
+#include "Stealth/StealthMemory.h"
+#include "Character/PlayerCharacter.h"
+#include "Kismet/GameplayStatics.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Telemetry Record"), STAT_StealthTelemetryRecord, STATGROUP_Stealth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Telemetry Dropped Samples"), STAT_StealthTelemetryDropped, STATGROUP_Stealth);
+
+namespace StealthTelemetry
+{
+	// Write at least this often so a crash loses little
+	constexpr float FlushInterval = 2.0f;
+
+	constexpr double FrameBudgetMs = 0.05;
+}
+
+bool UStealthTelemetrySubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UStealthTelemetrySubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	const UStealthSettings* Settings = UStealthSettings::Get();
+	if (!Settings->bRecordTelemetry && !FParse::Param(FCommandLine::Get(), TEXT("StealthTelemetry")))
+	{
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(Stealth_Telemetry);
+
+	const int32 RingSize = FMath::RoundUpToPowerOfTwo(FMath::Max(Settings->TelemetryRingSize, 64));
+	Ring.SetNumZeroed(RingSize);
+	Mask = RingSize - 1;
+
+	const FString MapName = UWorld::RemovePIEPrefix(InWorld.GetMapName());
+	const FDateTime Now = FDateTime::UtcNow();
+	Header.StartTimeUnix = Now.ToUnixTimestamp();
+	FCStringAnsi::Strncpy(Header.MapName, TCHAR_TO_ANSI(*MapName), UE_ARRAY_COUNT(Header.MapName));
+	FilePath = FPaths::ProjectSavedDir() / TEXT("Telemetry") / FString::Printf(TEXT("%s_%s.sttl"), *MapName, *Now.ToString());
+
+	SessionStartTime = InWorld.GetTimeSeconds();
+	bRecording = true;
+
+	if (UStealthEventBus* EventBus = InWorld.GetSubsystem<UStealthEventBus>())
+	{
+		MantleStartHandle = EventBus->OnEvent(EStealthEventType::MantleStart).AddUObject(this, &UStealthTelemetrySubsystem::OnMantleEvent);
+		MantleStopHandle = EventBus->OnEvent(EStealthEventType::MantleStop).AddUObject(this, &UStealthTelemetrySubsystem::OnMantleEvent);
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("StealthTelemetry: recording to %s"), *FilePath);
+}
+
+void UStealthTelemetrySubsystem::Deinitialize()
+{
+	if (bRecording)
+	{
+		if (UStealthEventBus* EventBus = GetWorld()->GetSubsystem<UStealthEventBus>())
+		{
+			EventBus->OnEvent(EStealthEventType::MantleStart).Remove(MantleStartHandle);
+			EventBus->OnEvent(EStealthEventType::MantleStop).Remove(MantleStopHandle);
+		}
+
+		// Write whatever is left before the ring goes away
+		FlushTask.Wait();
+		WritePending();
+		File.Reset();
+
+		UE_LOG(LogTemp, Display, TEXT("StealthTelemetry: %u samples written, %u dropped, recording cost %.4f ms/frame on average (worst %.4f ms)"),
+			Tail.load(), DroppedSamples, GetAverageFrameMs(), GetWorstFrameMs());
+		if (GetAverageFrameMs() > StealthTelemetry::FrameBudgetMs)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("StealthTelemetry: recording averaged %.4f ms/frame (budget %.2f ms)"), GetAverageFrameMs(), StealthTelemetry::FrameBudgetMs);
+		}
+		bRecording = false;
+	}
+
+	Ring.Empty();
+	Super::Deinitialize();
+}
+
+TStatId UStealthTelemetrySubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UStealthTelemetrySubsystem, STATGROUP_Stealth);
+}
+
+void UStealthTelemetrySubsystem::Tick(float DeltaTime)
+{
+	if (!bRecording)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_StealthTelemetryRecord);
+	STEALTH_HOT_PATH_SCOPE("Telemetry");
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	TimeSinceSample += DeltaTime;
+	const float SampleInterval = UStealthSettings::Get()->TelemetrySampleInterval;
+	if (TimeSinceSample >= SampleInterval)
+	{
+		TimeSinceSample = FMath::Fmod(TimeSinceSample, SampleInterval);
+		RecordPlayer(EStealthTelemetryEvent::None);
+	}
+
+	TimeSinceFlush += DeltaTime;
+	if (TimeSinceFlush >= StealthTelemetry::FlushInterval || Head.load(std::memory_order_relaxed) - Tail.load(std::memory_order_relaxed) >= static_cast<uint32>(Ring.Num() / 2))
+	{
+		Flush();
+	}
+
+	const double Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+	RecordSeconds += Seconds;
+	WorstFrameSeconds = FMath::Max(WorstFrameSeconds, Seconds);
+	++NumTimedFrames;
+
+	SET_DWORD_STAT(STAT_StealthTelemetryDropped, DroppedSamples);
+}
+
+void UStealthTelemetrySubsystem::OnMantleEvent(const FStealthEvent& Event)
+{
+	if (Event.Source.Get() != UGameplayStatics::GetPlayerCharacter(this, 0))
+	{
+		return;
+	}
+
+	if (Event.Type == EStealthEventType::MantleStart)
+	{
+		RecordPlayer(EStealthTelemetryEvent::MantleStarted, &Event.Location);
+	}
+	else
+	{
+		RecordPlayer(Event.Value > 0.5f ? EStealthTelemetryEvent::MantleSucceeded : EStealthTelemetryEvent::MantleFailed, &Event.Location);
+	}
+}
+
+void UStealthTelemetrySubsystem::RecordPlayer(EStealthTelemetryEvent Event, const FVector* EventLocation)
+{
+	const APlayerCharacter* Player = Cast<APlayerCharacter>(UGameplayStatics::GetPlayerCharacter(this, 0));
+	if (!Player)
+	{
+		return;
+	}
+
+	const FVector Location = EventLocation ? *EventLocation : Player->GetActorLocation();
+
+	FStealthTelemetrySample Sample;
+	Sample.Time = static_cast<float>(GetWorld()->GetTimeSeconds() - SessionStartTime);
+	Sample.X = Location.X;
+	Sample.Y = Location.Y;
+	Sample.Z = Location.Z;
+	Sample.Visibility = static_cast<uint8>(FMath::Clamp(FMath::RoundToInt(Player->CurrentVisibility / 100.0f * 255.0f), 0, 255));
+	Sample.Event = Event;
+
+	if (Player->bIsMantling)
+	{
+		Sample.Posture = EStealthPosture::Mantling;
+	}
+	else if (Player->bIsClimbing)
+	{
+		Sample.Posture = EStealthPosture::Climbing;
+	}
+	else if (Player->GetCharacterMovement()->IsCrouching())
+	{
+		Sample.Posture = EStealthPosture::Crouched;
+	}
+
+	Push(Sample);
+}
+
+void UStealthTelemetrySubsystem::Push(const FStealthTelemetrySample& Sample)
+{
+	const uint32 CurrentHead = Head.load(std::memory_order_relaxed);
+	if (CurrentHead - Tail.load(std::memory_order_acquire) >= static_cast<uint32>(Ring.Num()))
+	{
+		// The writer fell behind; losing a sample beats stalling the frame
+		++DroppedSamples;
+		return;
+	}
+
+	Ring[CurrentHead & Mask] = Sample;
+	Head.store(CurrentHead + 1, std::memory_order_release);
+}
+
+void UStealthTelemetrySubsystem::Flush()
+{
+	TimeSinceFlush = 0.0f;
+	if (!FlushTask.IsCompleted())
+	{
+		return;
+	}
+
+	// Launching the task allocates; it happens every couple of seconds rather than every frame
+	STEALTH_HOT_PATH_SUSPEND();
+	FlushTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this]()
+	{
+		WritePending();
+	});
+}
+
+void UStealthTelemetrySubsystem::WritePending()
+{
+	if (!File)
+	{
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		PlatformFile.CreateDirectoryTree(*FPaths::GetPath(FilePath));
+		File.Reset(PlatformFile.OpenWrite(*FilePath, true));
+		if (!File)
+		{
+			UE_LOG(LogTemp, Error, TEXT("StealthTelemetry: can't open %s"), *FilePath);
+			Tail.store(Head.load(std::memory_order_acquire), std::memory_order_release);
+			return;
+		}
+		if (File->Size() == 0)
+		{
+			File->Write(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+		}
+	}
+
+	const uint32 CurrentHead = Head.load(std::memory_order_acquire);
+	uint32 CurrentTail = Tail.load(std::memory_order_relaxed);
+	while (CurrentTail != CurrentHead)
+	{
+		// At most two contiguous runs: up to the end of the ring, then from the start
+		const uint32 First = CurrentTail & Mask;
+		const uint32 Count = FMath::Min(CurrentHead - CurrentTail, static_cast<uint32>(Ring.Num()) - First);
+		File->Write(reinterpret_cast<const uint8*>(&Ring[First]), Count * sizeof(FStealthTelemetrySample));
+		CurrentTail += Count;
+	}
+	File->Flush();
+
+	Tail.store(CurrentTail, std::memory_order_release);
+}
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommandWithWorldAndArgs GStealthTelemetryStatsCommand(
+	TEXT("Stealth.Telemetry.Stats"),
+	TEXT("Logs the telemetry file, sample counts and recording cost per frame"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const UStealthTelemetrySubsystem* Telemetry = World ? World->GetSubsystem<UStealthTelemetrySubsystem>() : nullptr;
+		if (!Telemetry || !Telemetry->IsRecording())
+		{
+			UE_LOG(LogTemp, Display, TEXT("StealthTelemetry: not recording (enable bRecordTelemetry in Stealth settings or pass -StealthTelemetry)"));
+			return;
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("StealthTelemetry: %s, %u dropped, %.4f ms/frame average, %.4f ms worst (budget %.2f ms)"),
+			*Telemetry->GetFilePath(), Telemetry->GetDroppedSamples(), Telemetry->GetAverageFrameMs(), Telemetry->GetWorstFrameMs(), StealthTelemetry::FrameBudgetMs);
+	}));
+#endif
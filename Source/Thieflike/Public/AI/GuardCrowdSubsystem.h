@@ -0,0 +1,159 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Stealth/StealthEventBus.h"
+#include "GuardCrowdSubsystem.generated.h"
+
+class ACharacter;
+
+UENUM(BlueprintType)
+enum class EGuardAlertState : uint8
+{
+	Patrolling,
+	Suspicious,
+	Alerted
+};
+
+// ---- Fragments ---- //
+// Each guard is an index into parallel fragment arrays; the arrays are processed in batches.
+
+struct FGuardPatrolFragment
+{
+	// On the floor, like the route points
+	FVector Location = FVector::ZeroVector;
+	float Yaw = 0.0f;
+	float Speed = 150.0f;
+
+	// Slice of UGuardCrowdSubsystem::RoutePoints
+	int32 RouteStart = 0;
+	int32 RouteLength = 0;
+	int32 WaypointIndex = 0;
+};
+
+struct FGuardPerceptionFragment
+{
+	float SightRange = 1500.0f;
+	float HalfFovCos = 0.5f; // cos(60 degrees)
+	float HearingRange = 1200.0f;
+
+	// 0 = nothing noticed, 1 = player spotted
+	float Suspicion = 0.0f;
+};
+
+struct FGuardAlertFragment
+{
+	EGuardAlertState State = EGuardAlertState::Patrolling;
+	float TimeInState = 0.0f;
+	FVector LastKnownPlayerLocation = FVector::ZeroVector;
+};
+
+/**
+ * Crowd of lightweight guards simulated as plain data, on the server only.
+ * Patrol, perception and alert are processed in parallel batches every frame. Guards near the player are
+ * promoted to a full ACharacter (UStealthSettings::GuardCharacterClass) which mirrors the crowd simulation.
+ * Perception reads APlayerCharacter::CurrentVisibility, the same value the rest of the stealth code uses, for every
+ * player; each guard notices whichever player it would spot fastest.
+ */
+UCLASS()
+class THIEFLIKE_API UGuardCrowdSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	// Copies the fragment arrays in and out for branching
+	friend class UStealthSnapshotSubsystem;
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	// Adds a guard walking the given looped route of floor points. Returns the guard index, INDEX_NONE on a client.
+	int32 AddGuard(const TArray<FVector>& Route, float Speed = 150.0f);
+
+	// Removes every guard and destroys their characters
+	void ResetCrowd();
+
+	int32 NumGuards() const { return Patrol.Num(); }
+	int32 NumPromotedGuards() const { return NumPromoted; }
+
+	const FGuardPatrolFragment& GetPatrol(int32 GuardIndex) const { return Patrol[GuardIndex]; }
+	const FGuardAlertFragment& GetAlert(int32 GuardIndex) const { return Alert[GuardIndex]; }
+
+	// Records the cost of the next Frames crowd updates and logs them against GuardFrameBudgetMs
+	void StartBudgetCheck(int32 Frames);
+
+private:
+	// State of each player gathered once per frame on the game thread and shared by every batch
+	struct FPlayerContext
+	{
+		const AActor* Actor = nullptr;
+		FVector Location = FVector::ZeroVector;
+		float Visibility = 0.0f; // 0..1
+	};
+
+	struct FNoise
+	{
+		FVector Location;
+		float Loudness;
+	};
+
+	// Co-op tops out at four players; more still work, off the inline storage
+	using FPlayerContexts = TArray<FPlayerContext, TInlineAllocator<4>>;
+
+	// A guard that would notice a player unless something blocks the sight line. Frame arena scratch.
+	struct FSightQuery
+	{
+		int32 GuardIndex;
+		int32 PlayerIndex;
+		FVector Eye;
+		float Gain;
+	};
+
+	void ProcessBatch(int32 First, int32 Last, float DeltaTime, TConstArrayView<FPlayerContext> Players);
+	bool HasLineOfSight(int32 GuardIndex, const FVector& Eye, const FPlayerContext& Player) const;
+	void UpdateRepresentation(TConstArrayView<FPlayerContext> Players);
+	void RequestDoors(TConstArrayView<FPlayerContext> Players);
+	static float GetClosestPlayerDistanceSq(const FVector& Location, TConstArrayView<FPlayerContext> Players);
+	void ReportBudgetCheck();
+	void OnNoise(const FStealthEvent& Event);
+
+	TArray<FGuardPatrolFragment> Patrol;
+	TArray<FGuardPerceptionFragment> Perception;
+	TArray<FGuardAlertFragment> Alert;
+	TArray<TWeakObjectPtr<ACharacter>> Representation;
+
+	// Alert state at the start of the frame, to post GuardAlert events after the parallel pass
+	TArray<EGuardAlertState> PreviousAlertState;
+
+	// Guard the next RequestDoors starts from
+	int32 NextDoorGuard = 0;
+
+	// Shared pool of patrol waypoints
+	TArray<FVector> RoutePoints;
+
+	// Noise heard since the last update. Fixed capacity; once full only louder noises get in.
+	static constexpr int32 MaxPendingNoises = 64;
+	TArray<FNoise> PendingNoises;
+
+	// Bounds of the closed doors the pending noises could be heard through, gathered for every batch. Frame arena scratch.
+	TArrayView<const FBox> ClosedDoors;
+
+	UPROPERTY()
+	TSubclassOf<ACharacter> GuardClass;
+
+	// Capsule half-height of GuardClass, to stand promoted characters on the crowd's floor locations
+	float GuardHalfHeight = 0.0f;
+
+	int32 NumPromoted = 0;
+	double LastBudgetWarningTime = 0.0;
+	FDelegateHandle NoiseHandle;
+
+	// Per-frame cost in ms while a budget check runs
+	TArray<float> BudgetCheckSamples;
+	int32 BudgetCheckFrames = 0;
+};
@@ -31,6 +31,10 @@ class THIEFLIKE_API ALightDetector : public AActor
 
 	UPROPERTY(EditAnywhere)
 	UTextureRenderTarget2D* detectorTextureBottom;
+
+	// Pixels read back per texture. Larger render targets are sampled in a centred square of this many pixels.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "1"))
+	int32 MaxDetectorPixels = 64 * 64;
 	
 public:	
 	// Sets default values for this actor's properties
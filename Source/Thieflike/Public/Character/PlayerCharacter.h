@@ -15,9 +15,15 @@
 #include "GameFramework/SpringArmComponent.h"
 #include "DrawDebugHelpers.h"
 #include "Engine/EngineTypes.h"
+#include "Stealth/StealthFixedStep.h"
+#include "Stealth/StealthExposure.h"
+#include "Movement/ClimbableIndexSubsystem.h"
 #include "PlayerCharacter.generated.h"
 
 class UInputMappingContext;
+class UPlayerCharacterAssets;
+class UStealthCharacterMovementComponent;
+enum class EInteractionAction : uint8;
 class UInputAction;
 class UInputComponent;
 class ALightDetector;
@@ -27,48 +33,90 @@ class THIEFLIKE_API APlayerCharacter : public ACharacter
 {
 	GENERATED_BODY()
 
+	// Copies simulation state in and out for branching
+	friend class UStealthSnapshotSubsystem;
+
 public:
 	// Sets default values for this character's properties
-	APlayerCharacter();
+	APlayerCharacter(const FObjectInitializer& ObjectInitializer);
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputMappingContext* FirstPersonContext;
+	// Input and first-person assets, loaded by Asset Manager bundle while the level streams instead of being
+	// pulled in with the character. Leave FirstPersonMeshComponent's own mesh empty in the Blueprint or it stays
+	// a hard reference.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Assets, meta = (AllowedTypes = "PlayerCharacterAssets"))
+	FPrimaryAssetId PlayerAssets;
+
+	virtual void PostInitializeComponents() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// ---- Async asset loading ---- //
+	// Adds the Input bundle at high priority; the Visual bundle follows once input is live
+	void RequestPlayerAssets();
+	void OnInputBundleLoaded();
+	void OnVisualBundleLoaded();
+
+	// The primary asset once its Input bundle is in
+	const UPlayerCharacterAssets* GetLoadedAssets() const;
+
+	// Adds the mapping context for the local player once it is loaded
+	void AddInputMappingContext();
+
+	// Binds the handlers for Action if it is loaded and not bound on the current input component yet
+	void BindInputAction(const TSoftObjectPtr<UInputAction>& Action);
+	void BindInputActions();
+
+	TArray<TSharedPtr<struct FStreamableHandle>> AssetLoadHandles;
+	TSet<const UInputAction*> BoundInputActions;
+
+	// Reports the first frame the player can move and look, measured from process start
+	void CheckControllable();
+	bool bReportedControllable = false;
+
+	// Posts a footstep noise every FootstepStride walked on the ground. Server only, where the guards listen.
+	void UpdateFootsteps(float DeltaTime);
+	float FootstepDistance = 0.0f;
+
+	// ---- Fixed-rate simulation ---- //
+	// Lean, visibility, crouch height, footsteps and climb / mantle movement advance in fixed steps
+	// (UStealthSettings::SimulationRate); Tick only interpolates what is shown between the last two steps.
+	void SimulateStep(float DeltaTime);
+	void UpdatePresentation(float Alpha);
+	void UpdateMantle(float DeltaTime);
 
-	// Move Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* MoveAction;
+	// The lights (or the light detector readback) are read once per rendered frame that runs steps, into
+	// TargetVisibility; each step only eases CurrentVisibility towards it.
+	void SampleVisibility();
+	void UpdateVisibility(float DeltaTime);
+	float TargetVisibility = 0.0f;
 
-	// Look Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* LookAction;
+	FStealthFixedStep SimulationStep;
 
-	// Jump Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* JumpAction;
+	float PreviousLeanOffset = 0.0f;
+	float PreviousLeanRoll = 0.0f;
 
-	// Crouch Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* CrouchAction;
+	// Spring arm height, simulated and as of the previous step
+	float CameraHeight = 64.0f;
+	float PreviousCameraHeight = 64.0f;
 
-	// Lean Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* LeanRightAction;
+	// Actor location while climbing or mantling, simulated and as of the previous step
+	FVector TraversalLocation = FVector::ZeroVector;
+	FVector PreviousTraversalLocation = FVector::ZeroVector;
 
-	// Lean Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* LeanLeftAction;
+	// ---- Server checks on client-driven traversal ---- //
+	bool ValidateTraversalStart(bool bMantling, bool bClimbing);
+	void CheckClientTraversal();
+	void RejectTraversal();
 
-	// Sprint Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* SprintAction;
+	// Where an accepted mantle may move the player, and the last position inside the move's bounds
+	FBox ServerMantleBounds = FBox(ForceInit);
+	FVector LastValidTraversalLocation = FVector::ZeroVector;
 
-	// Interact Input Actions
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input)
-	UInputAction* InteractAction;
+	// Render-target detector or analytic lights, see UStealthSettings::bUseRenderLightDetector
+	bool UsesRenderLightDetector() const;
 
 public:
 	// Called every frame
@@ -77,6 +125,8 @@ public:
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 	// Handles Movement Input
 	void Move(const FInputActionValue& Value);
 
@@ -92,18 +142,53 @@ public:
 	void StopLeanLeft(const FInputActionValue& Value);
 	void StartSprint();
 	void StopSprint();
+	UStealthCharacterMovementComponent* GetStealthMovement() const;
 	void StopMantle(bool bSuccess);
 
 	// ---- Mantle ---- //
 	bool CanMantle(FVector& OutMantleTargetLocation);
+	void StartMantle(const FVector& TargetLocation);
 
 	// Safety: Previous location to check if we are stuck in mantle
 	FVector LastMantleLocation;
 	float StuckTimer = 0.0f;
 
+	//---- Climb ----//
+	void ToggleClimb();
+	bool StartClimb();
+	void StopClimb(bool bJumpOff);
+	void UpdateClimb(float DeltaTime);
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Climbing")
+	float ClimbSpeed = 150.0f;
+
+	// How far from a climbable surface the player can grab it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Climbing")
+	float ClimbAttachDistance = 80.0f;
+
+	UPROPERTY(Replicated)
+	bool bIsClimbing = false;
+
+	// Surface in the UClimbableIndexSubsystem, position along it (0 = bottom, 1 = top) and sideways offset
+	// from its centre line (walls only)
+	FClimbableHandle ClimbSurface;
+	float ClimbAlpha = 0.0f;
+	float ClimbOffset = 0.0f;
+
+	// Forward/back and right/left input while climbing (-1 .. 1)
+	float ClimbInput = 0.0f;
+	float ClimbLateralInput = 0.0f;
+
 	//---- Interact ----//
 	void Interact();
 
+	// Queues an aimed request from the camera with the interaction subsystem
+	void RequestInteraction(EInteractionAction Action);
+
+	// Doors live on the server, so remote clients interact through it
+	UFUNCTION(Server, Reliable)
+	void ServerInteract();
+
 	UPROPERTY(EditAnywhere)
 	float InteractLineTraceLength = 350.f;
 
@@ -117,6 +202,19 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "leaning")
 	float LeanInterpSpeed = 12.0f;
 
+	// Lean direction (-1 left, 0 none, 1 right). Other clients rebuild offset and roll from it locally.
+	UPROPERTY(ReplicatedUsing = OnRep_LeanDirection)
+	int8 LeanDirection = 0;
+
+	UFUNCTION()
+	void OnRep_LeanDirection();
+
+	UFUNCTION(Server, Reliable)
+	void ServerSetLean(int8 Direction);
+
+	void SetLeanDirection(int8 Direction);
+	void ApplyLeanDirection(int8 Direction);
+
 	// Runtime
 	float TargetLeanOffset = 0.0f;
 	float CurrentLeanOffset = 0.0f;
@@ -139,6 +237,14 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Stealth")
 	float CurrentVisibility;
 
+	// Server-computed visibility quantized to a byte (0..255) for clients
+	UPROPERTY(Replicated)
+	uint8 ReplicatedVisibility = 0;
+
+	// Quantized visibility has to move this many steps before it is sent again
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stealth")
+	int32 VisibilityReplicationThreshold = 3;
+
 	/** Calculates the current visibility of the character based on surrounding light */
 	UFUNCTION(BlueprintCallable, Category = "Stealth")
 	void CalculateVisibility();
@@ -155,7 +261,23 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stealth")
 	float AmbientLightFactor = 0.1f; // Represents 10% ambient light when completely hidden from direct light
 
-	// Reference to LightDetector actor (assign in editor)
+	// Visibility has to move this many percent before a VisibilityChanged event is posted
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stealth")
+	float VisibilityEventThreshold = 2.0f;
+
+	// Visibility value carried by the last VisibilityChanged event
+	float LastPostedVisibility = -100.0f;
+
+	// The capsule as it is now, as an exposure query: live crouch height and lean offset
+	FStealthExposureQuery BuildExposureQuery() const;
+
+	// Exposure sample points of BuildExposureQuery, with their posture weights
+	void BuildExposureSamples(int32 NumPoints, StealthExposure::FCharacterSamples& OutSamples) const;
+
+	// Unoccluded lights at the sample points, re-evaluated every step for flicker and re-traced only when stale
+	StealthExposure::FExposureCache ExposureCache;
+
+	// Reference to LightDetector actor (assign in editor). Only read when UStealthSettings::bUseRenderLightDetector is set.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stealth")
 	ALightDetector* LightDetectorActor;
 
@@ -202,8 +324,24 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category = "Mantle")
 	float MantleSpeed = 10.0f;
 
+	UPROPERTY(Replicated)
 	bool bIsMantling = false;
 
+	// The owning client drives mantling and climbing. The server checks there is a ledge or climbable surface
+	// where it last saw the player, then accepts the client's position while the move stays within bounds.
+	UFUNCTION(Server, Reliable)
+	void ServerSetTraversal(bool bMantling, bool bClimbing);
+
+	// The server refused or cancelled the move: drop it and continue from the server's position
+	UFUNCTION(Client, Reliable)
+	void ClientRejectTraversal(FVector ServerLocation);
+
+	// How far a client-driven mantle or climb may stray from what the server validated before it is cancelled
+	UPROPERTY(EditDefaultsOnly, Category = "Mantle")
+	float TraversalTolerance = 50.0f;
+
+	void NotifyTraversalChanged();
+
 	// Track if the player is holding the jump button
 	bool bIsJumpHeld = false;
 
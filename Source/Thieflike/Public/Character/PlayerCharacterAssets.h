@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "PlayerCharacterAssets.generated.h"
+
+class UInputMappingContext;
+class UInputAction;
+class USkeletalMesh;
+class UAnimInstance;
+
+/**
+ * The player's input and first-person assets, as one primary asset split into Asset Manager bundles.
+ * APlayerCharacter loads the "Input" bundle first at high priority, then "Visual", while the level streams.
+ * Scanned from /Game/Blueprints (DefaultGame.ini).
+ */
+UCLASS(BlueprintType)
+class THIEFLIKE_API UPlayerCharacterAssets : public UPrimaryDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	static const FPrimaryAssetType AssetType;
+	static const FName InputBundle;
+	static const FName VisualBundle;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputMappingContext> FirstPersonContext;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> MoveAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> LookAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> JumpAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> CrouchAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> LeanRightAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> LeanLeftAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> SprintAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> InteractAction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AssetBundles = "Input"))
+	TSoftObjectPtr<UInputAction> ClimbAction;
+
+	// First-person arms and their anim class, applied to the character's FirstPersonMeshComponent once loaded
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Mesh, meta = (AssetBundles = "Visual"))
+	TSoftObjectPtr<USkeletalMesh> FirstPersonMesh;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Mesh, meta = (AssetBundles = "Visual"))
+	TSoftClassPtr<UAnimInstance> FirstPersonAnimClass;
+
+	TArray<const TSoftObjectPtr<UInputAction>*, TInlineAllocator<10>> GetInputActions() const
+	{
+		return { &MoveAction, &LookAction, &JumpAction, &CrouchAction, &LeanRightAction, &LeanLeftAction, &SprintAction, &InteractAction, &ClimbAction };
+	}
+
+	virtual FPrimaryAssetId GetPrimaryAssetId() const override { return FPrimaryAssetId(AssetType, GetFName()); }
+};
@@ -13,5 +13,15 @@ UCLASS()
 class THIEFLIKE_API AStealthGameMode : public AGameModeBase
 {
 	GENERATED_BODY()
-	
+
+public:
+	AStealthGameMode();
+
+	virtual void Tick(float DeltaSeconds) override;
+
+private:
+	// Logs per-client bandwidth when Stealth.Net.LogBandwidth is set
+	void LogClientBandwidth();
+
+	float BandwidthLogTimer = 0.0f;
 };
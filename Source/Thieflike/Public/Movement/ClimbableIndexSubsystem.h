@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Projectile/ArrowTarget.h"
+#include "ClimbableIndexSubsystem.generated.h"
+
+UENUM(BlueprintType)
+enum class EClimbableType : uint8
+{
+	Ladder,
+	Rope,
+	Wall
+};
+
+// A climbable segment: the player moves between Bottom and Top while facing -Normal
+struct FClimbableSurface
+{
+	FVector Bottom = FVector::ZeroVector;
+	FVector Top = FVector::ZeroVector;
+
+	// Points away from the surface, towards where the climber hangs
+	FVector Normal = FVector::ForwardVector;
+
+	// Half the width of the surface, across the climb direction
+	float HalfWidth = 50.0f;
+
+	EClimbableType Type = EClimbableType::Ladder;
+
+	// How far the climber can move sideways off the centre line: walls are climbed across their whole width,
+	// ladders and ropes only along the line
+	float GetLateralExtent() const { return Type == EClimbableType::Wall ? HalfWidth : 0.0f; }
+
+	// Sideways across the surface
+	FVector GetRight() const { return FVector::CrossProduct(Normal, Top - Bottom).GetSafeNormal(); }
+
+	// Alpha along the climb direction (0 = bottom, 1 = top), Offset sideways from the centre line
+	FVector GetPoint(float Alpha, float Offset) const { return FMath::Lerp(Bottom, Top, Alpha) + GetRight() * Offset; }
+};
+
+// Refers to a surface in the climbable index. Slots are reused after a surface is removed, so the generation
+// tells a stale handle apart from the surface that took its slot.
+struct FClimbableHandle
+{
+	int32 Index = INDEX_NONE;
+	uint32 Generation = 0;
+
+	bool IsSet() const { return Index != INDEX_NONE; }
+	void Reset() { *this = FClimbableHandle(); }
+};
+
+/**
+ * Uniform grid over every climbable surface in the level.
+ * Surfaces are inserted once (as their components begin play, or when a rope arrow lands), so attaching
+ * is a lookup in a few cells instead of probe traces every frame. Only the newest MaxRopeArrows ropes are kept.
+ */
+UCLASS()
+class THIEFLIKE_API UClimbableIndexSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static constexpr float CellSize = 200.0f;
+
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	FClimbableHandle AddSurface(const FClimbableSurface& Surface);
+	// Does nothing for a handle whose surface was already removed
+	void RemoveSurface(const FClimbableHandle& Handle);
+
+	bool IsValidSurface(const FClimbableHandle& Handle) const
+	{
+		return Surfaces.IsValidIndex(Handle.Index) && Generations[Handle.Index] == Handle.Generation;
+	}
+	const FClimbableSurface& GetSurface(const FClimbableHandle& Handle) const { check(IsValidSurface(Handle)); return Surfaces[Handle.Index]; }
+
+	// Finds the closest surface within MaxDistance that the climber at Location, facing Forward, can grab.
+	// OutAlpha is the position along the surface (0 = bottom, 1 = top), OutOffset the sideways offset
+	// within its lateral extent.
+	FClimbableHandle FindSurface(const FVector& Location, const FVector& Forward, float MaxDistance, float& OutAlpha, float& OutOffset) const;
+
+	int32 NumSurfaces() const { return Surfaces.Num(); }
+	int32 NumRopes() const { return Ropes.Num(); }
+
+private:
+	void OnArrowImpact(EArrowType ArrowType, const FHitResult& Hit);
+
+	FBox GetSurfaceBounds(const FClimbableSurface& Surface) const;
+
+	template <typename FuncType>
+	void ForEachCell(const FBox& Bounds, FuncType&& Func) const;
+
+	TSparseArray<FClimbableSurface> Surfaces;
+	// Per slot of Surfaces, bumped every time the slot's surface is removed
+	TArray<uint32> Generations;
+	TMap<FIntVector, TArray<int32>> Cells;
+
+	// Rope arrow surfaces, oldest first
+	TArray<FClimbableHandle> Ropes;
+
+	FDelegateHandle ArrowImpactHandle;
+};
@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "StealthCharacterMovementComponent.generated.h"
+
+/**
+ * Character movement with sprinting carried in the saved moves, so the server simulates the same speed the owning
+ * client predicts instead of correcting it back to a walk.
+ */
+UCLASS()
+class THIEFLIKE_API UStealthCharacterMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+public:
+	virtual float GetMaxSpeed() const override;
+	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
+	virtual FNetworkPredictionData_Client* GetPredictionData_Client() const override;
+
+	// Sprinting replaces MaxWalkSpeed while walking upright
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sprinting", meta = (ClampMin = "0"))
+	float MaxSprintSpeed = 600.0f;
+
+	// Set by input on the owning client, sent to the server with every move
+	bool bWantsToSprint = false;
+
+	bool IsSprinting() const { return bWantsToSprint && IsMovingOnGround() && !IsCrouching(); }
+};
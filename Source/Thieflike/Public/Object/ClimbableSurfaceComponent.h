@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/BoxComponent.h"
+#include "Movement/ClimbableIndexSubsystem.h"
+#include "ClimbableSurfaceComponent.generated.h"
+
+/**
+ * Marks a ladder, rope or climbable wall. The box's up axis is the climb direction and its forward
+ * axis points towards the side the player climbs from. Registers itself in the level's climbable index.
+ */
+UCLASS(ClassGroup = (Stealth), meta = (BlueprintSpawnableComponent))
+class THIEFLIKE_API UClimbableSurfaceComponent : public UBoxComponent
+{
+	GENERATED_BODY()
+
+public:
+	UClimbableSurfaceComponent();
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Climbing")
+	EClimbableType ClimbableType = EClimbableType::Ladder;
+
+	// The surface as the climbable index stores it, from the component's current transform
+	FClimbableSurface GetSurface() const;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	FClimbableHandle SurfaceHandle;
+};
@@ -4,12 +4,15 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Stealth/StealthFixedStep.h"
 #include "Door.generated.h"
 
 UCLASS()
 class THIEFLIKE_API ADoor : public AActor
 {
 	GENERATED_BODY()
+
+	friend class UStealthSnapshotSubsystem;
 	
 public:	
 	// Sets default values for this actor's properties
@@ -17,14 +20,23 @@ public:
 
 protected:
 	// Called when the game starts or when spawned
+	virtual void PostInitializeComponents() override;
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void OnActorChannelOpen(class FInBunch& InBunch, class UNetConnection* Connection) override;
+	virtual void PostRepNotifies() override;
+
 	void OnInteract(const FVector& InteractorForward);
 
+	// Outlined (custom depth) while a local player looks at it
+	void SetFocused(bool bFocused);
+
 	UFUNCTION()
 	void CloseDoor(float DeltaTime);
 
@@ -39,11 +51,41 @@ public:
 
 	bool Opening;
 	bool Closing;
+
+	// Replicated door state, clients play the swing themselves
+	UPROPERTY(ReplicatedUsing = OnRep_DoorState)
 	bool isClosed;
 
+	// Which way the door swings open (-1 / +1)
+	UPROPERTY(Replicated)
+	int8 OpenDirection;
+
+	UFUNCTION()
+	void OnRep_DoorState();
+
+	// Puts the door back at a saved yaw. A door saved mid-swing carries on swinging towards bClosed from there.
+	void RestoreState(bool bClosed, float Yaw);
+
 	float DotP;
 	float MaxDegree;
-	float AddRotation;
 	float PosNeg;
 	float DoorCurrentRotation;
+
+private:
+	FStealthFixedStep SimulationStep;
+
+	// Shows the door swung Yaw degrees about its hinge, keeping the pitch and roll it was placed with
+	void ShowRotation(float Yaw);
+
+	// DoorCurrentRotation as of the previous simulation step
+	float PreviousRotation = 0.0f;
+
+	// Yaw last passed to ShowRotation
+	float ShownRotation = 0.0f;
+
+	// The mesh's placed relative rotation, i.e. the closed pose every swing is relative to
+	FQuat ClosedRotation = FQuat::Identity;
+
+	// Set while the actor channel's first bunch is applied, so a late joiner snaps to the door's state instead of swinging to it
+	bool bInitialReplication = false;
 };
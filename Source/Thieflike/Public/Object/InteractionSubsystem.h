@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CoreGlobals.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "InteractionSubsystem.generated.h"
+
+class ADoor;
+
+enum class EInteractionQuery : uint8
+{
+	// Whatever the view ray hits first, like aiming at a door (players)
+	Aim,
+	// Closest door within Reach and the facing cone around Direction, when nothing blocks the line to it and it
+	// has finished swinging (AI)
+	Nearby
+};
+
+enum class EInteractionAction : uint8
+{
+	Toggle,
+	// Only doors in the other state are considered, and nothing happens if the state already matches
+	Open,
+	Close,
+	// Only looks: the door found becomes the requester's focus and nothing is applied. Queued every frame.
+	Focus
+};
+
+enum class EInteractionOutcome : uint8
+{
+	// Nothing to interact with
+	None,
+	Applied,
+	// The door is already in the requested state
+	NotNeeded,
+	// Another request took the same door this frame
+	Lost
+};
+
+// Players get doors before guards
+namespace InteractionPriority
+{
+	constexpr int32 Guard = 0;
+	constexpr int32 Player = 1;
+}
+
+struct FInteractionRequest
+{
+	// Ignored by the traces and reported as the instigator
+	TWeakObjectPtr<AActor> Requester;
+
+	// Stable per requester (player id, guard index); breaks ties between equal requests whatever the submission order
+	int32 RequesterId = 0;
+
+	// Higher wins when two requests want the same door in one frame
+	int32 Priority = 0;
+
+	EInteractionQuery Query = EInteractionQuery::Aim;
+	EInteractionAction Action = EInteractionAction::Toggle;
+
+	FVector Origin = FVector::ZeroVector;
+	FVector Direction = FVector::ForwardVector;
+	float Reach = 350.0f;
+
+	// Nearby only: cosine of the half cone around Direction, and how close a door may be
+	float MinFacing = 0.5f;
+	float MinDistance = 0.0f;
+
+	// Facing of the interactor, decides which way a door swings
+	FVector Forward = FVector::ForwardVector;
+};
+
+struct FInteractionResult
+{
+	// Index into the candidates of the pass, INDEX_NONE for nothing
+	int32 Target = INDEX_NONE;
+	// Where the view ray ended (Aim) or the door that was picked (Nearby)
+	FVector Point = FVector::ZeroVector;
+	float DistanceSq = 0.0f;
+	EInteractionOutcome Outcome = EInteractionOutcome::None;
+};
+
+/**
+ * Answers "what can I interact with" for every player and guard at once. Requests queued during the frame
+ * are evaluated in one parallel pass against a snapshot of the doors, conflicts over the same door are settled
+ * by priority, distance and requester id, and the winners are applied on the game thread in request order.
+ */
+UCLASS()
+class THIEFLIKE_API UInteractionSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	void RegisterDoor(ADoor* Door);
+	void UnregisterDoor(ADoor* Door);
+	int32 NumDoors() const { return Doors.Num(); }
+
+	// Resolved with every other request on the next update
+	void Request(const FInteractionRequest& Request);
+
+	// Evaluates Requests against the doors as they are now and settles conflicts, without applying anything
+	void Resolve(TConstArrayView<FInteractionRequest> Requests, TArray<FInteractionResult>& OutResults);
+
+	// Forgets queued requests (snapshot restore)
+	void ResetPending() { Pending.Reset(); }
+
+	// Door the requester's Focus request found on the last update
+	ADoor* GetFocus(const AActor* Requester) const;
+
+	// Door behind a result's Target, in the frame the results were resolved
+	ADoor* GetCandidateDoor(int32 Target) const
+	{
+		return CandidatesFrame == GFrameCounter && Candidates.IsValidIndex(Target) ? Candidates[Target].Door.Get() : nullptr;
+	}
+
+private:
+	// Door state gathered on the game thread before each pass; the workers only read it. Frame arena scratch.
+	struct FCandidate
+	{
+		TWeakObjectPtr<ADoor> Door;
+		FVector Location = FVector::ZeroVector;
+		bool bClosed = true;
+		bool bSwinging = false;
+	};
+
+	struct FFocus
+	{
+		TWeakObjectPtr<const AActor> Requester;
+		TWeakObjectPtr<ADoor> Door;
+	};
+
+	void GatherCandidates();
+	void Evaluate(const FInteractionRequest& Request, FInteractionResult& Result) const;
+	void UpdateFocus();
+
+	TArray<TWeakObjectPtr<ADoor>> Doors;
+	TArrayView<FCandidate> Candidates;
+	uint64 CandidatesFrame = 0;
+	TMap<const AActor*, int32> CandidateIndices;
+
+	TArray<FInteractionRequest> Pending;
+	TArray<FInteractionRequest> Processing;
+	TArray<FInteractionResult> Results;
+
+	// Focus found by this frame's requests and the previous one, to outline only the doors that changed
+	TArray<FFocus> Foci;
+	TArray<FFocus> PreviousFoci;
+
+	double LastBudgetWarningTime = 0.0;
+};
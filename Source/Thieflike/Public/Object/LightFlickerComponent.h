@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Stealth/StealthLightSubsystem.h"
+#include "LightFlickerComponent.generated.h"
+
+class ULocalLightComponent;
+
+/**
+ * Makes the owner's point / spot lights flicker like a torch or candle. The flicker is a parametric envelope
+ * (FStealthFlicker) around each light's placed intensity: the stealth code evaluates it in closed form from the
+ * light registry, and this component only animates the rendered intensity where the game renders.
+ */
+UCLASS(ClassGroup = (Stealth), meta = (BlueprintSpawnableComponent))
+class THIEFLIKE_API ULightFlickerComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	ULightFlickerComponent();
+
+	// Largest deviation from the base intensity, as a fraction of it
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Flicker", meta = (ClampMin = "0", ClampMax = "1"))
+	float Amplitude = 0.3f;
+
+	// Cycles per second of the slowest wave
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Flicker", meta = (ClampMin = "0"))
+	float Frequency = 6.0f;
+
+	// Phase of the flicker; 0 derives one from the owner's level path so placed torches differ
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Flicker")
+	int32 Seed = 0;
+
+	FStealthFlicker GetFlicker() const;
+
+	// Intensity LightComponent was placed with, before any flicker was applied
+	float GetBaseIntensity(const ULocalLightComponent* LightComponent) const;
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+protected:
+	virtual void OnRegister() override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	// Seed the server settled on. A spawned torch's path differs between server and clients, so the server's is sent;
+	// until it arrives, and for torches that don't replicate, clients derive the same one from the level path.
+	UPROPERTY(ReplicatedUsing = OnRep_ResolvedSeed)
+	uint32 ResolvedSeed = 0;
+
+	UFUNCTION()
+	void OnRep_ResolvedSeed();
+
+	// Owner's lights and their placed intensities, captured before the first flicker is applied
+	TArray<TPair<TWeakObjectPtr<ULocalLightComponent>, float>> BaseIntensities;
+};
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Projectile/ArrowTarget.h"
+#include "ArrowProjectileSubsystem.generated.h"
+
+class UInstancedStaticMeshComponent;
+
+// One pooled arrow
+struct FArrowProjectile
+{
+	FVector Location = FVector::ZeroVector;
+	FVector Velocity = FVector::ZeroVector;
+	float Age = 0.0f;
+	EArrowType Type = EArrowType::Noise;
+	TWeakObjectPtr<AActor> Instigator;
+};
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnArrowImpact, EArrowType /*ArrowType*/, const FHitResult& /*Hit*/);
+
+/**
+ * Arrows are not actors. A fixed pool is allocated when play begins and every in-flight arrow is
+ * advanced and swept in one pass per frame. Visuals are instances of a single instanced static mesh,
+ * one instance per pool slot, so firing never spawns anything.
+ */
+UCLASS()
+class THIEFLIKE_API UArrowProjectileSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	// Fires an arrow. If the pool is exhausted the oldest arrow in flight is recycled.
+	UFUNCTION(BlueprintCallable, Category = "Arrows")
+	void FireArrow(EArrowType ArrowType, FVector Start, FVector Velocity, AActor* Instigator);
+
+	int32 NumActiveArrows() const { return ActiveSlots.Num(); }
+	int32 PoolSize() const { return Pool.Num(); }
+
+	// Fired after the built-in impact handling (dousing, noise, IArrowTarget)
+	FOnArrowImpact OnArrowImpact;
+
+	// Adds pool slots (and their instances). Allocates, so call it outside of play-critical frames.
+	void GrowPool(int32 NumSlots);
+
+	// Stress test: fire this many arrows per second from the player's view for StressSeconds.
+	// The pool is grown first to hold every arrow the test can have in flight.
+	void StartStressTest(float ArrowsPerSecond, float Seconds);
+
+private:
+	// An arrow that hit something this sweep, handled once the active list is consistent again
+	struct FArrowImpact
+	{
+		FArrowProjectile Arrow;
+		FHitResult Hit;
+	};
+
+	void SweepArrows(float DeltaTime);
+	void HandleImpact(const FArrowProjectile& Arrow, const FHitResult& Hit);
+	void ReleaseSlot(int32 Slot);
+	void TickStressTest(float DeltaTime);
+
+	// Heap bytes held by the pool and its bookkeeping
+	SIZE_T GetAllocatedSize() const;
+
+	TArray<FArrowProjectile> Pool;
+	TArray<FArrowImpact> PendingImpacts;
+
+	// Slots in flight, oldest first
+	TArray<int32> ActiveSlots;
+	TArray<int32> FreeSlots;
+
+	// Instance transforms written once per frame for every slot
+	TArray<FTransform> InstanceTransforms;
+
+	UPROPERTY()
+	TObjectPtr<UInstancedStaticMeshComponent> ArrowInstances;
+
+	// Arrows recycled from a full pool, ever
+	int32 NumRecycled = 0;
+
+	float StressRate = 0.0f;
+	float StressTimeLeft = 0.0f;
+	float StressAccumulator = 0.0f;
+	uint64 StressStartMemory = 0;
+	uint64 StressPeakMemory = 0;
+	int32 StressStartRecycled = 0;
+	SIZE_T StressStartAllocatedSize = 0;
+	int32 StressStartSurfaces = 0;
+	int32 StressPeakInFlight = 0;
+	double StressWorstFrameMs = 0.0;
+	FRandomStream StressRandom;
+};
@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Interface.h"
+#include "Engine/HitResult.h"
+#include "ArrowTarget.generated.h"
+
+UENUM(BlueprintType)
+enum class EArrowType : uint8
+{
+	Water,	// Douses lights
+	Noise,	// Makes a noise where it lands
+	Rope	// Leaves a climbable rope
+};
+
+UINTERFACE(MinimalAPI, BlueprintType)
+class UArrowTarget : public UInterface
+{
+	GENERATED_BODY()
+};
+
+/**
+ * Implement on actors that react to being hit by an arrow (switches, targets, breakables...)
+ */
+class THIEFLIKE_API IArrowTarget
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintNativeEvent, BlueprintCallable, Category = "Arrows")
+	void OnArrowImpact(EArrowType ArrowType, const FHitResult& Hit);
+};
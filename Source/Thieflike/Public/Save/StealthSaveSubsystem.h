@@ -0,0 +1,178 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Containers/SortedMap.h"
+#include "Tasks/Task.h"
+#include "StealthSaveSubsystem.generated.h"
+
+class ADoor;
+
+// Player state worth restoring: where they are and whether they were crouched / mid-mantle
+struct FStealthPlayerSave
+{
+	FVector3f Location = FVector3f::ZeroVector;
+	FVector3f MantleTarget = FVector3f::ZeroVector;
+	int16 Yaw = 0;
+	uint8 bCrouched : 1 = false;
+	uint8 bMantling : 1 = false;
+
+	friend FArchive& operator<<(FArchive& Ar, FStealthPlayerSave& Player);
+};
+
+/**
+ * Whole-world stealth state. Doors and lights are parallel arrays sorted by stable id,
+ * with on/off style state packed into bit arrays and door yaw quantized to 1/100 degree.
+ */
+struct FStealthSaveData
+{
+	TArray<uint32> DoorIds;
+	TBitArray<> DoorClosed;
+	TArray<int16> DoorYaw;
+
+	TArray<uint32> LightIds;
+	TBitArray<> LightOn;
+
+	// Sorted stable ids of looted items
+	TArray<uint32> LootedIds;
+
+	FStealthPlayerSave Player;
+
+	friend FArchive& operator<<(FArchive& Ar, FStealthSaveData& Data);
+};
+
+// What changed since the previous save. Indices refer to the base save's arrays.
+struct FStealthSaveDelta
+{
+	TArray<int32> DoorIndices;
+	TBitArray<> DoorClosed;
+	TArray<int16> DoorYaw;
+
+	TArray<int32> LightIndices;
+	TBitArray<> LightOn;
+
+	TArray<uint32> NewlyLooted;
+
+	FStealthPlayerSave Player;
+
+	bool IsEmpty() const { return DoorIndices.Num() == 0 && LightIndices.Num() == 0 && NewlyLooted.Num() == 0; }
+
+	friend FArchive& operator<<(FArchive& Ar, FStealthSaveDelta& Delta);
+};
+
+/**
+ * Saves and loads the stealth state of the world (doors, lights, loot, player posture).
+ * A full save writes a base file; quicksaves append only what changed to a journal next to it.
+ * The game thread just gathers the packed state; serialization and file IO run on a worker.
+ */
+UCLASS()
+class THIEFLIKE_API UStealthSaveSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	static constexpr uint32 SaveMagic = 0x53545356; // 'STSV'
+	static constexpr uint32 SaveVersion = 1;
+
+	// Id that survives reloads: hash of the object's path without the PIE prefix
+	static uint32 StableId(const UObject* Object);
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	// Applies any saved state the door missed while it was streamed out
+	void RegisterDoor(ADoor* Door);
+	// A door that streams out keeps its state here, so saves still write it and it comes back as it was
+	void UnregisterDoor(ADoor* Door, bool bStreamedOut);
+
+	UFUNCTION(BlueprintCallable, Category = "Save")
+	void MarkLooted(AActor* Item);
+
+	UFUNCTION(BlueprintCallable, Category = "Save")
+	bool IsLooted(const AActor* Item) const;
+
+	// Writes a new base save and clears the journal
+	UFUNCTION(BlueprintCallable, Category = "Save")
+	void SaveGame(const FString& SlotName);
+
+	// Appends the changes since the last save. Falls back to a full save when there is no base yet.
+	UFUNCTION(BlueprintCallable, Category = "Save")
+	void QuickSave(const FString& SlotName);
+
+	// Reads base + journal on a worker and applies the result on the game thread
+	UFUNCTION(BlueprintCallable, Category = "Save")
+	void LoadGame(const FString& SlotName);
+
+	// True while a save or load is running on a worker
+	bool IsBusy() const { return !LastTask.IsCompleted(); }
+
+	// Blocks until queued saves / loads are done and applies a finished load right away
+	void Flush();
+
+	DECLARE_MULTICAST_DELEGATE_OneParam(FOnGameLoaded, bool /*bSuccess*/);
+	FOnGameLoaded OnGameLoaded;
+
+	// Game thread cost of the last save/quicksave
+	double GetLastSaveGameThreadMs() const { return LastSaveGameThreadMs; }
+
+	const TArray<TWeakObjectPtr<ADoor>>& GetDoors() const { return Doors; }
+
+	static FString GetBasePath(const FString& SlotName);
+	static FString GetJournalPath(const FString& SlotName);
+
+private:
+	// Builds the current state in registry order (game thread)
+	void GatherState(FStealthSaveData& OutData);
+
+	// Sorts doors and lights by stable id so saves don't depend on spawn order
+	void SortRegistry();
+
+	void ApplyState(const FStealthSaveData& Data);
+
+	// Hands a finished load to ApplyState
+	void FinishLoad();
+
+	// Registered doors, parallel to DoorIds
+	TArray<TWeakObjectPtr<ADoor>> Doors;
+	TArray<uint32> DoorIds;
+	bool bDoorsSorted = true;
+
+	// Saved or last known state of doors that are not loaded right now, by stable id
+	struct FDoorState
+	{
+		bool bClosed = true;
+		int16 Yaw = 0;
+	};
+	TSortedMap<uint32, FDoorState> UnloadedDoors;
+
+	// Light subsystem indices sorted by stable id, rebuilt when its revision changes
+	TArray<int32> LightOrder;
+	uint32 LightRevision = MAX_uint32;
+
+	TArray<uint32> LootedIds;
+
+	// Doors or lights were added or removed since the last save, so the journal's indices would be stale
+	bool bRegistryDirty = true;
+
+	// State as of the last save, for deltas
+	FStealthSaveData LastSaved;
+	bool bHasBase = false;
+	FString BaseSlotName;
+
+	// Saves and loads run one after another so the journal is always appended to the right base
+	UE::Tasks::FTask LastTask;
+
+	// Filled by the load worker, applied on the game thread
+	struct FLoadResult
+	{
+		FStealthSaveData Data;
+		bool bSuccess = false;
+	};
+	TSharedPtr<FLoadResult, ESPMode::ThreadSafe> PendingLoad;
+	UE::Tasks::FTask PendingLoadTask;
+
+	double LastSaveGameThreadMs = 0.0;
+};
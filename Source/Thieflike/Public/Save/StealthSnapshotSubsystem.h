@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "StealthSnapshotSubsystem.generated.h"
+
+class ADoor;
+class APlayerCharacter;
+
+/**
+ * In-memory checkpoint of the stealth simulation: one flat buffer of plain state, laid out as
+ * [player][doors][light on/off bytes][guard patrol][guard perception][guard alert][previous alert][pending noises].
+ * Reuse one snapshot for repeated captures and its buffer is only allocated once.
+ */
+struct FStealthSnapshot
+{
+	TArray<uint8> Data;
+
+	TWeakObjectPtr<APlayerCharacter> Player;
+	TArray<TWeakObjectPtr<ADoor>> Doors;
+
+	// Restoring needs the same lights and guards that were captured
+	uint32 LightRevision = 0;
+	int32 NumLights = 0;
+	int32 NumGuards = 0;
+
+	// Start of each section in Data, for reporting where two snapshots differ
+	int32 DoorsOffset = 0;
+	int32 LightsOffset = 0;
+	int32 GuardsOffset = 0;
+
+	bool IsValid() const { return Data.Num() > 0; }
+
+	// Name of the section holding byte Offset
+	const TCHAR* GetSectionName(int32 Offset) const;
+};
+
+/**
+ * Captures and restores the stealth-relevant world state (player transform, movement, mantle / climb / lean fields,
+ * doors, lights, crowd guards) so bots and AI tuning can branch many variations from one moment.
+ * State is copied field by field into FStealthSnapshot, no serialization; restoring touches only doors and
+ * lights whose state actually differs.
+ */
+UCLASS()
+class THIEFLIKE_API UStealthSnapshotSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Captures the current state into Snapshot, reusing its memory
+	void Capture(FStealthSnapshot& Snapshot) const;
+
+	// Puts the world back into the captured state. Fails if lights or guards were added or removed since.
+	bool Restore(const FStealthSnapshot& Snapshot);
+
+	// Advances only the snapshotted systems (guards, doors, player and its movement) by DeltaTime, for branching without
+	// ticking the world. Events posted during the step are dispatched before it returns.
+	void Step(float DeltaTime);
+
+	// Queued events are not part of a snapshot. Dispatch them before capturing a state that will be stepped from.
+	void FlushEvents();
+
+	// Runs the player NumSteps fixed steps from the current state with frames of one, two and half a step, and checks
+	// the runs end in the same state. Visibility may differ by VisibilityTolerance percent, since it reads the lights
+	// once per frame. Leaves the world as it was.
+	bool CheckPlayerFrameRates(int32 NumSteps, float VisibilityTolerance);
+
+private:
+	struct FPlayerState;
+	struct FDoorState;
+
+	static void CapturePlayer(const APlayerCharacter& Player, FPlayerState& OutState);
+	static void RestorePlayer(APlayerCharacter& Player, const FPlayerState& State);
+
+	static void CaptureDoor(const ADoor& Door, FDoorState& OutState);
+	static void RestoreDoor(ADoor& Door, const FDoorState& State);
+};
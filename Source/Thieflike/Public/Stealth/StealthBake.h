@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stealth/StealthLightSubsystem.h"
+
+class UWorld;
+class ARecastNavMesh;
+class UPrimitiveComponent;
+
+/**
+ * Shared by the offline stealth commandlets: loading a level for headless sampling, and hashing the inputs
+ * baked data depends on so unchanged areas can be skipped.
+ */
+namespace StealthBake
+{
+	// Loads MapName with collision, every sublevel and, on World Partition maps, every cell. The world stays rooted
+	// until ReleaseWorld. Null if the map could not be loaded whole.
+	THIEFLIKE_API UWorld* LoadWorld(const FString& MapName);
+	THIEFLIKE_API void ReleaseWorld(UWorld* World);
+
+	THIEFLIKE_API const ARecastNavMesh* FindNavMesh(UWorld* World);
+
+	// Every light the light subsystem would register when play begins
+	THIEFLIKE_API void GatherLights(UWorld* World, TArray<FStealthLight>& OutLights);
+
+	// Identity of a light: where it is, how far it reaches, how bright and how it flickers
+	THIEFLIKE_API uint32 HashLight(const FStealthLight& Light);
+
+	/**
+	 * Everything that blocks one of the channels a bake traces, bucketed on a 2D grid so the occluders of a region
+	 * (a tile and the lights reaching it) can be hashed without walking the whole level.
+	 */
+	class THIEFLIKE_API FOccluderIndex
+	{
+	public:
+		// Channels are every channel the bake queries; a primitive's responses to them are part of its hash
+		void Build(UWorld* World, TConstArrayView<ECollisionChannel> Channels);
+
+		// Hash of the occluders overlapping Region, independent of actor order
+		uint32 HashRegion(const FBox& Region) const;
+
+		int32 Num() const { return Occluders.Num(); }
+
+	private:
+		static constexpr float CellSize = 2000.0f;
+
+		struct FOccluder
+		{
+			FBox Bounds;
+			uint32 Hash = 0;
+		};
+
+		static uint32 HashOccluder(const UPrimitiveComponent& Component, TConstArrayView<ECollisionChannel> Channels);
+		static FIntPoint GetCell(const FVector& Location);
+
+		TArray<FOccluder> Occluders;
+		TMap<FIntPoint, TArray<int32>> Grid;
+	};
+}
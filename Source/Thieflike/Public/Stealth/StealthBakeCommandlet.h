@@ -0,0 +1,27 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "StealthBakeCommandlet.generated.h"
+
+/**
+ * Bakes the streamed stealth data (exposure samples, ledges, climbables, door portals) into one UStealthCellData
+ * asset per square chunk of the level. Every chunk's inputs (navmesh polygons, lights reaching it, occluders near it,
+ * doors, climbables) are hashed; results are kept in a local cache keyed by that hash, so only chunks whose inputs
+ * changed are rebaked, in parallel, and assets whose hash already matches are not re-saved. The level gets one
+ * AStealthCellDataActor per chunk pointing at its asset; actors and assets of chunks that no longer exist are deleted.
+ *
+ * UnrealEditor-Cmd Thieflike.uproject -run=StealthBake -Map=/Game/Maps/<Map> [-ChunkSize=3200] [-Cache=<dir>] [-Output=/Game/StealthData] [-Full]
+ */
+UCLASS()
+class THIEFLIKE_API UStealthBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UStealthBakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,131 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "GameFramework/Actor.h"
+#include "Engine/StreamableManager.h"
+#include "Movement/ClimbableIndexSubsystem.h"
+#include "StealthCellData.generated.h"
+
+// Baked exposure at one grid point (world space)
+USTRUCT()
+struct FStealthExposureSample
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere)
+	FVector Location = FVector::ZeroVector;
+
+	// 0 = dark, 255 = fully lit
+	UPROPERTY(EditAnywhere)
+	uint8 Exposure = 0;
+};
+
+// A mantleable ledge edge (world space)
+USTRUCT()
+struct FStealthLedge
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere)
+	FVector Start = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere)
+	FVector End = FVector::ZeroVector;
+
+	// Points away from the wall below the ledge
+	UPROPERTY(EditAnywhere)
+	FVector Normal = FVector::ForwardVector;
+};
+
+USTRUCT()
+struct FStealthClimbable
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere)
+	FVector Bottom = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere)
+	FVector Top = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere)
+	FVector Normal = FVector::ForwardVector;
+
+	UPROPERTY(EditAnywhere)
+	float HalfWidth = 50.0f;
+
+	UPROPERTY(EditAnywhere)
+	EClimbableType Type = EClimbableType::Ladder;
+};
+
+// A doorway; guards hear less of a noise through it while its door is closed
+USTRUCT()
+struct FStealthPortal
+{
+	GENERATED_BODY()
+
+	// Centre and half size of the door's bounds
+	UPROPERTY(EditAnywhere)
+	FVector Location = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere)
+	FVector Extent = FVector::ZeroVector;
+
+	// The door in the opening, see UStealthStreamingSubsystem::GetDoorId
+	UPROPERTY(EditAnywhere)
+	uint32 DoorId = 0;
+};
+
+/**
+ * Stealth data baked for one World Partition cell, written by UStealthBakeCommandlet
+ */
+UCLASS()
+class THIEFLIKE_API UStealthCellData : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, Category = "Stealth")
+	TArray<FStealthExposureSample> ExposureSamples;
+
+	UPROPERTY(EditAnywhere, Category = "Stealth")
+	TArray<FStealthLedge> Ledges;
+
+	UPROPERTY(EditAnywhere, Category = "Stealth")
+	TArray<FStealthClimbable> Climbables;
+
+	UPROPERTY(EditAnywhere, Category = "Stealth")
+	TArray<FStealthPortal> Portals;
+
+	// Content hash of the bake inputs this was built from; the bake commandlet leaves the asset alone while it matches
+	UPROPERTY(VisibleAnywhere, Category = "Stealth")
+	uint64 BakeHash = 0;
+};
+
+/**
+ * Place one per World Partition cell. It is spatially loaded with the cell, streams its UStealthCellData
+ * asynchronously and hands it to UStealthStreamingSubsystem, which patches it into the runtime structures.
+ */
+UCLASS()
+class THIEFLIKE_API AStealthCellDataActor : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AStealthCellDataActor();
+
+	UPROPERTY(EditAnywhere, Category = "Stealth")
+	TSoftObjectPtr<UStealthCellData> CellData;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	void OnCellDataLoaded();
+
+	TSharedPtr<FStreamableHandle> LoadHandle;
+};
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "StealthCoverageCommandlet.generated.h"
+
+/**
+ * Start of a shadow coverage file (.stcv): header, then one FStealthCoverageTile per navmesh tile,
+ * then one FStealthCoveragePoly per polygon, grouped by tile.
+ */
+struct FStealthCoverageHeader
+{
+	static constexpr uint32 FileMagic = 0x56435453; // 'STCV'
+	static constexpr uint32 CurrentVersion = 1;
+
+	uint32 Magic = FileMagic;
+	uint32 Version = CurrentVersion;
+	uint32 NumTiles = 0;
+	uint32 NumPolys = 0;
+	// Capsule half-heights the two exposure values were sampled at
+	float StandingHalfHeight = 0.0f;
+	float CrouchedHalfHeight = 0.0f;
+
+	bool IsValid() const { return Magic == FileMagic && Version == CurrentVersion; }
+};
+
+struct FStealthCoverageTile
+{
+	int32 X = 0;
+	int32 Y = 0;
+	int32 Layer = 0;
+	// Hash of everything the tile's exposure depends on: its polygons, the lights reaching it and the occluders near it
+	uint32 InputHash = 0;
+	int32 FirstPoly = 0;
+	int32 NumPolys = 0;
+};
+static_assert(sizeof(FStealthCoverageTile) == 24, "Coverage tile layout is part of the file format");
+
+struct FStealthCoveragePoly
+{
+	uint64 PolyRef = 0;
+	FVector3f Center = FVector3f::ZeroVector;
+	// Floor area seen from above, in m2
+	float Area = 0.0f;
+	// Mean exposure over the polygon quantized to 0..255
+	uint8 Standing = 0;
+	uint8 Crouched = 0;
+	uint8 Reserved[6] = {};
+};
+static_assert(sizeof(FStealthCoveragePoly) == 32, "Coverage poly layout is part of the file format");
+
+/**
+ * Offline shadow coverage audit: samples exposure over every walkable navmesh polygon at standing and crouched
+ * capsule heights, on all cores, and writes the per-polygon results plus a coverage summary.
+ * Reruns only re-sample navmesh tiles whose polygons, nearby lights or nearby occluders changed since the last file.
+ *
+ * UnrealEditor-Cmd Thieflike.uproject -run=StealthCoverage -Map=/Game/Maps/<Map> [-Output=<dir>] [-Spacing=100] [-HiddenThreshold=0.25] [-Full]
+ */
+UCLASS()
+class THIEFLIKE_API UStealthCoverageCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UStealthCoverageCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,176 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Containers/CircularQueue.h"
+#include "StealthEventBus.generated.h"
+
+UENUM(BlueprintType)
+enum class EStealthEventType : uint8
+{
+	VisibilityChanged,
+	DoorToggled,
+	Noise,
+	Interact,
+	MantleStart,
+	MantleStop,
+	GuardAlert,
+	LightToggled,
+
+	Count UMETA(Hidden)
+};
+
+// One stealth event. Plain data so it can be copied straight into a ring slot.
+struct FStealthEvent
+{
+	EStealthEventType Type = EStealthEventType::Noise;
+
+	// Actor that produced the event (door, player, guard...)
+	TWeakObjectPtr<AActor> Source;
+
+	FVector Location = FVector::ZeroVector;
+
+	// Meaning depends on Type: visibility percent, door open (1) / closed (0), noise loudness, mantle success, guard alert state, light on (1) / off (0)
+	float Value = 0.0f;
+
+	// Frame the event was posted on
+	uint32 Frame = 0;
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnStealthEvent, const FStealthEvent&);
+
+/**
+ * Set of per-producer rings. Each producer owns a single-producer/single-consumer lock-free queue
+ * with preallocated contiguous storage, so posting never locks or allocates.
+ * Draining visits producers in registration order and each ring FIFO, so the order is deterministic.
+ */
+class THIEFLIKE_API FStealthEventRings
+{
+public:
+	// Capacity of a producer ring unless registered with another. Events posted to a full ring are dropped and counted.
+	static constexpr uint32 RingCapacity = 1024;
+
+	// Ring slots are fixed so registering a producer never moves a ring another thread is posting to
+	static constexpr int32 MaxProducers = 64;
+
+	// Registers a new producer ring (game thread only). Returns INDEX_NONE once MaxProducers is reached.
+	// Producers and the consumer may already be running on other threads.
+	int32 RegisterProducer(FName DebugName, uint32 Capacity = RingCapacity);
+
+	// Lock-free post. Safe from any thread as long as each producer handle is used by a single thread.
+	bool Post(int32 Producer, const FStealthEvent& Event)
+	{
+		if (!TryPost(Producer, Event))
+		{
+			DroppedEvents.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	// As Post, but a full ring isn't counted as a drop, for a producer that can make room and retry
+	bool TryPost(int32 Producer, const FStealthEvent& Event)
+	{
+		return Producer >= 0 && Producer < NumRings.load(std::memory_order_acquire) && Rings[Producer]->Queue.Enqueue(Event);
+	}
+
+	// Consumer side. Only drains what was queued when the drain started, so a busy producer can't stall the frame.
+	template <typename VisitorType>
+	int32 Drain(VisitorType&& Visitor)
+	{
+		int32 NumDrained = 0;
+		FStealthEvent Event;
+		const int32 NumToDrain = NumRings.load(std::memory_order_acquire);
+		for (int32 RingIndex = 0; RingIndex < NumToDrain; ++RingIndex)
+		{
+			TCircularQueue<FStealthEvent>& Queue = Rings[RingIndex]->Queue;
+			for (uint32 Remaining = Queue.Count(); Remaining > 0 && Queue.Dequeue(Event); --Remaining)
+			{
+				Visitor(Event);
+				++NumDrained;
+			}
+		}
+		return NumDrained;
+	}
+
+	int32 NumProducers() const { return NumRings.load(std::memory_order_acquire); }
+	uint32 GetDroppedEventCount() const { return DroppedEvents.load(std::memory_order_relaxed); }
+
+private:
+	struct FProducerRing
+	{
+		FProducerRing(FName InName, uint32 Capacity) : Name(InName), Queue(Capacity) {}
+
+		FName Name;
+		TCircularQueue<FStealthEvent> Queue;
+	};
+
+	TUniquePtr<FProducerRing> Rings[MaxProducers];
+
+	// Published after the ring is built, so any thread that sees the count also sees the ring
+	std::atomic<int32> NumRings{ 0 };
+
+	std::atomic<uint32> DroppedEvents{ 0 };
+};
+
+/**
+ * Typed event bus for stealth gameplay events (visibility, doors, noise, interaction, mantling).
+ * Producers on the game thread and on async query workers post into their own ring; the bus drains
+ * every ring once per frame on the game thread and dispatches to the per-type subscribers (AI, audio, UI, telemetry).
+ */
+UCLASS()
+class THIEFLIKE_API UStealthEventBus : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Producer handle reserved for the game thread
+	static constexpr int32 GameThreadProducer = 0;
+
+	static UStealthEventBus* Get(const UObject* WorldContextObject);
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	// Registers a ring for a worker producer (game thread only)
+	int32 RegisterProducer(FName DebugName) { return Rings.RegisterProducer(DebugName); }
+
+	// Lock-free post from the thread that owns the producer handle
+	bool Post(int32 Producer, const FStealthEvent& Event) { return Rings.Post(Producer, Event); }
+
+	// Convenience for game thread producers. The game thread is also the consumer, so a full ring is dispatched
+	// there and then instead of dropping the event (unless it fills up from inside a dispatch).
+	bool Post(EStealthEventType Type, AActor* Source, const FVector& Location, float Value);
+
+	// Dispatches everything queued so far right away, instead of on the next tick (snapshot stepping)
+	void Flush();
+
+	// Drops everything queued without dispatching it (snapshot restore)
+	void Discard() { Rings.Drain([](const FStealthEvent&) {}); }
+
+	// Consumers subscribe per event type
+	FOnStealthEvent& OnEvent(EStealthEventType Type) { return EventDelegates[static_cast<int32>(Type)]; }
+
+	// Noise is reported from Blueprints as well (footsteps, thrown objects...)
+	UFUNCTION(BlueprintCallable, Category = "Stealth", meta = (WorldContext = "WorldContextObject"))
+	static void ReportNoise(const UObject* WorldContextObject, AActor* Source, FVector Location, float Loudness);
+
+	uint32 GetDroppedEventCount() const { return Rings.GetDroppedEventCount(); }
+
+private:
+	FStealthEventRings Rings;
+
+	FOnStealthEvent EventDelegates[static_cast<int32>(EStealthEventType::Count)];
+
+	uint32 LastReportedDrops = 0;
+
+	// Full game thread rings dispatched early since the last tick
+	int32 NumEarlyFlushes = 0;
+
+	bool bFlushing = false;
+};
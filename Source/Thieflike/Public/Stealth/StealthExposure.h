@@ -0,0 +1,174 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stealth/StealthLightSubsystem.h"
+
+class UWorld;
+class AActor;
+class UStealthStreamingSubsystem;
+
+namespace StealthExposure
+{
+	struct FExposureCache;
+}
+
+// Where a batch of exposure queries reads brightness from
+enum class EStealthExposureBackend : uint8
+{
+	// Occlusion-traced analytic lights
+	Analytic,
+	// UStealthStreamingSubsystem's baked grid, analytic lights where no cell is loaded
+	Baked,
+	// One brightness for every sample, e.g. the last ALightDetector readback
+	Constant,
+	// A character's StealthExposure::FExposureCache at a given time; the queries must expand to the points it was built for
+	Cached,
+};
+
+// Sample points per query, see StealthExposure::BuildCharacterSamples
+enum class EStealthExposureLayout : uint8
+{
+	Center,
+	Body,
+	Detailed,
+};
+
+// One character capsule (or, with the Center layout, one point) to evaluate
+struct FStealthExposureQuery
+{
+	FVector Center = FVector::ZeroVector;
+	FVector Right = FVector::RightVector;
+	float HalfHeight = 0.0f;
+	float Radius = 0.0f;
+	float LeanOffset = 0.0f;
+	float CrouchAlpha = 0.0f;
+};
+
+// What the backend of a batch reads
+struct FStealthExposureSource
+{
+	EStealthExposureBackend Backend = EStealthExposureBackend::Analytic;
+	const UWorld* World = nullptr;
+	TConstArrayView<FStealthLight> Lights;
+	const UStealthStreamingSubsystem* Streaming = nullptr;
+	float ConstantBrightness = 0.0f;
+	const StealthExposure::FExposureCache* Cache = nullptr;
+	double Time = 0.0;
+	// Skipped by occlusion traces
+	const AActor* IgnoreActor = nullptr;
+};
+
+/**
+ * Exposure evaluation that doesn't need a renderer (dedicated servers, -nullrhi, offline tools).
+ * Each light contributes its normalized intensity with a smooth distance falloff, if nothing blocks the line to it.
+ */
+namespace StealthExposure
+{
+	// Light intensity (in the light's own units) that counts as fully lit right next to the light
+	constexpr float ReferenceIntensity = 10.0f;
+
+	// Distance falloff of one light at Point (0..1), ignoring intensity and whether it is on
+	inline float LightFalloff(const FStealthLight& Light, const FVector& Point)
+	{
+		const float DistanceSq = FVector::DistSquared(Light.Location, Point);
+		if (DistanceSq >= FMath::Square(Light.Radius))
+		{
+			return 0.0f;
+		}
+
+		// Same shape as the engine's inverse-square falloff window: (1 - (d/r)^2)^2
+		return FMath::Square(1.0f - DistanceSq / FMath::Square(Light.Radius));
+	}
+
+	// Unoccluded contribution of one light at Point (0..1). Flickering lights count at their base intensity.
+	inline float LightContribution(const FStealthLight& Light, const FVector& Point)
+	{
+		return Light.bOn ? FMath::Min(Light.Intensity / ReferenceIntensity, 1.0f) * LightFalloff(Light, Point) : 0.0f;
+	}
+
+	// Brightness at Point from every registered light (0 = dark, 1 = fully lit). IgnoreActor is skipped by the occlusion traces.
+	THIEFLIKE_API float EvaluateAnalytic(const UWorld* World, TConstArrayView<FStealthLight> Lights, const FVector& Point, const AActor* IgnoreActor);
+
+	// EvaluateAnalytic for several points in one pass over the lights. Lights that reach none of the points are
+	// rejected once for the whole batch instead of once per point.
+	THIEFLIKE_API void EvaluateAnalyticBatch(const UWorld* World, TConstArrayView<FStealthLight> Lights, TConstArrayView<FVector> Points, TArrayView<float> OutBrightness, const AActor* IgnoreActor);
+
+	constexpr int32 MaxCharacterSamples = 8;
+
+	// Points on a character capsule where exposure is read, and how much each counts
+	struct FCharacterSamples
+	{
+		FVector Points[MaxCharacterSamples];
+		float Weights[MaxCharacterSamples];
+		int32 Num = 0;
+	};
+
+	// Lays out NumPoints samples on a capsule: 1 = centre; 3 = head, torso, feet; 8 = head, shoulders, torso, hips, feet
+	// (other counts use the next smaller layout). Points scale with the live HalfHeight, the upper body follows LeanOffset
+	// along Right, and CrouchAlpha (0 standing, 1 crouched) blends the standing and crouched weights.
+	THIEFLIKE_API void BuildCharacterSamples(const FVector& Center, const FVector& Right, float HalfHeight, float Radius, float LeanOffset, float CrouchAlpha, int32 NumPoints, FCharacterSamples& Out);
+
+	// Weighted brightness over a character's sample points, from one batched query
+	THIEFLIKE_API float EvaluateCharacter(const UWorld* World, TConstArrayView<FStealthLight> Lights, const FCharacterSamples& Samples, const AActor* IgnoreActor);
+
+	// One unoccluded light at one sample point
+	struct FExposureTerm
+	{
+		float Falloff = 0.0f;
+		// Base intensity / ReferenceIntensity
+		float Scale = 0.0f;
+		FStealthFlicker Flicker;
+
+		float Evaluate(double Time) const { return Falloff * FMath::Min(Scale * Flicker.Evaluate(Time), 1.0f); }
+	};
+
+	/**
+	 * A character's exposure kept as light terms instead of a single value. Building it traces occlusion once;
+	 * Evaluate then gives the exposure at any time in closed form, so standing next to a flickering torch costs
+	 * the same per update as standing next to a steady light.
+	 */
+	struct FExposureCache
+	{
+		FCharacterSamples Samples;
+		TArray<FExposureTerm, TInlineAllocator<16>> Terms;
+		// Terms of sample point N are Terms[TermEnds[N - 1]..TermEnds[N])
+		int32 TermEnds[MaxCharacterSamples] = {};
+
+		// What the cache was built from, for the owner to decide when to rebuild
+		uint32 LightRevision = 0;
+		uint32 LightStateRevision = 0;
+		double BuildTime = -1.0;
+
+		bool IsValid() const { return BuildTime >= 0.0; }
+		void Reset() { Samples.Num = 0; Terms.Reset(); BuildTime = -1.0; }
+
+		// True when built for exactly these sample points and weights
+		THIEFLIKE_API bool Matches(const FCharacterSamples& Other) const;
+
+		// Weighted exposure at Time, no traces
+		THIEFLIKE_API float Evaluate(double Time) const;
+
+		// Brightness of sample point Index at Time, no traces
+		float EvaluatePoint(int32 Index, double Time) const
+		{
+			float Brightness = 0.0f;
+			for (int32 TermIndex = Index > 0 ? TermEnds[Index - 1] : 0; TermIndex < TermEnds[Index]; ++TermIndex)
+			{
+				Brightness = FMath::Max(Brightness, Terms[TermIndex].Evaluate(Time));
+			}
+			return Brightness;
+		}
+	};
+
+	// Fills Cache with every unoccluded light that can be the brightest at a sample point at some point of its flicker
+	THIEFLIKE_API void BuildExposureCache(const UWorld* World, TConstArrayView<FStealthLight> Lights, const FCharacterSamples& Samples, const AActor* IgnoreActor, FExposureCache& OutCache);
+
+	// Layout BuildCharacterSamples uses for NumPoints
+	THIEFLIKE_API EStealthExposureLayout GetLayout(int32 NumPoints);
+
+	// Weighted brightness for every query. Backend and layout are resolved once for the batch; the loop over the
+	// queries is compiled per backend / layout pair, so there is no dispatch per sample.
+	THIEFLIKE_API void EvaluateQueries(const FStealthExposureSource& Source, EStealthExposureLayout Layout, TConstArrayView<FStealthExposureQuery> Queries, TArrayView<float> OutExposure);
+}
@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stealth/StealthSettings.h"
+
+/**
+ * Fixed-rate stepping for gameplay state that would otherwise advance once per render frame.
+ * Advance() banks the frame time and returns how many steps of GetStepSeconds() to simulate; GetAlpha() is how
+ * far the frame is between the previous and the latest step, for interpolating what is shown:
+ *
+ *	for (int32 Step = Stepper.Advance(DeltaTime); Step > 0; --Step) { Previous = Current; Simulate(Stepper.GetStepSeconds()); }
+ *	Show(FMath::Lerp(Previous, Current, Stepper.GetAlpha()));
+ */
+struct FStealthFixedStep
+{
+	int32 Advance(float DeltaTime)
+	{
+		const UStealthSettings* Settings = UStealthSettings::Get();
+		StepSeconds = 1.0f / FMath::Max(Settings->SimulationRate, 1.0f);
+		Accumulator += DeltaTime;
+
+		int32 Steps = FMath::FloorToInt(Accumulator / StepSeconds);
+		if (Steps > Settings->MaxSimulationStepsPerFrame)
+		{
+			// After a hitch, drop the time we can't catch up on instead of falling further behind
+			Steps = Settings->MaxSimulationStepsPerFrame;
+			Accumulator = Steps * StepSeconds;
+		}
+		Accumulator -= Steps * StepSeconds;
+		return Steps;
+	}
+
+	float GetStepSeconds() const { return StepSeconds; }
+	float GetAlpha() const { return FMath::Clamp(Accumulator / StepSeconds, 0.0f, 1.0f); }
+
+private:
+	float Accumulator = 0.0f;
+	float StepSeconds = 1.0f / 60.0f;
+};
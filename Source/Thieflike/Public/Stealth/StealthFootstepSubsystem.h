@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Chaos/ChaosEngineInterface.h"
+#include "StealthFootstepSubsystem.generated.h"
+
+class UPrimitiveComponent;
+
+UENUM(BlueprintType)
+enum class EStealthGait : uint8
+{
+	Crouch,
+	Walk,
+	Run,
+
+	Count UMETA(Hidden)
+};
+
+/**
+ * Footstep loudness by floor surface and gait.
+ * The physical surface under every navmesh polygon is classified once when play begins and cached per grid cell,
+ * so a footstep is a hash lookup and a table read instead of a trace. Movable floors, and places the bake
+ * didn't cover, fall back to a downward trace; static hits from that trace are added to the cache.
+ */
+UCLASS()
+class THIEFLIKE_API UStealthFootstepSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Vertical size of a cache cell; stacked floors closer than this share a cell
+	static constexpr float CellHeight = 100.0f;
+
+	static constexpr int32 NumGaits = static_cast<int32>(EStealthGait::Count);
+
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	// Surface under a foot. Floor is the component being stood on when known; movable floors are always traced.
+	EPhysicalSurface GetSurface(const FVector& FootLocation, const UPrimitiveComponent* Floor = nullptr, const AActor* IgnoreActor = nullptr);
+
+	float GetLoudness(EPhysicalSurface Surface, EStealthGait Gait) const { return LoudnessTable[Surface][static_cast<int32>(Gait)]; }
+
+	// Looks up the footstep loudness and posts it as a Noise event. Returns the loudness.
+	float ReportFootstep(AActor* Source, const FVector& FootLocation, EStealthGait Gait, const UPrimitiveComponent* Floor = nullptr);
+
+	// For footsteps driven from Blueprints (anim notifies on AI characters...)
+	UFUNCTION(BlueprintCallable, Category = "Stealth", meta = (WorldContext = "WorldContextObject"))
+	static float ReportFootstepNoise(const UObject* WorldContextObject, AActor* Source, FVector FootLocation, EStealthGait Gait);
+
+	// Uncached classification: one downward trace. bOutCacheable is set when the hit is static geometry.
+	EPhysicalSurface TraceSurface(const FVector& FootLocation, const AActor* IgnoreActor, bool& bOutCacheable) const;
+
+	// Re-classifies the surface under the current navmesh
+	void BuildCache();
+
+	int32 NumCachedCells() const { return Cells.Num(); }
+	TArray<FIntVector> GetCachedCells() const;
+
+	FIntVector GetCellKey(const FVector& Location) const;
+	FVector GetCellCenter(const FIntVector& Key) const;
+
+private:
+	void BuildLoudnessTable();
+	const uint8* FindCell(const FVector& FootLocation) const;
+
+	float CellSize = 50.0f;
+	TMap<FIntVector, uint8> Cells;
+
+	float LoudnessTable[SurfaceType_Max][NumGaits] = {};
+};
@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "StealthHeatmapCommandlet.generated.h"
+
+/**
+ * Turns telemetry sessions (.sttl) into per-map heatmaps: where players spend time, where they are seen,
+ * where they hide and where mantles fail. Files are memory-mapped and aggregated in parallel.
+ *
+ * UnrealEditor-Cmd Thieflike.uproject -run=StealthHeatmap [-Input=<dir>] [-Output=<dir>] [-CellSize=100] [-SeenThreshold=0.5]
+ */
+UCLASS()
+class THIEFLIKE_API UStealthHeatmapCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UStealthHeatmapCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
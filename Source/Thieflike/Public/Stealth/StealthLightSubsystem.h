@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "StealthLightSubsystem.generated.h"
+
+class ULocalLightComponent;
+
+// Parametric flicker of a torch or candle, so its intensity can be evaluated at any time without ticking it
+struct FStealthFlicker
+{
+	// Largest deviation from the base intensity, as a fraction of it
+	float Amplitude = 0.0f;
+	// Cycles per second of the slowest wave
+	float Frequency = 0.0f;
+	uint32 Seed = 0;
+
+	bool IsAnimated() const { return Amplitude > 0.0f && Frequency > 0.0f; }
+
+	// Bounds of Evaluate over all times
+	float GetMinScale() const { return IsAnimated() ? FMath::Max(1.0f - Amplitude, 0.0f) : 1.0f; }
+	float GetMaxScale() const { return IsAnimated() ? 1.0f + Amplitude : 1.0f; }
+
+	// Intensity multiplier at Time: three sines at seed-derived phases, so neighbouring torches don't pulse together
+	float Evaluate(double Time) const
+	{
+		if (!IsAnimated())
+		{
+			return 1.0f;
+		}
+
+		// Wrapped so float precision holds in long sessions; the wrap is a tiny step once every 1000 cycles
+		const float Angle = static_cast<float>(FMath::Fmod(Time * Frequency, 1000.0)) * UE_TWO_PI;
+		const float Phase = static_cast<float>(Seed % 1024u) * (UE_TWO_PI / 1024.0f);
+		const float Noise = 0.5f * FMath::Sin(Angle + Phase) + 0.3f * FMath::Sin(2.31f * Angle + 3.0f * Phase) + 0.2f * FMath::Sin(4.73f * Angle + 5.0f * Phase);
+		return FMath::Max(1.0f + Amplitude * Noise, 0.0f);
+	}
+};
+
+// A light the stealth systems know about
+struct FStealthLight
+{
+	FVector Location = FVector::ZeroVector;
+	float Radius = 0.0f;
+	// Base intensity; flickering lights vary around it
+	float Intensity = 0.0f;
+	bool bOn = true;
+
+	FStealthFlicker Flicker;
+
+	// Survives save/load, see UStealthSaveSubsystem::StableId
+	uint32 StableId = 0;
+
+	TWeakObjectPtr<ULocalLightComponent> Component;
+};
+
+/**
+ * Registry of the local (point / spot) lights in the world.
+ * Filled when play begins, then kept up to date as actors spawn and are destroyed and as levels (World Partition
+ * cells included) stream in and out. Water arrows douse lights through it, and exposure code reads it instead of
+ * iterating components.
+ */
+UCLASS()
+class THIEFLIKE_API UStealthLightSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	// Stealth view of a light component; also used by offline tools that have no subsystem
+	static FStealthLight DescribeLight(ULocalLightComponent* LightComponent);
+
+	// Clock flicker is evaluated against: the server's world time, so every machine shows a torch at the same phase
+	static double GetFlickerTime(const UWorld* World);
+
+	// Returns the light's index; registering a light twice returns the index it already has
+	int32 RegisterLight(ULocalLightComponent* LightComponent);
+	void UnregisterLight(ULocalLightComponent* LightComponent);
+
+	// Turns off every light whose source is within Radius of Location. Returns how many lights went out.
+	UFUNCTION(BlueprintCallable, Category = "Stealth|Lights")
+	int32 DouseLightsNear(FVector Location, float Radius);
+
+	// Switches a light on or off and keeps the component in sync
+	void SetLightOn(int32 LightIndex, bool bOn);
+
+	// Re-reads a registered light's flicker, e.g. once the server's seed for it has replicated
+	void RefreshFlicker(ULocalLightComponent* LightComponent);
+
+	const TArray<FStealthLight>& GetLights() const { return Lights; }
+
+	// Bumped whenever lights are added or removed, so cached orderings know to rebuild
+	uint32 GetRevision() const { return Revision; }
+
+	// Bumped whenever a light turns on or off, so cached exposure knows to rebuild
+	uint32 GetStateRevision() const { return StateRevision; }
+
+private:
+	void RegisterActor(AActor* Actor);
+	void UnregisterActor(AActor* Actor);
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	TArray<FStealthLight> Lights;
+	uint32 Revision = 0;
+	uint32 StateRevision = 0;
+
+	FDelegateHandle ActorSpawnedHandle;
+	FDelegateHandle ActorDestroyedHandle;
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+};
@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#include "CoreMinimal.h"
+
+/**
+ * Frame scratch for stealth hot paths.
+ *
+ * Transient query / candidate buffers are carved out of one linear block that is rewound at the start of every
+ * frame, so after warm-up they never touch the heap. Allocation is an atomic bump, safe from worker threads.
+ * Nothing is freed individually and no destructors run, so only trivially destructible types go in, and
+ * nothing handed out may be kept past the end of the frame:
+ *
+ *	TArrayView<FSightQuery> Queries = FStealthFrameArena::Get().AllocateArray<FSightQuery>(NumGuards);
+ *
+ * A frame that needs more than the block holds gets the rest from the heap; the block is grown to that
+ * frame's high-water mark at the next rewind.
+ */
+class THIEFLIKE_API FStealthFrameArena
+{
+public:
+	static FStealthFrameArena& Get();
+
+	void* Allocate(SIZE_T Size, SIZE_T Alignment);
+
+	// Num value-initialised elements, valid until the next frame starts
+	template <typename ElementType>
+	TArrayView<ElementType> AllocateArray(int32 Num)
+	{
+		static_assert(std::is_trivially_destructible_v<ElementType>, "The frame arena is rewound without running destructors");
+		Num = FMath::Max(Num, 0);
+		ElementType* Elements = static_cast<ElementType*>(Allocate(sizeof(ElementType) * Num, alignof(ElementType)));
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			new (Elements + Index) ElementType();
+		}
+		return TArrayView<ElementType>(Elements, Num);
+	}
+
+	// Releases everything handed out this frame. Game thread, between frames.
+	void Rewind();
+
+	SIZE_T GetCapacity() const { return Capacity; }
+	// Heap fallbacks since startup
+	int32 GetNumOverflows() const { return NumOverflows.load(std::memory_order_relaxed); }
+
+private:
+	FStealthFrameArena();
+
+	uint8* Block = nullptr;
+	SIZE_T Capacity = 0;
+
+	// Bytes requested this frame; can pass Capacity, the excess went to the heap
+	std::atomic<SIZE_T> Used{ 0 };
+
+	FCriticalSection OverflowLock;
+	TArray<void*> OverflowBlocks;
+	std::atomic<int32> NumOverflows{ 0 };
+};
+
+#if !UE_BUILD_SHIPPING
+
+// Marks a per-frame stealth code path, on the game thread or inside a worker batch. Heap allocations made on this
+// thread inside it, frame arena fallbacks included, are reported by Stealth.Memory.CheckSteadyState, which expects
+// none once the game has warmed up.
+struct THIEFLIKE_API FStealthHotPathScope
+{
+	explicit FStealthHotPathScope(const TCHAR* Name);
+	~FStealthHotPathScope();
+
+private:
+	const TCHAR* PreviousName;
+};
+
+#define STEALTH_HOT_PATH_SCOPE(Name) FStealthHotPathScope ANONYMOUS_VARIABLE(StealthHotPath)(TEXT(Name))
+
+// Stops attributing for the rest of the block, for scratch use inside a hot path that is not per-frame
+#define STEALTH_HOT_PATH_SUSPEND() FStealthHotPathScope ANONYMOUS_VARIABLE(StealthHotPath)(nullptr)
+
+#else
+
+#define STEALTH_HOT_PATH_SCOPE(Name)
+#define STEALTH_HOT_PATH_SUSPEND()
+
+#endif
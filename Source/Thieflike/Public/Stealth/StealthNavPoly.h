@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Navmesh polygon helpers shared by the footstep cache and the offline stealth commandlets, which all sample
+ * a grid of floor points inside each polygon.
+ */
+namespace StealthNavPoly
+{
+	// Navmesh polygons are convex: inside when every edge has the point on the same side
+	inline bool IsInside2D(TConstArrayView<FVector> Verts, float X, float Y)
+	{
+		float Sign = 0.0f;
+		for (int32 Index = 0; Index < Verts.Num(); ++Index)
+		{
+			const FVector& A = Verts[Index];
+			const FVector& B = Verts[(Index + 1) % Verts.Num()];
+			const float Cross = (B.X - A.X) * (Y - A.Y) - (B.Y - A.Y) * (X - A.X);
+			if (Cross * Sign < 0.0f)
+			{
+				return false;
+			}
+			if (Sign == 0.0f)
+			{
+				Sign = Cross;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,179 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "Chaos/ChaosEngineInterface.h"
+#include "StealthSettings.generated.h"
+
+class ACharacter;
+class UStaticMesh;
+
+// Loudness of a single footstep per gait, in UStealthEventBus::ReportNoise units (a noise arrow is 1)
+USTRUCT()
+struct FStealthFootstepLoudness
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0"))
+	float Crouch = 0.05f;
+
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0"))
+	float Walk = 0.2f;
+
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0"))
+	float Run = 0.6f;
+};
+
+/**
+ * Project-wide tuning for the stealth systems (Project Settings > Game > Stealth).
+ */
+UCLASS(Config = Game, DefaultConfig, meta = (DisplayName = "Stealth"))
+class THIEFLIKE_API UStealthSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	UStealthSettings();
+
+	static const UStealthSettings* Get() { return GetDefault<UStealthSettings>(); }
+
+	// ---- Guard Crowd ---- //
+	// Character spawned for a crowd guard once it gets close to the player
+	UPROPERTY(Config, EditAnywhere, Category = "Guards")
+	TSoftClassPtr<ACharacter> GuardCharacterClass;
+
+	// Guards closer than this to any player get a full character
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "0"))
+	float GuardPromoteDistance = 2500.0f;
+
+	// Promoted guards further than this go back to crowd-only simulation (larger than promote distance to avoid popping)
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "0"))
+	float GuardDemoteDistance = 3000.0f;
+
+	// Upper bound on simultaneously promoted guards
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "0"))
+	int32 MaxPromotedGuards = 16;
+
+	// Guards processed per parallel batch
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "1"))
+	int32 GuardBatchSize = 128;
+
+	// A warning is logged when a crowd update costs more than this
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "0"))
+	float GuardFrameBudgetMs = 1.0f;
+
+	// Guards that look for doors to open or close per frame; the rest wait their turn, round robin
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "0"))
+	int32 GuardDoorRequestsPerFrame = 32;
+
+	// Guards further than this from every player leave doors alone
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "0"))
+	float GuardDoorDistance = 4000.0f;
+
+	// Hearing range left for each closed door between a noise and a guard, as a fraction
+	UPROPERTY(Config, EditAnywhere, Category = "Guards", meta = (ClampMin = "0", ClampMax = "1"))
+	float ClosedDoorHearingScale = 0.35f;
+
+	// ---- Interaction ---- //
+	// A warning is logged when resolving and applying a frame's interaction requests costs more than this
+	UPROPERTY(Config, EditAnywhere, Category = "Interaction", meta = (ClampMin = "0"))
+	float InteractionFrameBudgetMs = 0.5f;
+
+	// ---- Arrows ---- //
+	// Arrows preallocated when play begins. Firing past this recycles the oldest arrow in flight.
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows", meta = (ClampMin = "1"))
+	int32 ArrowPoolSize = 512;
+
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows")
+	TSoftObjectPtr<UStaticMesh> ArrowMesh;
+
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows")
+	float ArrowGravityScale = 1.0f;
+
+	// Arrows that haven't hit anything after this long are returned to the pool
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows", meta = (ClampMin = "0"))
+	float ArrowMaxLifetime = 8.0f;
+
+	// Lights closer than this to a water arrow impact go out
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows", meta = (ClampMin = "0"))
+	float WaterArrowDouseRadius = 150.0f;
+
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows", meta = (ClampMin = "0"))
+	float NoiseArrowLoudness = 1.0f;
+
+	// Longest rope a rope arrow can drop
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows", meta = (ClampMin = "0"))
+	float RopeArrowLength = 600.0f;
+
+	// Ropes left hanging at once; firing another takes down the oldest
+	UPROPERTY(Config, EditAnywhere, Category = "Arrows", meta = (ClampMin = "1"))
+	int32 MaxRopeArrows = 16;
+
+	// ---- Streaming ---- //
+	// Game thread time per frame spent patching streamed-in cell data
+	UPROPERTY(Config, EditAnywhere, Category = "Streaming", meta = (ClampMin = "0.01"))
+	float CellPatchBudgetMs = 0.25f;
+
+	// ---- Exposure ---- //
+	// Points on the player's capsule where exposure is read in one batched query: 1 (centre), 3 (head, torso, feet)
+	// or 8 (head, shoulders, torso, hips, feet). Other values use the next smaller layout.
+	UPROPERTY(Config, EditAnywhere, Category = "Exposure", meta = (ClampMin = "1", ClampMax = "8"))
+	int32 ExposureSamplePoints = 3;
+
+	// Read exposure from the player's render-target ALightDetector instead, when one is assigned and the game renders.
+	// The detector is moved to the head sample point before each capture. Standalone only: networked games (the
+	// listen-server host included) always use the analytic lights so every player is judged the same way.
+	UPROPERTY(Config, EditAnywhere, Category = "Exposure")
+	bool bUseRenderLightDetector = false;
+
+	// Longest the player's cached light terms are used before occlusion is traced again while standing still
+	// (doors and other movers can change it). Moving, crouching, leaning or switching a light rebuilds them at once.
+	UPROPERTY(Config, EditAnywhere, Category = "Exposure", meta = (ClampMin = "0"))
+	float ExposureCacheMaxAge = 0.25f;
+
+	// ---- Simulation ---- //
+	// Steps per second for player lean / crouch / visibility / traversal and door motion. Rendering interpolates between steps.
+	UPROPERTY(Config, EditAnywhere, Category = "Simulation", meta = (ClampMin = "10", ClampMax = "240"))
+	float SimulationRate = 60.0f;
+
+	// Most steps simulated in one frame; time beyond that is dropped after a hitch
+	UPROPERTY(Config, EditAnywhere, Category = "Simulation", meta = (ClampMin = "1"))
+	int32 MaxSimulationStepsPerFrame = 4;
+
+	// ---- Footsteps ---- //
+	// Horizontal size of the cached floor surface cells
+	UPROPERTY(Config, EditAnywhere, Category = "Footsteps", meta = (ClampMin = "10"))
+	float FootstepCellSize = 50.0f;
+
+	// Distance walked on the ground between two footsteps
+	UPROPERTY(Config, EditAnywhere, Category = "Footsteps", meta = (ClampMin = "10"))
+	float FootstepStride = 150.0f;
+
+	// Used for physical surfaces that have no entry below
+	UPROPERTY(Config, EditAnywhere, Category = "Footsteps")
+	FStealthFootstepLoudness DefaultFootstepLoudness;
+
+	// Per physical surface (Project Settings > Physics > Physical Surface), e.g. carpet quieter, marble louder
+	UPROPERTY(Config, EditAnywhere, Category = "Footsteps")
+	TMap<TEnumAsByte<EPhysicalSurface>, FStealthFootstepLoudness> SurfaceFootstepLoudness;
+
+	// ---- Event Bus ---- //
+	// Events the game thread can post between two drains (rounded up to a power of two). Posting to a full ring dispatches it on the spot.
+	UPROPERTY(Config, EditAnywhere, Category = "Event Bus", meta = (ClampMin = "64"))
+	int32 GameThreadEventRingSize = 4096;
+
+	// ---- Telemetry ---- //
+	// Record player exposure / movement to Saved/Telemetry for heatmaps (also on with -StealthTelemetry)
+	UPROPERTY(Config, EditAnywhere, Category = "Telemetry")
+	bool bRecordTelemetry = false;
+
+	// Seconds between position / exposure samples. Mantle outcomes are recorded as they happen.
+	UPROPERTY(Config, EditAnywhere, Category = "Telemetry", meta = (ClampMin = "0.01"))
+	float TelemetrySampleInterval = 0.1f;
+
+	// Samples held in memory before they are written out (rounded up to a power of two)
+	UPROPERTY(Config, EditAnywhere, Category = "Telemetry", meta = (ClampMin = "64"))
+	int32 TelemetryRingSize = 4096;
+};
@@ -0,0 +1,143 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Containers/Queue.h"
+#include "Stealth/StealthCellData.h"
+#include "StealthStreamingSubsystem.generated.h"
+
+class ADoor;
+
+/**
+ * Runtime home of the per-cell stealth data (baked exposure, ledges, climbables, portals).
+ * Cells arrive as loaded UStealthCellData. A worker converts them to runtime form, then the game thread
+ * patches them in under a per-frame time budget. Cells are removed again when their actor streams out.
+ * Mantling looks up the baked ledges, and guard hearing the portals of closed doors.
+ */
+UCLASS()
+class THIEFLIKE_API UStealthStreamingSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Edge length of the baked exposure grid
+	static constexpr float ExposureCellSize = 100.0f;
+	// Edge length of the grid ledges are looked up in
+	static constexpr float LedgeCellSize = 200.0f;
+
+	// Matches a door to its baked portal by where it was placed, since actor paths differ between the editor and
+	// World Partition's runtime cells
+	static uint32 GetDoorId(const AActor* Door);
+
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	void AddCell(const AActor* CellOwner, const UStealthCellData* Data);
+	void RemoveCell(const AActor* CellOwner);
+
+	// Baked exposure at Location (0..1). False when no streamed cell covers it.
+	bool SampleBakedExposure(const FVector& Location, float& OutExposure) const;
+
+	// Closest point on a baked ledge that a climber with feet at Location, facing Forward, can pull up onto: in front
+	// and within MaxDistance horizontally, with the climber on the ledge's open side, and between MinHeight and MaxHeight
+	// above the feet. False when there is none.
+	bool FindLedge(const FVector& Location, const FVector& Forward, float MaxDistance, float MinHeight, float MaxHeight, FVector& OutPoint) const;
+
+	// Portal doors, so closed ones can be told apart from open ones
+	void RegisterDoor(const ADoor* Door);
+	void UnregisterDoor(const ADoor* Door);
+
+	// Writes the bounds of every portal whose door is loaded, closed and overlaps Area into OutBoxes, which must hold
+	// NumPortals() entries, and returns how many were written
+	int32 GatherClosedPortals(const FBox& Area, TArrayView<FBox> OutBoxes) const;
+	int32 NumPortals() const { return Portals.Num(); }
+
+	int32 NumLoadedCells() const { return Cells.Num(); }
+
+	static FIntVector ExposureKey(const FVector& Location)
+	{
+		return FIntVector(FMath::FloorToInt(Location.X / ExposureCellSize), FMath::FloorToInt(Location.Y / ExposureCellSize), FMath::FloorToInt(Location.Z / ExposureCellSize));
+	}
+
+	// Flies the player's pawn Distance along its view and back at Speed, so World Partition streams cells in and
+	// out, then logs the game thread time each cell took to patch in and PASS if every one stayed under 1 ms
+	void StartFlyThrough(float Speed, float Distance);
+
+private:
+	// Exposure keys on chunk borders can be patched in by more than one cell. They read the mean of those cells,
+	// which does not depend on the order cells came in and comes back right as each one goes. A key goes with its last cell.
+	struct FBakedExposure
+	{
+		uint32 ExposureSum = 0;
+		uint16 NumCells = 0;
+	};
+
+	// A cell in runtime form, plus what has been patched in so far so it can be undone
+	struct FStreamedCell
+	{
+		TObjectKey<AActor> Owner;
+
+		// Built on a worker
+		TArray<TPair<FIntVector, uint8>> Exposure;
+		TArray<FClimbableSurface> Climbables;
+		TArray<FStealthLedge> Ledges;
+		TArray<FStealthPortal> Portals;
+
+		// Patch progress (game thread)
+		int32 NextExposure = 0;
+		int32 NextClimbable = 0;
+		int32 NextLedge = 0;
+		int32 NextPortal = 0;
+		double GameThreadSeconds = 0.0;
+		int32 FramesToPatch = 0;
+		// Set on the game thread, read by the worker under the GC guard
+		std::atomic<bool> bCancelled{ false };
+
+		TArray<FClimbableHandle> ClimbableHandles;
+		TArray<int32> LedgeIds;
+		TArray<int32> PortalIds;
+	};
+
+	// Patches as much of the cell as fits before BudgetEnd. Returns true once the cell is complete.
+	bool PatchCell(FStreamedCell& Cell, double BudgetEnd);
+	void UnpatchCell(FStreamedCell& Cell);
+
+	template <typename FuncType>
+	static void ForEachLedgeCell(const FBox& Bounds, FuncType&& Func);
+
+	// Cells finished on workers, waiting for the game thread. Shared so a late worker never writes into a dead subsystem.
+	using FPreparedQueue = TQueue<TSharedPtr<FStreamedCell, ESPMode::ThreadSafe>, EQueueMode::Mpsc>;
+	TSharedRef<FPreparedQueue, ESPMode::ThreadSafe> PreparedCells = MakeShared<FPreparedQueue, ESPMode::ThreadSafe>();
+
+	// Cells being patched in, in arrival order
+	TArray<TSharedPtr<FStreamedCell, ESPMode::ThreadSafe>> PatchingCells;
+
+	// Every cell that is loading, patching or live
+	TMap<TObjectKey<AActor>, TSharedPtr<FStreamedCell, ESPMode::ThreadSafe>> Cells;
+
+	TMap<FIntVector, FBakedExposure> BakedExposure;
+	TSparseArray<FStealthLedge> Ledges;
+	TMap<FIntVector, TArray<int32>> LedgeCells;
+	TSparseArray<FStealthPortal> Portals;
+	TMap<uint32, TWeakObjectPtr<const ADoor>> PortalDoors;
+
+	// Fly-through test
+	void TickFlyThrough(float DeltaTime);
+	void ReportFlyThrough();
+
+	bool bFlyThrough = false;
+	TWeakObjectPtr<APawn> FlyThroughPawn;
+	FVector FlyThroughStart = FVector::ZeroVector;
+	FVector FlyThroughDirection = FVector::ForwardVector;
+	float FlyThroughSpeed = 0.0f;
+	float FlyThroughDistance = 0.0f;
+	float FlyThroughTravelled = 0.0f;
+	// Game thread time of every cell patched in and the slowest removal, in ms
+	TArray<double> FlyThroughPatchMs;
+	double FlyThroughWorstRemoveMs = 0.0;
+	int32 FlyThroughMaxFrames = 0;
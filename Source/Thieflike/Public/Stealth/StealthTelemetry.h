@@ -0,0 +1,127 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tasks/Task.h"
+#include "StealthTelemetry.generated.h"
+
+struct FStealthEvent;
+class IFileHandle;
+
+enum class EStealthPosture : uint8
+{
+	Standing,
+	Crouched,
+	Climbing,
+	Mantling,
+};
+
+enum class EStealthTelemetryEvent : uint8
+{
+	None,
+	MantleStarted,
+	MantleSucceeded,
+	// StopMantle(false): the player was pushed back off the ledge
+	MantleFailed,
+};
+
+// One record in a telemetry file. Plain data, written and mapped as-is.
+struct FStealthTelemetrySample
+{
+	// Seconds since the session started
+	float Time = 0.0f;
+	float X = 0.0f;
+	float Y = 0.0f;
+	float Z = 0.0f;
+	// CurrentVisibility quantized to 0..255
+	uint8 Visibility = 0;
+	EStealthPosture Posture = EStealthPosture::Standing;
+	EStealthTelemetryEvent Event = EStealthTelemetryEvent::None;
+	uint8 Reserved = 0;
+};
+static_assert(sizeof(FStealthTelemetrySample) == 20, "Telemetry sample layout is part of the file format");
+
+/**
+ * Start of every telemetry file, followed by samples until the end of the file.
+ * Readers take the sample count from the file size and ignore a trailing partial sample.
+ */
+struct FStealthTelemetryHeader
+{
+	static constexpr uint32 FileMagic = 0x4C545453; // 'STTL'
+	static constexpr uint32 CurrentVersion = 1;
+
+	uint32 Magic = FileMagic;
+	uint32 Version = CurrentVersion;
+	uint32 HeaderSize = sizeof(FStealthTelemetryHeader);
+	uint32 SampleSize = sizeof(FStealthTelemetrySample);
+	int64 StartTimeUnix = 0;
+	ANSICHAR MapName[64] = {};
+
+	bool IsValid() const { return Magic == FileMagic && Version == CurrentVersion && HeaderSize == sizeof(FStealthTelemetryHeader) && SampleSize == sizeof(FStealthTelemetrySample); }
+};
+static_assert(sizeof(FStealthTelemetryHeader) == 88, "Telemetry header layout is part of the file format");
+
+/**
+ * Records the local player's exposure, position, posture and mantle outcomes for heatmaps.
+ * Samples go into a fixed ring on the game thread; a background task appends them to Saved/Telemetry/<Map>_<Time>.sttl.
+ * Aggregate sessions with the StealthHeatmap commandlet.
+ */
+UCLASS()
+class THIEFLIKE_API UStealthTelemetrySubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	bool IsRecording() const { return bRecording; }
+
+	// Average / worst game thread cost of recording per frame
+	double GetAverageFrameMs() const { return NumTimedFrames > 0 ? RecordSeconds / NumTimedFrames * 1000.0 : 0.0; }
+	double GetWorstFrameMs() const { return WorstFrameSeconds * 1000.0; }
+	uint32 GetDroppedSamples() const { return DroppedSamples; }
+
+	const FString& GetFilePath() const { return FilePath; }
+
+private:
+	void OnMantleEvent(const FStealthEvent& Event);
+	void RecordPlayer(EStealthTelemetryEvent Event, const FVector* EventLocation = nullptr);
+	void Push(const FStealthTelemetrySample& Sample);
+
+	// Starts a background write of everything in the ring, unless one is still running
+	void Flush();
+	void WritePending();
+
+	bool bRecording = false;
+	FString FilePath;
+	FStealthTelemetryHeader Header;
+	double SessionStartTime = 0.0;
+	float TimeSinceSample = 0.0f;
+	float TimeSinceFlush = 0.0f;
+
+	// Single producer (game thread), single consumer (flush task). Indices count up forever and wrap through Mask.
+	TArray<FStealthTelemetrySample> Ring;
+	uint32 Mask = 0;
+	std::atomic<uint32> Head{ 0 };
+	std::atomic<uint32> Tail{ 0 };
+	uint32 DroppedSamples = 0;
+
+	// Only touched by the flush task
+	TUniquePtr<IFileHandle> File;
+	UE::Tasks::FTask FlushTask;
+
+	double RecordSeconds = 0.0;
+	double WorstFrameSeconds = 0.0;
+	int64 NumTimedFrames = 0;
+
+	FDelegateHandle MantleStartHandle;
+	FDelegateHandle MantleStopHandle;
+};
@@ -2,5 +2,29 @@
 
 #include "Thieflike.h"
 #include "Modules/ModuleManager.h"
+#include "Stealth/StealthMemory.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, Thieflike, "Thieflike" );
+LLM_DEFINE_TAG(Stealth);
+LLM_DEFINE_TAG(Stealth_EventBus, TEXT("EventBus"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Guards, TEXT("Guards"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Arrows, TEXT("Arrows"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Lights, TEXT("Lights"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Climbing, TEXT("Climbing"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Streaming, TEXT("Streaming"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Save, TEXT("Save"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Player, TEXT("Player"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Telemetry, TEXT("Telemetry"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_Footsteps, TEXT("Footsteps"), TEXT("Stealth"));
+LLM_DEFINE_TAG(Stealth_FrameArena, TEXT("FrameArena"), TEXT("Stealth"));
+
+class FThieflikeModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		// Made here on the game thread, not by whichever worker first asks for frame scratch
+		FStealthFrameArena::Get();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FThieflikeModule, Thieflike, "Thieflike" );
@@ -3,4 +3,22 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "HAL/LowLevelMemTracker.h"
 
+// Stat group shared by every stealth system ("stat Stealth" in the console)
+DECLARE_STATS_GROUP(TEXT("Stealth"), STATGROUP_Stealth, STATCAT_Advanced);
+
+// LLM tags, one per stealth system. Run with -llm and use "stat LLMFULL" or "memreport -llm" to see them.
+LLM_DECLARE_TAG_API(Stealth, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_EventBus, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Guards, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Arrows, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Lights, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Climbing, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Streaming, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Save, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Player, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Telemetry, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_Footsteps, THIEFLIKE_API);
+LLM_DECLARE_TAG_API(Stealth_FrameArena, THIEFLIKE_API);